@@ -0,0 +1,12 @@
+#
+# Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+#
+
+# zstd is optional, it enables compressed binary logs
+#
+# If the library is found, then you can use the PkgConfig::mc_rtc_3rd_party_zstd target
+
+find_package(PkgConfig QUIET)
+if(PKG_CONFIG_FOUND)
+  pkg_check_modules(mc_rtc_3rd_party_zstd QUIET libzstd IMPORTED_TARGET)
+endif()
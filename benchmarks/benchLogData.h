@@ -0,0 +1,163 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#pragma once
+
+#include <mc_rtc/log/BinaryLogIndex.h>
+#include <mc_rtc/log/Logger.h>
+
+#include <boost/filesystem.hpp>
+
+#ifdef __linux__
+#  include <unistd.h>
+#endif
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+/** Data logged by the logging benchmarks
+ *
+ * The mix of types is close to the one of a controller's log: mostly doubles and 3D vectors, some transforms, wrenches
+ * and orientations, joint-sized vectors and a few strings
+ */
+struct LogData
+{
+  LogData(size_t n) : n_(n)
+  {
+    for(size_t i = 0; i < n; ++i)
+    {
+      switch(type(i))
+      {
+        case mc_rtc::log::LogType::Double:
+          doubles_.push_back(static_cast<double>(i));
+          break;
+        case mc_rtc::log::LogType::Vector3d:
+          vectors_.push_back(Eigen::Vector3d::Random());
+          break;
+        case mc_rtc::log::LogType::PTransformd:
+          transforms_.push_back({Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d::Random()});
+          break;
+        case mc_rtc::log::LogType::ForceVecd:
+          wrenches_.push_back(sva::ForceVecd(Eigen::Vector6d::Random()));
+          break;
+        case mc_rtc::log::LogType::Quaterniond:
+          orientations_.push_back(Eigen::Quaterniond::UnitRandom());
+          break;
+        case mc_rtc::log::LogType::VectorXd:
+          joints_.push_back(Eigen::VectorXd::Random(32));
+          break;
+        case mc_rtc::log::LogType::VectorDouble:
+          std_vectors_.push_back(std::vector<double>(32, static_cast<double>(i)));
+          break;
+        default:
+          strings_.push_back("state_" + std::to_string(i));
+          break;
+      }
+    }
+  }
+
+  /** Type of the i-th entry */
+  static mc_rtc::log::LogType type(size_t i)
+  {
+    if(i % 100 == 99) { return mc_rtc::log::LogType::String; }
+    size_t k = i % 20;
+    if(k < 8) { return mc_rtc::log::LogType::Double; }
+    if(k < 13) { return mc_rtc::log::LogType::Vector3d; }
+    if(k < 15) { return mc_rtc::log::LogType::PTransformd; }
+    if(k < 17) { return mc_rtc::log::LogType::ForceVecd; }
+    if(k < 18) { return mc_rtc::log::LogType::Quaterniond; }
+    if(k < 19) { return mc_rtc::log::LogType::VectorXd; }
+    return mc_rtc::log::LogType::VectorDouble;
+  }
+
+  void addToLogger(mc_rtc::Logger & logger, const std::string & prefix = "entry_")
+  {
+    size_t idx[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for(size_t i = 0; i < n_; ++i)
+    {
+      std::string name = prefix + std::to_string(i);
+      switch(type(i))
+      {
+        case mc_rtc::log::LogType::Double:
+          logger.addLogEntry(name, this, [this, j = idx[0]++]() { return doubles_[j]; });
+          break;
+        case mc_rtc::log::LogType::Vector3d:
+          logger.addLogEntry(name, this, [this, j = idx[1]++]() -> const Eigen::Vector3d & { return vectors_[j]; });
+          break;
+        case mc_rtc::log::LogType::PTransformd:
+          logger.addLogEntry(name, this,
+                             [this, j = idx[2]++]() -> const sva::PTransformd & { return transforms_[j]; });
+          break;
+        case mc_rtc::log::LogType::ForceVecd:
+          logger.addLogEntry(name, this, [this, j = idx[3]++]() -> const sva::ForceVecd & { return wrenches_[j]; });
+          break;
+        case mc_rtc::log::LogType::Quaterniond:
+          logger.addLogEntry(name, this,
+                             [this, j = idx[4]++]() -> const Eigen::Quaterniond & { return orientations_[j]; });
+          break;
+        case mc_rtc::log::LogType::VectorXd:
+          logger.addLogEntry(name, this, [this, j = idx[5]++]() -> const Eigen::VectorXd & { return joints_[j]; });
+          break;
+        case mc_rtc::log::LogType::VectorDouble:
+          logger.addLogEntry(name, this,
+                             [this, j = idx[6]++]() -> const std::vector<double> & { return std_vectors_[j]; });
+          break;
+        default:
+          logger.addLogEntry(name, this, [this, j = idx[7]++]() -> const std::string & { return strings_[j]; });
+          break;
+      }
+    }
+  }
+
+  /** Update the numerical values as a controller would */
+  void update()
+  {
+    for(auto & d : doubles_) { d += 1e-3; }
+    for(auto & v : vectors_) { v.x() += 1e-3; }
+    for(auto & pt : transforms_) { pt.translation().z() += 1e-3; }
+    for(auto & w : wrenches_) { w.force().z() += 1e-3; }
+    for(auto & j : joints_) { j(0) += 1e-3; }
+    for(auto & v : std_vectors_) { v[0] += 1e-3; }
+  }
+
+private:
+  size_t n_;
+  std::vector<double> doubles_;
+  std::vector<Eigen::Vector3d> vectors_;
+  std::vector<sva::PTransformd> transforms_;
+  std::vector<sva::ForceVecd> wrenches_;
+  std::vector<Eigen::Quaterniond> orientations_;
+  std::vector<Eigen::VectorXd> joints_;
+  std::vector<std::vector<double>> std_vectors_;
+  std::vector<std::string> strings_;
+};
+
+/** Path of a log written by the benchmarks */
+inline std::string log_path(const std::string & name)
+{
+  return (boost::filesystem::temp_directory_path() / ("mc-rtc-bench-" + name + ".bin")).string();
+}
+
+/** Remove a log written by the benchmarks and the files that go with it */
+inline void remove_log(const std::string & path)
+{
+  namespace bfs = boost::filesystem;
+  if(path.empty()) { return; }
+  boost::system::error_code ec;
+  bfs::remove(path, ec);
+  bfs::remove(mc_rtc::log::BinaryLogIndex::path(path), ec);
+}
+
+/** Resident memory of the process in bytes (0 if it is not available) */
+inline size_t resident_memory()
+{
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  size_t size = 0;
+  size_t resident = 0;
+  if(statm >> size >> resident) { return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+#endif
+  return 0;
+}
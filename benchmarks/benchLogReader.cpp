@@ -0,0 +1,108 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/log/FlatLog.h>
+#include <mc_rtc/log/Logger.h>
+#include <mc_rtc/log/iterate_binary_log.h>
+
+#include <spdlog/spdlog.h>
+
+#include <map>
+
+#include "benchLogData.h"
+#include "benchmark/benchmark.h"
+
+/** Synthetic logs used by the benchmarks, they are written once and removed when the program exits */
+struct SyntheticLogs
+{
+  ~SyntheticLogs()
+  {
+    for(const auto & l : logs) { remove_log(l.second); }
+  }
+
+  /** Log with \p n_entries entries (see LogData) and \p n_frames frames */
+  const std::string & get(size_t n_entries, size_t n_frames)
+  {
+    auto key = std::make_pair(n_entries, n_frames);
+    auto it = logs.find(key);
+    if(it != logs.end()) { return it->second; }
+    spdlog::set_level(spdlog::level::err);
+    std::string path = log_path("reader-" + std::to_string(n_entries) + "-" + std::to_string(n_frames));
+    {
+      LogData data(n_entries);
+      mc_rtc::Logger logger(mc_rtc::Logger::Policy::NON_THREADED, "", "");
+      logger.open(path, 0.005);
+      data.addToLogger(logger);
+      for(size_t i = 0; i < n_frames; ++i)
+      {
+        data.update();
+        logger.log();
+      }
+    }
+    return logs.emplace(key, path).first->second;
+  }
+
+  std::map<std::pair<size_t, size_t>, std::string> logs;
+};
+
+static SyntheticLogs synthetic_logs;
+
+/** iterate_binary_log over a log with state.range(0) entries, the values are decoded if state.range(1) is 1 */
+static void BM_IterateBinaryLog(benchmark::State & state)
+{
+  const size_t n_frames = 2000;
+  const auto & path = synthetic_logs.get(static_cast<size_t>(state.range(0)), n_frames);
+  const bool extract = state.range(1) == 1;
+  for(auto _ : state)
+  {
+    size_t frames = 0;
+    mc_rtc::log::iterate_binary_log(
+        path,
+        [&](mc_rtc::log::IterateBinaryLogData data)
+        {
+          benchmark::DoNotOptimize(data.records.data());
+          frames++;
+          return true;
+        },
+        extract);
+    benchmark::DoNotOptimize(frames);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_frames));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * boost::filesystem::file_size(path)));
+}
+BENCHMARK(BM_IterateBinaryLog)
+    ->ArgsProduct({{100, 1000}, {0, 1}})
+    ->ArgNames({"entries", "extract"})
+    ->Unit(benchmark::kMillisecond);
+
+/** FlatLog load of a log with state.range(0) entries and state.range(1) frames using state.range(2) threads */
+static void BM_FlatLogLoad(benchmark::State & state)
+{
+  const auto & path = synthetic_logs.get(static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)));
+  size_t memory = 0;
+  for(auto _ : state)
+  {
+    const size_t before = resident_memory();
+    mc_rtc::log::FlatLog log(path, static_cast<size_t>(state.range(2)));
+    const size_t after = resident_memory();
+    if(after > before) { memory = std::max(memory, after - before); }
+    benchmark::DoNotOptimize(log.size());
+  }
+  // Increase of the resident memory while the log is loaded
+  state.counters["memory"] = benchmark::Counter(static_cast<double>(memory), benchmark::Counter::kDefaults,
+                                                benchmark::Counter::OneK::kIs1024);
+  state.counters["log_size"] = benchmark::Counter(static_cast<double>(boost::filesystem::file_size(path)),
+                                                  benchmark::Counter::kDefaults, benchmark::Counter::OneK::kIs1024);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * boost::filesystem::file_size(path)));
+}
+BENCHMARK(BM_FlatLogLoad)
+    ->Args({100, 1000, 1})
+    ->Args({100, 10000, 1})
+    ->Args({1000, 1000, 1})
+    ->Args({1000, 10000, 1})
+    ->Args({1000, 10000, 0})
+    ->ArgNames({"entries", "frames", "threads"})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/log/Logger.h>
+
+#include <spdlog/spdlog.h>
+
+#include "benchLogData.h"
+#include "benchmark/benchmark.h"
+
+/** Logger::log() with a mix of entries (state.range(0)) and the non-threaded (0) or threaded (1) policy */
+static void BM_Logger(benchmark::State & state)
+{
+  spdlog::set_level(spdlog::level::err);
+  const size_t n_entries = static_cast<size_t>(state.range(0));
+  const auto policy = state.range(1) == 0 ? mc_rtc::Logger::Policy::NON_THREADED : mc_rtc::Logger::Policy::THREADED;
+  const std::string path = log_path("logger");
+  LogData data(n_entries);
+  {
+    mc_rtc::Logger logger(policy, "", "");
+    logger.open(path, 0.005);
+    data.addToLogger(logger);
+    // The first frame holds the keys
+    logger.log();
+    for(auto _ : state)
+    {
+      data.update();
+      logger.log();
+    }
+    state.counters["dropped_frames"] = static_cast<double>(logger.bufferStats().dropped_frames);
+  }
+  state.counters["frame_size"] = static_cast<double>(boost::filesystem::file_size(path))
+                                 / static_cast<double>(state.iterations() + 1);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  remove_log(path);
+}
+// The minimum time bounds the size of the logs written by the benchmark
+BENCHMARK(BM_Logger)
+    ->ArgsProduct({{100, 500, 1000, 5000}, {0, 1}})
+    ->ArgNames({"entries", "threaded"})
+    ->MinTime(0.2)
+    ->Unit(benchmark::kMicrosecond);
+
+/** Removal of every entry of a source (state.range(0) entries) among other entries */
+static void BM_LoggerRemoveSource(benchmark::State & state)
+{
+  spdlog::set_level(spdlog::level::err);
+  const size_t n_entries = static_cast<size_t>(state.range(0));
+  mc_rtc::Logger logger(mc_rtc::Logger::Policy::NON_THREADED, "", "");
+  LogData others(n_entries);
+  others.addToLogger(logger);
+  LogData data(n_entries);
+  for(auto _ : state)
+  {
+    data.addToLogger(logger, "removed_");
+    logger.removeLogEntries(&data);
+    // Flush the key events
+    state.PauseTiming();
+    logger.log();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LoggerRemoveSource)->Arg(100)->Arg(1000)->ArgName("entries")->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/MessagePackBuilder.h>
+
+#include "benchmark/benchmark.h"
+
+template<typename T>
+T make_value();
+
+template<>
+double make_value()
+{
+  return 42.42;
+}
+
+template<>
+Eigen::Vector3d make_value()
+{
+  return Eigen::Vector3d::Random();
+}
+
+template<>
+Eigen::Quaterniond make_value()
+{
+  return Eigen::Quaterniond::UnitRandom();
+}
+
+template<>
+sva::PTransformd make_value()
+{
+  return {Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d::Random()};
+}
+
+template<>
+sva::ForceVecd make_value()
+{
+  return sva::ForceVecd(Eigen::Vector6d::Random());
+}
+
+template<>
+Eigen::VectorXd make_value()
+{
+  return Eigen::VectorXd::Random(32);
+}
+
+template<>
+std::vector<double> make_value()
+{
+  return std::vector<double>(32, 42.42);
+}
+
+template<>
+std::string make_value()
+{
+  return "state_name";
+}
+
+/** Serialize 1000 values of type T in a frame */
+template<typename T>
+static void BM_MessagePackBuilder(benchmark::State & state)
+{
+  constexpr size_t n_values = 1000;
+  const T value = make_value<T>();
+  std::vector<char> buffer;
+  size_t size = 0;
+  for(auto _ : state)
+  {
+    mc_rtc::MessagePackBuilder builder(buffer);
+    builder.start_array(n_values);
+    for(size_t i = 0; i < n_values; ++i) { builder.write(value); }
+    builder.finish_array();
+    size = builder.finish();
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_values));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, double);
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, Eigen::Vector3d);
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, Eigen::Quaterniond);
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, sva::PTransformd);
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, sva::ForceVecd);
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, Eigen::VectorXd);
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, std::vector<double>);
+BENCHMARK_TEMPLATE(BM_MessagePackBuilder, std::string);
+
+BENCHMARK_MAIN();
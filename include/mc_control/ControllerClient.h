@@ -11,8 +11,12 @@
 #include <mc_rtc/gui/plot/types.h>
 #include <mc_rtc/gui/types.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace mc_control
@@ -124,6 +128,19 @@ struct MC_CONTROL_CLIENT_DLLAPI ControllerClient
   /** Helper for the void case */
   void raw_request(const ElementId & id, std::string & out);
 
+  /** Subscribe to a part of the GUI
+   *
+   * Only the subscribed categories (with all their content) and their parents are received. The server does not
+   * evaluate the other elements for this client. nanomsg filters the topics on the client side so the messages
+   * published for other clients still go through the network.
+   *
+   * \param categories Categories to receive, the full GUI is received if empty
+   */
+  void subscribe(const std::vector<std::vector<std::string>> & categories);
+
+  /** Categories the client subscribed to, empty if it receives the full GUI */
+  inline const std::vector<std::vector<std::string>> & subscription() const noexcept { return subscription_; }
+
   /** Set the timeout of the SUB socket */
   void timeout(double t);
 
@@ -134,8 +151,11 @@ struct MC_CONTROL_CLIENT_DLLAPI ControllerClient
    *
    * This is the synchronous pendant to \ref start()
    *
-   * \param buffer Buffer to receive data from the server, if it is too small,
-   * the buffer is resized and the message is discarded
+   * Messages received from the SUB socket are decoded where nanomsg allocated them, when several messages are queued
+   * only the newest one is decoded
+   *
+   * \param buffer Buffer used when the message has to be copied (in-memory server or shared memory), it grows to fit
+   * the message
    *
    * \param t_last_received Time when the last message was received, it is
    * updated if the client receives a message. If a message has not been
@@ -153,6 +173,15 @@ struct MC_CONTROL_CLIENT_DLLAPI ControllerClient
    */
   void run(const char * buffer, size_t bufferSize);
 
+  /** Time spent receiving the last decoded message (ms) */
+  double receive_dt() const noexcept;
+
+  /** Time spent decoding the last message (ms) */
+  double decode_dt() const noexcept;
+
+  /** Number of messages that were dropped because a newer message was already queued */
+  uint64_t skipped_messages() const noexcept;
+
 protected:
   /** Should be called when the client is ready to receive data */
   void start();
@@ -172,9 +201,11 @@ protected:
 
   void handle_gui_state(mc_rtc::Configuration state);
 
-  void handle_category(const std::vector<std::string> & parent,
-                       const std::string & category,
-                       const mc_rtc::Configuration & data);
+  /** Handle a GUI message
+   *
+   * The message is decoded in place, a Configuration is only built for the data and the widgets that need it
+   */
+  void handle_gui_state(const char * data, size_t size);
 
   void handle_widget(const ElementId & id, const mc_rtc::Configuration & data);
 
@@ -941,6 +972,11 @@ protected:
   int push_socket_ = -1;
   double timeout_;
 
+  /* Timings of the last message, see receive_dt() and decode_dt() */
+  std::atomic<double> receive_dt_{0};
+  std::atomic<double> decode_dt_{0};
+  std::atomic<uint64_t> skipped_messages_{0};
+
   /* Hold data from the server */
   mc_rtc::Configuration data_;
 
@@ -949,6 +985,31 @@ protected:
   /* Pointer to the GUI if connected in-memory */
   mc_rtc::gui::StateBuilder * gui_ = nullptr;
 
+  /* Subscribed categories */
+  std::vector<std::vector<std::string>> subscription_;
+  /* Identifier of this client in subscription requests */
+  std::string subscription_id_;
+  /* Topic the SUB socket is subscribed to */
+  std::string subscription_topic_;
+  /* Endpoint of the subscriptions (see ControllerServer::subscriptions_uri) and its id, -1 if not connected */
+  std::string subscriptions_uri_;
+  int subscriptions_endpoint_ = -1;
+  /* Time when the subscription was last sent to the server */
+  std::chrono::system_clock::time_point t_last_subscribed_;
+
+  /** Send the subscription to the server */
+  void send_subscription();
+
+  /** Subscribe the SUB socket to the messages for this client */
+  void update_subscription_topic();
+
+  /* Shared memory of a server on the same host, null if the client is not connected to an IPC socket */
+  struct SharedMemory;
+  std::unique_ptr<SharedMemory> shm_;
+
+  /** Send a request through the shared memory if possible, through the PUSH socket otherwise */
+  void send_raw(const std::string & request);
+
 private:
   /** Default implementations for widgets' creations display a warning message to the user */
   virtual void default_impl(const std::string & type, const ElementId & id);
@@ -986,14 +1047,6 @@ private:
   /** Handle details of Form elements */
   void handle_form(const ElementId & id, const mc_rtc::Configuration & data);
 
-  /** Handle details of a plot */
-  void handle_plot(const mc_rtc::Configuration & plot);
-
-  /** Handle standard plot */
-  void handle_standard_plot(const mc_rtc::Configuration & plot);
-
-  /** Handle XY plot */
-  void handle_xy_plot(const mc_rtc::Configuration & plot);
 
   /** Handle Table details */
   void handle_table(const ElementId & id,
@@ -1005,6 +1058,90 @@ private:
    * automatically handled by the default implementation */
   bool default_polyhedron_triangles_list_ = false;
   bool default_polyhedron_vertices_triangles_ = false;
+
+  /** Identifier of the last GUI snapshot received (0 if none) */
+  uint64_t snapshot_ = 0;
+  /** Binary form of the data of the last GUI snapshot */
+  std::vector<char> snapshot_data_;
+  /** Binary form of the elements of the last GUI snapshot */
+  std::vector<char> snapshot_buffer_;
+  /** Offset and size of the elements of the last GUI snapshot in snapshot_buffer_, the elements that did not change
+   * are referenced by their index in deltas */
+  std::vector<std::pair<size_t, size_t>> snapshot_elements_;
+  /** True while a delta message is handled */
+  bool delta_ = false;
+  /** Binary form of data_ */
+  std::vector<char> data_buffer_;
+  struct Geometry
+  {
+    std::vector<char> data;
+    /** Last snapshot that referenced this payload, see snapshots_ */
+    uint64_t used = 0;
+  };
+  /** Geometry payloads referenced by the elements, by content hash
+   *
+   * Every snapshot holds the payloads it references, the payloads are kept across snapshots so that they are only
+   * copied when they change
+   */
+  std::unordered_map<uint64_t, Geometry> geometry_;
+  /** Number of snapshots received */
+  uint64_t snapshots_ = 0;
+  /** Payloads that were not referenced in this many snapshots are dropped from geometry_ */
+  static constexpr uint64_t GEOMETRY_MAX_AGE = 16;
+  /** Holds a widget after its geometry references were replaced */
+  std::vector<char> widget_buffer_;
+
+  /** Re-used by the widgets decoded in place */
+  std::string string_buffer_;
+  std::vector<std::string> labels_buffer_;
+  Eigen::VectorXd vector_buffer_;
+  /** Re-used by the plots, the AbscissaOrdinate points are flattened in plot_y_ */
+  std::vector<double> plot_x_;
+  std::vector<double> plot_y_;
+
+  /** Reads a MessagePack buffer in place */
+  struct Reader;
+
+  /** True if the GUI message is a delta, \p snapshot is then the identifier of the snapshot it refers to (or of the
+   * snapshot itself otherwise) */
+  static bool is_delta(const char * data, size_t size, uint64_t & snapshot);
+
+  /** Handle the binary form of a plot */
+  void handle_plot(const char * data, size_t size);
+
+  /** Handle standard plot, \p plot is positioned after the title, \p size is the size of the plot array */
+  void handle_standard_plot(uint64_t id, const std::string & title, size_t size, Reader & plot);
+
+  /** Handle XY plot, \p plot is positioned after the title, \p size is the size of the plot array */
+  void handle_xy_plot(uint64_t id, const std::string & title, size_t size, Reader & plot);
+
+  /** Handle a series of a plot, ordinates are only allowed in standard plots */
+  void handle_plot_series(uint64_t id,
+                          const std::string & title,
+                          uint64_t did,
+                          const char * data,
+                          size_t size,
+                          bool standard);
+
+  /** Handle a category, the category name is pushed to \p category while its content is handled */
+  void handle_category(std::vector<std::string> & category, Reader & data);
+
+  /** Replace the geometry references of a widget by their payload in widget_buffer_
+   *
+   * Returns false if a payload is missing
+   */
+  bool expand_geometry(const char * data, size_t size);
+
+  /** Handle the binary form of a widget */
+  void handle_widget(const std::vector<std::string> & category, const char * data, size_t size);
+
+  /** Decode simple widgets in place
+   *
+   * \param size Number of items in the widget array, \p data is positioned after the name, type and stack id
+   *
+   * Returns false if the widget should be handled through its Configuration form
+   */
+  bool handle_widget(const ElementId & id, mc_rtc::gui::Elements type, size_t size, Reader & data);
 };
 
 } // namespace mc_control
@@ -10,7 +10,11 @@
 #include <mc_rtc/gui/StateBuilder.h>
 #include <mc_rtc/log/Logger.h>
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace mc_control
@@ -21,6 +25,30 @@ namespace mc_control
  * - Uses a PUB socket to send the data stream
  *
  * - Uses a PULL socket to handle requests
+ *
+ * Clients can subscribe to a part of the GUI by sending a subscription request on the PULL socket:
+ *
+ * \code{.json}
+ * { "subscribe": "client id", "categories": [["Stabilizer"], ["Tasks", "CoM"]] }
+ * \endcode
+ *
+ * The server then publishes the subscribed categories in a message prefixed with \ref subscription_topic on a second
+ * PUB socket (see \ref subscriptions_uri). A subscription with no categories asks for the full GUI which is published
+ * without prefix on the PUB socket. The full GUI is also published when no subscription is active. Subscriptions
+ * expire after \ref subscription_timeout seconds, the clients should renew them before.
+ *
+ * nanomsg filters the topics on the SUB side: every client connected to the subscriptions endpoint receives the
+ * messages of every subscription and drops the ones that do not match its topic, the clients of the full GUI do not
+ * receive them.
+ *
+ * The server can also serve the full GUI through shared memory, see \ref shared_memory_name. The clients on the same
+ * host then read the latest message from memory and write their requests there.
+ *
+ * In threaded mode, publish() only captures the values of the GUI elements into pre-allocated buffers and
+ * handle_requests() only applies the requests received so far. A dedicated thread writes and sends the messages and
+ * receives the requests. When this thread misses a snapshot, the next publication is a snapshot. The capture still
+ * calls the callbacks of the captured elements and serializes their values (see mc_rtc::gui::StateBuilder::capture)
+ * on the thread that calls publish(), its cost grows with the number of elements.
  */
 struct MC_CONTROL_DLLAPI ControllerServer
 {
@@ -35,12 +63,23 @@ struct MC_CONTROL_DLLAPI ControllerServer
    *
    * \param pull_bind_uri List of URI the PULL socket should bind to
    *
+   * \param snapshot_period Period between two snapshots of the full GUI, see \ref
+   * ControllerServerConfiguration::snapshot_period
+   *
+   * \param threaded Send messages and receive requests in a dedicated thread, see \ref
+   * ControllerServerConfiguration::threaded
+   *
+   * \param shared_memory Name of the shared memory object used to serve local clients, disabled if empty
+   *
    * Check nanomsg documentation for supported protocols
    */
   ControllerServer(double dt,
                    double server_dt,
                    const std::vector<std::string> & pub_bind_uri,
-                   const std::vector<std::string> & pull_bind_uri);
+                   const std::vector<std::string> & pull_bind_uri,
+                   double snapshot_period = 1.0,
+                   bool threaded = false,
+                   const std::string & shared_memory = "");
 
   /** Construct from the provided configuration
    *
@@ -61,9 +100,42 @@ struct MC_CONTROL_DLLAPI ControllerServer
   /** Publish the current GUI state */
   void publish(mc_rtc::gui::StateBuilder & gui_builder);
 
-  /** Get latest published data */
+  /** Get latest published data
+   *
+   * In threaded mode, this returns the messages written by the network thread since the last call to publish()
+   */
   std::pair<const char *, size_t> data() const;
 
+  /** Get latest data published for a subscription
+   *
+   * Returns the full GUI data if the subscription does not exist or has no categories
+   */
+  std::pair<const char *, size_t> data(const std::string & id) const;
+
+  /** Prefix of the messages published for a subscription
+   *
+   * This starts with a byte that never starts a GUI message
+   */
+  static std::string subscription_topic(const std::string & id);
+
+  /** URI of the endpoint where the messages of the subscriptions are published alongside the PUB URI \p pub_uri
+   *
+   * The clients that only want the full GUI do not receive these messages. "_subscriptions" is added to IPC and
+   * in-process URIs (before the .ipc extension), TCP and WebSocket URIs use the port that follows the PUB port by 2.
+   *
+   * Returns an empty string if no endpoint can be derived from \p pub_uri
+   */
+  static std::string subscriptions_uri(const std::string & pub_uri);
+
+  /** Name of the shared memory object served alongside the IPC socket \p ipc_socket
+   *
+   * Clients connected to "ipc://" + ipc_socket + "_pub.ipc" look for this object
+   */
+  static std::string shared_memory_name(const std::string & ipc_socket);
+
+  /** Time after which a subscription that was not renewed expires (seconds) */
+  static constexpr double subscription_timeout = 5.0;
+
   /** Attach a logger to the server */
   inline void set_logger(std::shared_ptr<mc_rtc::Logger> logger) noexcept { logger_ = logger; }
 
@@ -76,15 +148,133 @@ struct MC_CONTROL_DLLAPI ControllerServer
   /** Update the rate of the server */
   void update_rate(double dt, double server_dt);
 
+  /** True if the network is handled in a dedicated thread */
+  inline bool threaded() const noexcept { return threaded_ != nullptr; }
+
+  /** Time spent sending the last messages and receiving requests (ms)
+   *
+   * In threaded mode, this is spent in the network thread and does not include the time spent in publish() and
+   * handle_requests()
+   */
+  double network_dt() const noexcept;
+
 private:
   unsigned int iter_;
   unsigned int rate_;
 
+  /** Period between two snapshots of the full GUI (seconds) */
+  double snapshot_period_;
+  /** Number of publications between two snapshots */
+  unsigned int snapshot_rate_ = 1;
+  /** Number of publications */
+  unsigned int publications_ = 0;
+  /** Publish a snapshot next, set when the network thread missed a snapshot */
+  bool force_snapshot_ = false;
+
+  /** Controller timestep */
+  double dt_;
+
+  struct Subscription
+  {
+    /** Topic prefixed to the messages */
+    std::string topic;
+    /** Subscribed categories, the full GUI if empty */
+    std::vector<std::vector<std::string>> categories;
+    /** Iteration of the last subscription request */
+    unsigned int renewed;
+  };
+  /** Active subscriptions by client id */
+  std::unordered_map<std::string, Subscription> subscriptions_;
+  /** True if the subscriptions changed since categories_ was computed */
+  bool categories_changed_ = true;
+  /** True if a client wants the full GUI */
+  bool full_ = true;
+  /** Categories captured in a publication, every category if full_ */
+  std::vector<std::vector<std::string>> categories_;
+
+  /** Handle a subscription request */
+  void subscribe(const std::string & id, std::vector<std::vector<std::string>> categories);
+
+  /** Handle a GUI request */
+  void handle_request(mc_rtc::gui::StateBuilder & gui_builder, mc_rtc::Logger::GUIEvent && request);
+
   int pub_socket_;
   int pull_socket_;
+  /** PUB socket of the subscriptions, see subscriptions_uri() */
+  int subscriptions_socket_ = -1;
+
+  /** Values captured in one publication */
+  struct Frame
+  {
+    mc_rtc::gui::StateBuilder::Capture capture;
+    /** Write deltas rather than snapshots */
+    bool delta = false;
+    struct Message
+    {
+      /** Subscription the message is written for, empty for the full GUI */
+      std::string id;
+      /** Topic prefixed to the message */
+      std::string topic;
+      /** Subscribed categories */
+      std::vector<std::vector<std::string>> categories;
+    };
+    /** Only the first count messages are valid */
+    std::vector<Message> messages;
+    size_t count = 0;
+  };
+  /** Frames exchanged with the network thread, only frames_[0] is used otherwise */
+  std::array<Frame, 3> frames_;
+  /** Frame written by publish() */
+  size_t back_ = 0;
+
+  /** Messages written from one frame */
+  struct Messages
+  {
+    struct Message
+    {
+      std::string id;
+      std::string topic;
+      std::vector<char> buffer;
+      size_t size = 0;
+    };
+    /** Only the first count messages are valid */
+    std::vector<Message> messages;
+    size_t count = 0;
+  };
+  /** Messages exchanged with the network thread, only messages_[0] is used otherwise */
+  std::array<Messages, 3> messages_;
+  /** Messages returned by data() */
+  size_t front_ = 0;
+  /** True if messages_[front_] were written since the previous call to publish() */
+  bool published_ = false;
+
+  /** Last snapshot of each subscription by id, the full GUI has an empty id
+   *
+   * This is only used by the thread that writes the messages
+   */
+  std::unordered_map<std::string, mc_rtc::gui::StateBuilder::Subscription> states_;
+  mc_rtc::gui::StateBuilder::Writer writer_;
+
+  /** Write the messages of a frame */
+  void write(const Frame & frame, Messages & out);
+
+  /** Send messages */
+  void send(const Messages & messages);
+
+  /** Receive the requests, calls callback on each one */
+  template<typename CallbackT>
+  void receive(CallbackT && callback);
+
+  /** Time spent in send() and receive() */
+  std::atomic<double> network_dt_{0};
+
+  /** Shared memory served to local clients, null if disabled */
+  struct SharedMemory;
+  std::unique_ptr<SharedMemory> shm_;
 
-  std::vector<char> buffer_;
-  size_t buffer_size_ = 0;
+  /** Network thread state */
+  struct Threaded;
+  std::unique_ptr<Threaded> threaded_;
 
   std::shared_ptr<mc_rtc::Logger> logger_;
 
@@ -28,7 +28,7 @@ struct SocketConfiguration
 {
   /** Which host the socket binds to */
   std::string host = "*";
-  /** Publisher port */
+  /** Publisher port, the subscriptions are published on pub_port + 2 */
   uint16_t pub_port = default_pub_port;
   /** Pull request port */
   uint16_t pull_port = default_pull_port;
@@ -47,14 +47,37 @@ struct MC_CONTROL_DLLAPI ControllerServerConfiguration
    */
   double timestep = 0.05;
 
+  /** Period between two snapshots of the full GUI (in seconds)
+   *
+   * In between, the server only publishes the elements that changed since the last snapshot. If it is null or
+   * negative, every publication is a snapshot
+   */
+  double snapshot_period = 1.0;
+
+  /** Send messages and receive requests in a dedicated thread
+   *
+   * The real-time thread then only captures the values of the GUI elements and applies the requests received by the
+   * network thread, the network thread writes the GUI messages. The callbacks of the elements are still called and
+   * their values serialized on the real-time thread.
+   */
+  bool threaded = false;
+
   /** IPC socket file
    *
-   * Actual ipc sockets are created as socket + "_pub.ipc" and socket + "_rep.ipc"
+   * Actual ipc sockets are created as socket + "_pub.ipc" and socket + "_rep.ipc", the subscriptions are published on
+   * socket + "_pub_subscriptions.ipc"
    *
    * If nullopt, IPC is disabled
    */
   std::optional<std::string> ipc_socket = mc_rtc::temp_directory_path("mc_rtc");
 
+  /** Also serve the full GUI and accept requests through shared memory
+   *
+   * Clients on the same host that connect to the IPC socket use the shared memory instead. This requires IPC and is
+   * not available on Windows
+   */
+  bool shared_memory = false;
+
   using TCPConfiguration = details::SocketConfiguration<4242, 4343>;
 
   /** Configuration for the TCP socket
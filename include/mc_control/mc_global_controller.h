@@ -918,6 +918,7 @@ public:
     mc_rtc::Logger::Policy log_policy = mc_rtc::Logger::Policy::NON_THREADED;
     std::string log_directory;
     std::string log_template = "mc-control";
+    mc_rtc::Logger::Options log_options;
 
     bool enable_gui_server = true;
     ControllerServerConfiguration gui_server_configuration;
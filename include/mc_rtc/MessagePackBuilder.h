@@ -76,6 +76,98 @@ struct has_write_builder<T, std::void_t<decltype(std::declval<const T &>().write
 template<typename T>
 static inline constexpr bool has_write_builder_v = has_write_builder<T>::value;
 
+/** Packed arrays hold little-endian values, containers are only written as packed arrays when they can be copied as-is */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static inline constexpr bool has_packed_arrays = false;
+#else
+static inline constexpr bool has_packed_arrays = true;
+#endif
+
+/** Numbers that can be written in a packed array */
+template<typename T>
+constexpr bool is_packed_scalar_v = std::is_arithmetic_v<T>
+                                    && (std::is_same_v<T, double> || std::is_same_v<T, float> || is_like_int32_t<T>
+                                        || is_like_int64_t<T> || is_like_uint64_t<T>);
+
+/** Type used to write a packed scalar */
+template<typename T>
+using packed_scalar_t = std::conditional_t<
+    is_like_int32_t<T>,
+    int32_t,
+    std::conditional_t<is_like_int64_t<T>, int64_t, std::conditional_t<is_like_uint64_t<T>, uint64_t, T>>>;
+
+/** Layout of an item of a packed array
+ *
+ * An item is a scalar or a fixed-size contiguous array of items, \a shape writes the size of each dimension
+ */
+template<typename T, typename = void>
+struct packed_item : std::false_type
+{
+};
+
+template<typename T>
+struct packed_item<T, std::enable_if_t<is_packed_scalar_v<T>>> : std::true_type
+{
+  using scalar = T;
+  static constexpr size_t rank = 0;
+  static constexpr size_t size = 1;
+  static void shape(uint8_t *) {}
+};
+
+template<typename T, size_t N>
+struct packed_item<std::array<T, N>,
+                   std::enable_if_t<packed_item<T>::value && (N < 256) && sizeof(std::array<T, N>) == N * sizeof(T)>>
+: std::true_type
+{
+  using scalar = typename packed_item<T>::scalar;
+  static constexpr size_t rank = packed_item<T>::rank + 1;
+  static constexpr size_t size = N * packed_item<T>::size;
+  static void shape(uint8_t * out)
+  {
+    out[0] = static_cast<uint8_t>(N);
+    packed_item<T>::shape(out + 1);
+  }
+};
+
+template<typename Scalar, int N, int Options, int MaxRows, int MaxCols>
+struct packed_item<Eigen::Matrix<Scalar, N, 1, Options, MaxRows, MaxCols>,
+                   std::enable_if_t<is_packed_scalar_v<Scalar> && (N > 0) && (N < 256)
+                                    && sizeof(Eigen::Matrix<Scalar, N, 1, Options, MaxRows, MaxCols>)
+                                           == N * sizeof(Scalar)>> : std::true_type
+{
+  using scalar = Scalar;
+  static constexpr size_t rank = 1;
+  static constexpr size_t size = N;
+  static void shape(uint8_t * out) { out[0] = static_cast<uint8_t>(N); }
+};
+
+/** Containers that can be written as a packed array */
+template<typename T, typename = void>
+struct packed_array : std::false_type
+{
+};
+
+template<typename T, typename A>
+struct packed_array<std::vector<T, A>, std::enable_if_t<packed_item<T>::value>> : std::true_type
+{
+  using item = packed_item<T>;
+  static const T * data(const std::vector<T, A> & v) { return v.data(); }
+  static size_t size(const std::vector<T, A> & v) { return v.size(); }
+};
+
+template<typename Scalar, int Options, int MaxRows, int MaxCols>
+struct packed_array<Eigen::Matrix<Scalar, Eigen::Dynamic, 1, Options, MaxRows, MaxCols>,
+                    std::enable_if_t<is_packed_scalar_v<Scalar>>> : std::true_type
+{
+  using VectorT = Eigen::Matrix<Scalar, Eigen::Dynamic, 1, Options, MaxRows, MaxCols>;
+  using item = packed_item<Scalar>;
+  static const Scalar * data(const VectorT & v) { return v.data(); }
+  static size_t size(const VectorT & v) { return static_cast<size_t>(v.size()); }
+};
+
+template<typename T>
+static inline constexpr bool is_packed_array_v = has_packed_arrays && packed_array<std::decay_t<T>>::value;
+
 } // namespace internal
 
 /** Helper class to build a MessagePack message
@@ -85,6 +177,25 @@ static inline constexpr bool has_write_builder_v = has_write_builder<T>::value;
  */
 struct MC_RTC_UTILS_DLLAPI MessagePackBuilder
 {
+  /** @name MessagePack extension types used by mc_rtc
+   *
+   * A packed array is an extension holding the rank of its items (1 byte), the size of each dimension of an item (1
+   * byte each) and then the little-endian values. The extension type gives the type of the values.
+   *
+   * A geometry reference is used by the GUI, see mc_rtc::gui::StateBuilder::GEOMETRY_EXT
+   *
+   * @{
+   */
+  static constexpr int8_t GEOMETRY_REF = 1;
+  static constexpr int8_t PACKED_FLOAT64 = 2;
+  static constexpr int8_t PACKED_FLOAT32 = 3;
+  static constexpr int8_t PACKED_INT32 = 4;
+  static constexpr int8_t PACKED_INT64 = 5;
+  static constexpr int8_t PACKED_UINT64 = 6;
+  static constexpr int8_t PACKED_UINT32 = 7;
+  static constexpr int8_t PACKED_UINT16 = 8;
+  /** @} */
+
   /** Constructor
    *
    * \param buffer Buffer used to store the data, it may grow depending on the needs
@@ -346,6 +457,51 @@ struct MC_RTC_UTILS_DLLAPI MessagePackBuilder
   /** @} */
   /* End Add data to the MessagePack section (containers) */
 
+  /** Write a container of numbers as a packed array
+   *
+   * This is supported for std::vector and dynamic Eigen vectors of numbers, std::vector of fixed-size Eigen vectors
+   * and std::vector of (nested) std::array, the data is copied at once.
+   *
+   * Other types are written by write(const T &)
+   */
+  template<typename T>
+  void write_packed(const T & value)
+  {
+    if constexpr(internal::is_packed_array_v<T>)
+    {
+      using array_t = internal::packed_array<std::decay_t<T>>;
+      using item_t = typename array_t::item;
+      using scalar_t = internal::packed_scalar_t<typename item_t::scalar>;
+      std::array<uint8_t, item_t::rank + 1> shape;
+      item_t::shape(shape.data());
+      write_packed(reinterpret_cast<const scalar_t *>(array_t::data(value)), array_t::size(value) * item_t::size,
+                   shape.data(), item_t::rank);
+    }
+    else { write(value); }
+  }
+
+  /** @name Write raw packed arrays
+   *
+   * \param data Values
+   *
+   * \param size Number of values
+   *
+   * \param shape Size of each dimension of an item
+   *
+   * \param rank Number of dimensions of an item (0 for an array of numbers)
+   *
+   * Unsigned integers (e.g. indices) are written with the narrowest type that holds every value (PACKED_UINT16,
+   * PACKED_UINT32 or PACKED_UINT64)
+   *
+   * @{
+   */
+  void write_packed(const double * data, size_t size, const uint8_t * shape = nullptr, size_t rank = 0);
+  void write_packed(const float * data, size_t size, const uint8_t * shape = nullptr, size_t rank = 0);
+  void write_packed(const int32_t * data, size_t size, const uint8_t * shape = nullptr, size_t rank = 0);
+  void write_packed(const int64_t * data, size_t size, const uint8_t * shape = nullptr, size_t rank = 0);
+  void write_packed(const uint64_t * data, size_t size, const uint8_t * shape = nullptr, size_t rank = 0);
+  /** @} */
+
   /** Start serializing an array
    *
    * \param size Size of the array
@@ -373,6 +529,12 @@ struct MC_RTC_UTILS_DLLAPI MessagePackBuilder
    */
   void write_object(const char * data, size_t s);
 
+  /** Returns the number of bytes written so far
+   *
+   * The data written so far are contiguous at the beginning of the buffer provided to the constructor
+   */
+  size_t size() const noexcept;
+
   /** Finish building the message
    *
    * Afterwards, data cannot be appended to the builder
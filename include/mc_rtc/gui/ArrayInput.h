@@ -41,7 +41,7 @@ struct ArrayInputImpl : public CommonInputImpl<GetT, SetT>
 
   void write(mc_rtc::MessagePackBuilder & writer)
   {
-    CommonInputImpl<GetT, SetT>::write(writer);
+    writer.write_packed(this->get_fn_());
     writer.write(labels_);
   }
 
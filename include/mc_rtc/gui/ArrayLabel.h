@@ -39,7 +39,7 @@ struct ArrayLabelImpl : public LabelImpl<GetT>
 
   void write(mc_rtc::MessagePackBuilder & writer)
   {
-    LabelImpl<GetT>::write(writer);
+    writer.write_packed(this->get_fn_());
     writer.write(labels_);
   }
 
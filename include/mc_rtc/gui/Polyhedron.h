@@ -39,7 +39,7 @@ struct PolyhedronTrianglesListImpl : public Element
 
   void write(mc_rtc::MessagePackBuilder & builder)
   {
-    builder.write(get_triangles_fn_());
+    builder.write_packed(get_triangles_fn_());
     config_.write(builder);
   }
 
@@ -78,8 +78,8 @@ struct PolyhedronVerticesTrianglesImpl : public Element
 
   void write(mc_rtc::MessagePackBuilder & builder)
   {
-    builder.write(get_vertices_fn_());
-    builder.write(get_triangles_fn_());
+    builder.write_packed(get_vertices_fn_());
+    builder.write_packed(get_triangles_fn_());
     config_.write(builder);
   }
 
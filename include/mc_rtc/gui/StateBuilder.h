@@ -8,7 +8,9 @@
 #include <mc_rtc/gui/elements.h>
 #include <mc_rtc/gui/plot.h>
 
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace mc_rtc
 {
@@ -36,7 +38,24 @@ struct MC_RTC_GUI_DLLAPI StateBuilder
    * - Adding fields to an existing Element
    * - Adding an Element type
    */
-  static constexpr int8_t PROTOCOL_VERSION = 4;
+  static constexpr int8_t PROTOCOL_VERSION = 7;
+
+  /** MessagePack extension type of a reference to a geometry payload
+   *
+   * The extension data is the 64-bit hash of the payload (little-endian), the payload is in the geometry table of the
+   * message or of the last snapshot
+   */
+  static constexpr int8_t GEOMETRY_EXT = mc_rtc::MessagePackBuilder::GEOMETRY_REF;
+
+  /** Geometry fields smaller than this (in bytes) are always sent by value */
+  static constexpr size_t GEOMETRY_MIN_SIZE = 64;
+
+  /** True if the field \p field of an element of type \p type holds geometry that is sent by reference
+   *
+   * This covers the triangles, vertices and colors of polyhedrons, the points of polygons, the description of visuals
+   * and the parameters of robots
+   */
+  static bool geometry(Elements type, size_t field) noexcept;
 
   /** Constructor */
   StateBuilder();
@@ -324,18 +343,132 @@ struct MC_RTC_GUI_DLLAPI StateBuilder
   /** Remove a plot identified by the provided name */
   void removePlot(const std::string & name);
 
+  /** Part of the GUI sent to a client and the last snapshot it was sent, see update(std::vector<char> &, Subscription
+   * &, bool) */
+  struct MC_RTC_GUI_DLLAPI Subscription
+  {
+    /** Categories sent to the client with all their content, the full GUI is sent if empty */
+    std::vector<std::vector<std::string>> categories;
+    /** Identifier of the last snapshot, 0 if no snapshot was written */
+    uint64_t snapshot = 0;
+    /** Binary form of data in the last snapshot */
+    std::vector<char> snapshot_data;
+    struct ElementSnapshot
+    {
+      /** Snapshot the element was last written in */
+      uint64_t snapshot;
+      /** Index of the element in this snapshot */
+      size_t index;
+      /** Binary form of the element in this snapshot */
+      std::vector<char> data;
+    };
+    /** Elements in the last snapshot by unique id */
+    std::unordered_map<uint64_t, ElementSnapshot> snapshot_elements;
+    /** Hash of the geometry payloads in the last snapshot */
+    std::unordered_set<uint64_t> snapshot_geometry;
+  };
+
+  /** Values of the GUI captured in one iteration, see capture()
+   *
+   * This holds the binary form of the data, of the captured elements (with their categories) and of the plots. The
+   * GUI messages are written from a capture by a Writer, possibly in another thread.
+   */
+  struct MC_RTC_GUI_DLLAPI Capture
+  {
+    /** Binary form of the capture */
+    std::vector<char> buffer;
+    /** Effective size of the capture */
+    size_t size = 0;
+  };
+
+  /** Write the GUI messages from captures
+   *
+   * The writer compares the elements to the snapshot of each subscription and replaces the geometry by references. It
+   * does not access the StateBuilder so it can be used in another thread than the one that updates the GUI, a writer
+   * must only be used from one thread.
+   */
+  struct MC_RTC_GUI_DLLAPI Writer
+  {
+    Writer();
+    ~Writer();
+    Writer(Writer &&) noexcept;
+    Writer & operator=(Writer &&) noexcept;
+
+    /** Write the GUI message of a subscription from a capture, see update(std::vector<char> &, Subscription &, bool)
+     *
+     * The subscribed categories must have been captured
+     */
+    size_t write(std::vector<char> & data, const Capture & capture, Subscription & subscription, bool delta = false);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+  };
+
+  /** Capture the values of the elements in \p categories (see Subscription::categories) and of the plots
+   *
+   * The callbacks of the elements that are not in \p categories are not called. The plots are written with their
+   * current samples, they are neither sampled nor cleared.
+   *
+   * \param capture Capture to write
+   *
+   * \param categories Categories to capture, every element is captured if empty
+   */
+  void capture(Capture & capture, const std::vector<std::vector<std::string>> & categories = {});
+
   /** Update the GUI message
+   *
+   * The message is either a snapshot of the full GUI or a delta against the last snapshot. In a delta, the elements
+   * that did not change since the snapshot are replaced by their index in the snapshot and the data is nil if it did
+   * not change. The message ends with the snapshot identifier, a delta flag and the geometry table.
+   *
+   * The geometry fields (see geometry(Elements, size_t)) are replaced by a GEOMETRY_EXT reference to their content
+   * hash. The geometry table maps these hashes to the payloads, in a delta it only holds the payloads that were not in
+   * the last snapshot.
    *
    * \param data Will hold binary data representing the GUI
    *
+   * \param delta Write a delta against the last snapshot, a snapshot is written if there is none yet
+   *
    * \returns Effective size of the GUI message
    *
    */
-  size_t update(std::vector<char> & data);
+  size_t update(std::vector<char> & data, bool delta = false);
+
+  /** Update the GUI message of a subscription
+   *
+   * Only the subscribed categories are written, the callbacks of the other elements are not called. The parents of the
+   * subscribed categories are written without their elements.
+   *
+   * \param data Will hold binary data representing the GUI
+   *
+   * \param subscription Subscription to write, its snapshot is updated
+   *
+   * \param delta Write a delta against the last snapshot of the subscription
+   *
+   * \returns Effective size of the GUI message
+   */
+  size_t update(std::vector<char> & data, Subscription & subscription, bool delta = false);
+
+  /** Write the GUI message of a subscription without sampling or clearing the plots
+   *
+   * This is used to write several messages for the same iteration: the plots are sampled once with update(), every
+   * message is written with the same samples and the samples are then cleared with clearPlots()
+   *
+   * See update(std::vector<char> &, Subscription &, bool) for the parameters
+   */
+  size_t write(std::vector<char> & data, Subscription & subscription, bool delta = false);
+
+  /** Write the full GUI message without sampling or clearing the plots, see write(std::vector<char> &, Subscription
+   * &, bool) */
+  size_t write(std::vector<char> & data, bool delta = false);
 
   /** Update the plots only */
   void update();
 
+  /** Clear the plot samples that were written */
+  void clearPlots();
+
   /** Handle a request */
   bool handleRequest(const std::vector<std::string> & category,
                      const std::string & name,
@@ -362,8 +495,19 @@ private:
 
   /** Holds static data for the GUI */
   mc_rtc::Configuration data_;
+  /** Action performed by a plot callback */
+  enum class PlotAction
+  {
+    /** Sample the plot data */
+    Update,
+    /** Write the plot and its samples into the GUI message */
+    Write,
+    /** Clear the samples */
+    Clear
+  };
   /** Callback used to write/update plot data into the GUI message */
-  using plot_callback_function_t = std::function<void(mc_rtc::MessagePackBuilder &, const std::string &, bool)>;
+  using plot_callback_function_t =
+      std::function<void(mc_rtc::MessagePackBuilder &, const std::string &, PlotAction)>;
   struct PlotCallback
   {
     plot::Plot type;
@@ -383,6 +527,14 @@ private:
   std::vector<char> data_buffer_;
   /** Holds data's binary size */
   size_t data_buffer_size_ = 0;
+  /** Subscription to the full GUI used by update(std::vector<char> &, bool) */
+  Subscription all_;
+  /** Capture used by write(std::vector<char> &, Subscription &, bool) */
+  Capture capture_;
+  /** Writer used by write(std::vector<char> &, Subscription &, bool) */
+  Writer writer_;
+  /** Unique id of the last element added */
+  uint64_t element_uid_ = 0;
   struct Category;
   struct MC_RTC_GUI_DLLAPI ElementStore
   {
@@ -392,6 +544,9 @@ private:
     void (*write)(Element &, mc_rtc::MessagePackBuilder &);
     bool (*handleRequest)(Element &, const mc_rtc::Configuration &);
     void * source;
+    /** Unique id of the element in this StateBuilder */
+    uint64_t uid = 0;
+    Elements type;
 
     template<typename T>
     ElementStore(T self, const Category & category, ElementsStacking stacking, void * source);
@@ -429,8 +584,19 @@ private:
   /** Get a category, creates it if does not exist */
   Category & getOrCreateCategory(const std::vector<std::string> & category);
 
-  /** Update the GUI data state for a given category */
-  void update(mc_rtc::MessagePackBuilder & builder, Category & category);
+  /** Capture all the elements of a category and its sub-categories */
+  void capture(mc_rtc::MessagePackBuilder & builder, Category & category);
+
+  /** Capture the elements of the categories in \p paths, the other categories are captured without their elements
+   *
+   * \param paths Categories to capture that start with this category
+   *
+   * \param depth Depth of this category
+   */
+  void capture(mc_rtc::MessagePackBuilder & builder,
+               Category & category,
+               const std::vector<const std::vector<std::string> *> & paths,
+               size_t depth);
 
   /** Remove all elements associated to the given in the given category */
   void removeElements(Category & category, void * source);
@@ -58,6 +58,7 @@ void StateBuilder::addElementImpl(void * source,
     return;
   }
   cat.elements.emplace_back(element, cat, stacking, source);
+  cat.elements.back().uid = ++element_uid_;
   if(rem == 0) { cat.id += 1; }
 }
 
@@ -100,6 +101,7 @@ template<typename T>
 StateBuilder::ElementStore::ElementStore(T self, const Category & category, ElementsStacking stacking, void * source)
 {
   self.id(category.id);
+  type = T::type;
   // FIXME In C++14 we could have T && self and move it into the lambda
   element = [self]() mutable -> Element & { return self; };
   if(stacking == ElementsStacking::Vertical)
@@ -173,9 +175,9 @@ void StateBuilder::addXYPlot(const std::string & name,
   uint64_t sz = 6;
   uint64_t id = ++plot_id_;
   plot_callback_function_t cb = [id, sz, xConfig, yLeftConfig, yRightConfig](mc_rtc::MessagePackBuilder & builder,
-                                                                             const std::string & name, bool update)
+                                                                             const std::string & name, PlotAction action)
   {
-    if(update) { return; }
+    if(action != PlotAction::Write) { return; }
     builder.write(static_cast<uint64_t>(plot::Plot::XY));
     builder.write(id);
     builder.write(name);
@@ -218,17 +220,22 @@ void StateBuilder::addPlot(const std::string & name,
   uint64_t sz = 6;
   uint64_t id = ++plot_id_;
   plot_callback_function_t cb = [abscissa, id, sz, yLeftConfig, yRightConfig](mc_rtc::MessagePackBuilder & builder,
-                                                                              const std::string & name, bool update)
+                                                                              const std::string & name,
+                                                                              PlotAction action)
   {
-    if(update)
+    if(action == PlotAction::Update)
     {
       abscissa.update();
       return;
     }
+    if(action == PlotAction::Clear)
+    {
+      abscissa.clear();
+      return;
+    }
     builder.write(static_cast<uint64_t>(plot::Plot::Standard));
     builder.write(id);
     builder.write(name);
-    abscissa.update();
     abscissa.write(builder);
     yLeftConfig.write(builder);
     yRightConfig.write(builder);
@@ -242,12 +249,22 @@ void StateBuilder::addPlotData(PlotCallback & callback, T plot, Args... args)
 {
   callback.msg_size += 1;
   auto prev_callback = callback.callback;
-  callback.callback = [prev_callback, plot](mc_rtc::MessagePackBuilder & builder, const std::string & name, bool update)
+  callback.callback =
+      [prev_callback, plot](mc_rtc::MessagePackBuilder & builder, const std::string & name, PlotAction action)
   {
-    prev_callback(builder, name, update);
-    plot.update();
-    if(update) { return; }
-    plot.write(builder);
+    prev_callback(builder, name, action);
+    switch(action)
+    {
+      case PlotAction::Update:
+        plot.update();
+        break;
+      case PlotAction::Write:
+        plot.write(builder);
+        break;
+      case PlotAction::Clear:
+        plot.clear();
+        break;
+    }
   };
   addPlotData(callback, args...);
 }
@@ -44,7 +44,7 @@ struct TrajectoryImpl : public DataElement<GetT>
 
   void write(mc_rtc::MessagePackBuilder & builder)
   {
-    DataElement<GetT>::write(builder);
+    builder.write_packed(this->get_fn_());
     config_.write(builder);
   }
 
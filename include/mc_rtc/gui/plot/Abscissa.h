@@ -37,13 +37,14 @@ struct Abscissa
   {
     builder.start_array(2);
     config_.write(builder);
-    builder.write(cache_);
+    builder.write_packed(cache_);
     builder.finish_array();
-    cache_.resize(0);
   }
 
   void update() const { cache_.push_back(get_fn_()); }
 
+  void clear() const { cache_.resize(0); }
+
   Abscissa & range(const Range & range)
   {
     config_.range = range;
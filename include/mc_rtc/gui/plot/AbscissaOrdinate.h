@@ -41,16 +41,17 @@ struct AbscissaOrdinate
     builder.start_array(6);
     builder.write(static_cast<uint64_t>(type));
     builder.write(name_);
-    builder.write(cache_);
+    builder.write_packed(cache_);
     color_.write(builder);
     builder.write(static_cast<uint64_t>(style_));
     builder.write(static_cast<uint64_t>(side_));
     builder.finish_array();
-    cache_.resize(0);
   }
 
   void update() const { update_fn_(cache_); }
 
+  void clear() const { cache_.resize(0); }
+
   AbscissaOrdinate & style(Style style)
   {
     style_ = style;
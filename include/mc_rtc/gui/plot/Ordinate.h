@@ -39,16 +39,17 @@ struct Ordinate
     builder.start_array(6);
     builder.write(static_cast<uint64_t>(type));
     builder.write(name_);
-    builder.write(cache_);
+    builder.write_packed(cache_);
     color_.write(builder);
     builder.write(static_cast<uint64_t>(style_));
     builder.write(static_cast<uint64_t>(side_));
     builder.finish_array();
-    cache_.resize(0);
   }
 
   void update() const { cache_.push_back(get_fn_()); }
 
+  void clear() const { cache_.resize(0); }
+
   Ordinate & style(Style style)
   {
     style_ = style;
@@ -43,6 +43,8 @@ struct Polygon
 
   void update() const {}
 
+  void clear() const {}
+
   Polygon & side(Side side)
   {
     side_ = side;
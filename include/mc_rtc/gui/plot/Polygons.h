@@ -46,6 +46,8 @@ struct Polygons
 
   void update() const {}
 
+  void clear() const {}
+
   Polygons & side(Side side)
   {
     side_ = side;
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#pragma once
+
+#include <mc_rtc/log/utils.h>
+#include <mc_rtc/utils_api.h>
+
+#include <string>
+#include <vector>
+
+namespace mc_rtc::log
+{
+
+/** Sparse time index of a binary log
+ *
+ * The index is stored next to the log (see \ref path), it is written by the Logger when the log is closed and can be
+ * rebuilt for existing logs with \ref build (mc_bin_utils index).
+ *
+ * Every point of the index is a frame where reading can start: every entry is written in this frame and the keys
+ * active at this frame are stored in the index. In compressed logs, index points are the first frame of a block.
+ *
+ * The file layout (native endianness) is:
+ * - a header: magic number (MCRTCIDX), format version and size of the indexed log
+ * - the tables of keys: number of tables then, for each table, the number of keys followed by the type (uint64_t),
+ *   name size (uint64_t) and name of each key
+ * - the points: number of points then one \ref Point per point
+ */
+struct MC_RTC_UTILS_DLLAPI BinaryLogIndex
+{
+  /** Version of the format */
+  static const uint64_t version;
+
+  /** A key of the log */
+  struct Key
+  {
+    LogType type;
+    std::string name;
+  };
+
+  /** A frame where reading can start */
+  struct Point
+  {
+    /** Time of the frame */
+    double t;
+    /** Offset of the frame in the log */
+    uint64_t offset;
+    /** Index of the keys active at this frame in \ref keys */
+    uint64_t keys;
+  };
+
+  /** Size of the indexed log, an index that does not match the log size is outdated */
+  uint64_t log_size = 0;
+  /** Tables of keys referenced by the points */
+  std::vector<std::vector<Key>> keys;
+  /** Index points sorted by time */
+  std::vector<Point> points;
+
+  /** Path to the index of a log */
+  static std::string path(const std::string & fpath);
+
+  /** Load the index of a log
+   *
+   * \returns False if the log has no index or if the index is invalid or outdated
+   */
+  bool load(const std::string & fpath);
+
+  /** Save the index of a log */
+  bool save(const std::string & fpath) const;
+
+  /** Build the index by reading a log
+   *
+   * \param fpath Log to index
+   *
+   * \param interval Minimum number of frames between two index points
+   *
+   * \returns False if the log could not be read
+   */
+  bool build(const std::string & fpath, size_t interval = 1000);
+
+  /** Returns the last index point at or before \p t, nullptr if there is none */
+  const Point * find(double t) const noexcept;
+};
+
+} // namespace mc_rtc::log
@@ -0,0 +1,316 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#pragma once
+
+#include <mc_rtc/log/utils.h>
+#include <mc_rtc/utils_api.h>
+
+#include <SpaceVecAlg/SpaceVecAlg>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mc_rtc::log
+{
+
+struct FlatLog;
+
+/** Read-only, memory-mapped, columnar log
+ *
+ * Every entry of the log is stored as one contiguous typed array, accessing the data through \ref View does not copy
+ * the data nor allocate memory.
+ *
+ * The file layout (native endianness, every section is 8-bytes aligned) is:
+ * - a header: magic number (MCRTCCOL), format version, number of samples, number of columns, offset of the column
+ *   directory and index of the time column (the "t" entry)
+ * - the column directory, one \ref Column per entry
+ * - for each column: its name, a presence mask (one byte per sample), the offsets of each sample for variable-size
+ *   data (VectorXd, std::vector<double> and std::string) and the data itself
+ *
+ * Fixed-size data is stored as doubles with the following layout:
+ * - Eigen::Vector2d/3d/6d: the vector coefficients
+ * - Eigen::Quaterniond: x, y, z, w (Eigen's storage order)
+ * - sva::PTransformd: rotation (column-major) then translation
+ * - sva::ForceVecd: couple then force
+ * - sva::MotionVecd: angular then linear
+ *
+ * Scalars are stored with their native type (bool is stored as uint8_t)
+ */
+struct MC_RTC_UTILS_DLLAPI ColumnarLog
+{
+  /** Version of the format */
+  static const uint64_t version;
+
+  /** On-disk description of a column, all offsets are relative to the start of the file */
+  struct Column
+  {
+    /** Name of the entry */
+    uint64_t name_offset;
+    uint64_t name_size;
+    /** Type of the entry (LogType) */
+    uint64_t type;
+    /** Number of scalars per sample for fixed-size data, zero for variable-size data */
+    uint64_t stride;
+    /** One byte per sample, non-zero when the entry has data at this sample */
+    uint64_t valid_offset;
+    /** For variable-size data, (size() + 1) uint64_t, sample i is [offsets[i], offsets[i + 1]) in data */
+    uint64_t offsets_offset;
+    /** Data of the column */
+    uint64_t data_offset;
+    uint64_t data_size;
+  };
+
+  /** Typed view over a column
+   *
+   * operator[] returns:
+   * - the value for scalars
+   * - an Eigen::Map for Eigen vectors, Eigen::VectorXd and std::vector<double>
+   * - a value for sva types (built from the mapped data)
+   * - a std::string_view for strings
+   *
+   * The view is empty if the entry does not exist or its type does not match T
+   */
+  template<typename T>
+  struct View;
+
+  /** Empty log */
+  ColumnarLog();
+
+  /** Open a columnar log */
+  ColumnarLog(const std::string & path);
+
+  ~ColumnarLog();
+
+  ColumnarLog(const ColumnarLog &) = delete;
+  ColumnarLog & operator=(const ColumnarLog &) = delete;
+
+  ColumnarLog(ColumnarLog &&);
+  ColumnarLog & operator=(ColumnarLog &&);
+
+  /** Open a columnar log, returns false if the file is not a valid columnar log */
+  bool open(const std::string & path);
+
+  /** Write a flat log into a columnar log
+   *
+   * For each entry, only the samples matching the first non-None type of the entry are kept
+   *
+   * \param log Log to write
+   *
+   * \param path Output file
+   *
+   * \param entries Entries to write (all if empty), the time entry is always written
+   */
+  static bool write(const FlatLog & log, const std::string & path, const std::vector<std::string> & entries = {});
+
+  /** Returns the number of samples in the log */
+  size_t size() const noexcept;
+
+  /** Returns a sorted list of entries in the log */
+  std::set<std::string> entries() const;
+
+  /** Returns true if the log has the provided entry */
+  bool has(const std::string & entry) const;
+
+  /** Type of an entry (None if the entry does not exist) */
+  LogType type(const std::string & entry) const;
+
+  /** Access an entry */
+  template<typename T>
+  View<T> get(const std::string & entry) const;
+
+  /** Access the time entry ("t") */
+  View<double> time() const;
+
+  /** Index of the first sample whose time is greater or equal to \p t (\ref size() if there is none)
+   *
+   * This is a binary search in the time column
+   */
+  size_t index(double t) const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+
+  const Column * column(const std::string & entry) const;
+  const char * data() const noexcept;
+};
+
+namespace details
+{
+
+/** How a type is stored and accessed in a \ref ColumnarLog */
+template<typename T>
+struct ColumnTraits
+{
+  static_assert(std::is_arithmetic_v<T>, "Not supported in columnar logs");
+  using stored_t = T;
+  static constexpr size_t stride = 1;
+  static T at(const stored_t * data) { return *data; }
+};
+
+template<>
+struct ColumnTraits<bool>
+{
+  using stored_t = uint8_t;
+  static constexpr size_t stride = 1;
+  static bool at(const stored_t * data) { return *data != 0; }
+};
+
+template<int N>
+struct ColumnTraitsVector
+{
+  using stored_t = double;
+  static constexpr size_t stride = N;
+  static Eigen::Map<const Eigen::Matrix<double, N, 1>> at(const double * data)
+  {
+    return Eigen::Map<const Eigen::Matrix<double, N, 1>>(data);
+  }
+};
+
+template<>
+struct ColumnTraits<Eigen::Vector2d> : public ColumnTraitsVector<2>
+{
+};
+
+template<>
+struct ColumnTraits<Eigen::Vector3d> : public ColumnTraitsVector<3>
+{
+};
+
+template<>
+struct ColumnTraits<Eigen::Vector6d> : public ColumnTraitsVector<6>
+{
+};
+
+template<>
+struct ColumnTraits<Eigen::Quaterniond>
+{
+  using stored_t = double;
+  static constexpr size_t stride = 4;
+  static Eigen::Map<const Eigen::Quaterniond> at(const double * data)
+  {
+    return Eigen::Map<const Eigen::Quaterniond>(data);
+  }
+};
+
+template<>
+struct ColumnTraits<sva::PTransformd>
+{
+  using stored_t = double;
+  static constexpr size_t stride = 12;
+  static sva::PTransformd at(const double * data)
+  {
+    return {Eigen::Map<const Eigen::Matrix3d>(data), Eigen::Map<const Eigen::Vector3d>(data + 9)};
+  }
+};
+
+template<>
+struct ColumnTraits<sva::ForceVecd>
+{
+  using stored_t = double;
+  static constexpr size_t stride = 6;
+  static sva::ForceVecd at(const double * data)
+  {
+    return {Eigen::Map<const Eigen::Vector3d>(data), Eigen::Map<const Eigen::Vector3d>(data + 3)};
+  }
+};
+
+template<>
+struct ColumnTraits<sva::MotionVecd>
+{
+  using stored_t = double;
+  static constexpr size_t stride = 6;
+  static sva::MotionVecd at(const double * data)
+  {
+    return {Eigen::Map<const Eigen::Vector3d>(data), Eigen::Map<const Eigen::Vector3d>(data + 3)};
+  }
+};
+
+/** Variable-size data */
+template<typename T>
+struct ColumnTraitsVariable
+{
+  using stored_t = double;
+  static constexpr size_t stride = 0;
+  static Eigen::Map<const Eigen::VectorXd> at(const double * data, uint64_t size)
+  {
+    return Eigen::Map<const Eigen::VectorXd>(data, static_cast<Eigen::DenseIndex>(size));
+  }
+};
+
+template<>
+struct ColumnTraits<Eigen::VectorXd> : public ColumnTraitsVariable<Eigen::VectorXd>
+{
+};
+
+template<>
+struct ColumnTraits<std::vector<double>> : public ColumnTraitsVariable<std::vector<double>>
+{
+};
+
+template<>
+struct ColumnTraits<std::string>
+{
+  using stored_t = char;
+  static constexpr size_t stride = 0;
+  static std::string_view at(const char * data, uint64_t size) { return {data, size}; }
+};
+
+} // namespace details
+
+template<typename T>
+struct ColumnarLog::View
+{
+  using traits = details::ColumnTraits<T>;
+  using stored_t = typename traits::stored_t;
+
+  View() = default;
+
+  View(size_t size, const uint8_t * valid, const uint64_t * offsets, const stored_t * data)
+  : size_(size), valid_(valid), offsets_(offsets), data_(data)
+  {
+  }
+
+  /** Number of samples (zero if the view is empty) */
+  inline size_t size() const noexcept { return size_; }
+
+  /** True if the view is empty */
+  inline bool empty() const noexcept { return size_ == 0; }
+
+  /** True if the entry has data at sample \p i */
+  inline bool valid(size_t i) const noexcept { return valid_[i] != 0; }
+
+  /** Access sample \p i (no bound checks) */
+  inline auto operator[](size_t i) const
+  {
+    if constexpr(traits::stride == 0) { return traits::at(data_ + offsets_[i], offsets_[i + 1] - offsets_[i]); }
+    else { return traits::at(data_ + traits::stride * i); }
+  }
+
+  /** Raw data, for fixed-size data sample i starts at data() + i * stride */
+  inline const stored_t * data() const noexcept { return data_; }
+
+private:
+  size_t size_ = 0;
+  const uint8_t * valid_ = nullptr;
+  const uint64_t * offsets_ = nullptr;
+  const stored_t * data_ = nullptr;
+};
+
+template<typename T>
+auto ColumnarLog::get(const std::string & entry) const -> View<T>
+{
+  const Column * c = column(entry);
+  if(!c || c->type != static_cast<uint64_t>(GetLogType<T>::type)) { return {}; }
+  const char * base = data();
+  return View<T>(size(), reinterpret_cast<const uint8_t *>(base + c->valid_offset),
+                 c->offsets_offset ? reinterpret_cast<const uint64_t *>(base + c->offsets_offset) : nullptr,
+                 reinterpret_cast<const typename View<T>::stored_t *>(base + c->data_offset));
+}
+
+} // namespace mc_rtc::log
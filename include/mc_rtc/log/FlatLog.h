@@ -10,6 +10,7 @@
 
 #include <SpaceVecAlg/SpaceVecAlg>
 
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -48,6 +49,9 @@ struct MC_RTC_UTILS_DLLAPI FlatLog
   /** Load a file into the log */
   FlatLog(const std::string & fpath);
 
+  /** Load a file into the log using \p threads to decode binary logs (see \ref setThreads) */
+  FlatLog(const std::string & fpath, size_t threads);
+
   FlatLog(const FlatLog &) = delete;
   FlatLog & operator=(const FlatLog &) = delete;
 
@@ -57,9 +61,34 @@ struct MC_RTC_UTILS_DLLAPI FlatLog
   /** Load a file into the log, erase the current content of the flat log */
   void load(const std::string & fpath);
 
-  /** Append a file into the flat log, the resulting content is the concatenation of the two logs*/
+  /** Load the provided keys of a file into the log, erase the current content of the flat log
+   *
+   * Other keys are skipped without being decoded. A key ending with '*' selects every key starting with the given
+   * prefix. The time entry ("t") is only loaded if it is requested. If keys is empty, all keys are loaded.
+   */
+  void load(const std::string & fpath, const std::vector<std::string> & keys);
+
+  /** Append a file into the flat log, the resulting content is the concatenation of the two logs
+   *
+   * When \p fpath is the first part of a rotated binary log, the following parts (see \ref Logger::partPath) are
+   * appended as well
+   */
   void append(const std::string & fpath);
 
+  /** Append the provided keys of a file into the flat log, see \ref load(const std::string &, const
+   * std::vector<std::string> &) */
+  void append(const std::string & fpath, const std::vector<std::string> & keys);
+
+  /** Set the number of threads used to decode binary logs
+   *
+   * 0 uses one thread per hardware thread, 1 (the default) decodes the log in the calling thread. The loaded data does
+   * not depend on the number of threads.
+   */
+  inline void setThreads(size_t threads) noexcept { threads_ = threads; }
+
+  /** Number of threads used to decode binary logs, see \ref setThreads */
+  inline size_t threads() const noexcept { return threads_; }
+
   /** Returns the size of the log */
   size_t size() const;
 
@@ -163,28 +192,98 @@ struct MC_RTC_UTILS_DLLAPI FlatLog
     LogType type = mc_rtc::log::LogType::None;
     unique_void_ptr data;
   };
+
+  /** Contiguous storage for the samples of an entry that have a given type
+   *
+   * Element i is only meaningful if the type of sample i is the column's type
+   */
+  struct column
+  {
+    column(LogType t) : type(t) {}
+    virtual ~column() = default;
+    /** Store data (pointing to an object of the column's type) at index i, the object is moved */
+    virtual void set(size_t i, void * data) = 0;
+    /** Copy element i - 1 into element i */
+    virtual void hold(size_t i) = 0;
+    LogType type;
+  };
+
+  template<typename T>
+  struct typed_column : public column
+  {
+    /** Wrapper so that std::vector<bool> is not used */
+    struct sample
+    {
+      T value;
+    };
+
+    typed_column() : column(GetLogType<T>::type) {}
+
+    void set(size_t i, void * value) override
+    {
+      if(data.size() <= i) { data.resize(i + 1); }
+      data[i].value = std::move(*static_cast<T *>(value));
+    }
+
+    void hold(size_t i) override
+    {
+      if(data.size() <= i) { data.resize(i + 1); }
+      data[i].value = data[i - 1].value;
+    }
+
+    std::vector<sample, Eigen::aligned_allocator<sample>> data;
+  };
+
   struct entry
   {
     std::string name;
-    std::vector<record> records;
+    /** Type of each sample, None when the entry has no data for this sample */
+    std::vector<LogType> types;
+    /** One column per type present in the entry */
+    std::vector<std::unique_ptr<column>> columns;
+
+    /** Returns the column of the provided type, nullptr if the entry never had this type */
+    const column * get(LogType type) const noexcept
+    {
+      for(const auto & c : columns)
+      {
+        if(c->type == type) { return c.get(); }
+      }
+      return nullptr;
+    }
+
+    /** Returns the typed column for the provided type, nullptr if the entry never had this type */
+    template<LogType type>
+    const typed_column<log_type_to_type_t<type>> * get() const noexcept
+    {
+      return static_cast<const typed_column<log_type_to_type_t<type>> *>(get(type));
+    }
   };
 
 private:
   std::vector<entry> data_;
+  std::unordered_map<std::string, size_t> index_;
   std::vector<std::vector<Logger::GUIEvent>> gui_events_;
   std::optional<Logger::Meta> meta_;
+  size_t threads_ = 1;
 
-  /** Retrieve records for a given entry */
-  const std::vector<record> & at(const std::string & entry) const;
+  /** Retrieve a given entry, nullptr if the entry does not exist */
+  const entry * find(const std::string & entry) const noexcept;
+
+  /** Retrieve (and create if needed) the column of a given type in an entry */
+  static column & get_column(entry & e, LogType type);
 
   /** Retrieve the index of a given entry, creates the entry if it doesn't exist */
   size_t index(const std::string & entry, size_t size);
 
   /** Append a flat file to the log, all entries will be either double or strings */
-  void appendFlat(const std::string & fpath);
+  void appendFlat(const std::string & fpath, const std::vector<std::string> & keys);
 
   /** Append a binary file to the log */
-  void appendBin(const std::string & fpath);
+  void appendBin(const std::string & fpath, const std::vector<std::string> & keys);
+
+  /** Append a columnar file to the log, see \ref ColumnarLog */
+  void appendColumnar(const std::string & fpath, const std::vector<std::string> & keys);
 };
 
 } // namespace mc_rtc::log
@@ -14,96 +14,79 @@ namespace mc_rtc::log
 namespace details
 {
 
+/** Access the samples of an entry as T */
 template<typename T>
-struct CheckLogType
+struct FlatLogColumn
 {
-  static bool check(const LogType & t) { return t == mc_rtc::log::GetLogType<T>::type; }
-};
+  static constexpr LogType type = GetLogType<T>::type;
+  static_assert(type != LogType::None, "This type cannot be retrieved from a FlatLog");
+  using column_t = FlatLog::typed_column<log_type_to_type_t<type>>;
 
-template<typename T>
-struct CastLogRecord
-{
-  static const T * cast(const FlatLog::record & r) { return static_cast<const T *>(r.data.get()); }
+  /** Returns sample i of the column (whose type must match) */
+  static const FlatLog::get_raw_return_t<T> * cast(const column_t & c, size_t i)
+  {
+    return static_cast<const FlatLog::get_raw_return_t<T> *>(static_cast<const void *>(&c.data[i].value));
+  }
 };
 
 template<int N, int _Options, int _MaxRows, int _MaxCols>
-struct CastLogRecord<Eigen::Matrix<double, N, 1, _Options, _MaxRows, _MaxCols>>
+struct FlatLogColumn<Eigen::Matrix<double, N, 1, _Options, _MaxRows, _MaxCols>>
 {
-  static const FlatLog::get_raw_return_t<Eigen::Matrix<double, N, 1, _Options, _MaxRows, _MaxCols>> * cast(
-      const FlatLog::record & r)
+  using T = Eigen::Matrix<double, N, 1, _Options, _MaxRows, _MaxCols>;
+  static constexpr LogType type = GetLogType<T>::type;
+  using column_t = FlatLog::typed_column<log_type_to_type_t<type>>;
+
+  static const FlatLog::get_raw_return_t<T> * cast(const column_t & c, size_t i)
   {
-    if constexpr(N == -1 || N == 2 || N == 3 || N == 6)
-    {
-      return static_cast<const Eigen::Matrix<double, N, 1, _Options, _MaxRows, _MaxCols> *>(r.data.get());
-    }
+    const auto & v = c.data[i].value;
+    if constexpr(N == -1 || N == 2 || N == 3 || N == 6) { return &v; }
     else
     {
-      auto v = static_cast<const Eigen::VectorXd *>(r.data.get());
-      if(v->size() == N) { return v; }
+      if(v.size() == N) { return &v; }
       else { return nullptr; }
     }
   }
 };
 
-template<typename T>
-const FlatLog::get_raw_return_t<T> * record_cast(const FlatLog::record & r)
-{
-  if(CheckLogType<T>::check(r.type)) { return CastLogRecord<T>::cast(r); }
-  return nullptr;
-}
-
-template<typename T>
-bool convert(const FlatLog::record & r, T & out)
-{
-  auto ptr = record_cast<T>(r);
-  if(ptr) { out = *ptr; }
-  return ptr;
-}
-
 } // namespace details
 
 template<typename T>
 auto FlatLog::getRaw(const std::string & entry) const -> std::vector<const get_raw_return_t<T> *>
 {
-  if(!has(entry))
+  using access = details::FlatLogColumn<T>;
+  const auto * e = find(entry);
+  if(!e)
   {
     log::error("No entry named {} in the loaded log", entry);
     return {};
   }
-  std::vector<const T *> ret;
-  const auto & data = at(entry);
-  ret.reserve(data.size());
-  for(const auto & r : data) { ret.push_back(details::record_cast<T>(r)); }
-  return ret;
-}
-
-template<typename T>
-auto FlatLog::get(const std::string & entry, const T & def) const -> std::vector<get_raw_return_t<T>>
-{
-  if(!has(entry))
+  std::vector<const get_raw_return_t<T> *> ret(e->types.size(), nullptr);
+  const auto * c = e->template get<access::type>();
+  if(!c) { return ret; }
+  for(size_t i = 0; i < ret.size(); ++i)
   {
-    log::error("No entry named {} in the loaded log", entry);
-    return {};
+    if(e->types[i] == access::type) { ret[i] = access::cast(*c, i); }
   }
-  const auto & data = at(entry);
-  std::vector<T> ret(data.size(), def);
-  for(size_t i = 0; i < data.size(); ++i) { details::convert<T>(data[i], ret[i]); }
   return ret;
 }
 
-template<>
-inline std::vector<bool> FlatLog::get(const std::string & entry, const bool & def) const
+template<typename T>
+auto FlatLog::get(const std::string & entry, const T & def) const -> std::vector<get_raw_return_t<T>>
 {
-  if(!has(entry))
+  using access = details::FlatLogColumn<T>;
+  const auto * e = find(entry);
+  if(!e)
   {
     log::error("No entry named {} in the loaded log", entry);
     return {};
   }
-  const auto & data = at(entry);
-  std::vector<bool> ret(data.size(), def);
-  for(size_t i = 0; i < data.size(); ++i)
+  std::vector<get_raw_return_t<T>> ret(e->types.size(), def);
+  const auto * c = e->template get<access::type>();
+  if(!c) { return ret; }
+  for(size_t i = 0; i < ret.size(); ++i)
   {
-    const bool * ptr = details::record_cast<bool>(data[i]);
+    if(e->types[i] != access::type) { continue; }
+    const auto * ptr = access::cast(*c, i);
     if(ptr) { ret[i] = *ptr; }
   }
   return ret;
@@ -112,31 +95,31 @@ inline std::vector<bool> FlatLog::get(const std::string & entry, const bool & de
 template<typename T>
 auto FlatLog::get(const std::string & entry) const -> std::vector<get_raw_return_t<T>>
 {
-  if(!has(entry))
+  using access = details::FlatLogColumn<T>;
+  const auto * e = find(entry);
+  if(!e)
   {
     log::error("No entry named {} in the loaded log", entry);
     return {};
   }
-  const auto & data = at(entry);
-  std::vector<T> ret;
+  std::vector<get_raw_return_t<T>> ret;
+  const auto * c = e->template get<access::type>();
+  auto at = [&](size_t i) -> const get_raw_return_t<T> *
+  { return e->types[i] == access::type ? access::cast(*c, i) : nullptr; };
   size_t start_i = 0;
-  T def{};
-  while(start_i < data.size())
-  {
-    const auto & r = data[start_i];
-    if(details::convert<T>(r, def)) { break; }
-    start_i++;
-  }
-  if(start_i == data.size())
+  while(c && start_i < e->types.size() && !at(start_i)) { start_i++; }
+  if(!c || start_i == e->types.size())
   {
     log::error("{} was not logged as the requested data type", entry);
     return ret;
   }
+  get_raw_return_t<T> def = *at(start_i);
   ret.resize(start_i, def);
-  ret.reserve(data.size());
-  for(size_t i = start_i; i < data.size(); ++i)
+  ret.reserve(e->types.size());
+  for(size_t i = start_i; i < e->types.size(); ++i)
   {
-    details::convert<T>(data[i], def);
+    const auto * ptr = at(i);
+    if(ptr) { def = *ptr; }
     ret.push_back(def);
   }
   return ret;
@@ -145,7 +128,7 @@ auto FlatLog::get(const std::string & entry) const -> std::vector<get_raw_return
 template<typename T>
 auto FlatLog::get(const std::string & entry, size_t i, const T & def) const -> get_raw_return_t<T>
 {
-  const T * data = getRaw<T>(entry, i);
+  const auto * data = getRaw<T>(entry, i);
   if(data) { return *data; }
   return def;
 }
@@ -153,18 +136,20 @@ auto FlatLog::get(const std::string & entry, size_t i, const T & def) const -> g
 template<typename T>
 auto FlatLog::getRaw(const std::string & entry, size_t i) const -> const get_raw_return_t<T> *
 {
-  if(!has(entry))
+  using access = details::FlatLogColumn<T>;
+  const auto * e = find(entry);
+  if(!e)
   {
     log::error("No entry named {} in the loaded log", entry);
     return nullptr;
   }
-  const auto & data = at(entry);
-  if(i >= data.size())
+  if(i >= e->types.size())
   {
-    log::error("Requested data ({}) out of available range ({}, available: {})", entry, i, data.size());
+    log::error("Requested data ({}) out of available range ({}, available: {})", entry, i, e->types.size());
     return nullptr;
   }
-  return details::record_cast<T>(data[i]);
+  if(e->types[i] != access::type) { return nullptr; }
+  return access::cast(*e->template get<access::type>(), i);
 }
 
 } // namespace mc_rtc::log
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#pragma once
+
+#include <mc_rtc/log/iterate_binary_log.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mc_rtc::log
+{
+
+struct LogTapImpl;
+
+/** Read the frames published live by a Logger in shared memory (see Logger::Options::tap)
+ *
+ * The frames are decoded as in \ref iterate_binary_log. A reader that connects while the Logger is running starts at
+ * the most recent frame: the keys and meta data are provided with the first frame but the entries that were not written
+ * in this frame (see Logger::EntryPolicy and Logger::Options::delta) have no data until they are written again.
+ *
+ * The Logger never waits for the readers, if a reader is too slow it skips the frames it missed (see \ref dropped).
+ *
+ * This is only available on POSIX systems
+ */
+struct MC_RTC_UTILS_DLLAPI LogTap
+{
+  /** Constructor
+   *
+   * \param name Name of the shared memory object (Logger::Options::tap)
+   *
+   * \param keys Only decode these keys (see \ref iterate_binary_log), all keys are decoded if empty
+   *
+   * \param extract Decode the values of the entries
+   *
+   * \param time Time entry provided in \ref IterateBinaryLogData::time, empty if not needed
+   */
+  LogTap(const std::string & name,
+         const std::vector<std::string> & keys = {},
+         bool extract = true,
+         const std::string & time = "t");
+
+  ~LogTap();
+
+  LogTap(const LogTap &) = delete;
+  LogTap & operator=(const LogTap &) = delete;
+
+  /** True if the reader is connected to a running Logger
+   *
+   * The reader tries to connect in \ref read when the Logger is not running yet
+   */
+  bool connected() const noexcept;
+
+  /** Read the frames published since the last call
+   *
+   * \param callback Called for each frame, stop reading when it returns false
+   *
+   * \param max_frames Read at most this many frames (0 for no limit)
+   *
+   * \returns The number of frames read
+   */
+  size_t read(const iterate_binary_log_callback & callback, size_t max_frames = 0);
+
+  /** Number of times the frames were overwritten before they could be read (the reader then skips to the most recent
+   * frame) */
+  size_t dropped() const noexcept;
+
+private:
+  std::unique_ptr<LogTapImpl> impl_;
+};
+
+} // namespace mc_rtc::log
@@ -10,7 +10,9 @@
 
 #include <mc_rtc/Configuration.h>
 
+#include <list>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 #include <variant>
 
@@ -34,10 +36,36 @@ public:
   /** Version of the log format
    *
    * This is stored in the binary file as data[3] - magic[3]
+   *
+   * This is the most recent version supported by this implementation. Logs that do not use any of the \ref Features
+   * are written with version 1 so that they remain readable by older versions of mc_rtc.
    */
   static const uint8_t version;
+  /** Optional features of the log format
+   *
+   * Starting with version 2, these are stored as a uint32_t bitfield right after the magic number
+   */
+  enum Features : uint32_t
+  {
+    /** Frames are grouped in zstd-compressed blocks
+     *
+     * Each block is stored as [compressed size (uint64_t)][raw size (uint64_t)][compressed data] and decompress to a
+     * sequence of [frame size (uint64_t)][frame data]
+     */
+    COMPRESSED = 1 << 0,
+    /** Some values are nil, readers hold the last value written for the entry
+     *
+     * This is used when an entry has a non-default \ref EntryPolicy or with delta encoding (see \ref Options::delta)
+     */
+    HELD_VALUES = 1 << 1
+  };
+  /** Returns true if this build of mc_rtc can read/write logs that use \p features */
+  static bool supports(uint32_t features) noexcept;
   /** A function that fills LogData vectors */
   typedef std::function<void(mc_rtc::MessagePackBuilder &)> serialize_fn;
+  /** A function that writes the values of an entry with a fixed layout (see log::FixedLayout) at the start of a buffer
+   * and returns the number of values, nothing is written if the buffer is too small */
+  typedef std::function<size_t(std::vector<double> &)> fixed_fn;
   /*! \brief Defines available policies for the logger */
   enum struct Policy
   {
@@ -59,6 +87,104 @@ public:
     THREADED = 1
   };
 
+  /*! \brief Options for the logger implementation
+   *
+   * These are typically provided by the global controller configuration
+   */
+  struct Options
+  {
+    /** Size (in bytes) of the buffer used by the threaded policy
+     *
+     * The buffer is allocated once when the policy is setup, frames that do not fit in the buffer are dropped. The
+     * events of a dropped frame (e.g. added or removed keys) are written with the next frame.
+     */
+    size_t buffer_size = 64 * 1024 * 1024;
+    /** If true, compress the log (see \ref Features::COMPRESSED)
+     *
+     * This is ignored if mc_rtc was built without zstd support
+     */
+    bool compress = false;
+    /** zstd compression level */
+    int compression_level = 3;
+    /** Number of frames in a compressed block */
+    size_t compression_block_size = 1000;
+    /** Delta encoding, when enabled an entry is only written if its serialized value differs from the last written
+     * value, readers hold the previous value otherwise
+     *
+     * The log uses \ref Features::HELD_VALUES and cannot be read by versions of mc_rtc that predate it
+     */
+    bool delta = false;
+    /** If true, every file uses \ref Features::HELD_VALUES so that the policies of the entries added after the file
+     * is started take effect (see \ref EntryPolicy), delta encoding implies it */
+    bool held_values = false;
+    /** When delta encoding or indexing is enabled, every entry is written once every \p keyframe_interval frames */
+    size_t keyframe_interval = 1000;
+    /** If true, write a sparse time index next to the log when it is closed (see \ref log::BinaryLogIndex)
+     *
+     * Keyframes that do not change the keys of the log are the points of the index
+     */
+    bool index = false;
+    /** Continue the log in a new file once the current file reaches \p rotate_size bytes (0 disables size-based
+     * rotation)
+     *
+     * Every part starts with the meta data and the active keys so it can be read on its own, see \ref partPath for the
+     * name of the parts
+     */
+    size_t rotate_size = 0;
+    /** Continue the log in a new file every \p rotate_duration seconds of log time (0 disables time-based rotation) */
+    double rotate_duration = 0;
+    /** If true, write the log with io_uring and O_DIRECT to bypass the page cache (Linux only)
+     *
+     * The latency of the writes is logged (perf_LogWrite_p50, perf_LogWrite_p99 and perf_LogWrite_max). Buffered
+     * writes are used when the platform or the file system does not support it.
+     */
+    bool direct_io = false;
+    /** If not empty, every frame is also published in a POSIX shared memory object with this name (e.g.
+     * /mc_rtc_log) so that other processes can read the log live with \ref log::LogTap
+     *
+     * Publishing a frame is a copy into the shared memory, the Logger never waits for the readers
+     */
+    std::string tap = "";
+    /** Size (in bytes) of the ring of frames in the shared memory */
+    size_t tap_size = 16 * 1024 * 1024;
+  };
+
+  /*! \brief Decide when a log entry is written into the log
+   *
+   * When an entry is not written, a nil value is stored instead and readers hold the last written value
+   * (sample-and-hold). An entry is always written the first time it is logged in a file.
+   *
+   * Logs that hold values use \ref Features::HELD_VALUES and cannot be read by versions of mc_rtc that predate it. The
+   * feature is decided when a file is opened: policies only take effect if an entry with a policy is in the log when
+   * the file is started or if \ref Options::held_values is set, otherwise every entry is written in every frame and a
+   * warning is displayed.
+   */
+  struct EntryPolicy
+  {
+    /** The entry is considered once every \p period calls to \ref log() (the callback is not called in-between) */
+    size_t period = 1;
+    /** When true the entry is only written when its value changed by more than \p threshold since the last time it
+     * was written */
+    bool on_change = false;
+    /** Largest absolute difference (per-component) tolerated before a change is detected, it is ignored for
+     * non-numeric data */
+    double threshold = 0.0;
+  };
+
+  /*! \brief Statistics about the buffer used by the threaded policy
+   *
+   * All values are zero for the non-threaded policy
+   */
+  struct BufferStats
+  {
+    /** Capacity of the buffer (bytes) */
+    size_t capacity = 0;
+    /** Maximum number of bytes that were waiting to be written at the same time */
+    size_t high_water_mark = 0;
+    /** Number of frames that could not be added to the buffer */
+    size_t dropped_frames = 0;
+  };
+
   /*! \brief Data for a key added event */
   struct KeyAddedEvent
   {
@@ -126,9 +252,24 @@ public:
    */
   Logger(const Policy & policy, const std::string & directory, const std::string & tmpl);
 
+  /*! \brief Constructor
+   *
+   * \param policy The chosen logging policy
+   *
+   * \param directory Path to the directory where log files will be stored
+   *
+   * \param tmpl Log file template
+   *
+   * \param options Implementation options
+   */
+  Logger(const Policy & policy, const std::string & directory, const std::string & tmpl, const Options & options);
+
   /*! \brief Destructor */
   ~Logger();
 
+  Logger(const Logger &) = delete;
+  Logger & operator=(const Logger &) = delete;
+
   /*! \brief Setup the constructor configuration
    *
    * \param policy The chosen logging policy
@@ -139,6 +280,18 @@ public:
    */
   void setup(const Policy & policy, const std::string & directory, const std::string & tmpl);
 
+  /*! \brief Setup the constructor configuration
+   *
+   * \param policy The chosen logging policy
+   *
+   * \param directory Path to the directory where log files will be stored
+   *
+   * \param tmpl Log file template
+   *
+   * \param options Implementation options
+   */
+  void setup(const Policy & policy, const std::string & directory, const std::string & tmpl, const Options & options);
+
   /*! \brief Access the log's metadata */
   inline Meta & meta() noexcept { return meta_; }
 
@@ -209,20 +362,68 @@ public:
   {
     using ret_t = decltype(get_fn());
     using base_t = typename std::decay<ret_t>::type;
-    auto it = find_entry(name);
-    if(it != log_entries_.end())
+    if(!overwrite && find_entry(name) != log_entries_.end())
     {
-      if(!overwrite)
-      {
-        log::error("Already logging an entry named {}", name);
-        return;
-      }
-      else { log_entries_.erase(it); }
+      log::error("Already logging an entry named {}", name);
+      return;
     }
     auto log_type = log::callback_is_serializable<CallbackT>::log_type;
-    log_events_.push_back(KeyAddedEvent{log_type, name});
-    log_entries_.push_back({log_type, name, source, [get_fn](mc_rtc::MessagePackBuilder & builder) mutable
-                            { mc_rtc::log::LogWriter<base_t>::write(get_fn(), builder); }});
+    auto & entry = add_entry({log_type, name, source, [get_fn](mc_rtc::MessagePackBuilder & builder) mutable
+                              { mc_rtc::log::LogWriter<base_t>::write(get_fn(), builder); }});
+    if constexpr(mc_rtc::log::FixedLayout<base_t>::value)
+    {
+      entry.fixed_cb = [get_fn](std::vector<double> & out) mutable
+      {
+        const base_t & value = get_fn();
+        size_t size = mc_rtc::log::FixedLayout<base_t>::size(value);
+        if(size <= out.size()) { mc_rtc::log::FixedLayout<base_t>::write(value, out.data()); }
+        return size;
+      };
+    }
+  }
+
+  /** Add a log entry into the log with the provided source and a policy that decides when the entry is written
+   *
+   * \see addLogEntry(const std::string &, const SourceT *, CallbackT &&, bool)
+   *
+   * \param policy Decides when the entry is written, see \ref EntryPolicy
+   *
+   */
+  template<typename CallbackT,
+           typename SourceT = void,
+           typename std::enable_if<mc_rtc::log::callback_is_serializable<CallbackT>::value, int>::type = 0>
+  void addLogEntry(const std::string & name,
+                   const SourceT * source,
+                   CallbackT && get_fn,
+                   const EntryPolicy & policy,
+                   bool overwrite = false)
+  {
+    using ret_t = decltype(get_fn());
+    using base_t = typename std::decay<ret_t>::type;
+    if(!overwrite && find_entry(name) != log_entries_.end())
+    {
+      log::error("Already logging an entry named {}", name);
+      return;
+    }
+    addLogEntry(name, source, get_fn, true);
+    auto & entry = log_entries_.back();
+    entry.policy = policy;
+    warn_ignored_policy(policy);
+    if(policy.on_change)
+    {
+      // The value read to detect a change is the one that is serialized, get_fn is called once per frame
+      using cache_t = typename std::conditional<std::is_reference<ret_t>::value, const base_t *,
+                                                std::optional<base_t>>::type;
+      auto cache = std::make_shared<cache_t>();
+      entry.changed_cb = [get_fn, cache, change = mc_rtc::log::LogChange<base_t>{}](double threshold) mutable
+      {
+        if constexpr(std::is_reference<ret_t>::value) { *cache = &get_fn(); }
+        else { cache->emplace(get_fn()); }
+        return change.update(**cache, threshold);
+      };
+      entry.log_cb = [cache](mc_rtc::MessagePackBuilder & builder)
+      { mc_rtc::log::LogWriter<base_t>::write(**cache, builder); };
+    }
   }
 
   /** Add a log entry from a source and a compile-time pointer to member
@@ -296,6 +497,19 @@ public:
     addLogEntry(name, static_cast<const void *>(nullptr), std::forward<T>(get_fn), overwrite);
   }
 
+  /** Add a log entry into the log with no source and a policy that decides when the entry is written
+   *
+   * \see addLogEntry(const std::string &, T &&, bool)
+   *
+   * \param policy Decides when the entry is written, see \ref EntryPolicy
+   *
+   */
+  template<typename T, typename std::enable_if<mc_rtc::log::callback_is_serializable<T>::value, int>::type = 0>
+  void addLogEntry(const std::string & name, T && get_fn, const EntryPolicy & policy, bool overwrite = false)
+  {
+    addLogEntry(name, static_cast<const void *>(nullptr), std::forward<T>(get_fn), policy, overwrite);
+  }
+
   /** Add multiple entries at once with the same entry
    *
    * \see addLogEntry for requirements on the callbacks
@@ -343,14 +557,29 @@ public:
   double t() const;
 
   /** Access the file opened by this Logger
+   *
+   * When the log is rotated (see \ref Options::rotate_size) this is the first part of the log
    *
    * \note This is empty before \ref start or \ref open has been called
    */
   const std::string & path() const;
 
+  /** Path to the \p part -th part of a rotated log whose first part is \p path
+   *
+   * The first part is \p path itself, the others are named after it: [name].bin is continued in [name]_part2.bin,
+   * [name]_part3.bin, ...
+   */
+  static std::string partPath(const std::string & path, size_t part);
+
   /** Flush the log data to disk (only implemented in the synchronous method) */
   void flush();
 
+  /** Returns statistics about the buffer used by the threaded policy
+   *
+   * This can be used to size \ref Options::buffer_size from real data
+   */
+  BufferStats bufferStats() const;
+
   /** Returns the number of entries currently in the log */
   inline size_t size() const { return log_entries_.size(); }
 
@@ -374,17 +603,57 @@ private:
     const void * source;
     /** Callback to log data */
     serialize_fn log_cb;
+    /** Policy for this entry */
+    EntryPolicy policy = {};
+    /** Returns true if the data changed (only set when policy.on_change is true)
+     *
+     * log_cb then serializes the value that was read by the last call
+     */
+    std::function<bool(double)> changed_cb = nullptr;
+    /** Number of calls to log() since the entry was last considered */
+    size_t ticks = 0;
+    /** If true, the entry is written on the next call to log() regardless of the policy */
+    bool force = true;
+    /** Last serialized value (only used with delta encoding) */
+    std::vector<char> last_bytes = {};
+    /** Callback to get the values of entries with a fixed layout (can be nullptr) */
+    fixed_fn fixed_cb = nullptr;
+    /** Position of the entry in the entries of its source */
+    size_t source_index = 0;
   };
+
+  /** Returns true if the entry should be written in this frame according to its policy */
+  bool should_write(LogEntry & entry);
+  /** Returns true if the next file uses \ref Features::HELD_VALUES */
+  bool held_values() const;
+  /** Warn (once) that \p policy is ignored if the current file does not hold values */
+  void warn_ignored_policy(const EntryPolicy & policy);
   /** Store implementation detail related to the logging policy */
   std::shared_ptr<LoggerImpl> impl_ = nullptr;
   /** Meta data for this instance */
   Meta meta_;
   /** Events that happened since the last time we wrote to the log */
   std::vector<LogEvent> log_events_;
-  /** Contains all the log entries */
-  std::vector<LogEntry> log_entries_;
+  /** Contains all the log entries in the order of the log */
+  std::list<LogEntry> log_entries_;
+  /** Log entries by name */
+  std::unordered_map<std::string, std::list<LogEntry>::iterator> entries_by_name_;
+  /** Log entries of each source */
+  std::unordered_map<const void *, std::vector<std::list<LogEntry>::iterator>> entries_by_source_;
+
+  std::list<LogEntry>::iterator find_entry(const std::string & name);
+
+  /** Add an entry at the end of the log and record the event, it replaces the entry with the same name (if any) */
+  LogEntry & add_entry(LogEntry && entry);
+
+  /** Remove an entry, returns the next entry of the log */
+  std::list<LogEntry>::iterator remove_entry(std::list<LogEntry>::iterator it);
+
+  /** Select the entries that are serialized with a fixed layout, their layout is computed when they are written */
+  void update_fixed_layout();
 
-  std::vector<LogEntry>::iterator find_entry(const std::string & name);
+  /** Add the time entry (and the statistics of the writer) when a file is started */
+  void add_default_entries(double timestep);
 
   /** Terminal condition for addLogEntries */
   template<typename SourceT>
@@ -5,6 +5,7 @@
  */
 
 #include <mc_rtc/MessagePackBuilder.h>
+#include <mc_rtc/log/BinaryLogIndex.h>
 #include <mc_rtc/log/FlatLog.h>
 
 namespace mc_rtc::log
@@ -17,13 +18,21 @@ struct MC_RTC_UTILS_DLLAPI IterateBinaryLogData
 {
   /** Keys in the log at this iteration */
   const std::vector<std::string> & keys;
-  /** Record (type + data) corresponding to the keys (in the same order) */
+  /** Record (type + data) corresponding to the keys (in the same order)
+   *
+   * A record with a type but no data means the entry was not written in this frame (see Logger::EntryPolicy and
+   * Logger::Options::delta), its value is the same as the last time it was written
+   */
   std::vector<FlatLog::record> & records;
   /** GUI events that happened at the iteration */
   std::vector<Logger::GUIEvent> & gui_events;
   /** Time value, if extracted */
   std::optional<double> time;
-  /** Callback that can be used to copy the entries into a new MsgPack with a different set of keys */
+  /** Callback that can be used to copy the entries into a new MsgPack with a different set of keys
+   *
+   * The GUI events and meta data written in this entry are copied as well. Entries that are not written in this frame
+   * are copied with the last value written for them so the copy can start a new log.
+   */
   const copy_callback & copy_cb;
   /** Raw data of the entry */
   const char * raw_data;
@@ -52,18 +61,42 @@ using binary_log_copy_callback = std::function<bool(const std::vector<std::strin
  *
  * If the callback returns false the parsing is interrupted.
  *
+ * If \p from is provided and the log has an up-to-date index (see \ref BinaryLogIndex), the parsing starts at the
+ * last index point before \p from rather than at the beginning of the log. Frames before \p from can still be provided
+ * to the callback. The first frame provided after seeking has its keys set.
+ *
  * \returns True if the parsing was successful, false otherwise
  */
 bool MC_RTC_UTILS_DLLAPI iterate_binary_log(const std::string & fpath,
                                             const iterate_binary_log_callback & callback,
                                             bool extract,
-                                            const std::string & time = "t");
+                                            const std::string & time = "t",
+                                            std::optional<double> from = std::nullopt);
+
+/** Iterate over a given binary log data, only decoding the provided keys
+ *
+ * This behaves like \ref iterate_binary_log but \ref IterateBinaryLogData::keys and \ref
+ * IterateBinaryLogData::records only contain the requested keys, the values of other keys are skipped without being
+ * decoded. A key ending with '*' selects every key starting with the given prefix.
+ *
+ * The time entry does not need to be part of the keys to be extracted. \ref IterateBinaryLogData::copy_cb only copies
+ * the requested keys while \ref IterateBinaryLogData::raw_data is the full frame.
+ *
+ * \returns True if the parsing was successful, false otherwise
+ */
+bool MC_RTC_UTILS_DLLAPI iterate_binary_log(const std::string & fpath,
+                                            const iterate_binary_log_callback & callback,
+                                            const std::vector<std::string> & keys,
+                                            bool extract,
+                                            const std::string & time = "t",
+                                            std::optional<double> from = std::nullopt);
 
 /** Provided for backward compatibility */
 inline bool iterate_binary_log(const std::string & fpath,
                                const binary_log_copy_callback & callback,
                                bool extract,
-                               const std::string & time = "t")
+                               const std::string & time = "t",
+                               std::optional<double> from = std::nullopt)
 {
   return iterate_binary_log(
       fpath,
@@ -71,7 +104,7 @@ inline bool iterate_binary_log(const std::string & fpath,
         return callback(data.keys, data.records, data.time.value_or(-1), data.copy_cb, data.raw_data,
                         data.raw_data_size);
       },
-      extract, time);
+      extract, time, from);
 }
 
 /** Provided for backward compatibility */
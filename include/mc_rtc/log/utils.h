@@ -185,6 +185,224 @@ struct LogWriter
   static void write(const T & data, mc_rtc::MessagePackBuilder & builder) { builder.write(data); }
 };
 
+/** Detect changes in logged data, this is used to implement Logger::EntryPolicy::on_change
+ *
+ * The default implementation keeps a copy of the last value and compares with operator==, the threshold is ignored
+ */
+template<typename T, typename = void>
+struct LogChange
+{
+  /** Returns true if \p value differs from the stored value by more than \p threshold, the stored value is updated in
+   * that case */
+  bool update(const T & value, double)
+  {
+    if(value == last_) { return false; }
+    last_ = value;
+    return true;
+  }
+
+private:
+  T last_{};
+};
+
+template<typename T>
+struct LogChange<T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type>
+{
+  bool update(const T & value, double threshold)
+  {
+    if(std::abs(static_cast<double>(value) - static_cast<double>(last_)) <= threshold) { return false; }
+    last_ = value;
+    return true;
+  }
+
+private:
+  T last_{};
+};
+
+/** Eigen vectors (including Eigen::Ref and mc_rbdyn::Gains) */
+template<typename T>
+struct LogChange<T, void_t<typename T::PlainObject>>
+{
+  template<typename Derived>
+  bool update(const Eigen::MatrixBase<Derived> & value, double threshold)
+  {
+    if(value.size() == last_.size() && (value.size() == 0 || (value - last_).cwiseAbs().maxCoeff() <= threshold))
+    {
+      return false;
+    }
+    last_ = value;
+    return true;
+  }
+
+private:
+  typename T::PlainObject last_;
+};
+
+template<>
+struct LogChange<Eigen::Quaterniond>
+{
+  bool update(const Eigen::Quaterniond & value, double threshold) { return coeffs_.update(value.coeffs(), threshold); }
+
+private:
+  LogChange<Eigen::Vector4d> coeffs_;
+};
+
+template<>
+struct LogChange<sva::PTransformd>
+{
+  bool update(const sva::PTransformd & value, double threshold)
+  {
+    Eigen::Matrix<double, 12, 1> v;
+    v << Eigen::Map<const Eigen::Matrix<double, 9, 1>>(value.rotation().data()), value.translation();
+    return data_.update(v, threshold);
+  }
+
+private:
+  LogChange<Eigen::Matrix<double, 12, 1>> data_;
+};
+
+/** sva::MotionVecd, sva::ForceVecd and sva::ImpedanceVecd */
+template<typename T>
+struct LogChange<T, void_t<decltype(std::declval<const T &>().vector())>>
+{
+  bool update(const T & value, double threshold) { return data_.update(value.vector(), threshold); }
+
+private:
+  LogChange<Eigen::Vector6d> data_;
+};
+
+/** Contiguous containers of double */
+template<typename T>
+struct LogChangeDoubleContainer
+{
+  bool update(const T & value, double threshold)
+  {
+    return data_.update(Eigen::Map<const Eigen::VectorXd>(value.data(), static_cast<Eigen::DenseIndex>(value.size())),
+                        threshold);
+  }
+
+private:
+  LogChange<Eigen::VectorXd> data_;
+};
+
+template<typename A>
+struct LogChange<std::vector<double, A>> : public LogChangeDoubleContainer<std::vector<double, A>>
+{
+};
+
+template<std::size_t N>
+struct LogChange<std::array<double, N>> : public LogChangeDoubleContainer<std::array<double, N>>
+{
+};
+
+/** Types that are serialized as a fixed number of doubles, this is used by the Logger to serialize these entries with
+ * a layout computed once (see Logger::log)
+ *
+ * Specializations provide size(value), the number of doubles, and write(value, out) that writes them in the order
+ * used by MessagePackBuilder::write
+ */
+template<typename T>
+struct FixedLayout
+{
+  static constexpr bool value = false;
+};
+
+template<>
+struct FixedLayout<double>
+{
+  static constexpr bool value = true;
+  static size_t size(double) noexcept { return 1; }
+  static void write(double value, double * out) noexcept { *out = value; }
+};
+
+template<int N, int _Options, int _MaxRows, int _MaxCols>
+struct FixedLayout<Eigen::Matrix<double, N, 1, _Options, _MaxRows, _MaxCols>>
+{
+  using VectorT = Eigen::Matrix<double, N, 1, _Options, _MaxRows, _MaxCols>;
+  static constexpr bool value = true;
+  static size_t size(const VectorT & value) noexcept { return static_cast<size_t>(value.size()); }
+  static void write(const VectorT & value, double * out) noexcept
+  {
+    std::copy(value.data(), value.data() + value.size(), out);
+  }
+};
+
+template<>
+struct FixedLayout<Eigen::Quaterniond>
+{
+  static constexpr bool value = true;
+  static size_t size(const Eigen::Quaterniond &) noexcept { return 4; }
+  static void write(const Eigen::Quaterniond & value, double * out) noexcept
+  {
+    out[0] = value.w();
+    out[1] = value.x();
+    out[2] = value.y();
+    out[3] = value.z();
+  }
+};
+
+template<>
+struct FixedLayout<sva::PTransformd>
+{
+  static constexpr bool value = true;
+  static size_t size(const sva::PTransformd &) noexcept { return 12; }
+  static void write(const sva::PTransformd & value, double * out) noexcept
+  {
+    // Row-major rotation followed by the translation
+    Eigen::Map<Eigen::Matrix<double, 3, 3, Eigen::RowMajor>> rotation(out);
+    rotation = value.rotation();
+    Eigen::Map<Eigen::Vector3d> translation(out + 9);
+    translation = value.translation();
+  }
+};
+
+/** sva::MotionVecd, sva::ForceVecd and sva::ImpedanceVecd */
+template<typename T>
+struct FixedLayoutSva
+{
+  static constexpr bool value = true;
+  static size_t size(const T &) noexcept { return 6; }
+  static void write(const T & value, double * out) noexcept
+  {
+    Eigen::Map<Eigen::Vector6d> vector(out);
+    vector = value.vector();
+  }
+};
+
+template<>
+struct FixedLayout<sva::MotionVecd> : public FixedLayoutSva<sva::MotionVecd>
+{
+};
+
+template<>
+struct FixedLayout<sva::ForceVecd> : public FixedLayoutSva<sva::ForceVecd>
+{
+};
+
+template<>
+struct FixedLayout<sva::ImpedanceVecd> : public FixedLayoutSva<sva::ImpedanceVecd>
+{
+};
+
+/** Contiguous containers of double */
+template<typename T>
+struct FixedLayoutDoubleContainer
+{
+  static constexpr bool value = true;
+  static size_t size(const T & value) noexcept { return value.size(); }
+  static void write(const T & value, double * out) noexcept { std::copy(value.begin(), value.end(), out); }
+};
+
+template<typename A>
+struct FixedLayout<std::vector<double, A>> : public FixedLayoutDoubleContainer<std::vector<double, A>>
+{
+};
+
+template<std::size_t N>
+struct FixedLayout<std::array<double, N>> : public FixedLayoutDoubleContainer<std::array<double, N>>
+{
+};
+
 /** Provide a correspondance from a log type to a C++ type */
 template<LogType type>
 struct log_type_to_type
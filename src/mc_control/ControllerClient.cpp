@@ -14,9 +14,21 @@
 #  include <nanomsg/reqrep.h>
 #endif
 
+#if !defined(MC_RTC_DISABLE_NETWORK) && !defined(_WIN32)
+#  define MC_CONTROL_CLIENT_SHARED_MEMORY
+#  include "internals/GUISharedMemory.h"
+#endif
+
+#include "mpack.h"
+
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstring>
+#include <random>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 #include <thread>
 
 namespace
@@ -38,12 +50,21 @@ std::string cat2str(const std::vector<std::string> & cat)
 namespace mc_control
 {
 
+namespace
+{
+
+using clock = std::chrono::steady_clock;
+using duration_ms = std::chrono::duration<double, std::milli>;
+
+} // namespace
+
 #ifndef MC_RTC_DISABLE_NETWORK
 
 namespace
 {
 
-void init_socket(int & socket, int proto, const std::string & uri, const std::string & name)
+/** Returns the endpoint id */
+int init_socket(int & socket, int proto, const std::string & uri, const std::string & name)
 {
   socket = nn_socket(AF_SP, proto);
   if(socket < 0) { mc_rtc::log::error_and_throw("Failed to initialize {}", name); }
@@ -58,12 +79,62 @@ void init_socket(int & socket, int proto, const std::string & uri, const std::st
     err = nn_setsockopt(socket, NN_SOL_SOCKET, NN_RCVMAXSIZE, &opt, sizeof(opt));
     if(err < 0) { mc_rtc::log::error_and_throw("Failed to set receive max size option on SUB socket"); }
   }
+  return ret;
 }
 
 } // namespace
 
 #endif
 
+struct ControllerClient::SharedMemory
+{
+#ifdef MC_CONTROL_CLIENT_SHARED_MEMORY
+  SharedMemory(const std::string & name, const std::string & sub_uri, int sub_endpoint)
+  : reader(name), sub_uri(sub_uri), sub_endpoint(sub_endpoint)
+  {
+  }
+
+  internal::GUIShmReader reader;
+  /** URI of the SUB socket, it is disconnected while the client reads the shared memory */
+  std::string sub_uri;
+  int sub_endpoint;
+  /** True if the client reads the shared memory */
+  bool active = false;
+
+  /** Creates the shared memory reader if \p sub_uri is the IPC socket of a local server */
+  static std::unique_ptr<SharedMemory> make(const std::string & sub_uri, int sub_endpoint)
+  {
+    static const std::string prefix = "ipc://";
+    static const std::string suffix = "_pub.ipc";
+    if(sub_uri.size() <= prefix.size() + suffix.size() || sub_uri.compare(0, prefix.size(), prefix) != 0
+       || sub_uri.compare(sub_uri.size() - suffix.size(), suffix.size(), suffix) != 0)
+    {
+      return nullptr;
+    }
+    auto socket = sub_uri.substr(prefix.size(), sub_uri.size() - prefix.size() - suffix.size());
+    return std::make_unique<SharedMemory>(ControllerServer::shared_memory_name(socket), sub_uri, sub_endpoint);
+  }
+
+  /** Switch between the shared memory and the SUB socket, returns \p use */
+  bool use(int sub_socket, bool use)
+  {
+    if(use == active) { return use; }
+    if(use)
+    {
+      mc_rtc::log::info("Receiving data through shared memory");
+      nn_shutdown(sub_socket, sub_endpoint);
+    }
+    else
+    {
+      sub_endpoint = nn_connect(sub_socket, sub_uri.c_str());
+      if(sub_endpoint < 0) { mc_rtc::log::error("Failed to reconnect SUB socket to uri: {}", sub_uri); }
+    }
+    active = use;
+    return use;
+  }
+#endif
+};
+
 ControllerClient::ControllerClient() = default;
 
 ControllerClient::ControllerClient(const std::string & sub_conn_uri, const std::string & push_conn_uri, double timeout)
@@ -75,8 +146,16 @@ ControllerClient::ControllerClient(const std::string & sub_conn_uri, const std::
 void ControllerClient::connect(const std::string & sub_conn_uri, const std::string & push_conn_uri)
 {
 #ifndef MC_RTC_DISABLE_NETWORK
-  init_socket(sub_socket_, NN_SUB, sub_conn_uri, "SUB socket");
+  auto sub_endpoint = init_socket(sub_socket_, NN_SUB, sub_conn_uri, "SUB socket");
   init_socket(push_socket_, NN_PUSH, push_conn_uri, "PUSH socket");
+#  ifdef MC_CONTROL_CLIENT_SHARED_MEMORY
+  shm_ = SharedMemory::make(sub_conn_uri, sub_endpoint);
+#  else
+  (void)sub_endpoint;
+#  endif
+  subscriptions_uri_ = ControllerServer::subscriptions_uri(sub_conn_uri);
+  subscription_topic_.clear();
+  update_subscription_topic();
   run_ = true;
 #endif
 }
@@ -103,76 +182,206 @@ void ControllerClient::stop()
   run_ = false;
 #ifndef MC_RTC_DISABLE_NETWORK
   if(sub_th_.joinable()) { sub_th_.join(); }
+  shm_.reset();
   nn_shutdown(sub_socket_, 0);
   nn_shutdown(push_socket_, 0);
   sub_socket_ = -1;
   push_socket_ = -1;
+  subscriptions_endpoint_ = -1;
 #endif
   server_ = nullptr;
   gui_ = nullptr;
+  t_last_subscribed_ = {};
+}
+
+void ControllerClient::subscribe(const std::vector<std::vector<std::string>> & categories)
+{
+  subscription_ = categories;
+  send_subscription();
+  update_subscription_topic();
+}
+
+void ControllerClient::send_subscription()
+{
+  if(subscription_id_.empty())
+  {
+    std::random_device rd;
+    std::mt19937_64 gen(rd());
+    subscription_id_ = fmt::format("{:016x}", gen());
+  }
+  mc_rtc::Configuration request;
+  request.add("subscribe", subscription_id_);
+  request.add("categories", subscription_);
+  auto out = request.dump();
+  send_raw(out);
+  if(server_) { server_->handle_requests(*gui_, out.c_str()); }
+  t_last_subscribed_ = std::chrono::system_clock::now();
+}
+
+void ControllerClient::update_subscription_topic()
+{
+#ifndef MC_RTC_DISABLE_NETWORK
+  if(sub_socket_ < 0) { return; }
+  auto topic = subscription_.empty() ? std::string{} : ControllerServer::subscription_topic(subscription_id_);
+  if(topic == subscription_topic_) { return; }
+  // The messages of the subscriptions are published on their own endpoint
+  if(topic.size() && subscriptions_endpoint_ < 0 && subscriptions_uri_.size())
+  {
+    subscriptions_endpoint_ = nn_connect(sub_socket_, subscriptions_uri_.c_str());
+    if(subscriptions_endpoint_ < 0)
+    {
+      mc_rtc::log::error("Failed to connect SUB socket to uri: {}", subscriptions_uri_);
+    }
+  }
+  // Subscribe to the new topic first so the SUB socket never drops every message
+  int err = nn_setsockopt(sub_socket_, NN_SUB, NN_SUB_SUBSCRIBE, topic.data(), topic.size());
+  if(err < 0) { mc_rtc::log::error("Failed to set subscribe option on SUB socket"); }
+  nn_setsockopt(sub_socket_, NN_SUB, NN_SUB_UNSUBSCRIBE, subscription_topic_.data(), subscription_topic_.size());
+  subscription_topic_ = topic;
+  if(topic.empty() && subscriptions_endpoint_ >= 0)
+  {
+    nn_shutdown(sub_socket_, subscriptions_endpoint_);
+    subscriptions_endpoint_ = -1;
+  }
+#endif
 }
 
 void ControllerClient::reconnect(const std::string & sub_conn_uri, const std::string & push_conn_uri)
 {
   stop();
 #ifndef MC_RTC_DISABLE_NETWORK
-  init_socket(sub_socket_, NN_SUB, sub_conn_uri, "SUB socket");
+  auto sub_endpoint = init_socket(sub_socket_, NN_SUB, sub_conn_uri, "SUB socket");
   init_socket(push_socket_, NN_PUSH, push_conn_uri, "PUSH socket");
+#  ifdef MC_CONTROL_CLIENT_SHARED_MEMORY
+  shm_ = SharedMemory::make(sub_conn_uri, sub_endpoint);
+#  else
+  (void)sub_endpoint;
+#  endif
+  subscriptions_uri_ = ControllerServer::subscriptions_uri(sub_conn_uri);
+  subscription_topic_.clear();
+  update_subscription_topic();
 #endif
   start();
 }
 
 void ControllerClient::run(std::vector<char> & buff, std::chrono::system_clock::time_point & t_last_received)
 {
-  auto resize_to_fit = [&](size_t s)
+  auto renew = std::chrono::duration<double>(ControllerServer::subscription_timeout / 5);
+  if((sub_socket_ >= 0 || server_ != nullptr) && std::chrono::system_clock::now() - t_last_subscribed_ > renew)
   {
-    if(buff.size() >= s) { return; }
-    size_t nsize = buff.size() == 0 ? 65535 : 2 * buff.size();
-    while(nsize < s) { nsize = 2 * nsize; }
-    buff.resize(nsize);
-  };
+    send_subscription();
+  }
   if(sub_socket_ >= 0)
   {
+#ifdef MC_CONTROL_CLIENT_SHARED_MEMORY
+    // The shared memory only holds the full GUI
+    if(shm_ && shm_->use(sub_socket_, subscription_.empty() && shm_->reader.connect()))
+    {
+      auto start_t = clock::now();
+      auto size = shm_->reader.read(buff);
+      auto now = std::chrono::system_clock::now();
+      if(size > 0)
+      {
+        t_last_received = now;
+        receive_dt_ = duration_ms(clock::now() - start_t).count();
+        run(buff.data(), size);
+      }
+      else if(timeout_ > 0 && now - t_last_received > std::chrono::duration<double>(timeout_))
+      {
+        t_last_received = now;
+        if(run_) { handle_gui_state(mc_rtc::Configuration{}); }
+      }
+      return;
+    }
+#endif
 #ifndef MC_RTC_DISABLE_NETWORK
-    memset(buff.data(), 0, buff.size() * sizeof(char));
-    auto recv = nn_recv(sub_socket_, buff.data(), buff.size(), NN_DONTWAIT);
+    auto start_t = clock::now();
+    auto topic_size = static_cast<int>(subscription_topic_.size());
+    auto for_this_client = [&](const char * data, int size)
+    {
+      // Messages of a previous subscription that were received before the client left the subscriptions endpoint
+      if(topic_size == 0) { return size > 0 && data[0] != '\xc1'; }
+      return size >= topic_size && memcmp(data, subscription_topic_.data(), subscription_topic_.size()) == 0;
+    };
+    // nanomsg allocates the messages, only the newest one and the newest snapshot are kept, the deltas refer to the
+    // snapshot so it must be handled first
+    void * msg = nullptr;
+    int msg_size = 0;
+    void * snapshot = nullptr;
+    int snapshot_size = 0;
+    uint64_t snapshot_id = 0;
+    bool received = false;
+    uint64_t skipped = 0;
+    auto release = [&](void *& m)
+    {
+      if(!m) { return; }
+      nn_freemsg(m);
+      skipped++;
+      m = nullptr;
+    };
+    void * next = nullptr;
+    int recv = 0;
+    while((recv = nn_recv(sub_socket_, &next, NN_MSG, NN_DONTWAIT)) >= 0)
+    {
+      received = true;
+      if(!for_this_client(static_cast<const char *>(next), recv))
+      {
+        nn_freemsg(next);
+        continue;
+      }
+      if(msg == snapshot) { msg = nullptr; }
+      release(msg);
+      msg = next;
+      msg_size = recv;
+      uint64_t id = 0;
+      if(!is_delta(static_cast<const char *>(msg) + topic_size, static_cast<size_t>(msg_size - topic_size), id))
+      {
+        release(snapshot);
+        snapshot = msg;
+        snapshot_size = msg_size;
+        snapshot_id = id;
+      }
+    }
+    auto err = nn_errno();
+    if(err != EAGAIN) { mc_rtc::log::error("ControllerClient failed to receive with errno: {}", err); }
     auto now = std::chrono::system_clock::now();
-    if(recv < 0)
+    if(!received)
     {
       if(timeout_ > 0 && now - t_last_received > std::chrono::duration<double>(timeout_))
       {
         t_last_received = now;
         if(run_) { handle_gui_state(mc_rtc::Configuration{}); }
       }
-      auto err = nn_errno();
-      if(err != EAGAIN) { mc_rtc::log::error("ControllerClient failed to receive with errno: {}", err); }
+      return;
     }
-    else if(recv > 0)
+    t_last_received = now;
+    if(!msg) { return; }
+    receive_dt_ = duration_ms(clock::now() - start_t).count();
+    std::unique_ptr<void, int (*)(void *)> release_msg(msg, nn_freemsg);
+    std::unique_ptr<void, int (*)(void *)> release_snapshot(snapshot != msg ? snapshot : nullptr, nn_freemsg);
+    if(release_snapshot)
     {
-      auto msg_size = recv;
-      while(recv > 0)
-      {
-        msg_size = recv;
-        recv = nn_recv(sub_socket_, buff.data(), buff.size(), NN_DONTWAIT);
-      }
-      t_last_received = now;
-      if(msg_size > static_cast<int>(buff.size()))
+      uint64_t msg_snapshot = 0;
+      if(is_delta(static_cast<const char *>(msg) + topic_size, static_cast<size_t>(msg_size - topic_size),
+                  msg_snapshot)
+         && msg_snapshot == snapshot_id)
       {
-        mc_rtc::log::warning(
-            "Receive buffer was too small to receive the latest state message, will resize for next time");
-        resize_to_fit(static_cast<size_t>(msg_size));
-        return;
+        run(static_cast<const char *>(snapshot) + topic_size, static_cast<size_t>(snapshot_size - topic_size));
       }
-      run(buff.data(), static_cast<size_t>(msg_size));
+      else { skipped++; }
     }
+    skipped_messages_ += skipped;
+    run(static_cast<const char *>(msg) + topic_size, static_cast<size_t>(msg_size - topic_size));
 #endif
   }
   else if(server_ != nullptr)
   {
-    auto recv = server_->data();
+    auto start_t = clock::now();
+    auto recv = server_->data(subscription_id_);
     if(recv.second == 0) { return; }
-    resize_to_fit(recv.second);
+    if(buff.size() < recv.second) { buff.resize(recv.second); }
     memcpy(buff.data(), recv.first, recv.second * sizeof(char));
+    receive_dt_ = duration_ms(clock::now() - start_t).count();
     run(buff.data(), recv.second);
   }
   else { handle_gui_state(mc_rtc::Configuration{}); }
@@ -180,7 +389,25 @@ void ControllerClient::run(std::vector<char> & buff, std::chrono::system_clock::
 
 void ControllerClient::run(const char * buffer, size_t bufferSize)
 {
-  if(run_) { handle_gui_state(mc_rtc::Configuration::fromMessagePack(buffer, bufferSize)); }
+  if(!run_) { return; }
+  auto start_t = clock::now();
+  handle_gui_state(buffer, bufferSize);
+  decode_dt_ = duration_ms(clock::now() - start_t).count();
+}
+
+double ControllerClient::receive_dt() const noexcept
+{
+  return receive_dt_;
+}
+
+double ControllerClient::decode_dt() const noexcept
+{
+  return decode_dt_;
+}
+
+uint64_t ControllerClient::skipped_messages() const noexcept
+{
+  return skipped_messages_;
 }
 
 void ControllerClient::start()
@@ -205,10 +432,20 @@ void ControllerClient::send_request(const ElementId & id, const mc_rtc::Configur
 {
   std::string out;
   raw_request(id, data, out);
+  send_raw(out);
+  if(server_) { server_->handle_requests(*gui_, out.c_str()); }
+}
+
+void ControllerClient::send_raw(const std::string & request)
+{
+#ifdef MC_CONTROL_CLIENT_SHARED_MEMORY
+  if(shm_ && shm_->reader.push(request.c_str(), request.size() + 1)) { return; }
+#endif
 #ifndef MC_RTC_DISABLE_NETWORK
-  nn_send(push_socket_, out.c_str(), out.size() + 1, NN_DONTWAIT);
+  if(push_socket_ >= 0) { nn_send(push_socket_, request.c_str(), request.size() + 1, NN_DONTWAIT); }
+#else
+  (void)request;
 #endif
-  if(server_) { server_->handle_requests(*gui_, out.c_str()); }
 }
 
 void ControllerClient::send_request(const ElementId & id)
@@ -240,54 +477,610 @@ double ControllerClient::timeout()
   return timeout_;
 }
 
+/** Reads a MessagePack buffer in place
+ *
+ * Strings are views of the buffer and objects can be skipped to get their binary form. Errors are reported through
+ * ok(), the reader returns zeros once an error occured. The reader can be dropped before the end of the data.
+ */
+struct ControllerClient::Reader
+{
+  Reader(const char * data, size_t size) { mpack_reader_init_data(&reader_, data, size); }
+
+  ~Reader()
+  {
+    // Cancel the checks of the arrays that were not read to the end
+    if(ok()) { mpack_reader_flag_error(&reader_, mpack_error_data); }
+    mpack_reader_destroy(&reader_);
+  }
+
+  Reader(const Reader &) = delete;
+  Reader & operator=(const Reader &) = delete;
+
+  inline bool ok() noexcept { return mpack_reader_error(&reader_) == mpack_ok; }
+
+  /** Type of the next object */
+  inline mpack_type_t peek() { return mpack_peek_tag(&reader_).type; }
+
+  /** Start an array, returns its size, finish() must be called once all the items have been read */
+  inline size_t array() { return mpack_expect_array(&reader_); }
+
+  inline void finish() { mpack_done_array(&reader_); }
+
+  /** Start a map, returns its size, finish_map() must be called once all the items have been read */
+  inline size_t map() { return mpack_expect_map(&reader_); }
+
+  inline void finish_map() { mpack_done_map(&reader_); }
+
+  inline std::string_view str()
+  {
+    uint32_t size = mpack_expect_str(&reader_);
+    const char * data = mpack_read_bytes_inplace(&reader_, size);
+    mpack_done_str(&reader_);
+    if(!ok()) { return {}; }
+    return {data, size};
+  }
+
+  inline bool boolean() { return mpack_expect_bool(&reader_); }
+
+  /** Read any numeric type */
+  inline double number()
+  {
+    auto tag = mpack_read_tag(&reader_);
+    switch(mpack_tag_type(&tag))
+    {
+      case mpack_type_int:
+        return static_cast<double>(mpack_tag_int_value(&tag));
+      case mpack_type_uint:
+        return static_cast<double>(mpack_tag_uint_value(&tag));
+      case mpack_type_float:
+        return mpack_tag_float_value(&tag);
+      case mpack_type_double:
+        return mpack_tag_double_value(&tag);
+      default:
+        mpack_reader_flag_error(&reader_, mpack_error_type);
+        return 0;
+    }
+  }
+
+  inline int64_t integer() { return mpack_expect_i64(&reader_); }
+
+  inline uint64_t u64() { return mpack_expect_u64(&reader_); }
+
+  /** Read an extension, returns its data */
+  inline std::string_view ext(int8_t & type)
+  {
+    auto tag = mpack_read_tag(&reader_);
+    if(mpack_tag_type(&tag) != mpack_type_ext)
+    {
+      mpack_reader_flag_error(&reader_, mpack_error_type);
+      return {};
+    }
+    type = mpack_tag_ext_exttype(&tag);
+    uint32_t size = mpack_tag_ext_length(&tag);
+    const char * data = mpack_read_bytes_inplace(&reader_, size);
+    mpack_done_ext(&reader_);
+    if(!ok()) { return {}; }
+    return {data, size};
+  }
+
+  /** Read an integer that might be nil */
+  inline int64_t integer(int64_t def)
+  {
+    if(peek() == mpack_type_nil)
+    {
+      mpack_expect_nil(&reader_);
+      return def;
+    }
+    return integer();
+  }
+
+  /** Skip the next object and returns its binary form */
+  inline std::pair<const char *, size_t> object()
+  {
+    const char * start = position();
+    mpack_discard(&reader_);
+    if(!ok()) { return {nullptr, 0}; }
+    return {start, static_cast<size_t>(position() - start)};
+  }
+
+  /** Read a configuration */
+  inline mc_rtc::Configuration configuration()
+  {
+    auto data = object();
+    if(!ok()) { return {}; }
+    return mc_rtc::Configuration::fromMessagePack(data.first, data.second);
+  }
+
+  /** Read a packed array (see mc_rtc::MessagePackBuilder::write_packed), returns its values */
+  inline std::string_view packed(int8_t & type)
+  {
+    auto data = ext(type);
+    if(!ok()) { return {}; }
+    size_t rank = data.size() ? static_cast<uint8_t>(data[0]) : 0;
+    size_t value_size = packed_size(type);
+    if(value_size == 0 || data.size() < 1 + rank || (data.size() - 1 - rank) % value_size != 0)
+    {
+      mpack_reader_flag_error(&reader_, mpack_error_type);
+      return {};
+    }
+    return data.substr(1 + rank);
+  }
+
+  /** Size of a value in a packed array of the given type (0 for other types) */
+  static inline size_t packed_size(int8_t type) noexcept
+  {
+    switch(type)
+    {
+      case mc_rtc::MessagePackBuilder::PACKED_UINT16:
+        return 2;
+      case mc_rtc::MessagePackBuilder::PACKED_FLOAT32:
+      case mc_rtc::MessagePackBuilder::PACKED_INT32:
+      case mc_rtc::MessagePackBuilder::PACKED_UINT32:
+        return 4;
+      case mc_rtc::MessagePackBuilder::PACKED_FLOAT64:
+      case mc_rtc::MessagePackBuilder::PACKED_INT64:
+      case mc_rtc::MessagePackBuilder::PACKED_UINT64:
+        return 8;
+      default:
+        return 0;
+    }
+  }
+
+  /** Convert the values of a packed array */
+  static inline void unpack(int8_t type, std::string_view data, double * out)
+  {
+    if(type == mc_rtc::MessagePackBuilder::PACKED_FLOAT64 && mc_rtc::internal::has_packed_arrays)
+    {
+      std::memcpy(out, data.data(), data.size());
+      return;
+    }
+    size_t size = data.size() / packed_size(type);
+    for(size_t i = 0; i < size; ++i)
+    {
+      const char * value = data.data() + i * packed_size(type);
+      switch(type)
+      {
+        case mc_rtc::MessagePackBuilder::PACKED_FLOAT64:
+          out[i] = load<double>(value);
+          break;
+        case mc_rtc::MessagePackBuilder::PACKED_FLOAT32:
+          out[i] = load<float>(value);
+          break;
+        case mc_rtc::MessagePackBuilder::PACKED_INT32:
+          out[i] = load<int32_t>(value);
+          break;
+        case mc_rtc::MessagePackBuilder::PACKED_INT64:
+          out[i] = static_cast<double>(load<int64_t>(value));
+          break;
+        case mc_rtc::MessagePackBuilder::PACKED_UINT32:
+          out[i] = load<uint32_t>(value);
+          break;
+        case mc_rtc::MessagePackBuilder::PACKED_UINT16:
+          out[i] = load<uint16_t>(value);
+          break;
+        default:
+          out[i] = static_cast<double>(load<uint64_t>(value));
+          break;
+      }
+    }
+  }
+
+  /** Read numbers, either a packed array or a (nested) array of numbers, the items are flattened in \p out */
+  inline void numbers(std::vector<double> & out)
+  {
+    out.resize(0);
+    append(out);
+  }
+
+  /** Read an array of numbers */
+  inline void read(Eigen::VectorXd & out)
+  {
+    if(peek() == mpack_type_ext)
+    {
+      int8_t type = 0;
+      auto data = packed(type);
+      if(!ok()) { return; }
+      out.resize(static_cast<Eigen::DenseIndex>(data.size() / packed_size(type)));
+      unpack(type, data, out.data());
+      return;
+    }
+    size_t size = array();
+    out.resize(static_cast<Eigen::DenseIndex>(size));
+    for(size_t i = 0; i < size; ++i) { out(static_cast<Eigen::DenseIndex>(i)) = number(); }
+    finish();
+  }
+
+  /** Read an array of strings */
+  inline void read(std::vector<std::string> & out)
+  {
+    size_t size = array();
+    out.resize(size);
+    for(size_t i = 0; i < size; ++i) { out[i] = str(); }
+    finish();
+  }
+
+  /** Current position in the buffer */
+  inline const char * position() const noexcept { return reader_.data; }
+
+private:
+  mpack_reader_t reader_;
+
+  /** Load a little-endian value */
+  template<typename T>
+  static inline T load(const char * data)
+  {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, data, sizeof(T));
+    if constexpr(!mc_rtc::internal::has_packed_arrays) { std::reverse(bytes, bytes + sizeof(T)); }
+    T out;
+    std::memcpy(&out, bytes, sizeof(T));
+    return out;
+  }
+
+  inline void append(std::vector<double> & out)
+  {
+    switch(peek())
+    {
+      case mpack_type_ext:
+      {
+        int8_t type = 0;
+        auto data = packed(type);
+        if(!ok()) { return; }
+        size_t offset = out.size();
+        out.resize(offset + data.size() / packed_size(type));
+        unpack(type, data, out.data() + offset);
+        break;
+      }
+      case mpack_type_array:
+      {
+        size_t size = array();
+        for(size_t i = 0; i < size && ok(); ++i) { append(out); }
+        finish();
+        break;
+      }
+      default:
+        out.push_back(number());
+    }
+  }
+};
+
+bool ControllerClient::is_delta(const char * data, size_t size, uint64_t & snapshot)
+{
+  Reader state(data, size);
+  size_t n_entries = state.array();
+  // Older servers only send full messages
+  if(n_entries < 6 || state.integer() < 5) { return !state.ok(); }
+  for(size_t i = 1; i < 4; ++i) { state.object(); }
+  snapshot = state.u64();
+  bool delta = state.boolean();
+  // An invalid message is not kept in place of the snapshot
+  return delta || !state.ok();
+}
+
 void ControllerClient::handle_gui_state(mc_rtc::Configuration state)
 {
   if(!state.size())
   {
     started();
-    handle_category({}, "", {});
     stopped();
     return;
   }
+  std::vector<char> buffer;
+  size_t size = state.toMessagePack(buffer);
+  handle_gui_state(buffer.data(), size);
+}
+
+void ControllerClient::handle_gui_state(const char * data, size_t size)
+{
+  // Locate the top-level entries first since the snapshot information is at the end of the message
+  std::array<std::pair<const char *, size_t>, 7> entries = {};
+  size_t n_entries = 0;
+  {
+    Reader state(data, size);
+    n_entries = state.array();
+    for(size_t i = 0; i < n_entries; ++i)
+    {
+      auto entry = state.object();
+      if(i < entries.size()) { entries[i] = entry; }
+    }
+    state.finish();
+    if(!state.ok() || n_entries < 3)
+    {
+      mc_rtc::log::error("[ControllerClient] Received an invalid GUI message");
+      return;
+    }
+  }
+  auto read = [&](size_t i, auto && callback)
+  {
+    Reader entry(entries[i].first, entries[i].second);
+    return callback(entry);
+  };
+  int version = static_cast<int>(read(0, [](Reader & r) { return r.integer(); }));
+  delta_ = version >= 5 && n_entries > 5 && read(5, [](Reader & r) { return r.boolean(); });
+  uint64_t snapshot = version >= 5 && n_entries > 4 ? read(4, [](Reader & r) { return r.u64(); }) : 0;
+  if(delta_ && snapshot != snapshot_)
+  {
+    // Wait for the snapshot this delta refers to
+    return;
+  }
   started();
-  int version = state[0];
   if(version > mc_rtc::gui::StateBuilder::PROTOCOL_VERSION)
   {
     mc_rtc::log::error("Receive message, version: {} but I can only handle version {} and lower", version,
                        mc_rtc::gui::StateBuilder::PROTOCOL_VERSION);
-    handle_category({}, "", {});
     stopped();
     return;
   }
-  data_ = state[1];
-  handle_category({}, "", state[2]);
-  if(3 < state.size())
+  if(!delta_)
+  {
+    snapshot_ = snapshot;
+    snapshot_buffer_.resize(0);
+    snapshot_elements_.resize(0);
+    ++snapshots_;
+  }
+  if(version >= 6 && n_entries > 6)
+  {
+    // Geometry referenced by the elements
+    Reader table(entries[6].first, entries[6].second);
+    size_t n_geometry = table.map();
+    for(size_t i = 0; i < n_geometry; ++i)
+    {
+      uint64_t hash = table.u64();
+      auto payload = table.object();
+      if(!table.ok()) { break; }
+      auto & geometry = geometry_[hash];
+      // The hash identifies the content, a payload already in the cache is not copied again
+      if(geometry.data.empty()) { geometry.data.assign(payload.first, payload.first + payload.second); }
+      geometry.used = snapshots_;
+    }
+    table.finish_map();
+    if(!table.ok()) { mc_rtc::log::error("[ControllerClient] Failed to decode the GUI geometry"); }
+  }
+  // The data is nil in a delta when it did not change since the snapshot, it is only decoded when it changed
+  auto data_bytes = entries[1];
+  if(!delta_) { snapshot_data_.assign(data_bytes.first, data_bytes.first + data_bytes.second); }
+  else if(read(1, [](Reader & r) { return r.peek() != mpack_type_map; }))
+  {
+    data_bytes = {snapshot_data_.data(), snapshot_data_.size()};
+  }
+  if(data_bytes.second
+     && (data_buffer_.size() != data_bytes.second
+         || !std::equal(data_buffer_.begin(), data_buffer_.end(), data_bytes.first)))
+  {
+    data_buffer_.assign(data_bytes.first, data_bytes.first + data_bytes.second);
+    data_ = mc_rtc::Configuration::fromMessagePack(data_bytes.first, data_bytes.second);
+  }
+  {
+    std::vector<std::string> category;
+    Reader root(entries[2].first, entries[2].second);
+    handle_category(category, root);
+    if(!root.ok()) { mc_rtc::log::error("[ControllerClient] Failed to decode the GUI elements"); }
+  }
+  if(!delta_)
+  {
+    for(auto it = geometry_.begin(); it != geometry_.end();)
+    {
+      if(snapshots_ - it->second.used > GEOMETRY_MAX_AGE) { it = geometry_.erase(it); }
+      else { ++it; }
+    }
+  }
+  if(3 < n_entries)
   {
-    auto plots = state[3];
-    for(size_t i = 0; i < plots.size(); ++i) { handle_plot(plots[i]); }
+    Reader plots(entries[3].first, entries[3].second);
+    size_t n_plots = plots.array();
+    for(size_t i = 0; i < n_plots; ++i)
+    {
+      auto plot = plots.object();
+      if(!plots.ok()) { break; }
+      handle_plot(plot.first, plot.second);
+    }
+    plots.finish();
   }
   stopped();
 }
 
-void ControllerClient::handle_category(const std::vector<std::string> & parent,
-                                       const std::string & category,
-                                       const mc_rtc::Configuration & data)
+void ControllerClient::handle_category(std::vector<std::string> & category, Reader & data)
 {
-  if(data.size() < 2) { return; }
-  if(category.size()) { this->category(parent, category); }
-  auto next_category = parent;
-  if(category.size()) { next_category.push_back(category); }
-  for(size_t i = 1; i < data.size() - 1; ++i)
+  size_t size = data.array();
+  if(size < 2)
   {
-    auto widget_data = data[i];
-    std::string widget_name = widget_data[0];
-    int sid = widget_data.at(2, -1);
-    handle_widget({next_category, widget_name, sid}, widget_data);
+    for(size_t i = 0; i < size; ++i) { data.object(); }
+    data.finish();
+    return;
   }
-  if(data[data.size() - 1].size())
+  auto name = data.str();
+  if(name.size())
   {
-    auto cat_data = data[data.size() - 1];
-    for(size_t i = 0; i < cat_data.size(); ++i) { handle_category(next_category, cat_data[i][0], cat_data[i]); }
+    this->category(category, std::string{name});
+    category.emplace_back(name);
+  }
+  for(size_t i = 1; i < size - 1; ++i)
+  {
+    if(data.peek() == mpack_type_uint)
+    {
+      // Element that did not change since the snapshot
+      size_t index = static_cast<size_t>(data.integer());
+      if(index >= snapshot_elements_.size())
+      {
+        mc_rtc::log::error("[ControllerClient] No element {} in the GUI snapshot", index);
+        continue;
+      }
+      const auto & element = snapshot_elements_[index];
+      handle_widget(category, snapshot_buffer_.data() + element.first, element.second);
+      continue;
+    }
+    auto widget = data.object();
+    if(!data.ok()) { break; }
+    if(!delta_)
+    {
+      snapshot_elements_.emplace_back(snapshot_buffer_.size(), widget.second);
+      snapshot_buffer_.insert(snapshot_buffer_.end(), widget.first, widget.first + widget.second);
+    }
+    handle_widget(category, widget.first, widget.second);
+  }
+  size_t n_sub = data.array();
+  for(size_t i = 0; i < n_sub; ++i) { handle_category(category, data); }
+  data.finish();
+  data.finish();
+  if(name.size()) { category.pop_back(); }
+}
+
+bool ControllerClient::expand_geometry(const char * data, size_t size)
+{
+  Reader widget(data, size);
+  size_t n = widget.array();
+  widget_buffer_.assign(data, widget.position());
+  for(size_t i = 0; i < n; ++i)
+  {
+    const char * start = widget.position();
+    if(widget.peek() == mpack_type_ext)
+    {
+      int8_t type = 0;
+      auto ref = widget.ext(type);
+      if(type == mc_rtc::gui::StateBuilder::GEOMETRY_EXT && ref.size() == 8)
+      {
+        uint64_t hash = 0;
+        for(size_t b = 0; b < 8; ++b) { hash |= static_cast<uint64_t>(static_cast<uint8_t>(ref[b])) << (8 * b); }
+        auto it = geometry_.find(hash);
+        if(it == geometry_.end())
+        {
+          mc_rtc::log::error("[ControllerClient] No geometry {:x} in the GUI cache", hash);
+          return false;
+        }
+        it->second.used = snapshots_;
+        widget_buffer_.insert(widget_buffer_.end(), it->second.data.begin(), it->second.data.end());
+        continue;
+      }
+    }
+    else { widget.object(); }
+    widget_buffer_.insert(widget_buffer_.end(), start, widget.position());
+  }
+  widget.finish();
+  return widget.ok();
+}
+
+void ControllerClient::handle_widget(const std::vector<std::string> & category, const char * data, size_t size)
+{
+  std::string name;
+  mc_rtc::gui::Elements type;
+  int sid = -1;
+  {
+    Reader widget(data, size);
+    widget.array();
+    widget.object();
+    type = static_cast<mc_rtc::gui::Elements>(widget.integer());
+  }
+  if(mc_rtc::gui::StateBuilder::geometry(type, 3))
+  {
+    if(!expand_geometry(data, size)) { return; }
+    data = widget_buffer_.data();
+    size = widget_buffer_.size();
+  }
+  {
+    Reader widget(data, size);
+    size_t n = widget.array();
+    if(n < 3)
+    {
+      mc_rtc::log::error("[ControllerClient] Received an invalid GUI element in category {}", cat2str(category));
+      return;
+    }
+    name = widget.str();
+    type = static_cast<mc_rtc::gui::Elements>(widget.integer());
+    sid = static_cast<int>(widget.integer(-1));
+    if(!widget.ok())
+    {
+      mc_rtc::log::error("[ControllerClient] Received an invalid GUI element in category {}", cat2str(category));
+      return;
+    }
+    ElementId id{category, name, sid};
+    if(handle_widget(id, type, n, widget)) { return; }
+  }
+  handle_widget({category, name, sid}, mc_rtc::Configuration::fromMessagePack(data, size));
+}
+
+bool ControllerClient::handle_widget(const ElementId & id, mc_rtc::gui::Elements type, size_t size, Reader & data)
+{
+  using Elements = mc_rtc::gui::Elements;
+  if(type == Elements::Button)
+  {
+    button(id);
+    return true;
+  }
+  if(size < 4) { return false; }
+  switch(type)
+  {
+    case Elements::Label:
+    {
+      switch(data.peek())
+      {
+        case mpack_type_str:
+          string_buffer_ = data.str();
+          break;
+        case mpack_type_bool:
+          string_buffer_ = data.boolean() ? "true" : "false";
+          break;
+        case mpack_type_int:
+        case mpack_type_uint:
+          string_buffer_ = std::to_string(data.integer());
+          break;
+        default:
+          return false;
+      }
+      if(!data.ok()) { return false; }
+      label(id, string_buffer_);
+      return true;
+    }
+    case Elements::ArrayLabel:
+    case Elements::ArrayInput:
+    {
+      data.read(vector_buffer_);
+      labels_buffer_.resize(0);
+      if(size > 4 && data.peek() == mpack_type_array) { data.read(labels_buffer_); }
+      if(!data.ok()) { return false; }
+      if(type == Elements::ArrayLabel) { array_label(id, labels_buffer_, vector_buffer_); }
+      else { array_input(id, labels_buffer_, vector_buffer_); }
+      return true;
+    }
+    case Elements::Checkbox:
+    {
+      bool value = data.boolean();
+      if(!data.ok()) { return false; }
+      checkbox(id, value);
+      return true;
+    }
+    case Elements::StringInput:
+    {
+      string_buffer_ = data.str();
+      if(!data.ok()) { return false; }
+      string_input(id, string_buffer_);
+      return true;
+    }
+    case Elements::IntegerInput:
+    {
+      auto value = static_cast<int>(data.integer());
+      if(!data.ok()) { return false; }
+      integer_input(id, value);
+      return true;
+    }
+    case Elements::NumberInput:
+    {
+      double value = data.number();
+      if(!data.ok()) { return false; }
+      number_input(id, value);
+      return true;
+    }
+    case Elements::NumberSlider:
+    {
+      if(size < 6) { return false; }
+      double value = data.number();
+      double min = data.number();
+      double max = data.number();
+      if(!data.ok()) { return false; }
+      number_slider(id, value, min, max);
+      return true;
+    }
+    default:
+      return false;
   }
 }
 
@@ -814,73 +1607,37 @@ void ControllerClient::handle_form(const ElementId & id, const mc_rtc::Configura
   }
 }
 
-void ControllerClient::handle_plot(const mc_rtc::Configuration & plot)
+void ControllerClient::handle_plot(const char * data, size_t size)
 {
-  auto pType = static_cast<mc_rtc::gui::plot::Plot>(static_cast<uint64_t>(plot[0]));
+  Reader plot(data, size);
+  size_t n = plot.array();
+  auto pType = static_cast<mc_rtc::gui::plot::Plot>(plot.integer());
+  if(!plot.ok() || n < 6)
+  {
+    mc_rtc::log::error("[ControllerClient] Received an invalid plot");
+    return;
+  }
+  uint64_t id = plot.u64();
+  std::string title(plot.str());
   switch(pType)
   {
     case mc_rtc::gui::plot::Plot::Standard:
-      handle_standard_plot(plot);
+      handle_standard_plot(id, title, n, plot);
       break;
     case mc_rtc::gui::plot::Plot::XY:
-      handle_xy_plot(plot);
+      handle_xy_plot(id, title, n, plot);
       break;
     default:
       mc_rtc::log::error("This client implementation only handles standard and XY plots");
+      return;
   }
+  plot.finish();
+  if(!plot.ok()) { mc_rtc::log::error("[ControllerClient] Received an invalid plot: {}", title); }
 }
 
 namespace
 {
 
-struct X
-{
-  mc_rtc::gui::plot::AxisConfiguration config;
-  std::vector<double> values;
-
-  X(const mc_rtc::Configuration & data)
-  {
-    config.fromMessagePack(data[0]);
-    values = data[1];
-  }
-};
-
-struct Y
-{
-  std::string legend;
-  std::vector<double> values;
-  mc_rtc::gui::Color color;
-  mc_rtc::gui::plot::Style style;
-  mc_rtc::gui::plot::Side side;
-
-  Y(const mc_rtc::Configuration & data)
-  {
-    legend = static_cast<std::string>(data[1]);
-    values = data[2];
-    color.fromMessagePack(data[3]);
-    style = static_cast<mc_rtc::gui::plot::Style>(static_cast<uint64_t>(data[4]));
-    side = static_cast<mc_rtc::gui::plot::Side>(static_cast<uint64_t>(data[5]));
-  }
-};
-
-struct XY
-{
-  std::string legend;
-  std::vector<std::array<double, 2>> values;
-  mc_rtc::gui::Color color;
-  mc_rtc::gui::plot::Style style;
-  mc_rtc::gui::plot::Side side;
-
-  XY(const mc_rtc::Configuration & data)
-  {
-    legend = static_cast<std::string>(data[1]);
-    values = data[2];
-    color.fromMessagePack(data[3]);
-    style = static_cast<mc_rtc::gui::plot::Style>(static_cast<uint64_t>(data[4]));
-    side = static_cast<mc_rtc::gui::plot::Side>(static_cast<uint64_t>(data[5]));
-  }
-};
-
 struct Polygon
 {
   std::string legend;
@@ -915,102 +1672,111 @@ struct Polygons
 
 } // namespace
 
-void ControllerClient::handle_standard_plot(const mc_rtc::Configuration & plot)
+void ControllerClient::handle_standard_plot(uint64_t id, const std::string & title, size_t size, Reader & plot)
 {
-  uint64_t id = plot[1];
-  std::string title = plot[2];
   start_plot(id, title);
-  X x(plot[3]);
-  plot_setup_xaxis(id, x.config.name, x.config.range);
+  mc_rtc::gui::plot::AxisConfiguration xConfig;
+  plot.array();
+  xConfig.fromMessagePack(plot.configuration());
+  plot.numbers(plot_x_);
+  plot.finish();
+  plot_setup_xaxis(id, xConfig.name, xConfig.range);
   mc_rtc::gui::plot::AxisConfiguration y1Config;
-  y1Config.fromMessagePack(plot[4]);
+  y1Config.fromMessagePack(plot.configuration());
   plot_setup_yaxis_left(id, y1Config.name, y1Config.range);
   mc_rtc::gui::plot::AxisConfiguration y2Config;
-  y2Config.fromMessagePack(plot[5]);
+  y2Config.fromMessagePack(plot.configuration());
   plot_setup_yaxis_right(id, y2Config.name, y2Config.range);
-  for(size_t i = 6; i < plot.size(); ++i)
+  for(size_t i = 6; i < size && plot.ok(); ++i)
   {
-    const auto & y_ = plot[i];
-    auto type = static_cast<mc_rtc::gui::plot::Type>(static_cast<uint64_t>(y_[0]));
-    using Type = mc_rtc::gui::plot::Type;
-    if(type == Type::Ordinate)
-    {
-      Y y(y_);
-      if(x.values.size() < y.values.size())
-      {
-        mc_rtc::log::error("[Plot::{}] Not enough X data compared to Y data", title);
-      }
-      size_t x_0 = y.values.size() - x.values.size();
-      for(size_t j = 0; j < y.values.size(); ++j)
-      {
-        plot_point(id, i - 6, y.legend, x.values[x_0 + j], y.values[j], y.color, y.style, y.side);
-      }
-    }
-    else if(type == Type::AbscissaOrdinate)
-    {
-      XY xy(y_);
-      for(const auto & v : xy.values) { plot_point(id, i - 6, xy.legend, v[0], v[1], xy.color, xy.style, xy.side); }
-    }
-    else if(type == Type::Polygon)
-    {
-      Polygon polygon(y_);
-      plot_polygon(id, i - 6, polygon.legend, polygon.polygon, polygon.side);
-    }
-    else if(type == Type::Polygons)
-    {
-      Polygons polygons(y_);
-      plot_polygons(id, i - 6, polygons.legend, polygons.polygons, polygons.side);
-    }
-    else
-    {
-      mc_rtc::log::error("Cannot handle provided data in {}:", title);
-      mc_rtc::log::warning(y_.dump(true, true));
-    }
+    auto y = plot.object();
+    handle_plot_series(id, title, i - 6, y.first, y.second, true);
   }
   end_plot(id);
 }
 
-void ControllerClient::handle_xy_plot(const mc_rtc::Configuration & plot)
+void ControllerClient::handle_xy_plot(uint64_t id, const std::string & title, size_t size, Reader & plot)
 {
-  uint64_t id = plot[1];
-  std::string title = plot[2];
   start_plot(id, title);
   mc_rtc::gui::plot::AxisConfiguration xConfig;
-  xConfig.fromMessagePack(plot[3]);
+  xConfig.fromMessagePack(plot.configuration());
   plot_setup_xaxis(id, xConfig.name, xConfig.range);
   mc_rtc::gui::plot::AxisConfiguration y1Config;
-  y1Config.fromMessagePack(plot[4]);
+  y1Config.fromMessagePack(plot.configuration());
   plot_setup_yaxis_left(id, y1Config.name, y1Config.range);
   mc_rtc::gui::plot::AxisConfiguration y2Config;
-  y2Config.fromMessagePack(plot[5]);
+  y2Config.fromMessagePack(plot.configuration());
   plot_setup_yaxis_right(id, y2Config.name, y2Config.range);
-  for(size_t i = 6; i < plot.size(); ++i)
+  for(size_t i = 6; i < size && plot.ok(); ++i)
   {
-    const auto & y_ = plot[i];
-    auto type = static_cast<mc_rtc::gui::plot::Type>(static_cast<uint64_t>(y_[0]));
-    using Type = mc_rtc::gui::plot::Type;
-    if(type == Type::AbscissaOrdinate)
+    auto y = plot.object();
+    handle_plot_series(id, title, i - 6, y.first, y.second, false);
+  }
+  end_plot(id);
+}
+
+void ControllerClient::handle_plot_series(uint64_t id,
+                                          const std::string & title,
+                                          uint64_t did,
+                                          const char * data,
+                                          size_t size,
+                                          bool standard)
+{
+  using Type = mc_rtc::gui::plot::Type;
+  Reader y(data, size);
+  y.array();
+  auto type = static_cast<Type>(y.integer());
+  if((standard && type == Type::Ordinate) || type == Type::AbscissaOrdinate)
+  {
+    std::string legend(y.str());
+    y.numbers(plot_y_);
+    mc_rtc::gui::Color color;
+    color.fromMessagePack(y.configuration());
+    auto style = static_cast<mc_rtc::gui::plot::Style>(y.integer());
+    auto side = static_cast<mc_rtc::gui::plot::Side>(y.integer());
+    y.finish();
+    if(!y.ok())
     {
-      XY xy(y_);
-      for(const auto & v : xy.values) { plot_point(id, i - 6, xy.legend, v[0], v[1], xy.color, xy.style, xy.side); }
+      mc_rtc::log::error("[Plot::{}] Invalid data for {}", title, legend);
+      return;
     }
-    else if(type == Type::Polygon)
+    if(type == Type::AbscissaOrdinate)
     {
-      Polygon polygon(y_);
-      plot_polygon(id, i - 6, polygon.legend, polygon.polygon, polygon.side);
+      // Points are flattened in plot_y_
+      for(size_t j = 0; j + 1 < plot_y_.size(); j += 2)
+      {
+        plot_point(id, did, legend, plot_y_[j], plot_y_[j + 1], color, style, side);
+      }
+      return;
     }
-    else if(type == Type::Polygons)
+    if(plot_x_.size() < plot_y_.size())
     {
-      Polygons polygons(y_);
-      plot_polygons(id, i - 6, polygons.legend, polygons.polygons, polygons.side);
+      mc_rtc::log::error("[Plot::{}] Not enough X data compared to Y data", title);
+      return;
     }
-    else
+    size_t x_0 = plot_x_.size() - plot_y_.size();
+    for(size_t j = 0; j < plot_y_.size(); ++j)
     {
-      mc_rtc::log::error("Cannot handle provided data in {}:", title);
-      mc_rtc::log::warning(y_.dump(true, true));
+      plot_point(id, did, legend, plot_x_[x_0 + j], plot_y_[j], color, style, side);
     }
+    return;
+  }
+  auto y_ = mc_rtc::Configuration::fromMessagePack(data, size);
+  if(type == Type::Polygon)
+  {
+    Polygon polygon(y_);
+    plot_polygon(id, did, polygon.legend, polygon.polygon, polygon.side);
+  }
+  else if(type == Type::Polygons)
+  {
+    Polygons polygons(y_);
+    plot_polygons(id, did, polygons.legend, polygons.polygons, polygons.side);
+  }
+  else
+  {
+    mc_rtc::log::error("Cannot handle provided data in {}:", title);
+    mc_rtc::log::warning(y_.dump(true, true));
   }
-  end_plot(id);
 }
 
 void ControllerClient::handle_table(const ElementId & id,
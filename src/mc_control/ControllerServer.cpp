@@ -4,6 +4,20 @@
 
 #include <mc_control/ControllerServer.h>
 
+#include <mc_rtc/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#  include "internals/GUISharedMemory.h"
+#endif
+
 #ifndef MC_RTC_DISABLE_NETWORK
 #  include <nanomsg/nn.h>
 #  include <nanomsg/pipeline.h>
@@ -14,18 +28,153 @@
 namespace mc_control
 {
 
+// Repeat static constexpr declarations
+// See https://stackoverflow.com/q/8016780
+constexpr double ControllerServer::subscription_timeout;
+
+namespace
+{
+
+/** A request received from a client */
+struct Request
+{
+  /** True for a subscription request */
+  bool subscription = false;
+  /** Subscription request */
+  std::string id;
+  std::vector<std::vector<std::string>> categories;
+  /** GUI request */
+  mc_rtc::Logger::GUIEvent event;
+};
+
+void parse_request(const char * data, Request & out)
+{
+  auto config = mc_rtc::Configuration::fromData(data);
+  out.subscription = config.has("subscribe");
+  if(out.subscription)
+  {
+    out.id = static_cast<std::string>(config("subscribe"));
+    out.categories = config("categories", std::vector<std::vector<std::string>>{});
+  }
+  else
+  {
+    out.event.category = config("category", std::vector<std::string>{});
+    out.event.name = config("name", std::string{});
+    out.event.data = config("data", mc_rtc::Configuration{});
+  }
+}
+
+using clock = std::chrono::steady_clock;
+using duration_ms = std::chrono::duration<double, std::milli>;
+
+} // namespace
+
+struct ControllerServer::Threaded
+{
+  /** Set on the middle frame index when it was written since the network thread last took it */
+  static constexpr size_t fresh = 4;
+  /** Frame shared between publish() and the network thread */
+  std::atomic<size_t> middle{1};
+  /** Frame written by the network thread */
+  size_t front = 2;
+  /** Messages shared between the network thread and publish() */
+  std::atomic<size_t> written{1};
+  /** Messages written by the network thread */
+  size_t written_back = 2;
+  /** Requests received by the network thread, applied by handle_requests() */
+  CircularBuffer<Request *, 256> requests;
+  /** Requests applied by handle_requests(), released by the network thread */
+  CircularBuffer<Request *, 256> done;
+  /** Requests that did not fit in the queue yet (network thread only) */
+  std::deque<Request *> pending;
+  std::atomic<bool> run{true};
+  std::thread thread;
+  /** Wakes the network thread when a frame is captured, publish() notifies without locking so the thread also wakes
+   * up every poll_period to receive the requests and to catch a missed notification */
+  std::mutex mutex;
+  std::condition_variable cv;
+  static constexpr std::chrono::milliseconds poll_period{1};
+
+  ~Threaded()
+  {
+    Request * r = nullptr;
+    while(requests.pop(r)) { delete r; }
+    while(done.pop(r)) { delete r; }
+    for(auto * p : pending) { delete p; }
+  }
+};
+
+constexpr size_t ControllerServer::Threaded::fresh;
+constexpr std::chrono::milliseconds ControllerServer::Threaded::poll_period;
+
+#ifndef _WIN32
+struct ControllerServer::SharedMemory : public internal::GUIShmWriter
+{
+  using internal::GUIShmWriter::GUIShmWriter;
+};
+#else
+struct ControllerServer::SharedMemory
+{
+};
+#endif
+
+template<typename CallbackT>
+void ControllerServer::receive(CallbackT && callback)
+{
+#ifndef MC_RTC_DISABLE_NETWORK
+  /*FIXME Avoid freeing the message constantly */
+  void * buf = nullptr;
+  int recv = 0;
+  do {
+    recv = nn_recv(pull_socket_, &buf, NN_MSG, NN_DONTWAIT);
+    if(recv < 0)
+    {
+      auto err = nn_errno();
+      if(err != EAGAIN) { mc_rtc::log::error("ControllerServer failed to receive requested with errno: {}", err); }
+    }
+    else
+    {
+      callback(static_cast<const char *>(buf));
+      nn_freemsg(buf);
+    }
+  } while(recv > 0);
+#endif
+#ifndef _WIN32
+  if(shm_) { shm_->receive(callback); }
+#endif
+}
+
 ControllerServer::ControllerServer(double dt, const ControllerServerConfiguration & config)
-: ControllerServer(dt, config.timestep, config.pub_uris(), config.pull_uris())
+: ControllerServer(dt,
+                   config.timestep,
+                   config.pub_uris(),
+                   config.pull_uris(),
+                   config.snapshot_period,
+                   config.threaded,
+                   config.shared_memory && config.ipc_socket ? shared_memory_name(*config.ipc_socket) : "")
 {
 }
 
 ControllerServer::ControllerServer(double dt,
                                    double server_dt,
                                    const std::vector<std::string> & pub_bind_uri,
-                                   const std::vector<std::string> & pull_bind_uri)
+                                   const std::vector<std::string> & pull_bind_uri,
+                                   double snapshot_period,
+                                   bool threaded,
+                                   const std::string & shared_memory)
+: snapshot_period_(snapshot_period)
 {
   iter_ = 0;
   update_rate(dt, server_dt);
+  if(shared_memory.size())
+  {
+#ifndef _WIN32
+    shm_.reset(new SharedMemory(shared_memory));
+    if(!shm_->valid()) { shm_.reset(); }
+#else
+    mc_rtc::log::warning("[ControllerServer] Shared memory is not available on Windows");
+#endif
+  }
 #ifndef MC_RTC_DISABLE_NETWORK
   auto init_socket = [](int & socket, int proto, const std::vector<std::string> & uris, const std::string & name)
   {
@@ -39,91 +188,361 @@ ControllerServer::ControllerServer(double dt,
   };
   init_socket(pub_socket_, NN_PUB, pub_bind_uri, "PUB socket");
   init_socket(pull_socket_, NN_PULL, pull_bind_uri, "PULL socket");
+  std::vector<std::string> subscriptions_bind_uri;
+  for(const auto & uri : pub_bind_uri)
+  {
+    auto subscriptions = subscriptions_uri(uri);
+    if(subscriptions.size()) { subscriptions_bind_uri.push_back(subscriptions); }
+    else { mc_rtc::log::warning("[ControllerServer] No subscriptions endpoint for {}", uri); }
+  }
+  init_socket(subscriptions_socket_, NN_PUB, subscriptions_bind_uri, "subscriptions PUB socket");
 #endif
+  if(threaded)
+  {
+    threaded_.reset(new Threaded());
+    threaded_->thread = std::thread(
+        [this]()
+        {
+          auto & t = *threaded_;
+          while(t.run)
+          {
+            auto start_t = clock::now();
+            bool work = false;
+            if(t.middle.load() & Threaded::fresh)
+            {
+              t.front = t.middle.exchange(t.front) & ~Threaded::fresh;
+              auto & messages = messages_[t.written_back];
+              write(frames_[t.front], messages);
+              send(messages);
+              t.written_back = t.written.exchange(t.written_back | Threaded::fresh) & ~Threaded::fresh;
+              work = true;
+            }
+            Request * r = nullptr;
+            while(t.done.pop(r)) { delete r; }
+            receive(
+                [&](const char * data)
+                {
+                  work = true;
+                  auto * request = new Request();
+                  try
+                  {
+                    parse_request(data, *request);
+                  }
+                  catch(const std::exception & exc)
+                  {
+                    mc_rtc::log::error("[ControllerServer] Invalid request: {}", exc.what());
+                    delete request;
+                    return;
+                  }
+                  t.pending.push_back(request);
+                });
+            while(t.pending.size() && t.requests.push(t.pending.front())) { t.pending.pop_front(); }
+            if(work) { network_dt_ = duration_ms(clock::now() - start_t).count(); }
+            std::unique_lock<std::mutex> lock(t.mutex);
+            t.cv.wait_for(lock, Threaded::poll_period,
+                          [&t]() { return !t.run || (t.middle.load() & Threaded::fresh); });
+          }
+        });
+  }
 }
 
 ControllerServer::~ControllerServer()
 {
+  if(threaded_)
+  {
+    threaded_->run = false;
+    threaded_->cv.notify_one();
+    threaded_->thread.join();
+  }
 #ifndef MC_RTC_DISABLE_NETWORK
   nn_close(pub_socket_);
   nn_close(pull_socket_);
+  nn_close(subscriptions_socket_);
 #endif
 }
 
 void ControllerServer::handle_requests(mc_rtc::gui::StateBuilder & gui_builder, const char * dataIn)
 {
-  auto config = mc_rtc::Configuration::fromData(static_cast<const char *>(dataIn));
-  auto category = config("category", std::vector<std::string>{});
-  auto name = config("name", std::string{});
-  auto data = config("data", mc_rtc::Configuration{});
-  if(!gui_builder.handleRequest(category, name, data))
+  Request request;
+  parse_request(dataIn, request);
+  if(request.subscription) { subscribe(request.id, std::move(request.categories)); }
+  else { handle_request(gui_builder, std::move(request.event)); }
+}
+
+void ControllerServer::handle_request(mc_rtc::gui::StateBuilder & gui_builder, mc_rtc::Logger::GUIEvent && r)
+{
+  if(!gui_builder.handleRequest(r.category, r.name, r.data))
   {
+    mc_rtc::Configuration config;
+    config.add("category", r.category);
+    config.add("name", r.name);
+    config.add("data", r.data);
     mc_rtc::log::error("Invokation of the following method failed\n{}\n", config.dump(true));
   }
-  if(logger_) { logger_->addGUIEvent({std::move(category), std::move(name), data}); }
+  if(logger_) { logger_->addGUIEvent(std::move(r)); }
 }
 
 void ControllerServer::handle_requests(mc_rtc::gui::StateBuilder & gui_builder)
 {
-  for(auto & r : requests_)
+  for(auto & r : requests_) { handle_request(gui_builder, std::move(r)); }
+  requests_.resize(0);
+  if(threaded_)
   {
-    if(!gui_builder.handleRequest(r.category, r.name, r.data))
+    Request * r = nullptr;
+    while(threaded_->requests.pop(r))
     {
-      mc_rtc::Configuration config;
-      config.add("category", r.category);
-      config.add("name", r.name);
-      config.add("data", r.data);
-      mc_rtc::log::error("Invokation of the following method failed\n{}\n", config.dump(true));
+      if(r->subscription) { subscribe(r->id, std::move(r->categories)); }
+      else { handle_request(gui_builder, std::move(r->event)); }
+      if(!threaded_->done.push(r)) { delete r; }
     }
-    if(logger_) { logger_->addGUIEvent(std::move(r)); }
+    return;
   }
-  requests_.resize(0);
-#ifndef MC_RTC_DISABLE_NETWORK
-  /*FIXME Avoid freeing the message constantly */
-  void * buf = nullptr;
-  int recv = 0;
-  do {
-    recv = nn_recv(pull_socket_, &buf, NN_MSG, NN_DONTWAIT);
-    if(recv < 0)
+  receive([&](const char * data) { handle_requests(gui_builder, data); });
+}
+
+void ControllerServer::subscribe(const std::string & id, std::vector<std::vector<std::string>> categories)
+{
+  auto it = subscriptions_.find(id);
+  if(it == subscriptions_.end())
+  {
+    it = subscriptions_.emplace(id, Subscription{}).first;
+    it->second.topic = subscription_topic(id);
+    categories_changed_ = true;
+  }
+  auto & subscription = it->second;
+  if(subscription.categories != categories)
+  {
+    // The subscription starts over from a new snapshot when the categories differ
+    subscription.categories = std::move(categories);
+    categories_changed_ = true;
+  }
+  subscription.renewed = iter_;
+}
+
+std::string ControllerServer::shared_memory_name(const std::string & ipc_socket)
+{
+  std::string out = ipc_socket + "_gui";
+  std::replace(out.begin(), out.end(), '/', '_');
+  if(out[0] != '_') { out = '_' + out; }
+  out[0] = '/';
+  return out;
+}
+
+std::string ControllerServer::subscription_topic(const std::string & id)
+{
+  // 0xc1 is never used in MessagePack
+  return '\xc1' + id;
+}
+
+std::string ControllerServer::subscriptions_uri(const std::string & pub_uri)
+{
+  static const std::string suffix = "_subscriptions";
+  auto starts_with = [&](const std::string & prefix) { return pub_uri.compare(0, prefix.size(), prefix) == 0; };
+  if(starts_with("ipc://") || starts_with("inproc://"))
+  {
+    static const std::string ext = ".ipc";
+    if(pub_uri.size() > ext.size() && pub_uri.compare(pub_uri.size() - ext.size(), ext.size(), ext) == 0)
     {
-      auto err = nn_errno();
-      if(err != EAGAIN) { mc_rtc::log::error("ControllerServer failed to receive requested with errno: {}", err); }
+      return pub_uri.substr(0, pub_uri.size() - ext.size()) + suffix + ext;
+    }
+    return pub_uri + suffix;
+  }
+  auto colon = pub_uri.rfind(':');
+  if(colon == std::string::npos || colon + 1 == pub_uri.size() || pub_uri.size() - colon - 1 > 5
+     || !std::all_of(pub_uri.begin() + static_cast<std::ptrdiff_t>(colon + 1), pub_uri.end(),
+                     [](char c) { return c >= '0' && c <= '9'; }))
+  {
+    return {};
+  }
+  auto port = std::stoul(pub_uri.substr(colon + 1)) + 2;
+  if(port > 65535) { return {}; }
+  return pub_uri.substr(0, colon + 1) + std::to_string(port);
+}
+
+void ControllerServer::publish(mc_rtc::gui::StateBuilder & gui_builder)
+{
+  if(iter_++ % rate_ == 0)
+  {
+    bool delta = publications_++ % snapshot_rate_ != 0 && !force_snapshot_;
+    force_snapshot_ = false;
+    auto timeout = static_cast<unsigned int>(ceil(subscription_timeout / dt_));
+    for(auto it = subscriptions_.begin(); it != subscriptions_.end();)
+    {
+      if(iter_ - it->second.renewed > timeout)
+      {
+        it = subscriptions_.erase(it);
+        categories_changed_ = true;
+      }
+      else { ++it; }
+    }
+    if(categories_changed_)
+    {
+      // The full GUI is only captured if a client wants it
+      full_ = subscriptions_.empty()
+              || std::any_of(subscriptions_.begin(), subscriptions_.end(),
+                             [](const auto & s) { return s.second.categories.empty(); });
+      categories_.clear();
+      for(const auto & s : subscriptions_)
+      {
+        if(full_) { break; }
+        for(const auto & c : s.second.categories)
+        {
+          if(std::find(categories_.begin(), categories_.end(), c) == categories_.end()) { categories_.push_back(c); }
+        }
+      }
+      categories_changed_ = false;
+    }
+    auto & frame = frames_[back_];
+    frame.delta = delta;
+    frame.count = 0;
+    auto next_message = [&frame](const std::string & id, const std::string & topic,
+                                 const std::vector<std::vector<std::string>> & categories)
+    {
+      if(frame.count == frame.messages.size()) { frame.messages.emplace_back(); }
+      auto & message = frame.messages[frame.count++];
+      message.id = id;
+      message.topic = topic;
+      message.categories = categories;
+    };
+    static const std::string empty;
+    static const std::vector<std::vector<std::string>> all;
+    if(full_) { next_message(empty, empty, all); }
+    for(const auto & s : subscriptions_)
+    {
+      if(s.second.categories.empty()) { continue; }
+      next_message(s.first, s.second.topic, s.second.categories);
+    }
+    // The plots are sampled once and the same samples are written in every message
+    gui_builder.update();
+    gui_builder.capture(frame.capture, full_ ? all : categories_);
+    gui_builder.clearPlots();
+    if(threaded_)
+    {
+      size_t previous = threaded_->middle.exchange(back_ | Threaded::fresh);
+      threaded_->cv.notify_one();
+      back_ = previous & ~Threaded::fresh;
+      // The network thread did not take this snapshot, the clients may be left without one
+      if((previous & Threaded::fresh) && !frames_[back_].delta) { force_snapshot_ = true; }
     }
     else
     {
-      handle_requests(gui_builder, static_cast<const char *>(buf));
-      nn_freemsg(buf);
+      auto start_t = clock::now();
+      write(frame, messages_[front_]);
+      send(messages_[front_]);
+      network_dt_ = duration_ms(clock::now() - start_t).count();
+      published_ = true;
     }
-  } while(recv > 0);
-#endif
+  }
+  else
+  {
+    gui_builder.update();
+    published_ = false;
+  }
+  if(threaded_)
+  {
+    published_ = threaded_->written.load() & Threaded::fresh;
+    if(published_) { front_ = threaded_->written.exchange(front_) & ~Threaded::fresh; }
+  }
 }
 
-void ControllerServer::publish(mc_rtc::gui::StateBuilder & gui_builder)
+void ControllerServer::write(const Frame & frame, Messages & out)
 {
-  if(iter_++ % rate_ == 0)
+  out.count = 0;
+  for(size_t i = 0; i < frame.count; ++i)
   {
-    buffer_size_ = gui_builder.update(buffer_);
+    const auto & m = frame.messages[i];
+    auto & state = states_[m.id];
+    if(state.categories != m.categories)
+    {
+      // Start over from a new snapshot
+      state = {};
+      state.categories = m.categories;
+    }
+    if(out.count == out.messages.size()) { out.messages.emplace_back(); }
+    auto & message = out.messages[out.count++];
+    message.id = m.id;
+    message.topic = m.topic;
+    message.size = writer_.write(message.buffer, frame.capture, state, frame.delta);
+  }
+  // Forget the subscriptions that expired
+  auto end = frame.messages.begin() + static_cast<std::ptrdiff_t>(frame.count);
+  for(auto it = states_.begin(); it != states_.end();)
+  {
+    if(std::none_of(frame.messages.begin(), end, [&it](const auto & m) { return m.id == it->first; }))
+    {
+      it = states_.erase(it);
+    }
+    else { ++it; }
+  }
+}
+
+void ControllerServer::send(const Messages & messages)
+{
 #ifndef MC_RTC_DISABLE_NETWORK
-    int err = nn_send(pub_socket_, buffer_.data(), buffer_size_, 0);
+  for(size_t i = 0; i < messages.count; ++i)
+  {
+    const auto & message = messages.messages[i];
+    nn_iovec iov[2];
+    iov[0].iov_base = const_cast<char *>(message.topic.data());
+    iov[0].iov_len = message.topic.size();
+    iov[1].iov_base = const_cast<char *>(message.buffer.data());
+    iov[1].iov_len = message.size;
+    nn_msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = message.topic.size() ? iov : iov + 1;
+    hdr.msg_iovlen = message.topic.size() ? 2 : 1;
+    // Only the full GUI is published on the PUB socket, the clients that did not subscribe only receive GUI messages
+    int err = nn_sendmsg(message.topic.size() ? subscriptions_socket_ : pub_socket_, &hdr, 0);
     if(err < 0) { mc_rtc::log::error("[ControllerServer] Failed to send {}", nn_strerror(nn_errno())); }
-#endif
   }
-  else
+#endif
+#ifndef _WIN32
+  if(shm_)
   {
-    gui_builder.update();
-    buffer_size_ = 0;
+    for(size_t i = 0; i < messages.count; ++i)
+    {
+      const auto & message = messages.messages[i];
+      if(message.id.empty()) { shm_->publish(message.buffer.data(), message.size); }
+    }
   }
+#endif
 }
 
 std::pair<const char *, size_t> ControllerServer::data() const
 {
-  return {buffer_.data(), buffer_size_};
+  return data(std::string{});
+}
+
+std::pair<const char *, size_t> ControllerServer::data(const std::string & id) const
+{
+  if(!published_) { return {nullptr, 0}; }
+  const auto & messages = messages_[front_];
+  const Messages::Message * full = nullptr;
+  for(size_t i = 0; i < messages.count; ++i)
+  {
+    const auto & message = messages.messages[i];
+    if(message.id == id) { return {message.buffer.data(), message.size}; }
+    if(message.id.empty()) { full = &message; }
+  }
+  if(full) { return {full->buffer.data(), full->size}; }
+  return {nullptr, 0};
+}
+
+double ControllerServer::network_dt() const noexcept
+{
+  return network_dt_;
 }
 
 void ControllerServer::update_rate(double dt, double server_dt)
 {
+  dt_ = dt;
   if(server_dt < dt) { server_dt = dt; }
   rate_ = static_cast<unsigned int>(ceil(server_dt / dt));
+  snapshot_rate_ = 1;
+  if(snapshot_period_ > 0)
+  {
+    snapshot_rate_ = std::max(static_cast<unsigned int>(ceil(snapshot_period_ / (rate_ * dt))), snapshot_rate_);
+  }
 }
 
 } // namespace mc_control
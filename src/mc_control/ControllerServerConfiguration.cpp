@@ -2,6 +2,7 @@
  * Copyright 2015-2024 CNRS-UM LIRMM, CNRS-AIST JRL
  */
 
+#include <mc_control/ControllerServer.h>
 #include <mc_control/ControllerServerConfiguration.h>
 
 namespace mc_control
@@ -17,8 +18,18 @@ ControllerServerConfiguration ControllerServerConfiguration::fromConfiguration(c
 void ControllerServerConfiguration::load(const mc_rtc::Configuration & config)
 {
   config("Timestep", timestep);
-  if(auto ipc = config.find("IPC")) { (*ipc)("Socket", ipc_socket); }
-  else { ipc_socket = std::nullopt; }
+  config("SnapshotPeriod", snapshot_period);
+  config("Threaded", threaded);
+  if(auto ipc = config.find("IPC"))
+  {
+    (*ipc)("Socket", ipc_socket);
+    (*ipc)("SharedMemory", shared_memory);
+  }
+  else
+  {
+    ipc_socket = std::nullopt;
+    shared_memory = false;
+  }
   auto socket_config = [&](const std::string & section, auto & opt_out)
   {
     using SocketT = typename std::remove_reference_t<decltype(opt_out)>::value_type;
@@ -71,8 +82,15 @@ void ControllerServerConfiguration::print_serving_information() const noexcept
 {
   mc_rtc::log::info("Publishing data on:");
   for(const auto & pub_uri : pub_uris()) { mc_rtc::log::info("- {}", pub_uri); }
+  mc_rtc::log::info("Publishing subscriptions on:");
+  for(const auto & pub_uri : pub_uris()) { mc_rtc::log::info("- {}", ControllerServer::subscriptions_uri(pub_uri)); }
   mc_rtc::log::info("Handling requests on:");
   for(const auto & pull_uri : pull_uris()) { mc_rtc::log::info("- {}", pull_uri); }
+  if(shared_memory && ipc_socket)
+  {
+    mc_rtc::log::info("Serving local clients through shared memory: {}",
+                      ControllerServer::shared_memory_name(*ipc_socket));
+  }
 }
 
 } // namespace mc_control
@@ -165,7 +165,7 @@ Ticker::Ticker(const Configuration & config) : config_(config), gc_(get_gc_confi
       log_to_datastore =
           mc_rtc::Configuration(replay_c.with_datastore_config).operator std::map<std::string, std::string>();
     }
-    log_ = std::make_shared<mc_rtc::log::FlatLog>(replay_c.log);
+    log_ = std::make_shared<mc_rtc::log::FlatLog>(replay_c.log, 0);
     gc_.controller().datastore().make<decltype(log_)>("Replay::Log", log_);
   }
   simulate_sensors();
@@ -0,0 +1,422 @@
+#pragma once
+
+/*
+ * Copyright 2015-2024 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/logging.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mc_control::internal
+{
+
+/** Layout of the shared memory used by ControllerServer to serve the clients on the same host
+ *
+ * The memory holds this header, three state buffers and the request ring:
+ * - the server writes the full GUI message in the buffer that follows the last one it published, every buffer has a
+ *   sequence counter (odd while it is written) so that the readers detect when the message they copy is overwritten;
+ * - the request ring is a single-producer single-consumer queue of [size (uint64_t)][request] items, the producer is
+ *   the client that owns the ring (see owner), the other clients send their requests on the PUSH socket.
+ *
+ * The server creates a larger object when a message does not fit, the clients reconnect when they see closed.
+ */
+struct GUIShmHeader
+{
+  static constexpr char magic[8] = {'M', 'C', 'R', 'T', 'C', 'G', 'U', 'I'};
+  static constexpr uint64_t layout_version = 1;
+
+  char magic_[8];
+  uint64_t version;
+  /** Size of a state buffer */
+  uint64_t capacity;
+  /** Size of the request ring */
+  uint64_t request_capacity;
+  /** Non-zero once the server is gone or moved to a new object */
+  std::atomic<uint64_t> closed;
+  /** Number of messages published, the last one is in buffer latest % 3 */
+  std::atomic<uint64_t> latest;
+  /** Sequence counter of each buffer, odd while it is written */
+  std::atomic<uint64_t> seq[3];
+  /** Size of the message in each buffer */
+  std::atomic<uint64_t> sizes[3];
+  /** Process id of the client that owns the request ring (0 if none) */
+  std::atomic<uint64_t> owner;
+  /** Position up to which the client wrote requests */
+  alignas(64) std::atomic<uint64_t> request_head;
+  /** Position up to which the server read requests */
+  alignas(64) std::atomic<uint64_t> request_tail;
+
+  static size_t header_size() noexcept { return (sizeof(GUIShmHeader) + 63) / 64 * 64; }
+
+  static size_t total_size(uint64_t capacity, uint64_t request_capacity) noexcept
+  {
+    return header_size() + 3 * capacity + request_capacity;
+  }
+
+  char * buffer(uint64_t i) noexcept { return reinterpret_cast<char *>(this) + header_size() + i * capacity; }
+
+  char * requests() noexcept { return buffer(3); }
+
+  void copy_in(uint64_t pos, const char * data, uint64_t size) noexcept
+  {
+    const uint64_t start = pos % request_capacity;
+    const uint64_t first = std::min<uint64_t>(size, request_capacity - start);
+    std::memcpy(requests() + start, data, first);
+    if(first < size) { std::memcpy(requests(), data + first, size - first); }
+  }
+
+  void copy_out(uint64_t pos, char * out, uint64_t size) noexcept
+  {
+    const uint64_t start = pos % request_capacity;
+    const uint64_t first = std::min<uint64_t>(size, request_capacity - start);
+    std::memcpy(out, requests() + start, first);
+    if(first < size) { std::memcpy(out + first, requests(), size - first); }
+  }
+};
+
+/** Server side of \ref GUIShmHeader
+ *
+ * publish() and receive() are called by the thread that sends the messages. When a message does not fit, it is dropped
+ * and a larger object is created in a background thread, publish() switches to it once it is ready.
+ */
+struct GUIShmWriter
+{
+  static constexpr uint64_t default_capacity = 4 * 1024 * 1024;
+  static constexpr uint64_t request_capacity = 1024 * 1024;
+
+  GUIShmWriter(const std::string & name, uint64_t capacity = default_capacity) : name_(name)
+  {
+    header_ = create(name_, capacity);
+    if(header_) { resize_thread_ = std::thread([this]() { resize(); }); }
+  }
+
+  GUIShmWriter(const GUIShmWriter &) = delete;
+  GUIShmWriter & operator=(const GUIShmWriter &) = delete;
+
+  ~GUIShmWriter()
+  {
+    if(resize_thread_.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(resize_mutex_);
+        run_ = false;
+      }
+      resize_cv_.notify_one();
+      resize_thread_.join();
+    }
+    for(auto * header : {header_, next_.exchange(nullptr), retired_.exchange(nullptr)})
+    {
+      if(!header) { continue; }
+      header->closed.store(1);
+      unmap(header);
+    }
+    if(header_) { shm_unlink(name_.c_str()); }
+  }
+
+  inline bool valid() const noexcept { return header_ != nullptr; }
+
+  /** Current capacity of a state buffer */
+  inline uint64_t capacity() const noexcept { return header_ ? header_->capacity : 0; }
+
+  /** Publish a message, never blocks
+   *
+   * \returns False if the message was dropped because it does not fit yet
+   */
+  bool publish(const char * data, uint64_t size)
+  {
+    if(!header_) { return false; }
+    auto * next = next_.load(std::memory_order_acquire);
+    if(next && !retired_.load(std::memory_order_acquire))
+    {
+      // The clients reconnect to the new object when they see the previous one is closed
+      next_.store(nullptr, std::memory_order_relaxed);
+      header_->closed.store(1);
+      retired_.store(header_, std::memory_order_release);
+      header_ = next;
+      resize_cv_.notify_one();
+    }
+    if(size > header_->capacity)
+    {
+      uint64_t capacity = header_->capacity;
+      while(capacity < 2 * size) { capacity *= 2; }
+      if(capacity > requested_.load(std::memory_order_relaxed))
+      {
+        requested_.store(capacity, std::memory_order_release);
+        resize_cv_.notify_one();
+      }
+      return false;
+    }
+    const uint64_t n = header_->latest.load(std::memory_order_relaxed) + 1;
+    const uint64_t b = n % 3;
+    const uint64_t seq = header_->seq[b].load(std::memory_order_relaxed);
+    header_->seq[b].store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header_->buffer(b), data, size);
+    header_->sizes[b].store(size, std::memory_order_relaxed);
+    header_->seq[b].store(seq + 2, std::memory_order_release);
+    header_->latest.store(n, std::memory_order_release);
+    return true;
+  }
+
+  /** Calls callback on every request written by the client */
+  template<typename CallbackT>
+  void receive(CallbackT && callback)
+  {
+    if(!header_) { return; }
+    uint64_t tail = header_->request_tail.load(std::memory_order_relaxed);
+    const uint64_t head = header_->request_head.load(std::memory_order_acquire);
+    while(tail != head)
+    {
+      uint64_t size = 0;
+      header_->copy_out(tail, reinterpret_cast<char *>(&size), sizeof(uint64_t));
+      if(size == 0 || head - tail < sizeof(uint64_t) + size)
+      {
+        mc_rtc::log::error("[ControllerServer] Corrupted request in the shared memory, dropping the pending requests");
+        tail = head;
+        break;
+      }
+      buffer_.resize(size);
+      header_->copy_out(tail + sizeof(uint64_t), buffer_.data(), size);
+      tail += sizeof(uint64_t) + size;
+      // Requests are null-terminated strings
+      buffer_.back() = 0;
+      callback(static_cast<const char *>(buffer_.data()));
+    }
+    header_->request_tail.store(tail, std::memory_order_release);
+  }
+
+private:
+  std::string name_;
+  /** Object used by publish() and receive() */
+  GUIShmHeader * header_ = nullptr;
+  /** Copy of the request being handled */
+  std::vector<char> buffer_;
+
+  /** Capacity requested by publish(), 0 if none */
+  std::atomic<uint64_t> requested_{0};
+  /** Object created by the resize thread, publish() switches to it */
+  std::atomic<GUIShmHeader *> next_{nullptr};
+  /** Object released by publish(), unmapped by the resize thread */
+  std::atomic<GUIShmHeader *> retired_{nullptr};
+  bool run_ = true;
+  std::mutex resize_mutex_;
+  std::condition_variable resize_cv_;
+  std::thread resize_thread_;
+
+  /** Create the objects requested by publish() and unmap the ones it released */
+  void resize()
+  {
+    std::unique_lock<std::mutex> lock(resize_mutex_);
+    while(run_)
+    {
+      // publish() notifies without the lock, the timeout covers a missed notification
+      resize_cv_.wait_for(lock, std::chrono::milliseconds(100));
+      if(auto * retired = retired_.load(std::memory_order_acquire))
+      {
+        unmap(retired);
+        retired_.store(nullptr, std::memory_order_release);
+      }
+      const uint64_t capacity = requested_.load(std::memory_order_acquire);
+      if(capacity == 0 || next_.load(std::memory_order_acquire) || retired_.load(std::memory_order_acquire))
+      {
+        continue;
+      }
+      // The name now refers to the new object, the clients of the previous one keep their mapping until it is closed
+      auto * next = create(name_, capacity);
+      requested_.store(0, std::memory_order_relaxed);
+      if(next) { next_.store(next, std::memory_order_release); }
+    }
+  }
+
+  static void unmap(GUIShmHeader * header) noexcept
+  {
+    munmap(header, GUIShmHeader::total_size(header->capacity, header->request_capacity));
+  }
+
+  static GUIShmHeader * create(const std::string & name, uint64_t capacity)
+  {
+    const size_t size = GUIShmHeader::total_size(capacity, request_capacity);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0)
+    {
+      mc_rtc::log::error("[ControllerServer] Failed to create the shared memory {}: {}", name, std::strerror(errno));
+      return nullptr;
+    }
+    if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+      mc_rtc::log::error("[ControllerServer] Failed to allocate the shared memory {}: {}", name, std::strerror(errno));
+      ::close(fd);
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    void * ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED)
+    {
+      mc_rtc::log::error("[ControllerServer] Failed to map the shared memory {}: {}", name, std::strerror(errno));
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    auto * header = new(ptr) GUIShmHeader{};
+    header->version = GUIShmHeader::layout_version;
+    header->capacity = capacity;
+    header->request_capacity = request_capacity;
+    // The magic number is written last, clients wait for it
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic_, GUIShmHeader::magic, sizeof(GUIShmHeader::magic));
+    return header;
+  }
+};
+
+/** Client side of \ref GUIShmHeader
+ *
+ * connect(), disconnect() and read() are called by the thread that receives the messages, push() can be called from
+ * any thread
+ */
+struct GUIShmReader
+{
+  GUIShmReader(const std::string & name) : name_(name) {}
+
+  GUIShmReader(const GUIShmReader &) = delete;
+  GUIShmReader & operator=(const GUIShmReader &) = delete;
+
+  ~GUIShmReader() { disconnect(); }
+
+  /** True if the reader is connected to a running server, connects if needed (at most once per second) */
+  bool connect()
+  {
+    if(header_ && header_->closed.load()) { disconnect(); }
+    if(header_) { return true; }
+    auto now = std::chrono::steady_clock::now();
+    if(now - t_attempt_ < std::chrono::seconds(1)) { return false; }
+    t_attempt_ = now;
+    int fd = shm_open(name_.c_str(), O_RDWR, 0);
+    if(fd < 0) { return false; }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < GUIShmHeader::header_size())
+    {
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void * ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED) { return false; }
+    auto * header = static_cast<GUIShmHeader *>(ptr);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(std::memcmp(header->magic_, GUIShmHeader::magic, sizeof(GUIShmHeader::magic)) != 0
+       || header->version != GUIShmHeader::layout_version
+       || GUIShmHeader::total_size(header->capacity, header->request_capacity) != size_ || header->closed.load())
+    {
+      munmap(header, size_);
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    header_ = header;
+    latest_ = 0;
+    owner_ = false;
+    return true;
+  }
+
+  void disconnect()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!header_) { return; }
+    if(owner_)
+    {
+      uint64_t pid = static_cast<uint64_t>(getpid());
+      header_->owner.compare_exchange_strong(pid, 0);
+    }
+    munmap(header_, size_);
+    header_ = nullptr;
+    owner_ = false;
+    // The server re-creates the memory when it closes it, look for it right away
+    t_attempt_ = {};
+  }
+
+  /** Copy the latest message into \p out if it was not read yet
+   *
+   * \returns The size of the message, 0 if there is no new message
+   */
+  size_t read(std::vector<char> & out)
+  {
+    if(!header_) { return 0; }
+    // Retry a few times if the server overwrote the buffer while it was copied
+    for(size_t attempt = 0; attempt < 3; ++attempt)
+    {
+      const uint64_t n = header_->latest.load(std::memory_order_acquire);
+      if(n == latest_) { return 0; }
+      const uint64_t b = n % 3;
+      const uint64_t seq = header_->seq[b].load(std::memory_order_acquire);
+      if(seq % 2 == 1) { continue; }
+      const uint64_t size = header_->sizes[b].load(std::memory_order_relaxed);
+      if(size > header_->capacity) { continue; }
+      if(out.size() < size) { out.resize(size); }
+      std::memcpy(out.data(), header_->buffer(b), size);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(header_->seq[b].load(std::memory_order_relaxed) != seq) { continue; }
+      latest_ = n;
+      return size;
+    }
+    return 0;
+  }
+
+  /** Write a request, returns false if this client cannot use the ring or the ring is full */
+  bool push(const char * data, uint64_t size)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!header_ || !own()) { return false; }
+    const uint64_t needed = sizeof(uint64_t) + size;
+    const uint64_t head = header_->request_head.load(std::memory_order_relaxed);
+    const uint64_t tail = header_->request_tail.load(std::memory_order_acquire);
+    if(head + needed - tail > header_->request_capacity) { return false; }
+    header_->copy_in(head, reinterpret_cast<const char *>(&size), sizeof(uint64_t));
+    header_->copy_in(head + sizeof(uint64_t), data, size);
+    header_->request_head.store(head + needed, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::string name_;
+  size_t size_ = 0;
+  GUIShmHeader * header_ = nullptr;
+  /** Last message read */
+  uint64_t latest_ = 0;
+  /** True if this client owns the request ring */
+  bool owner_ = false;
+  /** Last connection attempt */
+  std::chrono::steady_clock::time_point t_attempt_;
+  /** Protects the mapping and the request ring */
+  std::mutex mutex_;
+
+  /** Claim the request ring if it is free or its owner is gone */
+  bool own()
+  {
+    if(owner_) { return true; }
+    const uint64_t pid = static_cast<uint64_t>(getpid());
+    uint64_t current = header_->owner.load();
+    if(current != 0 && !(kill(static_cast<pid_t>(current), 0) != 0 && errno == ESRCH)) { return false; }
+    owner_ = header_->owner.compare_exchange_strong(current, pid);
+    return owner_;
+  }
+};
+
+} // namespace mc_control::internal
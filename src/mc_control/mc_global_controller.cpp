@@ -962,7 +962,8 @@ bool MCGlobalController::AddController(const std::string & name)
                                              [this](const std::string & name) { return EnableController(name); });
     if(config.enable_log)
     {
-      controllers[name]->logger().setup(config.log_policy, config.log_directory, config.log_template);
+      controllers[name]->logger().setup(config.log_policy, config.log_directory, config.log_template,
+                                        config.log_options);
     }
     controllers[name]->createObserverPipelines(config.controllers_configs[name]);
     return true;
@@ -994,7 +995,7 @@ bool MCGlobalController::AddController(const std::string & name, std::shared_ptr
   controllers[name] = controller;
   if(config.enable_log)
   {
-    controllers[name]->logger().setup(config.log_policy, config.log_directory, config.log_template);
+    controllers[name]->logger().setup(config.log_policy, config.log_directory, config.log_template, config.log_options);
   }
   return true;
 }
@@ -1061,6 +1062,10 @@ void MCGlobalController::setup_log()
   controller->logger().addLogEntry("perf_SolverSolve", [this]() { return solver_solve_t; });
   controller->logger().addLogEntry("perf_Log", [this]() { return log_dt.count(); });
   controller->logger().addLogEntry("perf_Gui", [this]() { return gui_dt.count(); });
+  if(server_ && server_->threaded())
+  {
+    controller->logger().addLogEntry("perf_GuiNetwork", [this]() { return server_->network_dt(); });
+  }
   controller->logger().addLogEntry("perf_FrameworkCost", [this]() { return framework_cost; });
   // Log system wall time as nanoseconds since epoch (can be used to manage synchronization with ros)
   controller->logger().addLogEntry("timeWall",
@@ -223,6 +223,31 @@ MCGlobalController::GlobalConfiguration::GlobalConfiguration(const std::string &
     if(v.size()) { log_directory = v; }
   }
   config("LogTemplate", log_template);
+  config("LogBufferSize", log_options.buffer_size);
+  if(auto compression = config.find("LogCompression"))
+  {
+    (*compression)("Enable", log_options.compress);
+    (*compression)("Level", log_options.compression_level);
+    (*compression)("BlockSize", log_options.compression_block_size);
+  }
+  if(auto delta = config.find("LogDeltaEncoding"))
+  {
+    (*delta)("Enable", log_options.delta);
+    (*delta)("KeyframeInterval", log_options.keyframe_interval);
+  }
+  config("LogHeldValues", log_options.held_values);
+  config("LogIndex", log_options.index);
+  if(auto rotation = config.find("LogRotation"))
+  {
+    (*rotation)("Size", log_options.rotate_size);
+    (*rotation)("Duration", log_options.rotate_duration);
+  }
+  config("LogDirectIO", log_options.direct_io);
+  if(auto tap = config.find("LogTap"))
+  {
+    (*tap)("Name", log_options.tap);
+    (*tap)("Size", log_options.tap_size);
+  }
 
   /////////////////////////
   //  GUI server options //
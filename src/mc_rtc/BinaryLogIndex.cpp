@@ -0,0 +1,207 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/log/BinaryLogIndex.h>
+
+#include "internals/BinaryLogReader.h"
+#include "internals/LogEntry.h"
+
+#include <boost/filesystem.hpp>
+namespace bfs = boost::filesystem;
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace mc_rtc::log
+{
+
+namespace
+{
+
+constexpr char magic[8] = {'M', 'C', 'R', 'T', 'C', 'I', 'D', 'X'};
+
+template<typename T>
+void write(std::ofstream & ofs, const T & value)
+{
+  ofs.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+bool read(std::ifstream & ifs, T & value)
+{
+  ifs.read(reinterpret_cast<char *>(&value), sizeof(T));
+  return ifs.good();
+}
+
+bool same_keys(const std::vector<BinaryLogIndex::Key> & lhs, const std::vector<internal::TypedKey> & rhs)
+{
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                    [](const auto & l, const auto & r) { return l.type == r.type && l.name == r.key; });
+}
+
+} // namespace
+
+const uint64_t BinaryLogIndex::version = 1;
+
+std::string BinaryLogIndex::path(const std::string & fpath)
+{
+  return fpath + ".idx";
+}
+
+bool BinaryLogIndex::load(const std::string & fpath)
+{
+  keys.clear();
+  points.clear();
+  boost::system::error_code ec;
+  // The index of a symlink (e.g. the latest log) is stored next to the actual log
+  auto log_path = bfs::canonical(fpath, ec).string();
+  if(ec) { return false; }
+  auto idx_path = path(log_path);
+  if(!bfs::exists(idx_path)) { return false; }
+  std::ifstream ifs(idx_path, std::ifstream::binary);
+  char m[sizeof(magic)];
+  uint64_t v = 0;
+  uint64_t n = 0;
+  if(!ifs.read(m, sizeof(m)) || std::memcmp(m, magic, sizeof(magic)) != 0 || !read(ifs, v) || v != version
+     || !read(ifs, log_size))
+  {
+    log::warning("{} is not a valid log index", idx_path);
+    return false;
+  }
+  if(log_size != bfs::file_size(log_path))
+  {
+    log::warning("{} is outdated, run mc_bin_utils index {} to update it", idx_path, fpath);
+    return false;
+  }
+  auto invalid = [&]()
+  {
+    log::warning("{} is a corrupted log index", idx_path);
+    keys.clear();
+    points.clear();
+    return false;
+  };
+  if(!read(ifs, n)) { return invalid(); }
+  for(uint64_t i = 0; i < n; ++i)
+  {
+    uint64_t n_keys = 0;
+    if(!read(ifs, n_keys)) { return invalid(); }
+    auto & table = keys.emplace_back();
+    for(uint64_t j = 0; j < n_keys; ++j)
+    {
+      uint64_t type = 0;
+      uint64_t size = 0;
+      if(!read(ifs, type) || !read(ifs, size) || size > log_size) { return invalid(); }
+      std::string name(size, '\0');
+      if(!ifs.read(name.data(), static_cast<std::streamsize>(size))) { return invalid(); }
+      table.push_back({static_cast<LogType>(type), std::move(name)});
+    }
+  }
+  if(!read(ifs, n) || n > log_size) { return invalid(); }
+  points.resize(n);
+  for(auto & p : points)
+  {
+    if(!read(ifs, p) || p.keys >= keys.size() || p.offset >= log_size) { return invalid(); }
+  }
+  return true;
+}
+
+bool BinaryLogIndex::save(const std::string & fpath) const
+{
+  boost::system::error_code ec;
+  auto log_path = bfs::canonical(fpath, ec);
+  auto idx_path = path(ec ? fpath : log_path.string());
+  std::ofstream ofs(idx_path, std::ofstream::binary);
+  if(!ofs.is_open())
+  {
+    log::error("Failed to open {} for writing", idx_path);
+    return false;
+  }
+  ofs.write(magic, sizeof(magic));
+  write(ofs, version);
+  write(ofs, log_size);
+  write(ofs, static_cast<uint64_t>(keys.size()));
+  for(const auto & table : keys)
+  {
+    write(ofs, static_cast<uint64_t>(table.size()));
+    for(const auto & k : table)
+    {
+      write(ofs, static_cast<uint64_t>(k.type));
+      write(ofs, static_cast<uint64_t>(k.name.size()));
+      ofs.write(k.name.data(), static_cast<std::streamsize>(k.name.size()));
+    }
+  }
+  write(ofs, static_cast<uint64_t>(points.size()));
+  for(const auto & p : points) { write(ofs, p); }
+  if(!ofs.good())
+  {
+    log::error("Failed to write log index {}", idx_path);
+    return false;
+  }
+  return true;
+}
+
+bool BinaryLogIndex::build(const std::string & fpath, size_t interval)
+{
+  keys.clear();
+  points.clear();
+  internal::BinaryLogReader reader;
+  if(!reader.open(fpath)) { return false; }
+  if(reader.version() < 1)
+  {
+    log::error("{} cannot be indexed (version 0 logs are not supported)", fpath);
+    return false;
+  }
+  std::vector<internal::TypedKey> log_keys;
+  std::optional<Logger::Meta> meta;
+  std::optional<size_t> t_index;
+  bool keys_saved = false;
+  size_t since_point = interval;
+  uint64_t offset = reader.offset();
+  const char * data = nullptr;
+  uint64_t size = 0;
+  while(reader.next(data, size))
+  {
+    bool keys_changed = false;
+    std::vector<Logger::GUIEvent> events;
+    internal::LogEntry entry(reader.version(), data, size, meta, log_keys, events, keys_changed, false);
+    if(!entry.valid()) { return false; }
+    if(keys_changed)
+    {
+      keys_saved = false;
+      auto t_it = std::find_if(log_keys.begin(), log_keys.end(), [](const auto & k) { return k.key == "t"; });
+      if(t_it != log_keys.end() && t_it->type == LogType::Double)
+      {
+        t_index = static_cast<size_t>(std::distance(log_keys.begin(), t_it));
+      }
+      else { t_index = std::nullopt; }
+    }
+    // A frame that changes the keys cannot be an index point: the index holds the keys after the frame
+    if(since_point >= interval && offset != internal::BinaryLogReader::npos && !keys_changed && t_index
+       && entry.complete())
+    {
+      if(!keys_saved && (keys.empty() || !same_keys(keys.back(), log_keys)))
+      {
+        auto & table = keys.emplace_back();
+        for(const auto & k : log_keys) { table.push_back({k.type, k.key}); }
+      }
+      keys_saved = true;
+      points.push_back({entry.getTime(*t_index), offset, keys.size() - 1});
+      since_point = 0;
+    }
+    since_point += 1;
+    offset = reader.offset();
+  }
+  log_size = bfs::file_size(fpath);
+  return true;
+}
+
+auto BinaryLogIndex::find(double t) const noexcept -> const Point *
+{
+  auto it = std::upper_bound(points.begin(), points.end(), t, [](double lhs, const Point & p) { return lhs < p.t; });
+  if(it == points.begin()) { return nullptr; }
+  return &*std::prev(it);
+}
+
+} // namespace mc_rtc::log
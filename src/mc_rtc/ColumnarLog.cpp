@@ -0,0 +1,327 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/log/ColumnarLog.h>
+#include <mc_rtc/log/FlatLog.h>
+
+#include "internals/LogEntry.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+namespace bip = boost::interprocess;
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+namespace mc_rtc::log
+{
+
+namespace
+{
+
+constexpr char magic[8] = {'M', 'C', 'R', 'T', 'C', 'C', 'O', 'L'};
+
+constexpr uint64_t no_time_column = std::numeric_limits<uint64_t>::max();
+
+struct Header
+{
+  char magic[8];
+  uint64_t version;
+  uint64_t size;
+  uint64_t n_columns;
+  uint64_t columns_offset;
+  uint64_t time_column;
+};
+
+/** Write 8-bytes aligned sections to a file and keep track of their offsets */
+struct SectionWriter
+{
+  SectionWriter(std::ofstream & ofs, uint64_t offset) : ofs_(ofs), offset_(offset) {}
+
+  template<typename T>
+  uint64_t write(const T * data, size_t n)
+  {
+    static const char zeros[8] = {};
+    uint64_t start = offset_;
+    size_t bytes = n * sizeof(T);
+    if(bytes) { ofs_.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(bytes)); }
+    size_t padding = (8 - bytes % 8) % 8;
+    ofs_.write(zeros, static_cast<std::streamsize>(padding));
+    offset_ += bytes + padding;
+    return start;
+  }
+
+private:
+  std::ofstream & ofs_;
+  uint64_t offset_;
+};
+
+template<typename T>
+void store(const T & value, typename details::ColumnTraits<T>::stored_t * out)
+{
+  if constexpr(std::is_arithmetic_v<T>) { *out = value; }
+  else if constexpr(std::is_same_v<T, Eigen::Quaterniond>)
+  {
+    std::memcpy(out, value.coeffs().data(), 4 * sizeof(double));
+  }
+  else if constexpr(std::is_same_v<T, sva::PTransformd>)
+  {
+    Eigen::Map<Eigen::Matrix3d>{out} = value.rotation();
+    Eigen::Map<Eigen::Vector3d>{out + 9} = value.translation();
+  }
+  else if constexpr(std::is_same_v<T, sva::ForceVecd>)
+  {
+    Eigen::Map<Eigen::Vector3d>{out} = value.couple();
+    Eigen::Map<Eigen::Vector3d>{out + 3} = value.force();
+  }
+  else if constexpr(std::is_same_v<T, sva::MotionVecd>)
+  {
+    Eigen::Map<Eigen::Vector3d>{out} = value.angular();
+    Eigen::Map<Eigen::Vector3d>{out + 3} = value.linear();
+  }
+  else { Eigen::Map<Eigen::Matrix<double, T::RowsAtCompileTime, 1>>{out} = value; }
+}
+
+template<typename T>
+ColumnarLog::Column writeColumn(const FlatLog & flat,
+                                const std::string & entry,
+                                SectionWriter & writer,
+                                std::vector<uint8_t> & valid)
+{
+  using traits = details::ColumnTraits<T>;
+  using stored_t = typename traits::stored_t;
+  auto records = flat.getRaw<T>(entry);
+  ColumnarLog::Column c;
+  c.name_size = entry.size();
+  c.name_offset = writer.write(entry.data(), entry.size());
+  c.type = static_cast<uint64_t>(GetLogType<T>::type);
+  c.stride = traits::stride;
+  std::vector<stored_t> data;
+  std::vector<uint64_t> offsets;
+  if constexpr(traits::stride == 0) { offsets.reserve(records.size() + 1); }
+  else { data.resize(traits::stride * records.size(), stored_t{}); }
+  for(size_t i = 0; i < records.size(); ++i)
+  {
+    const auto * r = records[i];
+    valid[i] = r != nullptr;
+    if constexpr(traits::stride == 0)
+    {
+      offsets.push_back(data.size());
+      if(r) { data.insert(data.end(), r->data(), r->data() + r->size()); }
+    }
+    else if(r) { store<T>(*r, data.data() + traits::stride * i); }
+  }
+  c.valid_offset = writer.write(valid.data(), valid.size());
+  if constexpr(traits::stride == 0)
+  {
+    offsets.push_back(data.size());
+    c.offsets_offset = writer.write(offsets.data(), offsets.size());
+  }
+  else { c.offsets_offset = 0; }
+  c.data_size = data.size() * sizeof(stored_t);
+  c.data_offset = writer.write(data.data(), data.size());
+  return c;
+}
+
+} // namespace
+
+const uint64_t ColumnarLog::version = 1;
+
+struct ColumnarLog::Impl
+{
+  bip::file_mapping file;
+  bip::mapped_region region;
+  const char * data = nullptr;
+  const Header * header = nullptr;
+  const Column * columns = nullptr;
+  std::unordered_map<std::string_view, size_t> index;
+};
+
+ColumnarLog::ColumnarLog() = default;
+
+ColumnarLog::ColumnarLog(const std::string & path)
+{
+  open(path);
+}
+
+ColumnarLog::~ColumnarLog() = default;
+
+ColumnarLog::ColumnarLog(ColumnarLog &&) = default;
+
+ColumnarLog & ColumnarLog::operator=(ColumnarLog &&) = default;
+
+bool ColumnarLog::open(const std::string & path)
+{
+  impl_.reset();
+  auto impl = std::make_unique<Impl>();
+  try
+  {
+    impl->file = bip::file_mapping(path.c_str(), bip::read_only);
+    impl->region = bip::mapped_region(impl->file, bip::read_only);
+  }
+  catch(const bip::interprocess_exception & exc)
+  {
+    log::error("Failed to open columnar log {}: {}", path, exc.what());
+    return false;
+  }
+  impl->data = static_cast<const char *>(impl->region.get_address());
+  uint64_t file_size = impl->region.get_size();
+  auto in_file = [&](uint64_t offset, uint64_t size)
+  { return offset <= file_size && size <= file_size - offset && offset % 8 == 0; };
+  if(!in_file(0, sizeof(Header)) || std::memcmp(impl->data, magic, sizeof(magic)) != 0)
+  {
+    log::error("{} is not a columnar log", path);
+    return false;
+  }
+  impl->header = reinterpret_cast<const Header *>(impl->data);
+  const auto & header = *impl->header;
+  if(header.version != version)
+  {
+    log::error("{} has an unsupported columnar log version ({}, expected {})", path, header.version, version);
+    return false;
+  }
+  if(header.n_columns > file_size / sizeof(Column)
+     || !in_file(header.columns_offset, header.n_columns * sizeof(Column)))
+  {
+    log::error("{} is a corrupted columnar log (invalid column directory)", path);
+    return false;
+  }
+  impl->columns = reinterpret_cast<const Column *>(impl->data + header.columns_offset);
+  for(size_t i = 0; i < header.n_columns; ++i)
+  {
+    const auto & c = impl->columns[i];
+    bool ok = in_file(c.name_offset, c.name_size) && in_file(c.valid_offset, header.size)
+              && in_file(c.data_offset, c.data_size);
+    auto check_data = [&](auto tag)
+    {
+      using traits = details::ColumnTraits<typename decltype(tag)::type>;
+      using stored_t = typename traits::stored_t;
+      if(c.stride != traits::stride) { ok = false; }
+      else if(traits::stride == 0)
+      {
+        ok = header.size < file_size && in_file(c.offsets_offset, (header.size + 1) * sizeof(uint64_t));
+        if(!ok) { return; }
+        auto offsets = reinterpret_cast<const uint64_t *>(impl->data + c.offsets_offset);
+        ok = std::is_sorted(offsets, offsets + header.size + 1)
+             && offsets[header.size] <= c.data_size / sizeof(stored_t);
+      }
+      else { ok = c.data_size / sizeof(stored_t) / traits::stride >= header.size; }
+    };
+    if(ok) { ok = internal::visitLogType(static_cast<LogType>(c.type), check_data) && ok; }
+    if(!ok)
+    {
+      log::error("{} is a corrupted columnar log (invalid column {})", path, i);
+      return false;
+    }
+    impl->index[std::string_view(impl->data + c.name_offset, c.name_size)] = i;
+  }
+  if(header.time_column != no_time_column
+     && (header.time_column >= header.n_columns
+         || impl->columns[header.time_column].type != static_cast<uint64_t>(LogType::Double)))
+  {
+    log::error("{} is a corrupted columnar log (invalid time column)", path);
+    return false;
+  }
+  impl_ = std::move(impl);
+  return true;
+}
+
+bool ColumnarLog::write(const FlatLog & flat, const std::string & path, const std::vector<std::string> & entries)
+{
+  std::ofstream ofs(path, std::ofstream::binary);
+  if(!ofs.is_open())
+  {
+    log::error("Failed to open {} for writing", path);
+    return false;
+  }
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.size = flat.size();
+  header.time_column = no_time_column;
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+  SectionWriter writer(ofs, sizeof(Header));
+  std::vector<Column> columns;
+  std::vector<uint8_t> valid(flat.size(), 0);
+  for(const auto & entry : flat.entries())
+  {
+    if(entries.size() && entry != "t" && std::find(entries.begin(), entries.end(), entry) == entries.end())
+    {
+      continue;
+    }
+    auto type = flat.type(entry);
+    internal::visitLogType(type,
+                           [&](auto tag)
+                           {
+                             if(entry == "t" && type == LogType::Double) { header.time_column = columns.size(); }
+                             columns.push_back(writeColumn<typename decltype(tag)::type>(flat, entry, writer, valid));
+                           });
+  }
+  header.n_columns = columns.size();
+  header.columns_offset = writer.write(columns.data(), columns.size());
+  ofs.seekp(0);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+  if(!ofs.good())
+  {
+    log::error("Failed to write columnar log {}", path);
+    return false;
+  }
+  return true;
+}
+
+size_t ColumnarLog::size() const noexcept
+{
+  return impl_ ? impl_->header->size : 0;
+}
+
+std::set<std::string> ColumnarLog::entries() const
+{
+  std::set<std::string> ret;
+  if(!impl_) { return ret; }
+  for(const auto & it : impl_->index) { ret.insert(std::string(it.first)); }
+  return ret;
+}
+
+bool ColumnarLog::has(const std::string & entry) const
+{
+  return column(entry) != nullptr;
+}
+
+LogType ColumnarLog::type(const std::string & entry) const
+{
+  const Column * c = column(entry);
+  return c ? static_cast<LogType>(c->type) : LogType::None;
+}
+
+auto ColumnarLog::time() const -> View<double>
+{
+  if(!impl_ || impl_->header->time_column == no_time_column) { return {}; }
+  const auto & c = impl_->columns[impl_->header->time_column];
+  return get<double>(std::string(impl_->data + c.name_offset, c.name_size));
+}
+
+size_t ColumnarLog::index(double t) const
+{
+  auto time = this->time();
+  if(time.empty()) { return size(); }
+  return static_cast<size_t>(std::lower_bound(time.data(), time.data() + time.size(), t) - time.data());
+}
+
+auto ColumnarLog::column(const std::string & entry) const -> const Column *
+{
+  if(!impl_) { return nullptr; }
+  auto it = impl_->index.find(entry);
+  if(it == impl_->index.end()) { return nullptr; }
+  return &impl_->columns[it->second];
+}
+
+const char * ColumnarLog::data() const noexcept
+{
+  return impl_ ? impl_->data : nullptr;
+}
+
+} // namespace mc_rtc::log
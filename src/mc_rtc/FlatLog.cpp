@@ -2,6 +2,7 @@
  * Copyright 2015-2019 CNRS-UM LIRMM, CNRS-AIST JRL
  */
 
+#include <mc_rtc/log/ColumnarLog.h>
 #include <mc_rtc/log/FlatLog.h>
 #include <mc_rtc/log/Logger.h>
 #include <mc_rtc/log/iterate_binary_log.h>
@@ -9,8 +10,13 @@
 #include <boost/filesystem.hpp>
 namespace bfs = boost::filesystem;
 
+#include "internals/BinaryLogReader.h"
 #include "internals/LogEntry.h"
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 namespace mc_rtc
 {
@@ -18,6 +24,237 @@ namespace mc_rtc
 namespace log
 {
 
+namespace
+{
+
+/** Keys of the log (and selection of keys) at a given frame */
+struct KeysState
+{
+  std::vector<internal::TypedKey> keys;
+  std::optional<internal::KeyFilter> filter;
+};
+
+/** A frame decoded by \ref decode_parallel */
+struct DecodedFrame
+{
+  size_t offset;
+  size_t size;
+  /** Keys active at this frame, nullptr if the frame was decoded with its events */
+  std::shared_ptr<KeysState> keys;
+  std::vector<std::string> keys_str;
+  std::vector<FlatLog::record> records;
+  std::vector<Logger::GUIEvent> events;
+  bool valid = true;
+};
+
+/** True if the frame has no events (and thus does not change the keys) */
+bool no_events(const char * data, size_t size)
+{
+  // A frame is a MessagePack array of size 2 (fixarray: 0x92) starting with nil (0xc0) when there is no event
+  return size >= 2 && static_cast<uint8_t>(data[0]) == 0x92 && static_cast<uint8_t>(data[1]) == 0xc0;
+}
+
+/** Frames read by \ref decode_parallel */
+struct DecodeBatch
+{
+  /** Data of the frames */
+  std::vector<char> data;
+  std::vector<DecodedFrame> frames;
+  /** Frames decoded by the workers */
+  std::vector<size_t> parallel;
+  /** Next element of parallel to decode */
+  std::atomic<size_t> next{0};
+  /** True if the log holds values (see Logger::HELD_VALUES) */
+  bool held_values = false;
+
+  void clear()
+  {
+    data.clear();
+    frames.clear();
+    parallel.clear();
+    next = 0;
+  }
+
+  /** Decode the frames of the batch until every frame has been taken by a thread */
+  void decode(int8_t version)
+  {
+    // Frames are taken by small groups to balance the work without contention on next
+    constexpr size_t chunk = 16;
+    std::optional<Logger::Meta> unused_meta;
+    std::vector<Logger::GUIEvent> unused_events;
+    for(size_t start = next.fetch_add(chunk); start < parallel.size(); start = next.fetch_add(chunk))
+    {
+      for(size_t i = start; i < std::min(start + chunk, parallel.size()); ++i)
+      {
+        auto & frame = frames[parallel[i]];
+        auto & frame_state = *frame.keys;
+        auto * filter = frame_state.filter ? &*frame_state.filter : nullptr;
+        bool keys_changed = false;
+        // Without events, keys and filter are not modified
+        internal::LogEntry entry(version, data.data() + frame.offset, frame.size, unused_meta, frame_state.keys,
+                                 unused_events, keys_changed, true, filter, held_values);
+        frame.valid = entry.valid();
+        frame.records = std::move(entry.records());
+      }
+    }
+  }
+};
+
+/** Worker threads that live for the whole decoding of a log and decode one batch at a time */
+struct DecodePool
+{
+  DecodePool(size_t workers, int8_t version) : version_(version)
+  {
+    for(size_t i = 0; i < workers; ++i) { workers_.emplace_back([this]() { run(); }); }
+  }
+
+  ~DecodePool()
+  {
+    {
+      std::lock_guard<std::mutex> lck(mtx_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for(auto & w : workers_) { w.join(); }
+  }
+
+  /** Start decoding \p batch in the workers, returns immediately */
+  void start(DecodeBatch & batch)
+  {
+    {
+      std::lock_guard<std::mutex> lck(mtx_);
+      batch_ = &batch;
+      generation_ += 1;
+    }
+    work_cv_.notify_all();
+  }
+
+  /** Help the workers with the current batch and wait until it is fully decoded */
+  void finish()
+  {
+    batch_->decode(version_);
+    std::unique_lock<std::mutex> lck(mtx_);
+    done_cv_.wait(lck, [this]() { return busy_ == 0; });
+    // Workers that wake up later must not touch the batch while it is filled again
+    batch_ = nullptr;
+  }
+
+private:
+  int8_t version_;
+  std::vector<std::thread> workers_;
+  std::mutex mtx_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  DecodeBatch * batch_ = nullptr;
+  size_t generation_ = 0;
+  /** Number of workers decoding batch_ */
+  size_t busy_ = 0;
+  bool stop_ = false;
+
+  void run()
+  {
+    size_t seen = 0;
+    std::unique_lock<std::mutex> lck(mtx_);
+    while(true)
+    {
+      work_cv_.wait(lck, [&]() { return stop_ || (batch_ && generation_ != seen); });
+      if(stop_) { return; }
+      seen = generation_;
+      DecodeBatch * batch = batch_;
+      busy_ += 1;
+      lck.unlock();
+      batch->decode(version_);
+      lck.lock();
+      if(--busy_ == 0) { done_cv_.notify_all(); }
+    }
+  }
+};
+
+/** Decode the frames of a binary log with several threads
+ *
+ * Frames are read by batches. Frames with events (that can change the keys) are decoded in order by the calling
+ * thread, the other frames are decoded by a pool of workers with the keys that are active at this frame. The calling
+ * thread reads the next batch while the workers decode the current one, then helps them. Finally, \p callback is
+ * called in order for every frame of the batch.
+ */
+template<typename CallbackT>
+bool decode_parallel(const std::string & f,
+                     const std::vector<std::string> & keys,
+                     size_t threads,
+                     std::optional<Logger::Meta> & meta,
+                     CallbackT && callback)
+{
+  internal::BinaryLogReader reader;
+  if(!reader.open(f)) { return false; }
+  auto state = std::make_shared<KeysState>();
+  if(keys.size()) { state->filter.emplace(keys); }
+  const size_t batch_size = 256 * threads;
+  bool done = false;
+  /** Read the next batch, returns false if the log is invalid */
+  auto read = [&](DecodeBatch & batch)
+  {
+    batch.clear();
+    const char * data = nullptr;
+    uint64_t size = 0;
+    while(batch.frames.size() < batch_size && !(done = !reader.next(data, size)))
+    {
+      auto & frame = batch.frames.emplace_back();
+      frame.offset = batch.data.size();
+      frame.size = size;
+      batch.data.insert(batch.data.end(), data, data + size);
+      if(no_events(data, size))
+      {
+        frame.keys = state;
+        batch.parallel.push_back(batch.frames.size() - 1);
+        continue;
+      }
+      state = std::make_shared<KeysState>(*state);
+      auto * filter = state->filter ? &*state->filter : nullptr;
+      bool keys_changed = false;
+      internal::LogEntry entry(reader.version(), data, size, meta, state->keys, frame.events, keys_changed, true,
+                               filter, batch.held_values);
+      if(!entry.valid()) { return false; }
+      frame.records = std::move(entry.records());
+      if(keys_changed && filter)
+      {
+        for(auto i : filter->selected) { frame.keys_str.push_back(state->keys[i].key); }
+      }
+      else if(keys_changed)
+      {
+        for(const auto & k : state->keys) { frame.keys_str.push_back(k.key); }
+      }
+    }
+    return true;
+  };
+  // Declared before the pool so that they outlive the workers
+  DecodeBatch batches[2];
+  for(auto & batch : batches) { batch.held_values = reader.features() & Logger::HELD_VALUES; }
+  DecodePool pool(threads - 1, reader.version());
+  size_t current = 0;
+  if(!read(batches[current])) { return false; }
+  pool.start(batches[current]);
+  while(batches[current].frames.size())
+  {
+    // Read the next batch while the workers decode the current one
+    auto & next = batches[1 - current];
+    next.clear();
+    const bool valid = done || read(next);
+    pool.finish();
+    if(!valid) { return false; }
+    for(auto & frame : batches[current].frames)
+    {
+      if(!frame.valid) { return false; }
+      callback(frame.keys_str, frame.records, frame.events);
+    }
+    current = 1 - current;
+    pool.start(batches[current]);
+  }
+  pool.finish();
+  return true;
+}
+
+} // namespace
+
 FlatLog::record::record() : type(), data(nullptr, internal::void_deleter<int>) {}
 
 FlatLog::FlatLog(const std::string & fpath)
@@ -25,32 +262,61 @@ FlatLog::FlatLog(const std::string & fpath)
   load(fpath);
 }
 
+FlatLog::FlatLog(const std::string & fpath, size_t threads) : threads_(threads)
+{
+  load(fpath);
+}
+
 void FlatLog::load(const std::string & fpath)
+{
+  load(fpath, {});
+}
+
+void FlatLog::load(const std::string & fpath, const std::vector<std::string> & keys)
 {
   data_.clear();
-  append(fpath);
+  index_.clear();
+  append(fpath, keys);
 }
 
-void FlatLog::append(const std::string & f)
+void FlatLog::append(const std::string & fpath)
+{
+  append(fpath, {});
+}
+
+void FlatLog::append(const std::string & f, const std::vector<std::string> & keys)
 {
   auto fpath = bfs::path(f);
-  if(fpath.extension() == ".flat") { appendFlat(f); }
-  else { appendBin(f); }
+  if(fpath.extension() == ".flat") { appendFlat(f, keys); }
+  else if(fpath.extension() == ".col") { appendColumnar(f, keys); }
+  else
+  {
+    appendBin(f, keys);
+    // Rotated logs are continued in the next parts, the latest log symlink points to the first part
+    boost::system::error_code ec;
+    auto first = bfs::canonical(fpath, ec);
+    if(ec) { return; }
+    for(size_t part = 2;; ++part)
+    {
+      auto next = Logger::partPath(first.string(), part);
+      if(!bfs::exists(next)) { break; }
+      appendBin(next, keys);
+    }
+  }
 }
 
-void FlatLog::appendBin(const std::string & f)
+void FlatLog::appendBin(const std::string & f, const std::vector<std::string> & keys)
 {
   std::vector<size_t> currentIndexes = {};
   std::vector<size_t> missingIndexes = {};
-  size_t size = data_.size() ? data_[0].records.size() : 0;
-  mc_rtc::log::iterate_binary_log_callback callback = [&](IterateBinaryLogData data)
+  size_t size = this->size();
+  auto append_frame = [&](const std::vector<std::string> & ks, std::vector<record> & records,
+                          std::vector<Logger::GUIEvent> & gui_events)
   {
-    if(!meta_ && data.meta) { meta_ = data.meta; }
-    const auto & ks = data.keys;
-    auto & records = data.records;
-    if(ks.size())
+    // When every (selected) key is removed the keys are empty but the records no longer match
+    if(ks.size() || records.size() != currentIndexes.size())
     {
-      for(const auto & k : missingIndexes) { data_[k].records.resize(size); }
+      for(const auto & k : missingIndexes) { data_[k].types.resize(size); }
       currentIndexes.clear();
       for(const auto & k : ks) { currentIndexes.push_back(index(k, size)); }
       missingIndexes.clear();
@@ -64,18 +330,81 @@ void FlatLog::appendBin(const std::string & f)
     }
     for(size_t i = 0; i < records.size(); ++i)
     {
-      auto & out = data_[currentIndexes[i]].records;
-      out.push_back(std::move(records[i]));
+      auto & out = data_[currentIndexes[i]];
+      auto & r = records[i];
+      if(r.data) { get_column(out, r.type).set(size, r.data.get()); }
+      // The entry was not written in this frame, hold the previous value
+      else if(r.type != LogType::None && size && out.types.back() == r.type) { get_column(out, r.type).hold(size); }
+      else
+      {
+        out.types.push_back(LogType::None);
+        continue;
+      }
+      out.types.push_back(r.type);
     }
-    gui_events_.push_back(std::move(data.gui_events));
+    gui_events_.push_back(std::move(gui_events));
     size += 1;
-    return true;
   };
-  iterate_binary_log(f, callback, true, "");
-  for(const auto & k : missingIndexes) { data_[k].records.resize(size); }
+  size_t threads = threads_ == 0 ? std::thread::hardware_concurrency() : threads_;
+  if(threads > 1)
+  {
+    std::optional<Logger::Meta> meta;
+    decode_parallel(f, keys, threads, meta, append_frame);
+    if(!meta_) { meta_ = meta; }
+  }
+  else
+  {
+    mc_rtc::log::iterate_binary_log_callback callback = [&](IterateBinaryLogData data)
+    {
+      if(!meta_ && data.meta) { meta_ = data.meta; }
+      append_frame(data.keys, data.records, data.gui_events);
+      return true;
+    };
+    if(keys.empty()) { iterate_binary_log(f, callback, true, ""); }
+    else { iterate_binary_log(f, callback, keys, true, ""); }
+  }
+  for(const auto & k : missingIndexes) { data_[k].types.resize(size); }
 }
 
-void FlatLog::appendFlat(const std::string & f)
+void FlatLog::appendColumnar(const std::string & f, const std::vector<std::string> & keys)
+{
+  ColumnarLog col(f);
+  internal::KeyFilter filter(keys);
+  size_t size = this->size();
+  for(const auto & entry : col.entries())
+  {
+    if(keys.size() && !filter.match(entry)) { continue; }
+    auto & out = data_[index(entry, size)];
+    out.types.reserve(size + col.size());
+    internal::visitLogType(col.type(entry),
+                           [&](auto tag)
+                           {
+                             using T = typename decltype(tag)::type;
+                             auto & column = static_cast<typed_column<T> &>(get_column(out, GetLogType<T>::type));
+                             column.data.resize(size + col.size());
+                             auto view = col.get<T>(entry);
+                             for(size_t i = 0; i < view.size(); ++i)
+                             {
+                               if(!view.valid(i))
+                               {
+                                 out.types.push_back(LogType::None);
+                                 continue;
+                               }
+                               auto & value = column.data[size + i].value;
+                               if constexpr(std::is_same_v<T, std::vector<double>>)
+                               {
+                                 auto v = view[i];
+                                 value.assign(v.data(), v.data() + v.size());
+                               }
+                               else { value = view[i]; }
+                               out.types.push_back(GetLogType<T>::type);
+                             }
+                           });
+  }
+  for(auto & e : data_) { e.types.resize(size + col.size()); }
+}
+
+void FlatLog::appendFlat(const std::string & f, const std::vector<std::string> & keys)
 {
   auto fpath = bfs::path(f);
   if(!bfs::exists(f) || !bfs::is_regular(f))
@@ -89,11 +418,11 @@ void FlatLog::appendFlat(const std::string & f)
     log::error("Failed to open {}", f);
     return;
   }
-  size_t size = 0;
-  if(data_.size()) { size = data_[0].records.size(); }
+  internal::KeyFilter filter(keys);
+  size_t size = this->size();
   uint64_t nEntries = 0;
   ifs.read((char *)&nEntries, sizeof(uint64_t));
-  size_t nsize = 0;
+  size_t nsize = size;
   for(size_t i = 0; i < nEntries; ++i)
   {
     bool is_numeric = false;
@@ -102,49 +431,59 @@ void FlatLog::appendFlat(const std::string & f)
     ifs.read((char *)&sz, sizeof(uint64_t));
     std::string key(sz, '0');
     ifs.read(&key[0], static_cast<int>(sz * sizeof(char)));
-    auto idx = index(key, size);
     ifs.read((char *)&sz, sizeof(uint64_t));
-    auto & entries = data_[idx].records;
+    if(keys.size() && !filter.match(key))
+    {
+      if(is_numeric) { ifs.seekg(static_cast<std::streamoff>(sz * sizeof(double)), std::ios_base::cur); }
+      else
+      {
+        for(size_t i = 0; i < sz; ++i)
+        {
+          uint64_t str_sz = 0;
+          ifs.read((char *)&str_sz, sizeof(uint64_t));
+          ifs.seekg(static_cast<std::streamoff>(str_sz), std::ios_base::cur);
+        }
+      }
+      continue;
+    }
+    auto idx = index(key, size);
+    auto & entry = data_[idx];
+    entry.types.reserve(entry.types.size() + sz);
     for(size_t i = 0; i < sz; ++i)
     {
       if(is_numeric)
       {
         double data = 0;
         ifs.read((char *)&data, sizeof(double));
-        if(std::isnan(data))
-        {
-          entries.emplace_back(LogType::None, record::unique_void_ptr{nullptr, internal::void_deleter<int>});
-        }
+        if(std::isnan(data)) { entry.types.push_back(LogType::None); }
         else
         {
-          entries.emplace_back(LogType::Double,
-                               record::unique_void_ptr{new double(data), internal::void_deleter<double>});
+          get_column(entry, LogType::Double).set(entry.types.size(), &data);
+          entry.types.push_back(LogType::Double);
         }
       }
       else
       {
         uint64_t str_sz = 0;
         ifs.read((char *)&str_sz, sizeof(uint64_t));
-        if(str_sz == 0)
-        {
-          entries.emplace_back(LogType::None, record::unique_void_ptr{nullptr, internal::void_deleter<int>});
-        }
+        if(str_sz == 0) { entry.types.push_back(LogType::None); }
         else
         {
-          std::string * str = new std::string(str_sz, '0');
-          ifs.read(&((*str)[0]), static_cast<int>(str_sz * sizeof(char)));
-          entries.emplace_back(LogType::String, record::unique_void_ptr{str, internal::void_deleter<std::string>});
+          std::string str(str_sz, '0');
+          ifs.read(&str[0], static_cast<int>(str_sz * sizeof(char)));
+          get_column(entry, LogType::String).set(entry.types.size(), &str);
+          entry.types.push_back(LogType::String);
         }
       }
     }
-    nsize = entries.size();
+    nsize = entry.types.size();
   }
-  for(auto & e : data_) { e.records.resize(nsize); }
+  for(auto & e : data_) { e.types.resize(nsize); }
 }
 
 size_t FlatLog::size() const
 {
-  return data_.size() == 0 ? 0 : data_[0].records.size();
+  return data_.size() == 0 ? 0 : data_[0].types.size();
 }
 
 std::set<std::string> FlatLog::entries() const
@@ -156,77 +495,88 @@ std::set<std::string> FlatLog::entries() const
 
 bool FlatLog::has(const std::string & entry) const
 {
-  return std::find_if(data_.begin(), data_.end(), [&entry](const FlatLog::entry & e) { return e.name == entry; })
-         != data_.end();
+  return index_.count(entry) != 0;
 }
 
 std::set<LogType> FlatLog::types(const std::string & entry) const
 {
-  if(!has(entry))
+  const auto * e = find(entry);
+  if(!e)
   {
     log::error("No entry named {} in the loaded log", entry);
     return {};
   }
   std::set<LogType> ret;
-  for(const auto & r : at(entry)) { ret.insert(r.type); }
-  ret.erase(mc_rtc::log::LogType::None);
+  for(const auto & c : e->columns) { ret.insert(c->type); }
   return ret;
 }
 
 LogType FlatLog::type(const std::string & entry) const
 {
-  if(!has(entry))
+  const auto * e = find(entry);
+  if(!e)
   {
     log::error("No entry named {} in the loaded log", entry);
     return {};
   }
-  for(const auto & r : at(entry))
+  for(const auto & t : e->types)
   {
-    if(r.type != mc_rtc::log::LogType::None) { return r.type; }
+    if(t != mc_rtc::log::LogType::None) { return t; }
   }
   return mc_rtc::log::LogType::None;
 }
 
 LogType FlatLog::type(const std::string & entry, size_t i) const
 {
-  if(!has(entry))
+  const auto * e = find(entry);
+  if(!e)
   {
     log::error("No entry named {} in the loaded log", entry);
     return LogType::None;
   }
-  const auto & records = at(entry);
-  if(i >= records.size())
+  if(i >= e->types.size())
   {
-    log::error("Requested data ({}) out of available range ({}, available: {})", entry, i, records.size());
+    log::error("Requested data ({}) out of available range ({}, available: {})", entry, i, e->types.size());
     return LogType::None;
   }
-  return records[i].type;
+  return e->types[i];
 }
 
-const std::vector<FlatLog::record> & FlatLog::at(const std::string & entry) const
+auto FlatLog::find(const std::string & entry) const noexcept -> const FlatLog::entry *
 {
-  for(const auto & d : data_)
-  {
-    if(d.name == entry) { return d.records; }
-  }
-  throw(std::runtime_error("No such entry"));
+  auto it = index_.find(entry);
+  if(it == index_.end()) { return nullptr; }
+  return &data_[it->second];
 }
 
 size_t FlatLog::index(const std::string & entry, size_t size)
 {
-  for(size_t i = 0; i < data_.size(); ++i)
+  auto it = index_.find(entry);
+  if(it != index_.end())
   {
-    auto & e = data_[i];
-    if(e.name == entry)
-    {
-      e.records.resize(size);
-      return i;
-    }
+    data_[it->second].types.resize(size);
+    return it->second;
   }
-  data_.push_back({entry, std::vector<FlatLog::record>{size}});
+  index_[entry] = data_.size();
+  data_.push_back({entry, std::vector<LogType>(size, LogType::None), {}});
   return data_.size() - 1;
 }
 
+auto FlatLog::get_column(entry & e, LogType type) -> column &
+{
+  for(auto & c : e.columns)
+  {
+    if(c->type == type) { return *c; }
+  }
+  internal::visitLogType(type,
+                         [&](auto tag)
+                         {
+                           using T = typename decltype(tag)::type;
+                           e.columns.push_back(std::make_unique<typed_column<T>>());
+                         });
+  return *e.columns.back();
+}
+
 } // namespace log
 
 } // namespace mc_rtc
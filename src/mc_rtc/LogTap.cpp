@@ -0,0 +1,223 @@
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/log/LogTap.h>
+
+#include "internals/FrameDecoder.h"
+
+#ifndef _WIN32
+#  include "internals/LogTap.h"
+#  include <sys/stat.h>
+#endif
+
+namespace mc_rtc::log
+{
+
+#ifndef _WIN32
+
+struct LogTapImpl
+{
+  LogTapImpl(const std::string & name, const std::vector<std::string> & keys, bool extract, const std::string & time)
+  : name_(name), extract_(extract), time_(time)
+  {
+    if(keys.size()) { filter_ = std::make_unique<internal::KeyFilter>(keys); }
+  }
+
+  ~LogTapImpl() { disconnect(); }
+
+  bool connect()
+  {
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if(fd < 0) { return false; }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < internal::LogTapHeader::size())
+    {
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void * ptr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED) { return false; }
+    header_ = static_cast<internal::LogTapHeader *>(ptr);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(std::memcmp(header_->magic_, internal::LogTapHeader::magic, sizeof(internal::LogTapHeader::magic)) != 0
+       || header_->version != internal::LogTapHeader::layout_version
+       || internal::LogTapHeader::size() + header_->snapshot_capacity + header_->capacity != size_)
+    {
+      disconnect();
+      return false;
+    }
+    // The frames are those of the Logger, the entries are not written in every frame when it holds values
+    decoder_ = std::make_unique<internal::FrameDecoder>(static_cast<int8_t>(header_->log_version), filter_.get(),
+                                                        extract_, time_, true);
+    synced_ = false;
+    return true;
+  }
+
+  void disconnect()
+  {
+    if(header_) { munmap(header_, size_); }
+    header_ = nullptr;
+    decoder_.reset();
+  }
+
+  /** Start reading at the last frame with the keys of the snapshot */
+  bool sync()
+  {
+    const uint64_t seq = header_->snapshot_seq.load(std::memory_order_acquire);
+    // No snapshot yet or being written
+    if(seq == 0 || seq % 2 == 1) { return false; }
+    const uint64_t size = header_->snapshot_size.load(std::memory_order_relaxed);
+    if(size == 0 || size > header_->snapshot_capacity) { return false; }
+    buffer_.resize(size);
+    std::memcpy(buffer_.data(), header_->snapshot(), size);
+    const uint64_t next = header_->snapshot_next.load(std::memory_order_relaxed);
+    const uint64_t last = header_->last_frame.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // The keys changed while the snapshot was read, try again on the next read
+    if(header_->snapshot_seq.load(std::memory_order_relaxed) != seq) { return false; }
+    std::vector<internal::TypedKey> keys;
+    std::vector<Logger::GUIEvent> events;
+    bool keys_changed = false;
+    decoder_->meta = std::nullopt;
+    internal::LogEntry snapshot(static_cast<int8_t>(header_->log_version), buffer_.data(), size, decoder_->meta, keys,
+                                events, keys_changed, false);
+    if(!snapshot.valid()) { return false; }
+    decoder_->reset(std::move(keys));
+    pos_ = std::max(next, last);
+    synced_ = true;
+    return true;
+  }
+
+  /** Copy \p size bytes at position \p pos of the ring into \p out */
+  void copy_out(uint64_t pos, char * out, uint64_t size)
+  {
+    const uint64_t capacity = header_->capacity;
+    const uint64_t start = pos % capacity;
+    const uint64_t first = std::min<uint64_t>(size, capacity - start);
+    std::memcpy(out, header_->ring() + start, first);
+    if(first < size) { std::memcpy(out + first, header_->ring(), size - first); }
+  }
+
+  /** True if the data at \p pos has not been overwritten */
+  bool intact(uint64_t pos)
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->reserve.load(std::memory_order_relaxed) <= pos + header_->capacity;
+  }
+
+  /** The reader was too slow, it starts again at the last frame */
+  void overrun()
+  {
+    dropped_ += 1;
+    synced_ = false;
+  }
+
+  size_t read(const iterate_binary_log_callback & callback, size_t max_frames)
+  {
+    if(!header_ && !connect()) { return 0; }
+    if(header_->closed.load())
+    {
+      // The Logger is gone, the next call connects to the next one
+      disconnect();
+      return 0;
+    }
+    size_t n = 0;
+    while(max_frames == 0 || n < max_frames)
+    {
+      if(!synced_ && !sync()) { break; }
+      const uint64_t head = header_->head.load(std::memory_order_acquire);
+      if(pos_ == head) { break; }
+      uint64_t size = 0;
+      copy_out(pos_, reinterpret_cast<char *>(&size), sizeof(uint64_t));
+      if(!intact(pos_) || head - pos_ < sizeof(uint64_t) + size)
+      {
+        overrun();
+        continue;
+      }
+      buffer_.resize(size);
+      copy_out(pos_ + sizeof(uint64_t), buffer_.data(), size);
+      if(!intact(pos_))
+      {
+        overrun();
+        continue;
+      }
+      pos_ += sizeof(uint64_t) + size;
+      n += 1;
+      auto result = decoder_->decode(buffer_.data(), size, callback);
+      if(result == internal::FrameDecoder::Result::Error) { synced_ = false; }
+      if(result != internal::FrameDecoder::Result::Continue) { break; }
+    }
+    return n;
+  }
+
+  std::string name_;
+  std::unique_ptr<internal::KeyFilter> filter_;
+  bool extract_;
+  std::string time_;
+  internal::LogTapHeader * header_ = nullptr;
+  size_t size_ = 0;
+  std::unique_ptr<internal::FrameDecoder> decoder_;
+  /** Copy of the frame being decoded */
+  std::vector<char> buffer_;
+  /** Position of the next frame */
+  uint64_t pos_ = 0;
+  bool synced_ = false;
+  size_t dropped_ = 0;
+};
+
+LogTap::LogTap(const std::string & name, const std::vector<std::string> & keys, bool extract, const std::string & time)
+: impl_(new LogTapImpl(name, keys, extract, time))
+{
+}
+
+LogTap::~LogTap() {}
+
+bool LogTap::connected() const noexcept
+{
+  return impl_->header_ && !impl_->header_->closed.load();
+}
+
+size_t LogTap::read(const iterate_binary_log_callback & callback, size_t max_frames)
+{
+  return impl_->read(callback, max_frames);
+}
+
+size_t LogTap::dropped() const noexcept
+{
+  return impl_->dropped_;
+}
+
+#else
+
+struct LogTapImpl
+{
+};
+
+LogTap::LogTap(const std::string &, const std::vector<std::string> &, bool, const std::string &)
+{
+  mc_rtc::log::error("LogTap is not supported on this platform");
+}
+
+LogTap::~LogTap() {}
+
+bool LogTap::connected() const noexcept
+{
+  return false;
+}
+
+size_t LogTap::read(const iterate_binary_log_callback &, size_t)
+{
+  return 0;
+}
+
+size_t LogTap::dropped() const noexcept
+{
+  return 0;
+}
+
+#endif
+
+} // namespace mc_rtc::log
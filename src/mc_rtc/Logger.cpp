@@ -2,15 +2,38 @@
  * Copyright 2015-2019 CNRS-UM LIRMM, CNRS-AIST JRL
  */
 
+#include <mc_rtc/log/BinaryLogIndex.h>
 #include <mc_rtc/log/Logger.h>
 #include <mc_rtc/utils.h>
 
 #include <boost/filesystem.hpp>
+
+#include "mpack.h"
 namespace bfs = boost::filesystem;
 
+#ifdef MC_RTC_HAS_ZSTD
+#  include <zstd.h>
+#endif
+
+#ifdef MC_RTC_HAS_IO_URING
+#  include "internals/DirectLogFile.h"
+#endif
+
+#ifndef _WIN32
+#  include "internals/LogTap.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iomanip>
+#include <limits>
+#include <mutex>
+#include <optional>
 #include <thread>
 
 namespace mc_rtc
@@ -18,20 +41,92 @@ namespace mc_rtc
 
 const uint8_t Logger::magic[4] = {0x41, 0x4e, 0x4e, 0x45};
 
-const uint8_t Logger::version = 1;
+const uint8_t Logger::version = 2;
+
+bool Logger::supports(uint32_t features) noexcept
+{
+#ifdef MC_RTC_HAS_ZSTD
+  constexpr uint32_t supported = COMPRESSED | HELD_VALUES;
+#else
+  constexpr uint32_t supported = HELD_VALUES;
+#endif
+  return (features & ~supported) == 0;
+}
 
 struct LoggerImpl
 {
-  LoggerImpl(const std::string & directory, const std::string & tmpl)
+  LoggerImpl(const std::string & directory, const std::string & tmpl, const Logger::Options & options)
   : data_(1024 * 1024), directory(directory), tmpl(tmpl)
   {
+    if(options.compress)
+    {
+      if(Logger::supports(Logger::COMPRESSED))
+      {
+        features_ |= Logger::COMPRESSED;
+        compression_level_ = options.compression_level;
+        compression_block_size_ = std::max<size_t>(options.compression_block_size, 1);
+      }
+      else { mc_rtc::log::warning("[Logger] mc_rtc was built without zstd support, the log will not be compressed"); }
+    }
+    delta_ = options.delta;
+    always_held_ = options.held_values;
+    keyframe_interval_ = std::max<size_t>(options.keyframe_interval, 1);
+    index_ = options.index;
+    rotate_size_ = options.rotate_size;
+    rotate_duration_ = options.rotate_duration;
+    if(options.direct_io)
+    {
+#ifdef MC_RTC_HAS_IO_URING
+      direct_ = std::make_unique<log::internal::DirectLogFile>();
+      if(!direct_->valid())
+      {
+        mc_rtc::log::warning("[Logger] io_uring is not available, the log will be written through the page cache");
+        direct_.reset();
+      }
+#else
+      mc_rtc::log::warning("[Logger] Direct I/O is not supported on this platform, the log will be written through the "
+                           "page cache");
+#endif
+    }
+    if(options.tap.size())
+    {
+#ifndef _WIN32
+      // The content of the frames did not change since version 1
+      tap_ = std::make_unique<log::internal::LogTapWriter>(options.tap, std::max<size_t>(options.tap_size, 1024), 1);
+      if(!tap_->valid()) { tap_.reset(); }
+#else
+      mc_rtc::log::warning("[Logger] The log tap is not supported on this platform");
+#endif
+    }
   }
 
-  virtual ~LoggerImpl() {}
+  virtual ~LoggerImpl()
+  {
+    if(is_open()) { close(); }
+#ifdef MC_RTC_HAS_ZSTD
+    ZSTD_freeCCtx(zctx_);
+#endif
+  }
+
+  /** Kind of frame given to \ref write */
+  enum class Frame
+  {
+    /** A regular frame */
+    Regular,
+    /** The frame is a point of the log index */
+    IndexPoint,
+    /** The frame is the first frame of the next part of the log */
+    NextPart
+  };
 
   virtual void initialize(const bfs::path & path) = 0;
-  virtual void write(char * data, size_t size) = 0;
+  /** Write a frame
+   *
+   * \returns False if the frame could not be written
+   */
+  virtual bool write(char * data, size_t size, Frame frame) = 0;
   virtual void flush() {}
+  virtual Logger::BufferStats stats() const { return {}; }
 
   std::vector<char> data_;
 
@@ -41,23 +136,448 @@ struct LoggerImpl
   bool valid_ = true;
   std::string path_ = "";
   std::ofstream log_;
+  /** Delta encoding of the log entries */
+  bool delta_ = false;
+  /** True if the current file uses Logger::HELD_VALUES, set before the file is opened */
+  bool held_values_ = false;
+  /** Every file uses Logger::HELD_VALUES (see Logger::Options::held_values) */
+  bool always_held_ = false;
+  /** True once the policies ignored in a file that does not hold values were reported */
+  bool warned_policy_ = false;
+  size_t keyframe_interval_ = 1;
+  /** Number of frames written since the last keyframe */
+  size_t frames_since_keyframe_ = 0;
+  /** Serialized values of the entries (delta encoding) */
+  std::vector<char> values_data_;
+  /** Serialization of an entry that is written as a fixed number of doubles (see Logger::update_fixed_layout) */
+  struct FixedEntry
+  {
+    /** True if the entry is serialized this way */
+    bool enabled = false;
+    /** Number of values, the header is written again when it changes and the entry still fits */
+    size_t size = std::numeric_limits<size_t>::max();
+    /** Offset of the serialized entry in fixed_data_ */
+    size_t offset = 0;
+    /** Size of the array header before the values (0 for a double) */
+    size_t header = 0;
+    /** Space reserved for the entry in fixed_data_ */
+    size_t capacity = 0;
+
+    static size_t header_size(size_t n, bool array)
+    {
+      return !array ? 0 : (n <= 15 ? 1 : (n <= std::numeric_limits<uint16_t>::max() ? 3 : 5));
+    }
+
+    /** True if the entry with \p n values fits in the space reserved for it */
+    bool fits(size_t n, bool array) const { return header_size(n, array) + 9 * n <= capacity; }
+
+    /** Serialize the entry with \p n values in \p data, the values themselves are written in every frame
+     *
+     * \p data only grows if the entry does not fit in the space reserved for it
+     */
+    void resize(std::vector<char> & data, size_t n, bool array)
+    {
+      const size_t header_size = FixedEntry::header_size(n, array);
+      const size_t needed = header_size + 9 * n;
+      if(needed > capacity)
+      {
+        offset = data.size();
+        capacity = needed;
+        data.resize(data.size() + needed);
+      }
+      size = n;
+      header = header_size;
+      char * out = data.data() + offset;
+      if(header == 1) { out[0] = static_cast<char>(0x90 | n); }
+      else if(header == 3)
+      {
+        out[0] = static_cast<char>(0xdc);
+        mpack_store_u16(out + 1, static_cast<uint16_t>(n));
+      }
+      else if(header == 5)
+      {
+        out[0] = static_cast<char>(0xdd);
+        mpack_store_u32(out + 1, static_cast<uint32_t>(n));
+      }
+      for(size_t i = 0; i < n; ++i) { out[header + 9 * i] = static_cast<char>(0xcb); }
+    }
+  };
+  /** Layout of each entry, it is reset when the keys change */
+  std::vector<FixedEntry> fixed_layout_;
+  bool fixed_layout_valid_ = false;
+  /** Serialized entries with a fixed layout, only the values are updated in every frame */
+  std::vector<char> fixed_data_;
+  /** Values of one entry with a fixed layout */
+  std::vector<double> fixed_values_;
+  /** Write an index of the log */
+  bool index_ = false;
+  /** Index points of the current log (the offsets are in index_offsets_), only accessed from the logging thread */
+  log::BinaryLogIndex index_data_;
+  /** True if the keys changed since the last index point */
+  bool index_keys_changed_ = true;
+  /** Rotation limits of the log (0 if disabled) */
+  uint64_t rotate_size_ = 0;
+  double rotate_duration_ = 0;
+  /** Time of the first frame of the current part, only accessed from the logging thread */
+  double part_start_t_ = 0;
+  /** Number of parts requested by the logging thread */
+  size_t parts_ = 1;
+  /** Bytes written in the current part by the logging thread */
+  uint64_t part_bytes_ = 0;
+  /** True if the next frame must start a new part */
+  bool rotate_pending_ = false;
+
+  /** Returns true if the log file is open */
+  inline bool is_open() const
+  {
+#ifdef MC_RTC_HAS_IO_URING
+    if(direct_active_) { return direct_->is_open(); }
+#endif
+    return log_.is_open();
+  }
+
+#ifdef MC_RTC_HAS_IO_URING
+  /** Direct I/O backend (nullptr when it is not used) */
+  std::unique_ptr<log::internal::DirectLogFile> direct_;
+  /** True if the current file is written with direct_ (only accessed from the writing thread) */
+  bool direct_active_ = false;
+#endif
+
+#ifndef _WIN32
+  /** Frames published in shared memory (nullptr if disabled), only accessed from the logging thread */
+  std::unique_ptr<log::internal::LogTapWriter> tap_;
+  /** Snapshot of the keys for the log tap */
+  std::vector<char> tap_data_;
+#endif
+
+  /** Returns true if the log is rotated */
+  inline bool rotates() const noexcept { return rotate_size_ != 0 || rotate_duration_ > 0; }
+
+  /** Called from the logging thread before the frame at time \p t is written
+   *
+   * \returns True if this frame must start a new part of the log
+   */
+  bool rotate(double t)
+  {
+    if(rotate_pending_) { return true; }
+    bool size_reached = rotate_size_ != 0 && part_size() >= rotate_size_;
+    bool duration_reached = rotate_duration_ > 0 && t - part_start_t_ >= rotate_duration_;
+    if(!size_reached && !duration_reached) { return false; }
+    // Hand over the index of the current part, it is saved by the writer when the part is closed
+    {
+      std::unique_lock<std::mutex> lck(rotate_mtx_);
+      rotate_index_.push_back(std::move(index_data_));
+    }
+    index_data_ = {};
+    index_keys_changed_ = true;
+    parts_ += 1;
+    rotate_pending_ = true;
+    return true;
+  }
+
+  /** Called from the logging thread once the first frame of a new part (at time \p t) has been written */
+  void rotated(double t)
+  {
+    rotate_pending_ = false;
+    part_start_t_ = t;
+    part_bytes_ = 0;
+  }
+
+  /** Size of the current part as seen from the logging thread
+   *
+   * Raw frames are written as-is so the size is known right away, the size of compressed logs is only known once the
+   * writer compressed the frames
+   */
+  uint64_t part_size() const noexcept
+  {
+    if(!(features_ & Logger::COMPRESSED)) { return part_bytes_; }
+    // The size is only meaningful once the writer opened the last requested part
+    if(parts_opened_.load() != parts_) { return 0; }
+    return part_size_.load(std::memory_order_relaxed);
+  }
 
 protected:
-  inline void fwrite(char * data, uint64_t size)
+  /** Features used by the log */
+  uint32_t features_ = 0;
+  int compression_level_ = 0;
+  size_t compression_block_size_ = 0;
+  /** Frames waiting to be compressed (size-prefixed) */
+  std::vector<char> block_;
+  /** Number of complete frames in block_ */
+  size_t block_frames_ = 0;
+  /** Offset of the first byte in block_ that does not belong to a complete frame */
+  size_t block_scan_ = 0;
+  /** Output buffer for compression */
+  std::vector<char> zblock_;
+#ifdef MC_RTC_HAS_ZSTD
+  ZSTD_CCtx * zctx_ = nullptr;
+#endif
+  /** Current offset in the log file */
+  uint64_t offset_ = 0;
+  /** File of the current part of the log, only accessed from the writing thread */
+  std::string file_path_;
+  /** Current part of the log, only accessed from the writing thread */
+  size_t part_ = 1;
+  /** Number of the part opened by the writing thread and its size */
+  std::atomic<size_t> parts_opened_{1};
+  std::atomic<uint64_t> part_size_{0};
+  /** Indexes of the parts waiting to be closed by the writing thread */
+  std::deque<log::BinaryLogIndex> rotate_index_;
+  std::mutex rotate_mtx_;
+  /** Offsets of the index points in the log file, only accessed from the writing thread */
+  std::vector<uint64_t> index_offsets_;
+  /** Size prefix of the next frame in write_frames (raw logs) */
+  char prefix_[sizeof(uint64_t)];
+  size_t prefix_size_ = 0;
+  /** Remaining bytes of the current frame in write_frames (raw logs) */
+  uint64_t frame_left_ = 0;
+
+  /** Replaces the size of a frame in write_frames to indicate that the next frame is an index point */
+  static constexpr uint64_t index_marker = std::numeric_limits<uint64_t>::max();
+  /** Replaces the size of a frame in write_frames to indicate that the next frame starts a new part */
+  static constexpr uint64_t part_marker = index_marker - 1;
+
+  inline void fwrite(char * data, uint64_t size, Frame frame)
+  {
+    if(frame == Frame::NextPart) { next_part(); }
+    else if(frame == Frame::IndexPoint)
+    {
+      // Index points start a new compressed block
+      flush_block();
+      index_offsets_.push_back(offset_);
+    }
+    if(features_ & Logger::COMPRESSED)
+    {
+      append_frames((const char *)&size, sizeof(uint64_t));
+      append_frames(data, size);
+      return;
+    }
+    write_raw((char *)&size, sizeof(uint64_t));
+    write_raw(data, size);
+  }
+
+  /** Write a sequence of size-prefixed frames
+   *
+   * \p data does not need to contain complete frames, the remaining data is kept until the next call. A frame size
+   * equal to index_marker (resp. part_marker) marks the next frame as an index point (resp. the start of a new part).
+   */
+  void write_frames(const char * data, uint64_t size)
   {
-    log_.write((char *)&size, sizeof(uint64_t));
-    log_.write(data, static_cast<int>(size));
+    if(features_ & Logger::COMPRESSED) { append_frames(data, size); }
+    else if(!index_ && !rotates()) { write_raw(data, size); }
+    else { write_raw_frames(data, size); }
+  }
+
+  /** Send the pending writes of the direct I/O backend to the kernel, called after each batch of frames */
+  void submit()
+  {
+#ifdef MC_RTC_HAS_IO_URING
+    if(direct_active_) { direct_->submit(); }
+#endif
+  }
+
+  /** Write the frames that are waiting for compression into the log */
+  void flush_block()
+  {
+    if(block_scan_ != 0) { write_block(block_scan_); }
   }
 
   // Open file and write magic number to it right away
   void open(const std::string & path)
   {
     path_ = path;
+    part_ = 1;
+    parts_opened_ = 1;
+    if(held_values_) { features_ |= Logger::HELD_VALUES; }
+    else { features_ &= ~static_cast<uint32_t>(Logger::HELD_VALUES); }
+    open_file(path);
+  }
+
+  /** Close the log and write its index */
+  void close()
+  {
+    // The index of the current part has been handed over if the logging thread requested a new part
+    {
+      std::unique_lock<std::mutex> lck(rotate_mtx_);
+      if(rotate_index_.size()) { index_data_ = std::move(rotate_index_.front()); }
+      rotate_index_.clear();
+    }
+    close_file(index_data_);
+    index_data_ = {};
+    index_keys_changed_ = true;
+    rotate_pending_ = false;
+    prefix_size_ = 0;
+    frame_left_ = 0;
+  }
+
+  /** Close the current part of the log and open the next one, called from the writing thread */
+  void next_part()
+  {
+    log::BinaryLogIndex index;
+    {
+      std::unique_lock<std::mutex> lck(rotate_mtx_);
+      if(rotate_index_.size())
+      {
+        index = std::move(rotate_index_.front());
+        rotate_index_.pop_front();
+      }
+    }
+    close_file(index);
+    open_file(Logger::partPath(path_, ++part_));
+    parts_opened_ = part_;
+    if(is_open()) { mc_rtc::log::info("[Logger] Continue logging in {}", file_path_); }
+    else { mc_rtc::log::error("[Logger] Failed to open {}, the log cannot be continued", file_path_); }
+  }
+
+private:
+  void open_file(const std::string & path)
+  {
+    file_path_ = path;
+    offset_ = 0;
+    part_size_ = 0;
+#ifdef MC_RTC_HAS_IO_URING
+    direct_active_ = direct_ && direct_->open(path);
+    if(direct_ && !direct_active_)
+    {
+      mc_rtc::log::warning("[Logger] {} cannot be opened for direct I/O, it will be written through the page cache",
+                           path);
+    }
+    if(!direct_active_) { log_.open(path, std::ofstream::binary); }
+#else
     log_.open(path, std::ofstream::binary);
+#endif
     static_assert(sizeof(uint8_t) == sizeof(char));
-    log_.write((const char *)&Logger::magic, sizeof(Logger::magic) - sizeof(uint8_t));
-    const char version = static_cast<uint8_t>(Logger::magic[3] + Logger::version);
-    log_.write(&version, sizeof(uint8_t));
+    write_raw((const char *)&Logger::magic, sizeof(Logger::magic) - sizeof(uint8_t));
+    // Logs without extra features are kept readable by older readers
+    const uint8_t log_version = features_ == 0 ? 1 : Logger::version;
+    const char version = static_cast<uint8_t>(Logger::magic[3] + log_version);
+    write_raw(&version, sizeof(uint8_t));
+    if(log_version > 1) { write_raw((const char *)&features_, sizeof(uint32_t)); }
+  }
+
+  /** Close the current file and write its index */
+  void close_file(log::BinaryLogIndex & index)
+  {
+    flush_block();
+#ifdef MC_RTC_HAS_IO_URING
+    if(direct_active_) { direct_->close(); }
+    else { log_.close(); }
+#else
+    log_.close();
+#endif
+    auto & points = index.points;
+    if(index_ && points.size())
+    {
+      if(points.size() != index_offsets_.size())
+      {
+        mc_rtc::log::warning("[Logger] Inconsistent index for {} ({} points, {} offsets)", file_path_, points.size(),
+                             index_offsets_.size());
+        points.resize(std::min(points.size(), index_offsets_.size()));
+      }
+      for(size_t i = 0; i < points.size(); ++i) { points[i].offset = index_offsets_[i]; }
+      index.log_size = offset_;
+      index.save(file_path_);
+    }
+    index_offsets_.clear();
+  }
+
+  void write_raw(const char * data, uint64_t size)
+  {
+#ifdef MC_RTC_HAS_IO_URING
+    if(direct_active_) { direct_->write(data, size); }
+    else { log_.write(data, static_cast<std::streamsize>(size)); }
+#else
+    log_.write(data, static_cast<std::streamsize>(size));
+#endif
+    offset_ += size;
+    part_size_.store(offset_, std::memory_order_relaxed);
+  }
+
+  void write_raw_frames(const char * data, uint64_t size)
+  {
+    while(size)
+    {
+      if(frame_left_)
+      {
+        uint64_t n = std::min(frame_left_, size);
+        write_raw(data, n);
+        data += n;
+        size -= n;
+        frame_left_ -= n;
+        continue;
+      }
+      // The size prefix is only written once complete as index markers are removed
+      uint64_t n = std::min<uint64_t>(sizeof(uint64_t) - prefix_size_, size);
+      std::memcpy(prefix_ + prefix_size_, data, n);
+      prefix_size_ += n;
+      data += n;
+      size -= n;
+      if(prefix_size_ < sizeof(uint64_t)) { continue; }
+      prefix_size_ = 0;
+      std::memcpy(&frame_left_, prefix_, sizeof(uint64_t));
+      if(frame_left_ == index_marker)
+      {
+        frame_left_ = 0;
+        index_offsets_.push_back(offset_);
+        continue;
+      }
+      if(frame_left_ == part_marker)
+      {
+        frame_left_ = 0;
+        next_part();
+        continue;
+      }
+      write_raw(prefix_, sizeof(uint64_t));
+    }
+  }
+
+  void append_frames(const char * data, uint64_t size)
+  {
+    block_.insert(block_.end(), data, data + size);
+    while(block_scan_ + sizeof(uint64_t) <= block_.size())
+    {
+      uint64_t frame_size = 0;
+      std::memcpy(&frame_size, block_.data() + block_scan_, sizeof(uint64_t));
+      if(frame_size == index_marker)
+      {
+        auto marker = block_.begin() + static_cast<std::ptrdiff_t>(block_scan_);
+        block_.erase(marker, marker + sizeof(uint64_t));
+        // Index points start a new block
+        flush_block();
+        index_offsets_.push_back(offset_);
+        continue;
+      }
+      if(frame_size == part_marker)
+      {
+        auto marker = block_.begin() + static_cast<std::ptrdiff_t>(block_scan_);
+        block_.erase(marker, marker + sizeof(uint64_t));
+        next_part();
+        continue;
+      }
+      if(block_scan_ + sizeof(uint64_t) + frame_size > block_.size()) { break; }
+      block_scan_ += sizeof(uint64_t) + frame_size;
+      if(++block_frames_ >= compression_block_size_) { write_block(block_scan_); }
+    }
+  }
+
+  /** Compress and write the first \p size bytes of block_ */
+  void write_block(size_t size)
+  {
+#ifdef MC_RTC_HAS_ZSTD
+    if(!zctx_) { zctx_ = ZSTD_createCCtx(); }
+    zblock_.resize(ZSTD_compressBound(size));
+    size_t zsize = ZSTD_compressCCtx(zctx_, zblock_.data(), zblock_.size(), block_.data(), size, compression_level_);
+    if(ZSTD_isError(zsize)) { mc_rtc::log::critical("[Logger] Compression failed: {}", ZSTD_getErrorName(zsize)); }
+    else
+    {
+      uint64_t header[2] = {zsize, size};
+      write_raw((const char *)header, sizeof(header));
+      write_raw(zblock_.data(), zsize);
+    }
+#endif
+    block_.erase(block_.begin(), block_.begin() + static_cast<std::ptrdiff_t>(size));
+    block_scan_ -= size;
+    block_frames_ = 0;
   }
 };
 
@@ -65,87 +585,235 @@ namespace
 {
 struct LoggerNonThreadedPolicyImpl : public LoggerImpl
 {
-  LoggerNonThreadedPolicyImpl(const std::string & directory, const std::string & tmpl) : LoggerImpl(directory, tmpl) {}
+  LoggerNonThreadedPolicyImpl(const std::string & directory,
+                              const std::string & tmpl,
+                              const Logger::Options & options)
+  : LoggerImpl(directory, tmpl, options)
+  {
+  }
 
   void initialize(const bfs::path & path) final
   {
-    if(log_.is_open()) { log_.close(); }
+    if(is_open()) { close(); }
     open(path.string());
   }
 
-  void write(char * data, size_t size) final
+  bool write(char * data, size_t size, Frame frame) final
   {
-    if(valid_) { fwrite(data, size); }
+    if(valid_)
+    {
+      fwrite(data, size, frame);
+      submit();
+    }
+    return valid_;
   }
 
   void flush() final
   {
-    if(valid_) { log_.flush(); }
+    if(valid_)
+    {
+      flush_block();
+#ifdef MC_RTC_HAS_IO_URING
+      if(direct_active_)
+      {
+        direct_->flush();
+        return;
+      }
+#endif
+      log_.flush();
+    }
+  }
+};
+
+/** Single-producer single-consumer byte ring holding size-prefixed frames
+ *
+ * Frames are stored exactly as they are written on disk (uint64_t size followed by the data) so the consumer can write
+ * the available bytes without further processing.
+ *
+ * The storage is allocated (and touched) once at construction, pushing a frame never allocates memory.
+ */
+struct FrameRing
+{
+  FrameRing(size_t capacity) : data_(capacity, 0)
+  {
+    if(!head_.is_lock_free())
+    {
+      mc_rtc::log::warning("Your platform does not support std::atomic<uint64_t> as lock free operations");
+    }
+  }
+
+  /** Producer side, returns false if the frame does not fit in the remaining space
+   *
+   * If \p marker is provided, it is written before the frame (in the same operation)
+   */
+  bool push(const char * data, uint64_t size, std::optional<uint64_t> marker = std::nullopt)
+  {
+    const uint64_t needed = (marker ? 2 : 1) * sizeof(uint64_t) + size;
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t used = head - tail_.load(std::memory_order_acquire);
+    if(needed > data_.size() - used)
+    {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    uint64_t pos = head;
+    if(marker)
+    {
+      copy_in(pos, reinterpret_cast<const char *>(&*marker), sizeof(uint64_t));
+      pos += sizeof(uint64_t);
+    }
+    copy_in(pos, reinterpret_cast<const char *>(&size), sizeof(uint64_t));
+    copy_in(pos + sizeof(uint64_t), data, size);
+    head_.store(head + needed);
+    if(used + needed > high_water_mark_.load(std::memory_order_relaxed))
+    {
+      high_water_mark_.store(used + needed, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  /** Consumer side, calls \p write with (at most two) contiguous spans of available data
+   *
+   * \returns The number of bytes consumed
+   */
+  template<typename WriteT>
+  uint64_t consume(WriteT && write)
+  {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load();
+    if(head == tail) { return 0; }
+    const uint64_t size = head - tail;
+    const uint64_t start = tail % data_.size();
+    const uint64_t first = std::min<uint64_t>(size, data_.size() - start);
+    write(data_.data() + start, first);
+    if(first < size) { write(data_.data(), size - first); }
+    tail_.store(head, std::memory_order_release);
+    return size;
+  }
+
+  bool empty() const { return head_.load() == tail_.load(std::memory_order_acquire); }
+
+  size_t capacity() const noexcept { return data_.size(); }
+
+  size_t high_water_mark() const noexcept { return high_water_mark_.load(std::memory_order_relaxed); }
+
+  size_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  std::vector<char> data_;
+  /** Monotonic write/read positions, the actual offset in data_ is position % capacity */
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> tail_{0};
+  std::atomic<size_t> high_water_mark_{0};
+  std::atomic<size_t> dropped_{0};
+
+  void copy_in(uint64_t pos, const char * data, uint64_t size)
+  {
+    const uint64_t start = pos % data_.size();
+    const uint64_t first = std::min<uint64_t>(size, data_.size() - start);
+    std::memcpy(data_.data() + start, data, first);
+    if(first < size) { std::memcpy(data_.data(), data + first, size - first); }
   }
 };
 
 struct LoggerThreadedPolicyImpl : public LoggerImpl
 {
-  LoggerThreadedPolicyImpl(const std::string & directory, const std::string & tmpl) : LoggerImpl(directory, tmpl)
+  LoggerThreadedPolicyImpl(const std::string & directory, const std::string & tmpl, const Logger::Options & options)
+  : LoggerImpl(directory, tmpl, options), ring_(options.buffer_size)
   {
     log_sync_th_ = std::thread(
         [this]()
         {
-          while(log_sync_th_run_ && valid_)
+          while(log_sync_th_run_)
           {
-            while(!write_data()) {}
-            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            write_data();
+            std::unique_lock<std::mutex> lck(wait_mtx_);
+            consumer_waiting_ = true;
+            // The timeout is only a safety net, the producer wakes us up when the thread is waiting
+            wait_cv_.wait_for(lck, std::chrono::milliseconds(100),
+                              [this]() { return !log_sync_th_run_ || !ring_.empty(); });
+            consumer_waiting_ = false;
           }
-          while(!write_data()) {}
+          write_data();
         });
   }
 
   ~LoggerThreadedPolicyImpl()
   {
-    log_sync_th_run_ = false;
+    {
+      std::lock_guard<std::mutex> lck(wait_mtx_);
+      log_sync_th_run_ = false;
+    }
+    wait_cv_.notify_one();
     if(log_sync_th_.joinable()) { log_sync_th_.join(); }
+    if(ring_.dropped())
+    {
+      mc_rtc::log::warning("[Logger] {} frames were dropped, buffer high-water mark: {}/{} bytes", ring_.dropped(),
+                           ring_.high_water_mark(), ring_.capacity());
+    }
   }
 
-  // Returns true when all data has been consumed
-  bool write_data()
+  void write_data()
   {
-    if(data_.pop(pop_))
-    {
-      char * data = pop_.first;
-      size_t size = pop_.second;
-      fwrite(data, size);
-      delete[] data;
-      return false;
-    }
-    return true;
+    std::unique_lock<std::mutex> lck(file_mtx_);
+    ring_.consume(
+        [this](const char * data, uint64_t size)
+        {
+          if(valid_) { write_frames(data, size); }
+        });
+    submit();
   }
 
   void initialize(const bfs::path & path) final
   {
-    if(log_.is_open())
+    if(is_open())
     {
       /* Wait until the previous log is flushed */
-      while(!data_.empty()) { std::this_thread::sleep_for(std::chrono::microseconds(500)); }
-      log_.close();
+      while(!ring_.empty())
+      {
+        wait_cv_.notify_one();
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+      }
+      std::unique_lock<std::mutex> lck(file_mtx_);
+      close();
     }
+    std::unique_lock<std::mutex> lck(file_mtx_);
     open(path.string());
   }
 
-  void write(char * data, size_t size) final
+  bool write(char * data, size_t size, Frame frame) final
   {
-    char * ndata = new char[size];
-    std::memcpy(ndata, data, size);
-    if(!data_.push({ndata, size}))
+    std::optional<uint64_t> marker = std::nullopt;
+    if(frame == Frame::IndexPoint) { marker = index_marker; }
+    else if(frame == Frame::NextPart) { marker = part_marker; }
+    if(!ring_.push(data, size, marker))
+    {
+      if(!dropping_) { mc_rtc::log::critical("Data cannot be added to the log (buffer full)"); }
+      dropping_ = true;
+      return false;
+    }
+    dropping_ = false;
+    if(consumer_waiting_)
     {
-      mc_rtc::log::critical("Data cannot be added to the log");
-      delete[] ndata;
+      // Holding the mutex guarantees the consumer is either before its predicate check or inside wait
+      std::lock_guard<std::mutex> lck(wait_mtx_);
+      wait_cv_.notify_one();
     }
+    return true;
   }
 
+  Logger::BufferStats stats() const final { return {ring_.capacity(), ring_.high_water_mark(), ring_.dropped()}; }
+
   std::thread log_sync_th_;
-  bool log_sync_th_run_ = true;
-  CircularBuffer<std::pair<char *, size_t>, 2048> data_;
-  std::pair<char *, size_t> pop_;
+  std::atomic<bool> log_sync_th_run_{true};
+  FrameRing ring_;
+  /** True when the last frame was dropped, avoid flooding the output when the buffer is full */
+  bool dropping_ = false;
+  /** Protect the file against concurrent (re-)opening and writing */
+  std::mutex file_mtx_;
+  std::mutex wait_mtx_;
+  std::condition_variable wait_cv_;
+  std::atomic<bool> consumer_waiting_{false};
 };
 } // namespace
 
@@ -154,24 +822,70 @@ Logger::Logger(const Policy & policy, const std::string & directory, const std::
   setup(policy, directory, tmpl);
 }
 
+Logger::Logger(const Policy & policy, const std::string & directory, const std::string & tmpl, const Options & options)
+{
+  setup(policy, directory, tmpl, options);
+}
+
 Logger::~Logger() {}
 
 void Logger::setup(const Policy & policy, const std::string & directory, const std::string & tmpl)
+{
+  setup(policy, directory, tmpl, Options{});
+}
+
+void Logger::setup(const Policy & policy,
+                   const std::string & directory,
+                   const std::string & tmpl,
+                   const Options & options)
 {
   switch(policy)
   {
     case Policy::NON_THREADED:
-      impl_.reset(new LoggerNonThreadedPolicyImpl(directory, tmpl));
+      impl_.reset(new LoggerNonThreadedPolicyImpl(directory, tmpl, options));
       break;
     case Policy::THREADED:
-      impl_.reset(new LoggerThreadedPolicyImpl(directory, tmpl));
+      impl_.reset(new LoggerThreadedPolicyImpl(directory, tmpl, options));
       break;
   };
 }
 
-auto Logger::find_entry(const std::string & name) -> std::vector<LogEntry>::iterator
+auto Logger::find_entry(const std::string & name) -> std::list<LogEntry>::iterator
+{
+  auto it = entries_by_name_.find(name);
+  if(it == entries_by_name_.end()) { return log_entries_.end(); }
+  return it->second;
+}
+
+auto Logger::add_entry(LogEntry && entry) -> LogEntry &
+{
+  auto previous = find_entry(entry.key);
+  if(previous != log_entries_.end())
+  {
+    // The replaced entry is removed so that readers keep the same order as the log
+    log_events_.push_back(KeyRemovedEvent{entry.key});
+    remove_entry(previous);
+  }
+  log_events_.push_back(KeyAddedEvent{entry.type, entry.key});
+  auto it = log_entries_.insert(log_entries_.end(), std::move(entry));
+  entries_by_name_[it->key] = it;
+  auto & source_entries = entries_by_source_[it->source];
+  it->source_index = source_entries.size();
+  source_entries.push_back(it);
+  return *it;
+}
+
+auto Logger::remove_entry(std::list<LogEntry>::iterator it) -> std::list<LogEntry>::iterator
 {
-  return std::find_if(log_entries_.begin(), log_entries_.end(), [&](const auto & e) { return e.key == name; });
+  entries_by_name_.erase(it->key);
+  auto source_it = entries_by_source_.find(it->source);
+  auto & source_entries = source_it->second;
+  // Swap with the last entry of the source
+  source_entries[it->source_index] = source_entries.back();
+  source_entries[it->source_index]->source_index = it->source_index;
+  source_entries.pop_back();
+  if(source_entries.empty()) { entries_by_source_.erase(source_it); }
+  return log_entries_.erase(it);
 }
 
 void Logger::start(const std::string & ctl_name, double timestep, bool resume, double start_t)
@@ -197,6 +911,7 @@ void Logger::start(const std::string & ctl_name, double timestep, bool resume, d
     return log_path;
   };
   auto log_path = get_log_path();
+  impl_->held_values_ = held_values();
   impl_->initialize(log_path);
   std::stringstream ss_sym;
   ss_sym << impl_->tmpl << "-" << ctl_name << "-latest.bin";
@@ -209,7 +924,7 @@ void Logger::start(const std::string & ctl_name, double timestep, bool resume, d
     if(!ec) { log::info("Updated latest log symlink: {}", log_sym_path.string()); }
     else { log::info("Failed to create latest log symlink: {}", ec.message()); }
   }
-  if(impl_->log_.is_open())
+  if(impl_->is_open())
   {
     if(resume)
     {
@@ -218,15 +933,7 @@ void Logger::start(const std::string & ctl_name, double timestep, bool resume, d
       for(const auto & e : log_entries_) { log_events_.push_back(KeyAddedEvent{e.type, e.key}); }
     }
     else { impl_->log_iter_ = start_t; }
-    if(find_entry("t") == log_entries_.end())
-    {
-      addLogEntry("t", this,
-                  [this, timestep]()
-                  {
-                    impl_->log_iter_ += timestep;
-                    return impl_->log_iter_ - timestep;
-                  });
-    }
+    add_default_entries(timestep);
     impl_->valid_ = true;
   }
   else
@@ -234,23 +941,22 @@ void Logger::start(const std::string & ctl_name, double timestep, bool resume, d
     impl_->valid_ = false;
     log::error("Failed to open log file {}", log_path.string());
   }
+  // A new file is started, every entry must be written at least once
+  for(auto & e : log_entries_) { e.force = true; }
+  impl_->frames_since_keyframe_ = 0;
+  impl_->parts_ = 1;
+  impl_->part_start_t_ = impl_->log_iter_;
+  impl_->part_bytes_ = 0;
   log_events_.push_back(StartEvent{});
 }
 
 void Logger::open(const std::string & file, double timestep, double start_t)
 {
+  impl_->held_values_ = held_values();
   impl_->initialize(file);
-  if(impl_->log_.is_open())
+  if(impl_->is_open())
   {
-    if(find_entry("t") == log_entries_.end())
-    {
-      addLogEntry("t", this,
-                  [this, timestep]()
-                  {
-                    impl_->log_iter_ += timestep;
-                    return impl_->log_iter_ - timestep;
-                  });
-    }
+    add_default_entries(timestep);
     impl_->log_iter_ = start_t;
     impl_->valid_ = true;
   }
@@ -259,69 +965,315 @@ void Logger::open(const std::string & file, double timestep, double start_t)
     impl_->valid_ = false;
     log::error("Failed to open log file {}", file);
   }
+  // A new file is started, every entry must be written at least once
+  for(auto & e : log_entries_) { e.force = true; }
+  impl_->frames_since_keyframe_ = 0;
+  impl_->parts_ = 1;
+  impl_->part_start_t_ = impl_->log_iter_;
+  impl_->part_bytes_ = 0;
   log_events_.push_back(StartEvent{});
 }
 
+void Logger::add_default_entries(double timestep)
+{
+  if(find_entry("t") == log_entries_.end())
+  {
+    addLogEntry("t", this,
+                [this, timestep]()
+                {
+                  impl_->log_iter_ += timestep;
+                  return impl_->log_iter_ - timestep;
+                });
+  }
+#ifdef MC_RTC_HAS_IO_URING
+  if(impl_->direct_ && find_entry("perf_LogWrite_p50") == log_entries_.end())
+  {
+    addLogEntry("perf_LogWrite_p50", this,
+                [this]()
+                { return impl_->direct_ ? impl_->direct_->latency().p50.load(std::memory_order_relaxed) : 0.0; });
+    addLogEntry("perf_LogWrite_p99", this,
+                [this]()
+                { return impl_->direct_ ? impl_->direct_->latency().p99.load(std::memory_order_relaxed) : 0.0; });
+    addLogEntry("perf_LogWrite_max", this,
+                [this]()
+                { return impl_->direct_ ? impl_->direct_->latency().max.load(std::memory_order_relaxed) : 0.0; });
+  }
+#endif
+}
+
+bool Logger::held_values() const
+{
+  if(impl_->delta_ || impl_->always_held_) { return true; }
+  return std::any_of(log_entries_.begin(), log_entries_.end(),
+                     [](const LogEntry & e) { return e.policy.period > 1 || e.policy.on_change; });
+}
+
+void Logger::warn_ignored_policy(const EntryPolicy & policy)
+{
+  if(impl_->warned_policy_ || impl_->held_values_ || !impl_->is_open() || (policy.period <= 1 && !policy.on_change))
+  {
+    return;
+  }
+  impl_->warned_policy_ = true;
+  log::warning("[Logger] The current log file does not hold values, the policies of the entries added after it was "
+               "started are ignored until the next file (see Logger::Options::held_values)");
+}
+
+bool Logger::should_write(LogEntry & e)
+{
+  // Every entry is written in every frame of a file that does not hold values
+  if(e.force || !impl_->held_values_)
+  {
+    e.force = false;
+    e.ticks = 0;
+    // Update the reference value
+    if(e.changed_cb) { e.changed_cb(e.policy.threshold); }
+    return true;
+  }
+  // Entries that are not written are replaced by nil, readers hold the previous value
+  if(++e.ticks < e.policy.period) { return false; }
+  e.ticks = 0;
+  return !e.changed_cb || e.changed_cb(e.policy.threshold);
+}
+
+namespace
+{
+
+/** Serialize a log event */
+void write_event(mc_rtc::MessagePackBuilder & builder, const Logger::LogEvent & event, const Logger::Meta & meta)
+{
+  auto visitor = [&](auto && event)
+  {
+    using T = std::decay_t<decltype(event)>;
+    if constexpr(std::is_same_v<T, Logger::KeyAddedEvent>)
+    {
+      builder.start_array(3);
+      builder.write(static_cast<uint8_t>(0));
+      builder.write(static_cast<typename std::underlying_type<log::LogType>::type>(event.type));
+      builder.write(event.key);
+      builder.finish_array();
+    }
+    else if constexpr(std::is_same_v<T, Logger::KeyRemovedEvent>)
+    {
+      builder.start_array(2);
+      builder.write(static_cast<uint8_t>(1));
+      builder.write(event.key);
+      builder.finish_array();
+    }
+    else if constexpr(std::is_same_v<T, Logger::GUIEvent>)
+    {
+      builder.start_array(4);
+      builder.write(static_cast<uint8_t>(2));
+      builder.write(event.category);
+      builder.write(event.name);
+      builder.write(event.data);
+      builder.finish_array();
+    }
+    else if constexpr(std::is_same_v<T, Logger::StartEvent>)
+    {
+      builder.start_array(7);
+      builder.write(static_cast<uint8_t>(3));
+      builder.write(meta.timestep);
+      builder.write(meta.main_robot);
+      builder.write(meta.main_robot_module);
+      builder.write(meta.init);
+      builder.write(meta.init_q);
+      builder.write(meta.calibs);
+      builder.finish_array();
+    }
+    else { static_assert(!std::is_same_v<T, T>, "non-exhaustive visitor"); }
+  };
+  std::visit(visitor, event);
+}
+
+} // namespace
+
 void Logger::log()
 {
+  const double t = impl_->log_iter_;
+  const bool next_part = impl_->valid_ && impl_->rotates() && impl_->rotate(t);
+  if(next_part)
+  {
+    // The first frame of a part holds the meta data and the active keys so that the part can be read on its own
+    std::vector<LogEvent> events;
+    events.reserve(log_entries_.size() + log_events_.size() + 1);
+    events.push_back(StartEvent{});
+    for(const auto & e : log_entries_) { events.push_back(KeyAddedEvent{e.type, e.key}); }
+    for(auto & e : log_events_)
+    {
+      if(std::holds_alternative<GUIEvent>(e)) { events.push_back(std::move(e)); }
+    }
+    log_events_ = std::move(events);
+    for(auto & e : log_entries_) { e.force = true; }
+  }
+  bool keys_changed = false;
+  bool started = false;
   mc_rtc::MessagePackBuilder builder(impl_->data_);
   builder.start_array(2);
   if(log_events_.size())
   {
     builder.start_array(log_events_.size());
-    auto event_visitor = [&builder, this](auto && event)
+    for(const auto & e : log_events_)
     {
-      using T = std::decay_t<decltype(event)>;
-      if constexpr(std::is_same_v<T, KeyAddedEvent>)
+      if(std::holds_alternative<KeyAddedEvent>(e) || std::holds_alternative<KeyRemovedEvent>(e))
       {
-        builder.start_array(3);
-        builder.write(static_cast<uint8_t>(0));
-        builder.write(static_cast<typename std::underlying_type<log::LogType>::type>(event.type));
-        builder.write(event.key);
-        builder.finish_array();
+        keys_changed = true;
       }
-      else if constexpr(std::is_same_v<T, KeyRemovedEvent>)
+      started = started || std::holds_alternative<StartEvent>(e);
+      write_event(builder, e, meta_);
+    }
+    builder.finish_array();
+  }
+  else { builder.write(); }
+  builder.start_array(log_entries_.size());
+  bool keyframe = false;
+  if(impl_->delta_ || impl_->index_)
+  {
+    // Every entry is written in a keyframe
+    keyframe = impl_->frames_since_keyframe_ == 0;
+    if(keyframe)
+    {
+      for(auto & e : log_entries_) { e.force = true; }
+    }
+    impl_->frames_since_keyframe_ = (impl_->frames_since_keyframe_ + 1) % impl_->keyframe_interval_;
+  }
+  if(impl_->delta_)
+  {
+    mc_rtc::MessagePackBuilder values(impl_->values_data_);
+    values.start_array(log_entries_.size());
+    for(auto & e : log_entries_)
+    {
+      bool force = e.force;
+      if(!should_write(e))
       {
-        builder.start_array(2);
-        builder.write(static_cast<uint8_t>(1));
-        builder.write(event.key);
-        builder.finish_array();
+        values.write();
+        builder.write();
+        continue;
       }
-      else if constexpr(std::is_same_v<T, GUIEvent>)
+      size_t start = values.size();
+      e.log_cb(values);
+      const char * data = impl_->values_data_.data() + start;
+      size_t size = values.size() - start;
+      // Unchanged entries are replaced by nil, readers hold the previous value
+      if(!force && size == e.last_bytes.size() && std::memcmp(data, e.last_bytes.data(), size) == 0)
       {
-        builder.start_array(4);
-        builder.write(static_cast<uint8_t>(2));
-        builder.write(event.category);
-        builder.write(event.name);
-        builder.write(event.data);
-        builder.finish_array();
+        builder.write();
+        continue;
       }
-      else if constexpr(std::is_same_v<T, StartEvent>)
+      e.last_bytes.assign(data, data + size);
+      builder.write_object(data, size);
+    }
+    values.finish_array();
+    values.finish();
+  }
+  else
+  {
+    if(keys_changed || !impl_->fixed_layout_valid_ || impl_->fixed_layout_.size() != log_entries_.size())
+    {
+      update_fixed_layout();
+    }
+    auto & values = impl_->fixed_values_;
+    size_t i = 0;
+    for(auto & e : log_entries_)
+    {
+      auto & layout = impl_->fixed_layout_[i++];
+      if(layout.enabled)
       {
-        builder.start_array(7);
-        builder.write(static_cast<uint8_t>(3));
-        builder.write(meta_.timestep);
-        builder.write(meta_.main_robot);
-        builder.write(meta_.main_robot_module);
-        builder.write(meta_.init);
-        builder.write(meta_.init_q);
-        builder.write(meta_.calibs);
-        builder.finish_array();
+        const size_t size = e.fixed_cb(values);
+        const bool array = e.type != log::LogType::Double;
+        if(size != layout.size)
+        {
+          // Nothing is allocated here, an entry that outgrows its space is serialized normally until the keys change
+          if(size <= values.size() && layout.fits(size, array)) { layout.resize(impl_->fixed_data_, size, array); }
+          else { layout.enabled = false; }
+        }
       }
-      else { static_assert(!std::is_same_v<T, T>, "non-exhaustive visitor"); }
-    };
-
-    for(auto & e : log_events_) { std::visit(event_visitor, e); }
-    builder.finish_array();
-    log_events_.resize(0);
+      if(layout.enabled)
+      {
+        const size_t size = layout.size;
+        // Only the doubles change, the array header and the type tags are already in place
+        char * data = impl_->fixed_data_.data() + layout.offset;
+        for(size_t j = 0; j < size; ++j) { mpack_store_double(data + layout.header + 9 * j + 1, values[j]); }
+        builder.write_object(data, layout.header + 9 * size);
+        continue;
+      }
+      if(should_write(e)) { e.log_cb(builder); }
+      else { builder.write(); }
+    }
   }
-  else { builder.write(); }
-  builder.start_array(log_entries_.size());
-  for(auto & e : log_entries_) { e.log_cb(builder); }
   builder.finish_array();
   builder.finish_array();
   size_t s = builder.finish();
-  impl_->write(impl_->data_.data(), s);
+  if(keys_changed) { impl_->index_keys_changed_ = true; }
+  // The index holds the keys after the frame so a frame that changes the keys cannot be an index point
+  const bool index_point = keyframe && impl_->index_ && !keys_changed && !next_part;
+#ifndef _WIN32
+  if(impl_->tap_)
+  {
+    impl_->tap_->push(impl_->data_.data(), s);
+    // The snapshot holds the meta data and the keys so that readers can start reading at any frame
+    if(keys_changed || started)
+    {
+      mc_rtc::MessagePackBuilder snapshot(impl_->tap_data_);
+      snapshot.start_array(2);
+      snapshot.start_array(log_entries_.size() + 1);
+      write_event(snapshot, StartEvent{}, meta_);
+      for(const auto & e : log_entries_) { write_event(snapshot, KeyAddedEvent{e.type, e.key}, meta_); }
+      snapshot.finish_array();
+      snapshot.start_array(log_entries_.size());
+      for(size_t i = 0; i < log_entries_.size(); ++i) { snapshot.write(); }
+      snapshot.finish_array();
+      snapshot.finish_array();
+      size_t snapshot_size = snapshot.finish();
+      impl_->tap_->snapshot(impl_->tap_data_.data(), snapshot_size);
+    }
+  }
+#endif
+  using Frame = LoggerImpl::Frame;
+  const Frame frame = next_part ? Frame::NextPart : (index_point ? Frame::IndexPoint : Frame::Regular);
+  if(!impl_->write(impl_->data_.data(), s, frame))
+  {
+    // The events of a dropped frame are written with the next frame, readers would not know the keys otherwise
+    // The next frame is a keyframe, the entries left out of this frame were compared to values readers never got
+    for(auto & e : log_entries_) { e.force = true; }
+    impl_->frames_since_keyframe_ = 0;
+    return;
+  }
+  log_events_.resize(0);
+  if(next_part) { impl_->rotated(t); }
+  impl_->part_bytes_ += sizeof(uint64_t) + s;
+  if(index_point)
+  {
+    auto & index = impl_->index_data_;
+    if(impl_->index_keys_changed_)
+    {
+      auto & keys = index.keys.emplace_back();
+      keys.reserve(log_entries_.size());
+      for(const auto & e : log_entries_) { keys.push_back({e.type, e.key}); }
+      impl_->index_keys_changed_ = false;
+    }
+    index.points.push_back({t, 0, index.keys.size() - 1});
+  }
+}
+
+void Logger::update_fixed_layout()
+{
+  impl_->fixed_layout_.assign(log_entries_.size(), LoggerImpl::FixedEntry{});
+  impl_->fixed_data_.clear();
+  auto & values = impl_->fixed_values_;
+  size_t i = 0;
+  for(const auto & e : log_entries_)
+  {
+    auto & layout = impl_->fixed_layout_[i++];
+    // Entries that are not written in every frame go through should_write
+    layout.enabled = e.fixed_cb && e.policy.period <= 1 && !e.changed_cb;
+    if(!layout.enabled) { continue; }
+    // The buffers are sized with the current values so that log() does not allocate afterwards
+    const size_t size = e.fixed_cb(values);
+    if(size > values.size()) { values.resize(size); }
+    layout.resize(impl_->fixed_data_, size, e.type != log::LogType::Double);
+  }
+  impl_->fixed_layout_valid_ = true;
 }
 
 void Logger::removeLogEntry(const std::string & name)
@@ -330,31 +1282,34 @@ void Logger::removeLogEntry(const std::string & name)
   if(it != log_entries_.end())
   {
     log_events_.push_back(KeyRemovedEvent{name});
-    log_entries_.erase(it);
+    remove_entry(it);
   }
 }
 
 void Logger::removeLogEntries(const void * source)
 {
-  for(auto it = log_entries_.begin(); it != log_entries_.end();)
+  auto source_it = entries_by_source_.find(source);
+  if(source_it == entries_by_source_.end()) { return; }
+  auto source_entries = std::move(source_it->second);
+  entries_by_source_.erase(source_it);
+  for(auto it : source_entries)
   {
-    if(it->source == source)
-    {
-      log_events_.push_back(KeyRemovedEvent{it->key});
-      it = log_entries_.erase(it);
-    }
-    else { ++it; }
+    log_events_.push_back(KeyRemovedEvent{it->key});
+    entries_by_name_.erase(it->key);
+    log_entries_.erase(it);
   }
 }
 
 void Logger::clear(bool record)
 {
+  impl_->index_keys_changed_ = true;
+  impl_->fixed_layout_valid_ = false;
   for(auto it = log_entries_.begin(); it != log_entries_.end();)
   {
     if(it->key != "t")
     {
       if(record) { log_events_.push_back(KeyRemovedEvent{it->key}); }
-      it = log_entries_.erase(it);
+      it = remove_entry(it);
     }
     else { ++it; }
   }
@@ -370,9 +1325,22 @@ const std::string & Logger::path() const
   return impl_->path_;
 }
 
+std::string Logger::partPath(const std::string & path, size_t part)
+{
+  if(part <= 1) { return path; }
+  auto p = bfs::path(path);
+  auto name = fmt::format("{}_part{}{}", p.stem().string(), part, p.extension().string());
+  return (p.parent_path() / name).string();
+}
+
 void Logger::flush()
 {
   impl_->flush();
 }
 
+auto Logger::bufferStats() const -> BufferStats
+{
+  return impl_->stats();
+}
+
 } // namespace mc_rtc
@@ -4,6 +4,10 @@
 
 #include "mpack.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 #if !EIGEN_VERSION_AT_LEAST(3, 2, 90)
 namespace Eigen
 {
@@ -14,6 +18,17 @@ using Index = Eigen::DenseIndex;
 namespace mc_rtc
 {
 
+// Repeat static constexpr declarations
+// See https://stackoverflow.com/q/8016780
+constexpr int8_t MessagePackBuilder::GEOMETRY_REF;
+constexpr int8_t MessagePackBuilder::PACKED_FLOAT64;
+constexpr int8_t MessagePackBuilder::PACKED_FLOAT32;
+constexpr int8_t MessagePackBuilder::PACKED_INT32;
+constexpr int8_t MessagePackBuilder::PACKED_INT64;
+constexpr int8_t MessagePackBuilder::PACKED_UINT64;
+constexpr int8_t MessagePackBuilder::PACKED_UINT32;
+constexpr int8_t MessagePackBuilder::PACKED_UINT16;
+
 struct MessagePackBuilderImpl : mpack_writer_t
 {
 };
@@ -166,6 +181,58 @@ inline void write_vector(mpack_writer_t * writer, const T & v)
   for(Eigen::Index i = 0; i < v.size(); ++i) { mpack_write_double(writer, v(i)); }
 }
 
+template<typename T>
+inline void write_packed(mpack_writer_t * writer,
+                         int8_t type,
+                         const T * data,
+                         size_t size,
+                         const uint8_t * shape,
+                         size_t rank)
+{
+  size_t bytes = size * sizeof(T);
+  mpack_start_ext(writer, type, static_cast<uint32_t>(1 + rank + bytes));
+  char header = static_cast<char>(rank);
+  mpack_write_bytes(writer, &header, 1);
+  if(rank) { mpack_write_bytes(writer, reinterpret_cast<const char *>(shape), rank); }
+  if constexpr(internal::has_packed_arrays) { mpack_write_bytes(writer, reinterpret_cast<const char *>(data), bytes); }
+  else
+  {
+    for(size_t i = 0; i < size; ++i)
+    {
+      char value[sizeof(T)];
+      std::memcpy(value, data + i, sizeof(T));
+      std::reverse(value, value + sizeof(T));
+      mpack_write_bytes(writer, value, sizeof(T));
+    }
+  }
+  mpack_finish_ext(writer);
+}
+
+/** Write unsigned values with a narrower type \p U, every value must fit in \p U */
+template<typename U, typename T>
+inline void write_packed_narrow(mpack_writer_t * writer,
+                                int8_t type,
+                                const T * data,
+                                size_t size,
+                                const uint8_t * shape,
+                                size_t rank)
+{
+  size_t bytes = size * sizeof(U);
+  mpack_start_ext(writer, type, static_cast<uint32_t>(1 + rank + bytes));
+  char header = static_cast<char>(rank);
+  mpack_write_bytes(writer, &header, 1);
+  if(rank) { mpack_write_bytes(writer, reinterpret_cast<const char *>(shape), rank); }
+  for(size_t i = 0; i < size; ++i)
+  {
+    char value[sizeof(U)];
+    U v = static_cast<U>(data[i]);
+    std::memcpy(value, &v, sizeof(U));
+    if constexpr(!internal::has_packed_arrays) { std::reverse(value, value + sizeof(U)); }
+    mpack_write_bytes(writer, value, sizeof(U));
+  }
+  mpack_finish_ext(writer);
+}
+
 template<typename T>
 inline void write_matrix(mpack_writer_t * writer, const T & m)
 {
@@ -261,6 +328,40 @@ void MessagePackBuilder::write(const sva::ImpedanceVecd & iv)
   finish_array();
 }
 
+void MessagePackBuilder::write_packed(const double * data, size_t size, const uint8_t * shape, size_t rank)
+{
+  mc_rtc::write_packed(impl_.get(), PACKED_FLOAT64, data, size, shape, rank);
+}
+
+void MessagePackBuilder::write_packed(const float * data, size_t size, const uint8_t * shape, size_t rank)
+{
+  mc_rtc::write_packed(impl_.get(), PACKED_FLOAT32, data, size, shape, rank);
+}
+
+void MessagePackBuilder::write_packed(const int32_t * data, size_t size, const uint8_t * shape, size_t rank)
+{
+  mc_rtc::write_packed(impl_.get(), PACKED_INT32, data, size, shape, rank);
+}
+
+void MessagePackBuilder::write_packed(const int64_t * data, size_t size, const uint8_t * shape, size_t rank)
+{
+  mc_rtc::write_packed(impl_.get(), PACKED_INT64, data, size, shape, rank);
+}
+
+void MessagePackBuilder::write_packed(const uint64_t * data, size_t size, const uint8_t * shape, size_t rank)
+{
+  uint64_t max = size ? *std::max_element(data, data + size) : 0;
+  if(max <= std::numeric_limits<uint16_t>::max())
+  {
+    write_packed_narrow<uint16_t>(impl_.get(), PACKED_UINT16, data, size, shape, rank);
+  }
+  else if(max <= std::numeric_limits<uint32_t>::max())
+  {
+    write_packed_narrow<uint32_t>(impl_.get(), PACKED_UINT32, data, size, shape, rank);
+  }
+  else { mc_rtc::write_packed(impl_.get(), PACKED_UINT64, data, size, shape, rank); }
+}
+
 void MessagePackBuilder::write(const mc_rtc::Configuration & config)
 {
   config.toMessagePack(*this);
@@ -291,6 +392,11 @@ void MessagePackBuilder::write_object(const char * data, size_t s)
   mpack_write_object_bytes(impl_.get(), data, s);
 }
 
+size_t MessagePackBuilder::size() const noexcept
+{
+  return mpack_writer_buffer_used(impl_.get());
+}
+
 size_t MessagePackBuilder::finish()
 {
   if(mpack_writer_destroy(impl_.get()) != mpack_ok)
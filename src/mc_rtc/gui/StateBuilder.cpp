@@ -6,6 +6,13 @@
 
 #include <mc_rtc/gui/plot/types.h>
 
+#include "mpack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
 namespace mc_rtc
 {
 
@@ -15,6 +22,65 @@ namespace gui
 // Repeat static constexpr declarations
 // See https://stackoverflow.com/q/8016780
 constexpr int8_t StateBuilder::PROTOCOL_VERSION;
+constexpr int8_t StateBuilder::GEOMETRY_EXT;
+constexpr size_t StateBuilder::GEOMETRY_MIN_SIZE;
+
+namespace
+{
+
+/** Snapshot identifiers are unique in the process and unlikely to match the ones of a previous run that a client might
+ * still hold */
+uint64_t next_snapshot_id()
+{
+  static std::atomic<uint64_t> id{static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count())};
+  return ++id;
+}
+
+/** 64-bit FNV-1a hash */
+uint64_t hash(const char * data, size_t size)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i = 0; i < size; ++i)
+  {
+    h ^= static_cast<uint8_t>(data[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/** Skip the next object, returns its binary form */
+std::pair<const char *, size_t> object(mpack_reader_t & reader)
+{
+  const char * start = reader.data;
+  mpack_discard(&reader);
+  if(mpack_reader_error(&reader) != mpack_ok) { return {start, 0}; }
+  return {start, static_cast<size_t>(reader.data - start)};
+}
+
+/** Read a string in place */
+std::string_view str(mpack_reader_t & reader)
+{
+  uint32_t size = mpack_expect_str(&reader);
+  const char * data = mpack_read_bytes_inplace(&reader, size);
+  mpack_done_str(&reader);
+  if(mpack_reader_error(&reader) != mpack_ok) { return {}; }
+  return {data, size};
+}
+
+/** Name of a captured category */
+std::string_view category_name(const std::pair<const char *, size_t> & category)
+{
+  mpack_reader_t reader;
+  mpack_reader_init_data(&reader, category.first, category.second);
+  mpack_expect_array(&reader);
+  auto name = str(reader);
+  // The rest of the category is not read
+  mpack_reader_flag_error(&reader, mpack_error_data);
+  mpack_reader_destroy(&reader);
+  return name;
+}
+
+} // namespace
 
 const Color Color::White = Color(1, 1, 1, 1);
 const Color Color::Black = Color(0, 0, 0, 1);
@@ -152,57 +218,497 @@ void StateBuilder::removeElements(Category & category, void * source)
                  elements.end());
 }
 
-size_t StateBuilder::update(std::vector<char> & buffer)
+size_t StateBuilder::update(std::vector<char> & buffer, bool delta)
 {
-  mc_rtc::MessagePackBuilder builder(buffer);
-  builder.start_array(4);
+  return update(buffer, all_, delta);
+}
 
-  // Write protocol version
-  builder.write(PROTOCOL_VERSION);
+size_t StateBuilder::update(std::vector<char> & buffer, Subscription & subscription, bool delta)
+{
+  update();
+  size_t size = write(buffer, subscription, delta);
+  clearPlots();
+  return size;
+}
 
-  // Write static data
+size_t StateBuilder::write(std::vector<char> & buffer, bool delta)
+{
+  return write(buffer, all_, delta);
+}
+
+size_t StateBuilder::write(std::vector<char> & buffer, Subscription & subscription, bool delta)
+{
+  capture(capture_, subscription.categories);
+  return writer_.write(buffer, capture_, subscription, delta);
+}
+
+void StateBuilder::update()
+{
+  static std::vector<char> buffer;
+  static mc_rtc::MessagePackBuilder builder(buffer);
+  for(auto & p : plots_) { p.second.callback(builder, p.first, PlotAction::Update); }
+}
+
+void StateBuilder::clearPlots()
+{
+  static std::vector<char> buffer;
+  static mc_rtc::MessagePackBuilder builder(buffer);
+  for(auto & p : plots_) { p.second.callback(builder, p.first, PlotAction::Clear); }
+}
+
+void StateBuilder::capture(Capture & capture, const std::vector<std::vector<std::string>> & categories)
+{
   if(update_data_)
   {
     data_buffer_size_ = data_.toMessagePack(data_buffer_);
     update_data_ = false;
   }
+  mc_rtc::MessagePackBuilder builder(capture.buffer);
+  builder.start_array(3);
   builder.write_object(data_buffer_.data(), data_buffer_size_);
-
-  // Write elements
-  update(builder, elements_);
-
-  // Write plots
+  if(categories.empty()) { this->capture(builder, elements_); }
+  else
+  {
+    std::vector<const std::vector<std::string> *> paths;
+    for(const auto & c : categories) { paths.push_back(&c); }
+    this->capture(builder, elements_, paths, 0);
+  }
   builder.start_array(plots_.size());
   for(auto & p : plots_)
   {
     builder.start_array(p.second.msg_size);
-    p.second.callback(builder, p.first, false);
+    p.second.callback(builder, p.first, PlotAction::Write);
     builder.finish_array();
   }
   builder.finish_array();
-
   builder.finish_array();
-  return builder.finish();
+  capture.size = builder.finish();
 }
 
-void StateBuilder::update()
+void StateBuilder::capture(mc_rtc::MessagePackBuilder & builder, Category & category)
 {
-  static std::vector<char> buffer;
-  static mc_rtc::MessagePackBuilder builder(buffer);
-  for(auto & p : plots_) { p.second.callback(builder, p.first, true); }
+  // [name, [[uid, type, element], ...], [sub-categories]]
+  builder.start_array(3);
+  builder.write(category.name);
+  builder.start_array(category.elements.size());
+  for(auto & e : category.elements)
+  {
+    builder.start_array(3);
+    builder.write(e.uid);
+    builder.write(static_cast<uint64_t>(e.type));
+    e.write(e.element(), builder);
+    builder.finish_array();
+  }
+  builder.finish_array();
+  builder.start_array(category.sub.size());
+  for(auto & s : category.sub) { capture(builder, s); }
+  builder.finish_array();
+  builder.finish_array();
 }
 
-void StateBuilder::update(mc_rtc::MessagePackBuilder & builder, Category & category)
+void StateBuilder::capture(mc_rtc::MessagePackBuilder & builder,
+                           Category & category,
+                           const std::vector<const std::vector<std::string> *> & paths,
+                           size_t depth)
 {
-  builder.start_array(1 + category.elements.size() + 1);
+  for(const auto * p : paths)
+  {
+    if(p->size() == depth)
+    {
+      capture(builder, category);
+      return;
+    }
+  }
+  std::vector<Category *> sub;
+  std::vector<std::vector<const std::vector<std::string> *>> sub_paths;
+  for(auto & s : category.sub)
+  {
+    std::vector<const std::vector<std::string> *> s_paths;
+    for(const auto * p : paths)
+    {
+      if((*p)[depth] == s.name) { s_paths.push_back(p); }
+    }
+    if(s_paths.size())
+    {
+      sub.push_back(&s);
+      sub_paths.push_back(std::move(s_paths));
+    }
+  }
+  // The elements of this category are not captured
+  builder.start_array(3);
   builder.write(category.name);
-  for(auto & e : category.elements) { e.write(e.element(), builder); }
-  builder.start_array(category.sub.size());
-  for(auto & s : category.sub) { update(builder, s); }
+  builder.write();
+  builder.start_array(sub.size());
+  for(size_t i = 0; i < sub.size(); ++i) { capture(builder, *sub[i], sub_paths[i], depth + 1); }
+  builder.finish_array();
+  builder.finish_array();
+}
+
+struct StateBuilder::Writer::Impl
+{
+  /** Geometry of the elements that were not written in this many messages is dropped */
+  static constexpr uint64_t GEOMETRY_MAX_AGE = 1024;
+
+  struct Geometry
+  {
+    uint64_t hash = 0;
+    std::vector<char> data;
+  };
+  struct ElementGeometry
+  {
+    /** Message the element was last written in */
+    uint64_t used = 0;
+    /** Last geometry payloads of the element by field index */
+    std::vector<Geometry> fields;
+  };
+  /** Last geometry payloads by element uid, this only saves hashing the payloads again */
+  std::unordered_map<uint64_t, ElementGeometry> geometry;
+  /** Number of messages written */
+  uint64_t writes = 0;
+  /** Holds the binary form of an element while its geometry is replaced by references */
+  std::vector<char> element_buffer;
+  /** Geometry payloads written in the message */
+  std::vector<std::pair<uint64_t, const std::vector<char> *>> message_geometry;
+
+  size_t write(std::vector<char> & buffer, const Capture & capture, Subscription & subscription, bool delta);
+
+  /** Write a captured category
+   *
+   * \param delta Replace the elements that did not change since the last snapshot by their index in the snapshot,
+   * otherwise the elements are written in a new snapshot
+   *
+   * \param index Index of the next element in the snapshot
+   */
+  void write(mc_rtc::MessagePackBuilder & builder,
+             mpack_reader_t & reader,
+             Subscription & subscription,
+             bool delta,
+             size_t & index);
+
+  /** Write the subscribed parts of a captured category
+   *
+   * \param paths Subscribed categories that start with this category
+   *
+   * \param depth Depth of this category
+   */
+  void write(mc_rtc::MessagePackBuilder & builder,
+             mpack_reader_t & reader,
+             const std::vector<const std::vector<std::string> *> & paths,
+             size_t depth,
+             Subscription & subscription,
+             bool delta,
+             size_t & index);
+
+  /** Write an element in element_buffer with its geometry replaced by references
+   *
+   * \returns The size of the element in element_buffer
+   */
+  size_t writeGeometry(uint64_t uid,
+                       Elements type,
+                       const char * data,
+                       size_t size,
+                       Subscription & subscription,
+                       bool delta);
+};
+
+constexpr uint64_t StateBuilder::Writer::Impl::GEOMETRY_MAX_AGE;
+
+StateBuilder::Writer::Writer() : impl_(new Impl()) {}
+
+StateBuilder::Writer::~Writer() = default;
+
+StateBuilder::Writer::Writer(Writer &&) noexcept = default;
+
+StateBuilder::Writer & StateBuilder::Writer::operator=(Writer &&) noexcept = default;
+
+size_t StateBuilder::Writer::write(std::vector<char> & buffer,
+                                   const Capture & capture,
+                                   Subscription & subscription,
+                                   bool delta)
+{
+  return impl_->write(buffer, capture, subscription, delta);
+}
+
+size_t StateBuilder::Writer::Impl::write(std::vector<char> & buffer,
+                                         const Capture & capture,
+                                         Subscription & subscription,
+                                         bool delta)
+{
+  delta = delta && subscription.snapshot != 0;
+  if(!delta) { subscription.snapshot = next_snapshot_id(); }
+  ++writes;
+
+  mpack_reader_t reader;
+  mpack_reader_init_data(&reader, capture.buffer.data(), capture.size);
+  mpack_expect_array_match(&reader, 3);
+
+  mc_rtc::MessagePackBuilder builder(buffer);
+  builder.start_array(7);
+  message_geometry.resize(0);
+
+  // Write protocol version
+  builder.write(PROTOCOL_VERSION);
+
+  // Write static data
+  auto data = object(reader);
+  auto & snapshot_data = subscription.snapshot_data;
+  if(delta && data.second == snapshot_data.size() && std::equal(snapshot_data.begin(), snapshot_data.end(), data.first))
+  {
+    builder.write();
+  }
+  else { builder.write_object(data.first, data.second); }
+  if(!delta) { snapshot_data.assign(data.first, data.first + data.second); }
+
+  // Write elements
+  size_t index = 0;
+  if(subscription.categories.empty()) { write(builder, reader, subscription, delta, index); }
+  else
+  {
+    std::vector<const std::vector<std::string> *> paths;
+    for(const auto & c : subscription.categories) { paths.push_back(&c); }
+    write(builder, reader, paths, 0, subscription, delta, index);
+  }
+  if(!delta)
+  {
+    // Forget the elements that were removed since the previous snapshot
+    auto & elements = subscription.snapshot_elements;
+    for(auto it = elements.begin(); it != elements.end();)
+    {
+      if(it->second.snapshot != subscription.snapshot) { it = elements.erase(it); }
+      else { ++it; }
+    }
+  }
+
+  // Write plots
+  auto plots = object(reader);
+  builder.write_object(plots.first, plots.second);
+  mpack_done_array(&reader);
+
+  // Write the snapshot this message refers to
+  builder.write(subscription.snapshot);
+  builder.write(delta);
+
+  // Write the geometry table
+  builder.start_map(message_geometry.size());
+  for(const auto & g : message_geometry)
+  {
+    builder.write(g.first);
+    builder.write_object(g.second->data(), g.second->size());
+  }
+  builder.finish_map();
+  if(!delta)
+  {
+    subscription.snapshot_geometry.clear();
+    for(const auto & g : message_geometry) { subscription.snapshot_geometry.insert(g.first); }
+    for(auto it = geometry.begin(); it != geometry.end();)
+    {
+      if(writes - it->second.used > GEOMETRY_MAX_AGE) { it = geometry.erase(it); }
+      else { ++it; }
+    }
+  }
+
+  builder.finish_array();
+  size_t size = builder.finish();
+  if(mpack_reader_destroy(&reader) != mpack_ok)
+  {
+    mc_rtc::log::error("[StateBuilder] Failed to read the GUI capture");
+    return 0;
+  }
+  return size;
+}
+
+void StateBuilder::Writer::Impl::write(mc_rtc::MessagePackBuilder & builder,
+                                       mpack_reader_t & reader,
+                                       Subscription & subscription,
+                                       bool delta,
+                                       size_t & index)
+{
+  mpack_expect_array_match(&reader, 3);
+  auto name = str(reader);
+  // A category captured without its elements is written without them
+  size_t n = 0;
+  bool captured = mpack_peek_tag(&reader).type != mpack_type_nil;
+  if(captured) { n = mpack_expect_array(&reader); }
+  else { mpack_expect_nil(&reader); }
+  builder.start_array(1 + n + 1);
+  builder.write(name.data(), name.size());
+  for(size_t i = 0; i < n; ++i)
+  {
+    mpack_expect_array_match(&reader, 3);
+    uint64_t uid = mpack_expect_u64(&reader);
+    auto type = static_cast<Elements>(mpack_expect_u64(&reader));
+    auto element = object(reader);
+    mpack_done_array(&reader);
+    if(mpack_reader_error(&reader) != mpack_ok)
+    {
+      builder.write();
+      continue;
+    }
+    const char * data = element.first;
+    size_t size = element.second;
+    if(StateBuilder::geometry(type, 3))
+    {
+      size = writeGeometry(uid, type, data, size, subscription, delta);
+      data = element_buffer.data();
+    }
+    if(delta)
+    {
+      auto it = subscription.snapshot_elements.find(uid);
+      if(it != subscription.snapshot_elements.end() && it->second.snapshot == subscription.snapshot
+         && size == it->second.data.size() && std::equal(it->second.data.begin(), it->second.data.end(), data))
+      {
+        builder.write(static_cast<uint64_t>(it->second.index));
+        continue;
+      }
+    }
+    builder.write_object(data, size);
+    if(!delta)
+    {
+      auto & snapshot = subscription.snapshot_elements[uid];
+      snapshot.snapshot = subscription.snapshot;
+      snapshot.index = index++;
+      snapshot.data.assign(data, data + size);
+    }
+  }
+  if(captured) { mpack_done_array(&reader); }
+  size_t n_sub = mpack_expect_array(&reader);
+  builder.start_array(n_sub);
+  for(size_t i = 0; i < n_sub; ++i) { write(builder, reader, subscription, delta, index); }
+  mpack_done_array(&reader);
+  builder.finish_array();
+  mpack_done_array(&reader);
+  builder.finish_array();
+}
+
+void StateBuilder::Writer::Impl::write(mc_rtc::MessagePackBuilder & builder,
+                                       mpack_reader_t & reader,
+                                       const std::vector<const std::vector<std::string> *> & paths,
+                                       size_t depth,
+                                       Subscription & subscription,
+                                       bool delta,
+                                       size_t & index)
+{
+  for(const auto * p : paths)
+  {
+    if(p->size() == depth)
+    {
+      write(builder, reader, subscription, delta, index);
+      return;
+    }
+  }
+  mpack_expect_array_match(&reader, 3);
+  auto name = str(reader);
+  // The elements of the parents of the subscribed categories are not written
+  mpack_discard(&reader);
+  struct Sub
+  {
+    std::pair<const char *, size_t> data;
+    std::vector<const std::vector<std::string> *> paths;
+  };
+  std::vector<Sub> sub;
+  size_t n_sub = mpack_expect_array(&reader);
+  for(size_t i = 0; i < n_sub; ++i)
+  {
+    auto s = object(reader);
+    if(mpack_reader_error(&reader) != mpack_ok) { break; }
+    auto s_name = category_name(s);
+    std::vector<const std::vector<std::string> *> s_paths;
+    for(const auto * p : paths)
+    {
+      if((*p)[depth] == s_name) { s_paths.push_back(p); }
+    }
+    if(s_paths.size()) { sub.push_back({s, std::move(s_paths)}); }
+  }
+  mpack_done_array(&reader);
+  mpack_done_array(&reader);
+  builder.start_array(2);
+  builder.write(name.data(), name.size());
+  builder.start_array(sub.size());
+  for(const auto & s : sub)
+  {
+    mpack_reader_t sub_reader;
+    mpack_reader_init_data(&sub_reader, s.data.first, s.data.second);
+    write(builder, sub_reader, s.paths, depth + 1, subscription, delta, index);
+    if(mpack_reader_destroy(&sub_reader) != mpack_ok) { mpack_reader_flag_error(&reader, mpack_error_data); }
+  }
   builder.finish_array();
   builder.finish_array();
 }
 
+bool StateBuilder::geometry(Elements type, size_t field) noexcept
+{
+  switch(type)
+  {
+    case Elements::PolyhedronTrianglesList:
+    case Elements::PolyhedronVerticesTriangles:
+      return field >= 3;
+    case Elements::Polygon:
+    case Elements::Visual:
+    case Elements::Robot:
+      return field == 3;
+    default:
+      return false;
+  }
+}
+
+size_t StateBuilder::Writer::Impl::writeGeometry(uint64_t uid,
+                                                 Elements type,
+                                                 const char * data,
+                                                 size_t size,
+                                                 Subscription & subscription,
+                                                 bool delta)
+{
+  mpack_reader_t reader;
+  mpack_reader_init_data(&reader, data, size);
+  size_t n = mpack_expect_array(&reader);
+  auto & element = geometry[uid];
+  element.used = writes;
+  if(element.fields.size() < n) { element.fields.resize(n); }
+  element_buffer.resize(size);
+  // The array header does not change
+  size_t out = static_cast<size_t>(reader.data - data);
+  std::copy(data, reader.data, element_buffer.data());
+  for(size_t i = 0; i < n; ++i)
+  {
+    const char * start = reader.data;
+    mpack_discard(&reader);
+    if(mpack_reader_error(&reader) != mpack_ok) { break; }
+    size_t field_size = static_cast<size_t>(reader.data - start);
+    if(!StateBuilder::geometry(type, i) || field_size < GEOMETRY_MIN_SIZE)
+    {
+      std::copy(start, reader.data, element_buffer.data() + out);
+      out += field_size;
+      continue;
+    }
+    auto & g = element.fields[i];
+    if(g.data.size() != field_size || !std::equal(g.data.begin(), g.data.end(), start))
+    {
+      g.data.assign(start, reader.data);
+      g.hash = hash(start, field_size);
+    }
+    if((!delta || subscription.snapshot_geometry.count(g.hash) == 0)
+       && std::none_of(message_geometry.begin(), message_geometry.end(),
+                       [&g](const auto & mg) { return mg.first == g.hash; }))
+    {
+      message_geometry.push_back({g.hash, &g.data});
+    }
+    // fixext 8
+    char * ref = element_buffer.data() + out;
+    ref[0] = static_cast<char>(0xd7);
+    ref[1] = GEOMETRY_EXT;
+    for(size_t b = 0; b < 8; ++b) { ref[2 + b] = static_cast<char>((g.hash >> (8 * b)) & 0xff); }
+    out += 10;
+  }
+  mpack_done_array(&reader);
+  if(mpack_reader_destroy(&reader) != mpack_ok)
+  {
+    mc_rtc::log::error("[StateBuilder] Failed to write the geometry of an element");
+    element_buffer.assign(data, data + size);
+    return size;
+  }
+  return out;
+}
+
 bool StateBuilder::handleRequest(const std::vector<std::string> & category,
                                  const std::string & name,
                                  const mc_rtc::Configuration & data)
@@ -0,0 +1,197 @@
+#pragma once
+
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/log/Logger.h>
+#include <mc_rtc/logging.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+#ifdef MC_RTC_HAS_ZSTD
+#  include <zstd.h>
+#endif
+
+namespace mc_rtc::log::internal
+{
+
+/** Read the frames of a binary log, transparently decompress the blocks of compressed logs */
+struct BinaryLogReader
+{
+  /** Returned by \ref offset() when reading cannot resume at the next frame */
+  static constexpr uint64_t npos = std::numeric_limits<uint64_t>::max();
+
+  BinaryLogReader() = default;
+  BinaryLogReader(const BinaryLogReader &) = delete;
+  BinaryLogReader & operator=(const BinaryLogReader &) = delete;
+
+  ~BinaryLogReader()
+  {
+#ifdef MC_RTC_HAS_ZSTD
+    ZSTD_freeDCtx(dctx_);
+#endif
+  }
+
+  /** Open a log and read its header
+   *
+   * \returns False if the file cannot be opened or is not a valid (supported) log, the error is displayed
+   */
+  bool open(const std::string & f)
+  {
+    namespace bfs = boost::filesystem;
+    if(!bfs::exists(f) || !bfs::is_regular(f))
+    {
+      log::error("Could not open log {}, file does not exist", f);
+      return false;
+    }
+    ifs_.open(f, std::ifstream::binary);
+    if(!ifs_.is_open())
+    {
+      log::error("Failed to open {}", f);
+      return false;
+    }
+    char magic[sizeof(Logger::magic)];
+    ifs_.read(magic, sizeof(Logger::magic));
+    if(!ifs_ || memcmp(magic, &Logger::magic, sizeof(Logger::magic) - 1) != 0)
+    {
+      log::error("Log {} is not a valid mc_rtc binary log (Invalid magic number)", f);
+      return false;
+    }
+    int8_t version = static_cast<int8_t>(magic[sizeof(Logger::magic) - 1] - Logger::magic[3]);
+    if(version < 0)
+    {
+      log::error("Log {} is not a valid mc_rtc binary log (Invalid version number)", f);
+      return false;
+    }
+    if(version > Logger::version)
+    {
+      log::error("Log {} cannot be read by this version of mc_rtc ({} > {})", f, version, Logger::version);
+      return false;
+    }
+    uint32_t features = 0;
+    if(version > 1)
+    {
+      ifs_.read((char *)&features, sizeof(uint32_t));
+      if(!ifs_)
+      {
+        log::error("Log {} is not a valid mc_rtc binary log (Missing features)", f);
+        return false;
+      }
+      if(!Logger::supports(features))
+      {
+        log::error("Log {} uses features that are not supported by this build of mc_rtc (features: {:#x}){}", f,
+                   features, (features & Logger::COMPRESSED) ? ", compressed logs require zstd support" : "");
+        return false;
+      }
+    }
+    // The frames layout did not change since version 1, HELD_VALUES only allows nil values
+    version_ = std::min<int8_t>(version, 1);
+    features_ = features;
+    compressed_ = features & Logger::COMPRESSED;
+    start_ = static_cast<uint64_t>(ifs_.tellg());
+    offset_ = start_;
+    return true;
+  }
+
+  /** Version of the frames in the log */
+  int8_t version() const noexcept { return version_; }
+
+  /** Features of the log (see Logger::Features) */
+  uint32_t features() const noexcept { return features_; }
+
+  /** Offset of the first frame in the file */
+  uint64_t start() const noexcept { return start_; }
+
+  /** Offset where reading can resume to get the next frame or \ref npos
+   *
+   * For a compressed log this is only available when the next frame is the first frame of a block
+   */
+  uint64_t offset() const noexcept { return offset_; }
+
+  /** Resume reading at the given offset which must have been obtained from \ref offset() */
+  bool seek(uint64_t offset)
+  {
+    ifs_.clear();
+    ifs_.seekg(static_cast<std::streamoff>(offset));
+    block_size_ = 0;
+    block_offset_ = 0;
+    offset_ = offset;
+    return ifs_.good();
+  }
+
+  /** Read the next frame, returns false when there is no more frame to read */
+  bool next(const char *& data, uint64_t & size)
+  {
+    if(!compressed_)
+    {
+      ifs_.read((char *)&size, sizeof(uint64_t));
+      if(!ifs_) { return false; }
+      if(buffer_.size() < size) { buffer_.resize(size); }
+      ifs_.read(buffer_.data(), static_cast<std::streamsize>(size));
+      if(!ifs_) { return false; }
+      data = buffer_.data();
+      offset_ += sizeof(uint64_t) + size;
+      return true;
+    }
+    if(block_offset_ + sizeof(uint64_t) > block_size_ && !read_block()) { return false; }
+    std::memcpy(&size, buffer_.data() + block_offset_, sizeof(uint64_t));
+    block_offset_ += sizeof(uint64_t);
+    if(block_offset_ + size > block_size_)
+    {
+      log::error("Corrupted block in compressed log");
+      return false;
+    }
+    data = buffer_.data() + block_offset_;
+    block_offset_ += size;
+    offset_ = block_offset_ + sizeof(uint64_t) > block_size_ ? static_cast<uint64_t>(ifs_.tellg()) : npos;
+    return true;
+  }
+
+private:
+  std::ifstream ifs_;
+  int8_t version_ = 0;
+  uint32_t features_ = 0;
+  bool compressed_ = false;
+  uint64_t start_ = 0;
+  uint64_t offset_ = 0;
+  std::vector<char> buffer_;
+  std::vector<char> zbuffer_;
+  size_t block_size_ = 0;
+  size_t block_offset_ = 0;
+#ifdef MC_RTC_HAS_ZSTD
+  ZSTD_DCtx * dctx_ = nullptr;
+#endif
+
+  bool read_block()
+  {
+#ifdef MC_RTC_HAS_ZSTD
+    uint64_t header[2] = {0, 0};
+    ifs_.read((char *)header, sizeof(header));
+    if(!ifs_) { return false; }
+    if(zbuffer_.size() < header[0]) { zbuffer_.resize(header[0]); }
+    if(buffer_.size() < header[1]) { buffer_.resize(header[1]); }
+    ifs_.read(zbuffer_.data(), static_cast<std::streamsize>(header[0]));
+    if(!ifs_) { return false; }
+    if(!dctx_) { dctx_ = ZSTD_createDCtx(); }
+    size_t size = ZSTD_decompressDCtx(dctx_, buffer_.data(), header[1], zbuffer_.data(), header[0]);
+    if(ZSTD_isError(size) || size != header[1])
+    {
+      log::error("Failed to decompress a block of the log");
+      return false;
+    }
+    block_size_ = size;
+    block_offset_ = 0;
+    return true;
+#else
+    return false;
+#endif
+  }
+};
+
+} // namespace mc_rtc::log::internal
@@ -0,0 +1,335 @@
+#pragma once
+
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/logging.h>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace mc_rtc::log::internal
+{
+
+/** Write a file with io_uring and O_DIRECT, bypassing the page cache
+ *
+ * Data is copied into a fixed pool of aligned buffers allocated (and touched) at construction. Full buffers are queued
+ * as io_uring writes and sent to the kernel in batches by \ref submit, the buffers are re-used once their write
+ * completed. The file is pre-allocated ahead of the writes and truncated to the size of the data when it is closed.
+ *
+ * All methods must be called from the same thread except \ref latency
+ */
+struct DirectLogFile
+{
+  /** Alignment of the buffers, sizes and offsets of the writes */
+  static constexpr size_t alignment = 4096;
+  /** Size of the file pre-allocations */
+  static constexpr uint64_t preallocation = 64 * 1024 * 1024;
+
+  /** Write latency statistics (milliseconds, from queuing to completion) over the last writes */
+  struct Latency
+  {
+    std::atomic<double> p50{0};
+    std::atomic<double> p99{0};
+    std::atomic<double> max{0};
+  };
+
+  DirectLogFile(size_t buffer_size = 1024 * 1024, size_t n_buffers = 8)
+  : buffer_size_(std::max<size_t>(alignment, buffer_size / alignment * alignment)),
+    buffers_(std::max<size_t>(n_buffers, 2))
+  {
+    for(auto & b : buffers_)
+    {
+      b.data = static_cast<char *>(std::aligned_alloc(alignment, buffer_size_));
+      if(!b.data) { return; }
+      std::memset(b.data, 0, buffer_size_);
+    }
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(buffers_.size()), &params));
+    if(ring_fd_ < 0) { return; }
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) { sq_size = cq_size = std::max(sq_size, cq_size); }
+    sq_size_ = sq_size;
+    cq_size_ = single_mmap ? 0 : cq_size;
+    sq_ptr_ = map(sq_size, IORING_OFF_SQ_RING);
+    cq_ptr_ = single_mmap ? sq_ptr_ : map(cq_size, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(map(sqes_size_, IORING_OFF_SQES));
+    if(!sq_ptr_ || !cq_ptr_ || !sqes_) { return; }
+    auto sq = static_cast<char *>(sq_ptr_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto cq = static_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    valid_ = true;
+  }
+
+  DirectLogFile(const DirectLogFile &) = delete;
+  DirectLogFile & operator=(const DirectLogFile &) = delete;
+
+  ~DirectLogFile()
+  {
+    if(is_open()) { close(); }
+    if(sqes_) { munmap(sqes_, sqes_size_); }
+    if(cq_ptr_ && cq_ptr_ != sq_ptr_) { munmap(cq_ptr_, cq_size_); }
+    if(sq_ptr_) { munmap(sq_ptr_, sq_size_); }
+    if(ring_fd_ >= 0) { ::close(ring_fd_); }
+    for(auto & b : buffers_) { std::free(b.data); }
+  }
+
+  /** True if io_uring is available */
+  inline bool valid() const noexcept { return valid_; }
+
+  inline bool is_open() const noexcept { return fd_ >= 0; }
+
+  /** Open (and truncate) \p path
+   *
+   * \returns False if the file cannot be opened with O_DIRECT (e.g. on tmpfs), the caller should use buffered writes
+   */
+  bool open(const std::string & path)
+  {
+    if(!valid_) { return false; }
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT | O_CLOEXEC, 0644);
+    if(fd_ < 0) { return false; }
+    size_ = 0;
+    buffer_offset_ = 0;
+    fill_ = 0;
+    current_ = 0;
+    allocated_ = 0;
+    failed_ = false;
+    return true;
+  }
+
+  /** Append data to the file, full buffers are queued until the next call to \ref submit */
+  void write(const char * data, uint64_t size)
+  {
+    size_ += size;
+    while(size)
+    {
+      size_t n = std::min<uint64_t>(size, buffer_size_ - fill_);
+      std::memcpy(buffers_[current_].data + fill_, data, n);
+      fill_ += n;
+      data += n;
+      size -= n;
+      if(fill_ == buffer_size_)
+      {
+        queue(current_, buffer_size_);
+        next_buffer();
+      }
+    }
+  }
+
+  /** Send the queued writes to the kernel and collect the completed ones */
+  void submit()
+  {
+    if(queued_) { enter(0); }
+    reap();
+  }
+
+  /** Write the data of the current (incomplete) buffer and wait for every write to complete */
+  void flush()
+  {
+    if(fill_ != 0)
+    {
+      // The end of the last block is padded and removed when the file is truncated
+      size_t size = (fill_ + alignment - 1) / alignment * alignment;
+      std::memset(buffers_[current_].data + fill_, 0, size - fill_);
+      queue(current_, size);
+    }
+    wait_all();
+    if(ftruncate(fd_, static_cast<off_t>(size_)) != 0) { error("truncate"); }
+    allocated_ = size_;
+  }
+
+  /** Flush the data and close the file */
+  void close()
+  {
+    flush();
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  /** Statistics of the write latencies, can be read from any thread */
+  inline const Latency & latency() const noexcept { return latency_; }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct Buffer
+  {
+    char * data = nullptr;
+    iovec iov;
+    bool in_flight = false;
+    clock::time_point queued;
+  };
+
+  size_t buffer_size_;
+  std::vector<Buffer> buffers_;
+  bool valid_ = false;
+  int ring_fd_ = -1;
+  void * sq_ptr_ = nullptr;
+  size_t sq_size_ = 0;
+  void * cq_ptr_ = nullptr;
+  size_t cq_size_ = 0;
+  io_uring_sqe * sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  unsigned * sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned * sq_array_ = nullptr;
+  unsigned * cq_head_ = nullptr;
+  unsigned * cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe * cqes_ = nullptr;
+
+  int fd_ = -1;
+  /** Size of the data written in the file */
+  uint64_t size_ = 0;
+  /** Offset of the current buffer in the file */
+  uint64_t buffer_offset_ = 0;
+  /** Bytes in the current buffer */
+  size_t fill_ = 0;
+  size_t current_ = 0;
+  /** Pre-allocated size of the file */
+  uint64_t allocated_ = 0;
+  /** Number of writes queued but not submitted yet */
+  unsigned queued_ = 0;
+  /** Number of writes submitted but not completed yet */
+  size_t in_flight_ = 0;
+  bool failed_ = false;
+
+  /** Latencies of the last writes */
+  std::array<double, 128> latencies_;
+  size_t n_latencies_ = 0;
+  Latency latency_;
+
+  void * map(size_t size, off_t offset)
+  {
+    void * ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  void error(const char * what)
+  {
+    if(!failed_) { mc_rtc::log::error("[Logger] Direct write failed ({}): {}", what, std::strerror(errno)); }
+    failed_ = true;
+  }
+
+  void queue(size_t idx, size_t size)
+  {
+    auto & b = buffers_[idx];
+    if(buffer_offset_ + size > allocated_)
+    {
+      // Reserve space ahead of the writes so they do not update the file metadata, failures are not an error
+      if(fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(allocated_), preallocation) == 0)
+      {
+        allocated_ += preallocation;
+      }
+    }
+    b.iov.iov_base = b.data;
+    b.iov.iov_len = size;
+    b.in_flight = true;
+    b.queued = clock::now();
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    auto & sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<uint64_t>(&b.iov);
+    sqe.len = 1;
+    sqe.off = buffer_offset_;
+    sqe.user_data = idx;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    queued_ += 1;
+    in_flight_ += 1;
+  }
+
+  void next_buffer()
+  {
+    current_ = (current_ + 1) % buffers_.size();
+    buffer_offset_ += buffer_size_;
+    fill_ = 0;
+    // Every buffer is in use, wait for the oldest write
+    while(buffers_[current_].in_flight) { enter(1); }
+  }
+
+  void wait_all()
+  {
+    while(in_flight_) { enter(1); }
+  }
+
+  /** Submit the queued writes and wait for \p min_complete completions */
+  void enter(unsigned min_complete)
+  {
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, queued_, min_complete, flags, nullptr, 0));
+    if(ret < 0)
+    {
+      if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+        error("submit");
+        // Nothing will complete, give up on the pending writes
+        for(auto & b : buffers_) { b.in_flight = false; }
+        in_flight_ = 0;
+        queued_ = 0;
+      }
+    }
+    else { queued_ -= std::min<unsigned>(queued_, static_cast<unsigned>(ret)); }
+    reap();
+  }
+
+  void reap()
+  {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if(head == tail) { return; }
+    auto now = clock::now();
+    for(; head != tail; ++head)
+    {
+      const auto & cqe = cqes_[head & cq_mask_];
+      auto & b = buffers_[cqe.user_data];
+      if(cqe.res < 0 || static_cast<size_t>(cqe.res) != b.iov.iov_len)
+      {
+        errno = cqe.res < 0 ? -cqe.res : EIO;
+        error("write");
+      }
+      b.in_flight = false;
+      in_flight_ -= 1;
+      latencies_[n_latencies_++ % latencies_.size()] =
+          std::chrono::duration<double, std::milli>(now - b.queued).count();
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    std::array<double, 128> sorted;
+    size_t n = std::min(n_latencies_, latencies_.size());
+    std::copy_n(latencies_.begin(), n, sorted.begin());
+    std::sort(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(n));
+    latency_.p50.store(sorted[n / 2], std::memory_order_relaxed);
+    latency_.p99.store(sorted[n * 99 / 100], std::memory_order_relaxed);
+    latency_.max.store(sorted[n - 1], std::memory_order_relaxed);
+  }
+};
+
+} // namespace mc_rtc::log::internal
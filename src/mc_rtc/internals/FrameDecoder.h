@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/log/iterate_binary_log.h>
+
+#include "LogEntry.h"
+
+namespace mc_rtc::log::internal
+{
+
+/** Decode the frames of a binary log one at a time and hand them to an \ref iterate_binary_log_callback
+ *
+ * The decoder keeps track of the keys and meta data of the log across frames
+ */
+struct FrameDecoder
+{
+  /** Result of \ref decode */
+  enum class Result
+  {
+    /** The frame could not be decoded */
+    Error,
+    /** The callback returned false */
+    Stop,
+    /** The next frame can be decoded */
+    Continue
+  };
+
+  /** Constructor
+   *
+   * \param version Version of the frames
+   *
+   * \param filter If not null, only the selected keys are decoded
+   *
+   * \param extract Decode the values of the entries
+   *
+   * \param time Time entry provided in \ref IterateBinaryLogData::time, empty if not needed
+   *
+   * \param held_values True if the log holds values (see Logger::HELD_VALUES), \ref IterateBinaryLogData::copy_cb then
+   * writes the last value of the entries that are not written in the frame
+   */
+  FrameDecoder(int8_t version, KeyFilter * filter, bool extract, const std::string & time, bool held_values = false)
+  : version_(version), filter_(filter), extract_(extract), time_(time), held_(held_values)
+  {
+  }
+
+  /** Keys of the log */
+  std::vector<TypedKey> keys;
+  /** Meta data of the log */
+  std::optional<Logger::Meta> meta;
+
+  /** Set the keys of the log when reading does not start with the first frame
+   *
+   * The keys are reported to the callback with the next frame
+   */
+  void reset(std::vector<TypedKey> && log_keys)
+  {
+    keys = std::move(log_keys);
+    if(filter_) { filter_->update(keys); }
+    reset_ = true;
+  }
+
+  /** Decode a frame and call \p callback */
+  Result decode(const char * data, uint64_t size, const iterate_binary_log_callback & callback)
+  {
+    bool keys_changed = reset_;
+    reset_ = false;
+    std::vector<Logger::GUIEvent> events;
+    LogEntry log(version_, data, size, meta, keys, events, keys_changed, extract_, filter_, held_);
+    if(!log.valid()) { return Result::Error; }
+    if(held_)
+    {
+      if(keys_changed) { held_values_.update(keys); }
+      log.hold(held_values_);
+    }
+    std::optional<double> t;
+    if(time_.size())
+    {
+      auto t_it = std::find_if(keys.begin(), keys.end(), [&](const auto & k) { return k.key == time_; });
+      if(t_it == keys.end())
+      {
+        log::error("Request time key: {} not found in log", time_);
+        return Result::Error;
+      }
+      if(t_it->type != LogType::Double)
+      {
+        log::error("Time key: {} not recording double", time_);
+        return Result::Error;
+      }
+      t = log.getTime(static_cast<size_t>(std::distance(keys.begin(), t_it)));
+    }
+    std::vector<std::string> keys_str;
+    if(keys_changed && filter_)
+    {
+      keys_str.reserve(filter_->selected.size());
+      for(auto i : filter_->selected) { keys_str.push_back(keys[i].key); }
+    }
+    else if(keys_changed)
+    {
+      keys_str.reserve(keys.size());
+      for(const auto & k : keys) { keys_str.push_back(k.key); }
+    }
+    copy_callback copy = [&](mc_rtc::MessagePackBuilder & builder, const std::vector<std::string> & keys)
+    { log.copy(builder, keys, held_ ? &held_values_ : nullptr); };
+    if(!callback(IterateBinaryLogData{keys_str, log.records(), events, t, copy, data, size, meta}))
+    {
+      return Result::Stop;
+    }
+    return Result::Continue;
+  }
+
+private:
+  int8_t version_;
+  KeyFilter * filter_;
+  bool extract_;
+  std::string time_;
+  bool reset_ = false;
+  bool held_;
+  /** Last value written for each key when held_ is true */
+  HeldValues held_values_;
+};
+
+} // namespace mc_rtc::log::internal
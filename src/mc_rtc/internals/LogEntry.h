@@ -3,7 +3,10 @@
 #include <mc_rtc/log/FlatLog.h>
 #include <mc_rtc/logging.h>
 
+#include <algorithm>
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "msgpack.h"
 
@@ -298,6 +301,87 @@ inline FlatLog::record::unique_void_ptr dataFromNode(const LogType & type, mpack
   }
 }
 
+template<typename T>
+struct LogTypeTag
+{
+  using type = T;
+};
+
+/** Call \p cb with a \ref LogTypeTag matching \p type, returns false if type is None */
+template<typename CallbackT>
+bool visitLogType(const LogType & type, CallbackT && cb)
+{
+  switch(type)
+  {
+    case LogType::Bool:
+      cb(LogTypeTag<bool>{});
+      return true;
+    case LogType::Int8_t:
+      cb(LogTypeTag<int8_t>{});
+      return true;
+    case LogType::Int16_t:
+      cb(LogTypeTag<int16_t>{});
+      return true;
+    case LogType::Int32_t:
+      cb(LogTypeTag<int32_t>{});
+      return true;
+    case LogType::Int64_t:
+      cb(LogTypeTag<int64_t>{});
+      return true;
+    case LogType::Uint8_t:
+      cb(LogTypeTag<uint8_t>{});
+      return true;
+    case LogType::Uint16_t:
+      cb(LogTypeTag<uint16_t>{});
+      return true;
+    case LogType::Uint32_t:
+      cb(LogTypeTag<uint32_t>{});
+      return true;
+    case LogType::Uint64_t:
+      cb(LogTypeTag<uint64_t>{});
+      return true;
+    case LogType::Float:
+      cb(LogTypeTag<float>{});
+      return true;
+    case LogType::Double:
+      cb(LogTypeTag<double>{});
+      return true;
+    case LogType::String:
+      cb(LogTypeTag<std::string>{});
+      return true;
+    case LogType::Vector2d:
+      cb(LogTypeTag<Eigen::Vector2d>{});
+      return true;
+    case LogType::Vector3d:
+      cb(LogTypeTag<Eigen::Vector3d>{});
+      return true;
+    case LogType::Vector6d:
+      cb(LogTypeTag<Eigen::Vector6d>{});
+      return true;
+    case LogType::VectorXd:
+      cb(LogTypeTag<Eigen::VectorXd>{});
+      return true;
+    case LogType::Quaterniond:
+      cb(LogTypeTag<Eigen::Quaterniond>{});
+      return true;
+    case LogType::PTransformd:
+      cb(LogTypeTag<sva::PTransformd>{});
+      return true;
+    case LogType::ForceVecd:
+      cb(LogTypeTag<sva::ForceVecd>{});
+      return true;
+    case LogType::MotionVecd:
+      cb(LogTypeTag<sva::MotionVecd>{});
+      return true;
+    case LogType::VectorDouble:
+      cb(LogTypeTag<std::vector<double>>{});
+      return true;
+    case LogType::None:
+    default:
+      return false;
+  }
+}
+
 // For version 0, type and data are stored in the node every iteration
 inline FlatLog::record recordFromNode(mpack_node_t node, bool extract_data, size_t idx)
 {
@@ -309,19 +393,25 @@ inline FlatLog::record recordFromNode(mpack_node_t node, bool extract_data, size
   auto type = logTypeFromNode(node, idx);
   if(extract_data)
   {
-    auto data = mpack_node_array_at(node, idx + 1);
-    return {type, dataFromNode(type, data)};
+    auto data = dataFromNode(type, mpack_node_array_at(node, idx + 1));
+    if(!data) { return {LogType::None, std::move(data)}; }
+    return {type, std::move(data)};
   }
   else { return {type, {nullptr, void_deleter<int>}}; }
 }
 
 // For version 1 and up, only data is stored in the node, type is from events
-inline FlatLog::record recordFromNode(LogType type, mpack_node_t node, bool extract_data, size_t idx)
+// In a log that holds values, a nil value means the entry was not written in this frame (see Logger::EntryPolicy), the
+// returned record has no data. A value that cannot be decoded is returned as a LogType::None record.
+inline FlatLog::record recordFromNode(LogType type, mpack_node_t node, bool extract_data, size_t idx, bool held_values)
 {
   if(extract_data)
   {
     auto data = mpack_node_array_at(node, idx);
-    return {type, dataFromNode(type, data)};
+    if(held_values && mpack_node_type(data) == mpack_type_nil) { return {type, {nullptr, void_deleter<int>}}; }
+    auto value = dataFromNode(type, data);
+    if(!value) { return {LogType::None, std::move(value)}; }
+    return {type, std::move(value)};
   }
   else { return {type, {nullptr, void_deleter<int>}}; }
 }
@@ -332,19 +422,91 @@ struct TypedKey
   std::string key;
 };
 
+/** Restrict the records decoded by \ref LogEntry to a set of keys
+ *
+ * A key ending with '*' selects all the keys that start with the given prefix
+ */
+struct KeyFilter
+{
+  KeyFilter(const std::vector<std::string> & keys)
+  {
+    for(const auto & k : keys)
+    {
+      if(k.size() && k.back() == '*') { prefixes.push_back(k.substr(0, k.size() - 1)); }
+      else { this->keys.insert(k); }
+    }
+  }
+
+  /** Update the selection after the keys in the log changed */
+  void update(const std::vector<TypedKey> & log_keys)
+  {
+    selected.clear();
+    for(size_t i = 0; i < log_keys.size(); ++i)
+    {
+      if(match(log_keys[i].key)) { selected.push_back(i); }
+    }
+  }
+
+  bool match(const std::string & key) const
+  {
+    if(keys.count(key)) { return true; }
+    return std::any_of(prefixes.begin(), prefixes.end(),
+                       [&](const std::string & p) { return key.compare(0, p.size(), p) == 0; });
+  }
+
+  /** Keys to decode */
+  std::unordered_set<std::string> keys;
+  /** Prefixes of keys to decode */
+  std::vector<std::string> prefixes;
+  /** Indexes of the selected keys in the log's keys */
+  std::vector<size_t> selected;
+};
+
+/** Last value written for each key of a log that holds values (see Logger::HELD_VALUES)
+ *
+ * The values are kept serialized so that they can replace nil values when a frame is copied at the start of a new log
+ */
+struct HeldValues
+{
+  /** Keys of the log */
+  std::vector<std::string> keys;
+  /** Serialized value of each key, empty if the key was never written */
+  std::vector<std::vector<char>> values;
+  /** Scratch buffer used to serialize the values */
+  std::vector<char> buffer;
+
+  /** Update the storage after the keys of the log changed, the values of the removed keys are dropped */
+  void update(const std::vector<TypedKey> & log_keys)
+  {
+    std::unordered_map<std::string, std::vector<char>> previous;
+    for(size_t i = 0; i < keys.size(); ++i) { previous[keys[i]] = std::move(values[i]); }
+    keys.resize(log_keys.size());
+    values.resize(log_keys.size());
+    for(size_t i = 0; i < log_keys.size(); ++i)
+    {
+      keys[i] = log_keys[i].key;
+      auto it = previous.find(keys[i]);
+      if(it != previous.end()) { values[i] = std::move(it->second); }
+      else { values[i].clear(); }
+    }
+  }
+};
+
 struct LogEntry : mpack_tree_t
 {
   LogEntry(int8_t version,
-           const std::vector<char> & data,
+           const char * data,
            size_t size,
            std::optional<Logger::Meta> & metaOut,
            std::vector<TypedKey> & keysOut,
            std::vector<Logger::GUIEvent> & eventsOut,
            bool & keysChanged,
-           bool extract_data = true)
-  : version_(version)
+           bool extract_data = true,
+           KeyFilter * filter = nullptr,
+           bool held_values = false)
+  : version_(version), filter_(filter)
   {
-    mpack_tree_init_data(this, data.data(), size);
+    mpack_tree_init_data(this, data, size);
     mpack_tree_parse(this);
     if(mpack_tree_error(this) != mpack_ok)
     {
@@ -398,10 +560,22 @@ struct LogEntry : mpack_tree_t
         return;
       }
       size_t s = mpack_node_array_length(records);
-      for(size_t i = 0; i < s / 2; ++i)
+      if(!filter_)
       {
-        records_.push_back(recordFromNode(records, extract_data, 2 * i));
-        if(keys_.size()) { keysOut.push_back({records_.back().type, keys_[i]}); }
+        for(size_t i = 0; i < s / 2; ++i)
+        {
+          records_.push_back(recordFromNode(records, extract_data, 2 * i));
+          if(keys_.size()) { keysOut.push_back({records_.back().type, keys_[i]}); }
+        }
+      }
+      else
+      {
+        if(keys_.size())
+        {
+          for(size_t i = 0; i < s / 2; ++i) { keysOut.push_back({logTypeFromNode(records, 2 * i), keys_[i]}); }
+          filter_->update(keysOut);
+        }
+        for(auto i : filter_->selected) { records_.push_back(recordFromNode(records, extract_data, 2 * i)); }
       }
     }
     else if(version_ == 1)
@@ -544,8 +718,23 @@ struct LogEntry : mpack_tree_t
         valid_ = false;
         return;
       }
-      size_t s = mpack_node_array_length(records);
-      for(size_t i = 0; i < s; ++i) { records_.push_back(recordFromNode(keysOut[i].type, records, extract_data, i)); }
+      if(!filter_)
+      {
+        size_t s = mpack_node_array_length(records);
+        for(size_t i = 0; i < s; ++i)
+        {
+          records_.push_back(recordFromNode(keysOut[i].type, records, extract_data, i, held_values));
+        }
+      }
+      else
+      {
+        if(keysChanged) { filter_->update(keysOut); }
+        records_.reserve(filter_->selected.size());
+        for(auto i : filter_->selected)
+        {
+          records_.push_back(recordFromNode(keysOut[i].type, records, extract_data, i, held_values));
+        }
+      }
     }
     else
     {
@@ -566,6 +755,18 @@ struct LogEntry : mpack_tree_t
 
   std::vector<FlatLog::record> & records() { return records_; }
 
+  /** True if every entry is written in this frame (i.e. no value is nil) */
+  bool complete() const
+  {
+    if(version_ == 0) { return true; }
+    auto values = mpack_node_array_at(root_, 1);
+    for(size_t i = 0; i < mpack_node_array_length(values); ++i)
+    {
+      if(mpack_node_type(mpack_node_array_at(values, i)) == mpack_type_nil) { return false; }
+    }
+    return true;
+  }
+
   /** Should only be used to retrieve time values from the log */
   double getTime(size_t idx)
   {
@@ -575,15 +776,60 @@ struct LogEntry : mpack_tree_t
     else { return mpack_node_double(mpack_node_array_at(values, idx)); }
   }
 
-  /** Rebuild this log entry with new keys */
-  void copy(mc_rtc::MessagePackBuilder & builder, const std::vector<std::string> & keys)
+  /** Keep the values written in this frame (only the selected values when a filter is used)
+   *
+   * \p held must be up-to-date with the keys of the log (see HeldValues::update)
+   */
+  void hold(HeldValues & held)
+  {
+    if(version_ == 0) { return; }
+    auto values = mpack_node_array_at(root_, 1);
+    std::vector<size_t> written;
+    auto select = [&](size_t i)
+    {
+      if(i < held.values.size() && mpack_node_type(mpack_node_array_at(values, i)) != mpack_type_nil)
+      {
+        written.push_back(i);
+      }
+    };
+    if(filter_)
+    {
+      for(auto i : filter_->selected) { select(i); }
+    }
+    else
+    {
+      for(size_t i = 0; i < mpack_node_array_length(values); ++i) { select(i); }
+    }
+    if(written.empty()) { return; }
+    // The values are serialized one after the other in the scratch buffer then copied
+    mc_rtc::MessagePackBuilder builder(held.buffer);
+    builder.start_array(written.size());
+    for(auto i : written)
+    {
+      size_t start = builder.size();
+      copy_data(builder, mpack_node_array_at(values, i));
+      held.values[i].assign(held.buffer.data() + start, held.buffer.data() + builder.size());
+    }
+    builder.finish_array();
+    builder.finish();
+  }
+
+  /** Rebuild this log entry with new keys
+   *
+   * The GUI events and start event of the entry are kept. When a filter is used, only the selected values are copied
+   *
+   * If \p held is provided, nil values are replaced by the last value written for the entry
+   */
+  void copy(mc_rtc::MessagePackBuilder & builder,
+            const std::vector<std::string> & keys,
+            const HeldValues * held = nullptr)
   {
     builder.start_array(2);
     if(keys.size() != records_.size())
     {
       mc_rtc::log::error_and_throw("Expected to copy {} but has {} records", keys.size(), records_.size());
     }
-    builder.start_array(keys.size());
+    builder.start_array(keys.size() + events(2) + events(3));
     for(size_t i = 0; i < keys.size(); ++i)
     {
       const auto & k = keys[i];
@@ -594,14 +840,40 @@ struct LogEntry : mpack_tree_t
       builder.write(k);
       builder.finish_array();
     }
+    copy_events(builder, 3);
+    copy_events(builder, 2);
     builder.finish_array();
-    copy(builder, mpack_node_array_at(root_, 1));
+    copy(builder, mpack_node_array_at(root_, 1), held);
     builder.finish_array();
   }
 
+  /** Copy the values of this entry (only the selected values when a filter is used)
+   *
+   * If \p held is provided, nil values are replaced by the last value written for the entry
+   */
+  void copy_values(mc_rtc::MessagePackBuilder & builder, const HeldValues * held = nullptr)
+  {
+    copy(builder, mpack_node_array_at(root_, 1), held);
+  }
+
+  /** Number of events of the given type (see Logger) in this entry */
+  size_t events(uint8_t type) const
+  {
+    size_t n = 0;
+    for_each_event(type, [&n](mpack_node_t) { n++; });
+    return n;
+  }
+
+  /** Copy the events of the given type (see Logger) in this entry, events are copied one after the other */
+  void copy_events(mc_rtc::MessagePackBuilder & builder, uint8_t type)
+  {
+    for_each_event(type, [&](mpack_node_t event) { copy_data(builder, event); });
+  }
+
 private:
   int8_t version_ = 0;
   bool valid_ = true;
+  KeyFilter * filter_ = nullptr;
   mpack_node_t root_;
   std::vector<FlatLog::record> records_;
 
@@ -632,8 +904,20 @@ private:
         for(size_t i = 0; i < mpack_node_array_length(data); ++i) { copy_data(builder, mpack_node_array_at(data, i)); }
         builder.finish_array();
         break;
-      case mpack_type_map:
       case mpack_type_nil:
+        // Entry not written in this frame
+        builder.write();
+        break;
+      case mpack_type_map:
+        // Only found in events data
+        builder.start_map(mpack_node_map_count(data));
+        for(size_t i = 0; i < mpack_node_map_count(data); ++i)
+        {
+          copy_data(builder, mpack_node_map_key_at(data, i));
+          copy_data(builder, mpack_node_map_value_at(data, i));
+        }
+        builder.finish_map();
+        break;
       case mpack_type_missing:
       default:
         log::error("This data should not appear in a log");
@@ -641,11 +925,40 @@ private:
     };
   }
 
-  void copy(mc_rtc::MessagePackBuilder & builder, mpack_node_t value)
+  template<typename CallbackT>
+  void for_each_event(uint8_t type, CallbackT && cb) const
+  {
+    if(version_ == 0) { return; }
+    auto events = mpack_node_array_at(root_, 0);
+    if(mpack_node_type(events) != mpack_type_array) { return; }
+    for(size_t i = 0; i < mpack_node_array_length(events); ++i)
+    {
+      auto event = mpack_node_array_at(events, i);
+      if(mpack_node_u8(mpack_node_array_at(event, 0)) == type) { cb(event); }
+    }
+  }
+
+  void copy(mc_rtc::MessagePackBuilder & builder, mpack_node_t value, const HeldValues * held)
   {
+    auto copy_value = [&](size_t i)
+    {
+      auto data = mpack_node_array_at(value, i);
+      if(held && mpack_node_type(data) == mpack_type_nil && i < held->values.size() && held->values[i].size())
+      {
+        builder.write_object(held->values[i].data(), held->values[i].size());
+      }
+      else { copy_data(builder, data); }
+    };
+    if(filter_)
+    {
+      builder.start_array(filter_->selected.size());
+      for(auto i : filter_->selected) { copy_value(i); }
+      builder.finish_array();
+      return;
+    }
     size_t s = mpack_node_array_length(value);
     builder.start_array(s);
-    for(size_t i = 0; i < s; ++i) { copy_data(builder, mpack_node_array_at(value, i)); }
+    for(size_t i = 0; i < s; ++i) { copy_value(i); }
     builder.finish_array();
   }
 };
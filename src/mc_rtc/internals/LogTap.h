@@ -0,0 +1,174 @@
+#pragma once
+
+/*
+ * Copyright 2015-2023 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_rtc/logging.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace mc_rtc::log::internal
+{
+
+/** Layout of the shared memory written by the Logger for \ref mc_rtc::log::LogTap
+ *
+ * The memory holds this header, followed by the snapshot area and the frame ring:
+ * - the ring holds the frames exactly as they are written on disk ([size (uint64_t)][frame]), the writer never waits
+ *   for the readers: they detect when the data they read was overwritten;
+ * - the snapshot is a frame that holds the meta data and every active key (and no value), it is updated after every
+ *   frame that changes the keys so that readers can start reading at any frame of the ring.
+ */
+struct LogTapHeader
+{
+  static constexpr char magic[8] = {'M', 'C', 'R', 'T', 'C', 'T', 'A', 'P'};
+  static constexpr uint64_t layout_version = 1;
+
+  char magic_[8];
+  uint64_t version;
+  /** Version of the frames */
+  uint64_t log_version;
+  /** Size of the snapshot area */
+  uint64_t snapshot_capacity;
+  /** Size of the ring */
+  uint64_t capacity;
+  /** Non-zero once the Logger is gone */
+  std::atomic<uint64_t> closed;
+  /** Sequence counter of the snapshot, odd while it is written and 0 before the first snapshot */
+  std::atomic<uint64_t> snapshot_seq;
+  /** Size of the snapshot */
+  std::atomic<uint64_t> snapshot_size;
+  /** Position of the first frame that follows the snapshot */
+  std::atomic<uint64_t> snapshot_next;
+  /** Position up to which the ring is being written, the data before reserve - capacity is overwritten */
+  alignas(64) std::atomic<uint64_t> reserve;
+  /** Position up to which the ring is written */
+  std::atomic<uint64_t> head;
+  /** Position of the last frame in the ring */
+  std::atomic<uint64_t> last_frame;
+
+  static size_t size() noexcept { return (sizeof(LogTapHeader) + 63) / 64 * 64; }
+
+  char * snapshot() noexcept { return reinterpret_cast<char *>(this) + size(); }
+
+  char * ring() noexcept { return snapshot() + snapshot_capacity; }
+};
+
+/** Publish the frames of a Logger in shared memory, see \ref LogTapHeader */
+struct LogTapWriter
+{
+  LogTapWriter(const std::string & name, size_t capacity, int8_t log_version) : name_(name)
+  {
+    const uint64_t snapshot_capacity = std::max<uint64_t>(1024 * 1024, capacity / 4);
+    size_ = LogTapHeader::size() + snapshot_capacity + capacity;
+    // Readers of a previous Logger keep their mapping, the new Logger starts with a new object
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+    {
+      mc_rtc::log::error("[Logger] Failed to create the log tap {}: {}", name, std::strerror(errno));
+      return;
+    }
+    if(ftruncate(fd, static_cast<off_t>(size_)) != 0)
+    {
+      mc_rtc::log::error("[Logger] Failed to allocate the log tap {}: {}", name, std::strerror(errno));
+      ::close(fd);
+      shm_unlink(name.c_str());
+      return;
+    }
+    void * ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED)
+    {
+      mc_rtc::log::error("[Logger] Failed to map the log tap {}: {}", name, std::strerror(errno));
+      shm_unlink(name.c_str());
+      return;
+    }
+    header_ = new(ptr) LogTapHeader{};
+    header_->version = LogTapHeader::layout_version;
+    header_->log_version = static_cast<uint64_t>(log_version);
+    header_->snapshot_capacity = snapshot_capacity;
+    header_->capacity = capacity;
+    // The magic number is written last, readers wait for it
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header_->magic_, LogTapHeader::magic, sizeof(LogTapHeader::magic));
+  }
+
+  LogTapWriter(const LogTapWriter &) = delete;
+  LogTapWriter & operator=(const LogTapWriter &) = delete;
+
+  ~LogTapWriter()
+  {
+    if(!header_) { return; }
+    header_->closed.store(1);
+    munmap(header_, size_);
+    shm_unlink(name_.c_str());
+  }
+
+  inline bool valid() const noexcept { return header_ != nullptr; }
+
+  /** Publish a frame, never blocks */
+  void push(const char * data, uint64_t size)
+  {
+    const uint64_t needed = sizeof(uint64_t) + size;
+    if(needed > header_->capacity)
+    {
+      if(!too_large_) { mc_rtc::log::warning("[Logger] Frame too large for the log tap ({} bytes)", size); }
+      too_large_ = true;
+      return;
+    }
+    const uint64_t pos = head_;
+    header_->reserve.store(pos + needed, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    copy_in(pos, reinterpret_cast<const char *>(&size), sizeof(uint64_t));
+    copy_in(pos + sizeof(uint64_t), data, size);
+    head_ = pos + needed;
+    header_->head.store(head_, std::memory_order_release);
+    header_->last_frame.store(pos, std::memory_order_release);
+  }
+
+  /** Update the snapshot after the last pushed frame */
+  void snapshot(const char * data, uint64_t size)
+  {
+    if(size > header_->snapshot_capacity)
+    {
+      mc_rtc::log::warning("[Logger] The keys of the log do not fit in the log tap ({} > {} bytes)", size,
+                           header_->snapshot_capacity);
+      size = 0;
+    }
+    const uint64_t seq = header_->snapshot_seq.load(std::memory_order_relaxed);
+    header_->snapshot_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header_->snapshot(), data, size);
+    header_->snapshot_size.store(size, std::memory_order_relaxed);
+    header_->snapshot_next.store(head_, std::memory_order_relaxed);
+    header_->snapshot_seq.store(seq + 2, std::memory_order_release);
+  }
+
+private:
+  std::string name_;
+  size_t size_ = 0;
+  LogTapHeader * header_ = nullptr;
+  /** Local copy of the head position */
+  uint64_t head_ = 0;
+  bool too_large_ = false;
+
+  void copy_in(uint64_t pos, const char * data, uint64_t size)
+  {
+    const uint64_t capacity = header_->capacity;
+    const uint64_t start = pos % capacity;
+    const uint64_t first = std::min<uint64_t>(size, capacity - start);
+    std::memcpy(header_->ring() + start, data, first);
+    if(first < size) { std::memcpy(header_->ring(), data + first, size - first); }
+  }
+};
+
+} // namespace mc_rtc::log::internal
@@ -5,6 +5,10 @@
 #include "mpack.h"
 
 #include <mc_rtc/Configuration.h>
+#include <mc_rtc/MessagePackBuilder.h>
+
+#include <algorithm>
+#include <cstring>
 
 namespace mc_rtc::internal
 {
@@ -21,6 +25,109 @@ inline std::string toString(mpack_node_t node)
   return {mpack_node_str(node), mpack_node_strlen(node)};
 }
 
+/** Map keys are usually strings, integer keys are converted to their string representation */
+inline std::string toKey(mpack_node_t node)
+{
+  switch(mpack_node_type(node))
+  {
+    case mpack_type_int:
+      return std::to_string(mpack_node_i64(node));
+    case mpack_type_uint:
+      return std::to_string(mpack_node_u64(node));
+    default:
+      return toString(node);
+  }
+}
+
+/** Load a little-endian value */
+template<typename T>
+inline T load(const char * data)
+{
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, data, sizeof(T));
+  if constexpr(!mc_rtc::internal::has_packed_arrays) { std::reverse(bytes, bytes + sizeof(T)); }
+  T out;
+  std::memcpy(&out, bytes, sizeof(T));
+  return out;
+}
+
+/** Push \p count items of a packed array into an array */
+template<typename T>
+inline void fromPackedArray(mc_rtc::Configuration config,
+                            const char *& data,
+                            size_t count,
+                            const uint8_t * shape,
+                            size_t rank)
+{
+  for(size_t i = 0; i < count; ++i)
+  {
+    if(rank == 0)
+    {
+      config.push(load<T>(data));
+      data += sizeof(T);
+    }
+    else { fromPackedArray<T>(config.array(shape[0]), data, shape[0], shape + 1, rank - 1); }
+  }
+}
+
+/** Decode a packed array (see mc_rtc::MessagePackBuilder::write_packed) */
+template<typename T, typename ArrayT>
+inline void fromPackedArray(mpack_node_t node, ArrayT && array)
+{
+  const char * data = mpack_node_data(node);
+  size_t size = mpack_node_data_len(node);
+  size_t rank = size ? static_cast<uint8_t>(data[0]) : 0;
+  if(size < 1 + rank) { log::error_and_throw("Invalid packed array in MessagePack"); }
+  const uint8_t * shape = reinterpret_cast<const uint8_t *>(data + 1);
+  size_t item = sizeof(T);
+  for(size_t i = 0; i < rank; ++i) { item *= shape[i]; }
+  size -= 1 + rank;
+  if(item == 0 || size % item != 0) { log::error_and_throw("Invalid packed array in MessagePack"); }
+  data += 1 + rank;
+  fromPackedArray<T>(array(size / item), data, size / item, shape, rank);
+}
+
+/** Decode the extensions used by mc_rtc
+ *
+ * Packed arrays are decoded as arrays and a GUI geometry reference (see mc_rtc::gui::StateBuilder::GEOMETRY_EXT) is
+ * decoded as the hash it holds
+ */
+template<typename ArrayT, typename ValueT>
+inline void fromExtension(mpack_node_t node, ArrayT && array, ValueT && value)
+{
+  switch(mpack_node_exttype(node))
+  {
+    case mc_rtc::MessagePackBuilder::GEOMETRY_REF:
+      if(mpack_node_data_len(node) != 8) { break; }
+      value(load<uint64_t>(mpack_node_data(node)));
+      return;
+    case mc_rtc::MessagePackBuilder::PACKED_FLOAT64:
+      fromPackedArray<double>(node, array);
+      return;
+    case mc_rtc::MessagePackBuilder::PACKED_FLOAT32:
+      fromPackedArray<float>(node, array);
+      return;
+    case mc_rtc::MessagePackBuilder::PACKED_INT32:
+      fromPackedArray<int32_t>(node, array);
+      return;
+    case mc_rtc::MessagePackBuilder::PACKED_INT64:
+      fromPackedArray<int64_t>(node, array);
+      return;
+    case mc_rtc::MessagePackBuilder::PACKED_UINT64:
+      fromPackedArray<uint64_t>(node, array);
+      return;
+    case mc_rtc::MessagePackBuilder::PACKED_UINT32:
+      fromPackedArray<uint32_t>(node, array);
+      return;
+    case mc_rtc::MessagePackBuilder::PACKED_UINT16:
+      fromPackedArray<uint16_t>(node, array);
+      return;
+    default:
+      break;
+  }
+  log::error_and_throw("Unsupported extension in MessagePack");
+}
+
 /** Add data into a map */
 inline void fromMessagePack(mc_rtc::Configuration config, const std::string & key, mpack_node_t node)
 {
@@ -55,6 +162,11 @@ inline void fromMessagePack(mc_rtc::Configuration config, const std::string & ke
     case mpack_type_map:
       fromMessagePackMap(config.add(key), node);
       break;
+    case mpack_type_ext:
+      fromExtension(
+          node, [&](size_t size) { return config.array(key, size); },
+          [&](uint64_t value) { config.add(key, value); });
+      break;
     default:
       log::error_and_throw("Unsupported type in MessagePack");
   }
@@ -94,6 +206,10 @@ inline void fromMessagePack(mc_rtc::Configuration config, mpack_node_t node)
     case mpack_type_map:
       fromMessagePackMap(config.object(), node);
       break;
+    case mpack_type_ext:
+      fromExtension(
+          node, [&](size_t size) { return config.array(size); }, [&](uint64_t value) { config.push(value); });
+      break;
     default:
       log::error_and_throw("Unsupported type in MessagePack");
   }
@@ -108,7 +224,7 @@ inline void fromMessagePackMap(mc_rtc::Configuration config, mpack_node_t node)
 {
   for(size_t i = 0; i < mpack_node_map_count(node); ++i)
   {
-    fromMessagePack(config, toString(mpack_node_map_key_at(node, i)), mpack_node_map_value_at(node, i));
+    fromMessagePack(config, toKey(mpack_node_map_key_at(node, i)), mpack_node_map_value_at(node, i));
   }
 }
 
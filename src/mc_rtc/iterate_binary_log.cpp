@@ -1,104 +1,97 @@
+#include <mc_rtc/log/BinaryLogIndex.h>
 #include <mc_rtc/log/Logger.h>
 #include <mc_rtc/log/iterate_binary_log.h>
 
-#include <boost/filesystem.hpp>
-namespace bfs = boost::filesystem;
-
-#include "internals/LogEntry.h"
-#include <fstream>
+#include "internals/BinaryLogReader.h"
+#include "internals/FrameDecoder.h"
 
 namespace mc_rtc::log
 {
 
-bool iterate_binary_log(const std::string & f,
-                        const iterate_binary_log_callback & callback,
-                        bool extract,
-                        const std::string & time)
+namespace
 {
-  auto fpath = bfs::path(f);
-  if(!bfs::exists(f) || !bfs::is_regular(f))
-  {
-    log::error("Could not open log {}, file does not exist", f);
-    return false;
-  }
-  std::ifstream ifs(f, std::ifstream::binary);
-  if(!ifs.is_open())
-  {
-    log::error("Failed to open {}", f);
-    return false;
-  }
-  std::vector<char> buffer(1024);
-  ifs.read(buffer.data(), sizeof(mc_rtc::Logger::magic));
-  if(memcmp(buffer.data(), &mc_rtc::Logger::magic, sizeof(mc_rtc::Logger::magic) - 1) != 0)
-  {
-    log::error("Log {} is not a valid mc_rtc binary log (Invalid magic number)", f);
-    return false;
-  }
-  int8_t version = static_cast<int8_t>(buffer.data()[sizeof(mc_rtc::Logger::magic) - 1] - mc_rtc::Logger::magic[3]);
-  if(version < 0)
+
+/** Start reading at the last index point before \p from
+ *
+ * The meta data is read from the first frame of the log and \p keys are initialized from the index
+ *
+ * \returns False if the log cannot be read from an index point, the reader is left at the start of the log
+ */
+bool seek(internal::BinaryLogReader & reader,
+          const std::string & f,
+          double from,
+          std::vector<internal::TypedKey> & keys,
+          std::optional<Logger::Meta> & meta)
+{
+  if(reader.version() < 1) { return false; }
+  BinaryLogIndex index;
+  if(!index.load(f)) { return false; }
+  const auto * point = index.find(from);
+  if(!point || point->offset == reader.start()) { return false; }
+  const char * data = nullptr;
+  uint64_t size = 0;
+  if(reader.next(data, size))
   {
-    log::error("Log {} is not a valid mc_rtc binary log (Invalid version number)", f);
-    return false;
+    std::vector<internal::TypedKey> first_keys;
+    std::vector<Logger::GUIEvent> events;
+    bool keys_changed = false;
+    internal::LogEntry first(reader.version(), data, size, meta, first_keys, events, keys_changed, false);
   }
-  if(version > mc_rtc::Logger::version)
+  if(!reader.seek(point->offset))
   {
-    log::error("Log {} cannot be read by this version of mc_rtc ({} > {})", version, mc_rtc::Logger::version);
+    meta = std::nullopt;
+    reader.seek(reader.start());
     return false;
   }
-  size_t t_index = 0;
-  bool extract_t = time.size() != 0;
+  keys.clear();
+  for(const auto & k : index.keys[point->keys]) { keys.push_back({k.type, k.name}); }
+  return true;
+}
+
+bool iterate_binary_log_impl(const std::string & f,
+                             const iterate_binary_log_callback & callback,
+                             internal::KeyFilter * filter,
+                             bool extract,
+                             const std::string & time,
+                             std::optional<double> from)
+{
+  internal::BinaryLogReader reader;
+  if(!reader.open(f)) { return false; }
+  internal::FrameDecoder decoder(reader.version(), filter, extract, time, reader.features() & Logger::HELD_VALUES);
 
   std::vector<internal::TypedKey> keys;
-  std::optional<Logger::Meta> meta;
+  // After seeking, the keys are provided in the first frame
+  if(from && seek(reader, f, *from, keys, decoder.meta)) { decoder.reset(std::move(keys)); }
 
-  while(ifs)
+  const char * entry = nullptr;
+  uint64_t entrySize = 0;
+  while(reader.next(entry, entrySize))
   {
-    uint64_t entrySize = 0;
-    ifs.read((char *)&entrySize, sizeof(uint64_t));
-    if(!ifs) { break; }
-    while(buffer.size() < entrySize) { buffer.resize(2 * buffer.size()); }
-    ifs.read(buffer.data(), static_cast<int>(entrySize));
-    if(!ifs) { break; }
-    bool keys_changed = false;
-    std::vector<Logger::GUIEvent> events;
-    internal::LogEntry log(version, buffer, entrySize, meta, keys, events, keys_changed, extract);
-    if(!log.valid()) { return false; }
-    if(extract_t)
-    {
-      auto t_it = std::find_if(keys.begin(), keys.end(), [&](const auto & k) { return k.key == time; });
-      if(t_it == keys.end())
-      {
-        log::error("Request time key: {} not found in log", time);
-        return false;
-      }
-      if(t_it->type != LogType::Double)
-      {
-        log::error("Time key: {} not recording double", time);
-        return false;
-      }
-      t_index = static_cast<size_t>(std::distance(keys.begin(), t_it));
-    }
-    std::optional<double> t;
-    if(extract_t) { t = log.getTime(t_index); }
-    auto keys_str = [&]()
-    {
-      std::vector<std::string> keys_str;
-      if(keys_changed)
-      {
-        keys_str.reserve(keys.size());
-        for(const auto & k : keys) { keys_str.push_back(k.key); }
-      }
-      return keys_str;
-    }();
-    if(!callback(
-           IterateBinaryLogData{keys_str, log.records(), events, t,
-                                [&log](mc_rtc::MessagePackBuilder & builder, const std::vector<std::string> & keys)
-                                { log.copy(builder, keys); }, buffer.data(), entrySize, meta}))
-    {
-      return false;
-    }
+    if(decoder.decode(entry, entrySize, callback) != internal::FrameDecoder::Result::Continue) { return false; }
   }
   return true;
 }
 
+} // namespace
+
+bool iterate_binary_log(const std::string & f,
+                        const iterate_binary_log_callback & callback,
+                        bool extract,
+                        const std::string & time,
+                        std::optional<double> from)
+{
+  return iterate_binary_log_impl(f, callback, nullptr, extract, time, from);
+}
+
+bool iterate_binary_log(const std::string & f,
+                        const iterate_binary_log_callback & callback,
+                        const std::vector<std::string> & keys,
+                        bool extract,
+                        const std::string & time,
+                        std::optional<double> from)
+{
+  internal::KeyFilter filter(keys);
+  return iterate_binary_log_impl(f, callback, &filter, extract, time, from);
+}
+
 } // namespace mc_rtc::log
@@ -1520,3 +1520,61 @@ BOOST_AUTO_TEST_CASE(TestVariant)
     BOOST_REQUIRE(std::get<1>(variant_array[1]) == "hello");
   }
 }
+
+BOOST_AUTO_TEST_CASE(TestPackedArrays)
+{
+  std::vector<double> values = {1.0, 2.0, 3.0};
+  std::vector<Eigen::Vector3d> points = {Eigen::Vector3d(1, 2, 3), Eigen::Vector3d(4, 5, 6)};
+  std::vector<std::array<size_t, 3>> indices = {{0, 1, 2}};
+  Eigen::VectorXd v = Eigen::VectorXd::Ones(4);
+  std::vector<MyNumber> numbers(2);
+  std::vector<char> buffer;
+  mc_rtc::MessagePackBuilder builder(buffer);
+  builder.start_array(5);
+  builder.write_packed(values);
+  builder.write_packed(points);
+  builder.write_packed(indices);
+  builder.write_packed(v);
+  builder.write_packed(numbers);
+  builder.finish_array();
+  size_t size = builder.finish();
+  // Packed arrays are decoded with their original shape
+  auto config = mc_rtc::Configuration::fromMessagePack(buffer.data(), size);
+  BOOST_REQUIRE(config.size() == 5);
+  BOOST_REQUIRE(config[0].size() == 3);
+  BOOST_REQUIRE(static_cast<std::vector<double>>(config[0]) == values);
+  BOOST_REQUIRE(static_cast<std::vector<Eigen::Vector3d>>(config[1]) == points);
+  std::vector<std::array<size_t, 3>> indices_out = config[2];
+  BOOST_REQUIRE(indices_out == indices);
+  BOOST_REQUIRE(static_cast<Eigen::VectorXd>(config[3]) == v);
+  BOOST_REQUIRE(config[4].size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(TestPackedIndices)
+{
+  // Unsigned integers are written with the narrowest type that holds them
+  auto pack = [](const std::vector<std::array<size_t, 3>> & indices, std::vector<char> & buffer)
+  {
+    mc_rtc::MessagePackBuilder builder(buffer);
+    builder.write_packed(indices);
+    return builder.finish();
+  };
+  std::vector<std::array<size_t, 3>> small = {{0, 1, 2}, {2, 3, 65535}};
+  std::vector<std::array<size_t, 3>> medium = {{0, 1, 2}, {2, 3, 65536}};
+  std::vector<std::array<size_t, 3>> large = {{0, 1, 2}, {2, 3, size_t(1) << 40}};
+  std::vector<char> small_buffer;
+  std::vector<char> medium_buffer;
+  std::vector<char> large_buffer;
+  size_t small_size = pack(small, small_buffer);
+  size_t medium_size = pack(medium, medium_buffer);
+  size_t large_size = pack(large, large_buffer);
+  BOOST_REQUIRE(small_size < medium_size);
+  BOOST_REQUIRE(medium_size < large_size);
+  std::vector<std::array<size_t, 3>> small_out = mc_rtc::Configuration::fromMessagePack(small_buffer.data(), small_size);
+  BOOST_REQUIRE(small_out == small);
+  std::vector<std::array<size_t, 3>> medium_out =
+      mc_rtc::Configuration::fromMessagePack(medium_buffer.data(), medium_size);
+  BOOST_REQUIRE(medium_out == medium);
+  std::vector<std::array<size_t, 3>> large_out = mc_rtc::Configuration::fromMessagePack(large_buffer.data(), large_size);
+  BOOST_REQUIRE(large_out == large);
+}
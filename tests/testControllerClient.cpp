@@ -0,0 +1,255 @@
+/*
+ * Copyright 2015-2019 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include <mc_control/ControllerClient.h>
+#include <mc_control/ControllerServer.h>
+#include <mc_rtc/gui/Checkbox.h>
+#include <mc_rtc/gui/Label.h>
+#include <mc_rtc/gui/NumberInput.h>
+#include <mc_rtc/gui/Polygon.h>
+#include <mc_rtc/gui/StateBuilder.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <map>
+#include <thread>
+
+struct TestClient : public mc_control::ControllerClient
+{
+  using mc_control::ControllerClient::ControllerClient;
+
+  const mc_rtc::Configuration & gui_data() const { return data_; }
+
+  void label(const mc_control::ElementId & id, const std::string & text) override { labels[id.name] = text; }
+
+  void checkbox(const mc_control::ElementId & id, bool state) override { checkboxes[id.name] = state; }
+
+  void number_input(const mc_control::ElementId & id, double data) override { numbers[id.name] = data; }
+
+  using mc_control::ControllerClient::polygon;
+  void polygon(const mc_control::ElementId & id,
+               const std::vector<std::vector<Eigen::Vector3d>> & points,
+               const mc_rtc::gui::Color &) override
+  {
+    polygons[id.name] = points.size();
+  }
+
+  std::map<std::string, std::string> labels;
+  std::map<std::string, bool> checkboxes;
+  std::map<std::string, double> numbers;
+  std::map<std::string, size_t> polygons;
+};
+
+BOOST_AUTO_TEST_CASE(TestControllerClientDeltaData)
+{
+  mc_rtc::gui::StateBuilder builder;
+  TestClient client;
+  std::vector<char> buffer;
+  auto send = [&](bool delta)
+  {
+    size_t size = builder.update(buffer, delta);
+    client.run(buffer.data(), size);
+  };
+  builder.data().add("value", 1);
+  send(false);
+  BOOST_REQUIRE(client.gui_data()("value", 0) == 1);
+  // The data differs from the snapshot
+  builder.data().add("value", 2);
+  send(true);
+  BOOST_REQUIRE(client.gui_data()("value", 0) == 2);
+  // The data is nil in the delta since it is the same as in the snapshot
+  builder.data().add("value", 1);
+  send(true);
+  BOOST_REQUIRE(client.gui_data()("value", 0) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(TestControllerClientGeometryCache)
+{
+  std::vector<Eigen::Vector3d> points(16, Eigen::Vector3d(1.0, 2.0, 3.0));
+  mc_rtc::gui::StateBuilder gui;
+  gui.addElement({"Test"}, mc_rtc::gui::Polygon("polygon", [&points]() { return points; }));
+  mc_rtc::gui::StateBuilder::Capture capture;
+  mc_rtc::gui::StateBuilder::Writer writer;
+  mc_rtc::gui::StateBuilder::Subscription subscription;
+  TestClient client;
+  std::vector<char> buffer;
+  auto send = [&](bool delta)
+  {
+    gui.capture(capture);
+    size_t size = writer.write(buffer, capture, subscription, delta);
+    client.polygons.clear();
+    client.run(buffer.data(), size);
+    return size;
+  };
+  size_t first = send(false);
+  BOOST_REQUIRE(client.polygons.count("polygon"));
+  // The payload referenced in the snapshot is not sent again in the deltas
+  BOOST_REQUIRE(send(true) < first);
+  BOOST_REQUIRE(client.polygons.count("polygon"));
+  // Every snapshot holds the payloads it references, a client that missed the previous ones can display them
+  BOOST_REQUIRE(send(false) == first);
+  BOOST_REQUIRE(client.polygons.count("polygon"));
+  TestClient late;
+  late.run(buffer.data(), first);
+  BOOST_REQUIRE(late.polygons.count("polygon"));
+}
+
+BOOST_AUTO_TEST_CASE(TestControllerClientInMemory)
+{
+  bool checked = false;
+  double number = 1.0;
+  mc_rtc::gui::StateBuilder gui;
+  gui.addElement({"Test"}, mc_rtc::gui::Label("label", []() { return std::string("hello"); }),
+                 mc_rtc::gui::Checkbox(
+                     "checkbox", [&checked]() { return checked; }, [&checked]() { checked = !checked; }),
+                 mc_rtc::gui::NumberInput(
+                     "number", [&number]() { return number; }, [&number](double n) { number = n; }));
+  double dt = 0.005;
+  // Publish a snapshot then deltas
+  mc_control::ControllerServer server(dt, dt, {}, {}, 10 * dt);
+  TestClient client(server, gui);
+  std::vector<char> buffer;
+  auto t_last_received = std::chrono::system_clock::now();
+  auto step = [&]()
+  {
+    server.handle_requests(gui);
+    server.publish(gui);
+    client.run(buffer, t_last_received);
+  };
+  step();
+  BOOST_REQUIRE(client.labels["label"] == "hello");
+  BOOST_REQUIRE(client.checkboxes.count("checkbox") && !client.checkboxes["checkbox"]);
+  BOOST_REQUIRE(client.numbers["number"] == 1.0);
+  // Requests are handled by the in-memory server
+  client.send_request({{"Test"}, "checkbox"});
+  client.send_request({{"Test"}, "number"}, 42.0);
+  BOOST_REQUIRE(checked);
+  BOOST_REQUIRE(number == 42.0);
+  // The changes are received in the next deltas and the unchanged elements are restored from the snapshot
+  for(size_t i = 0; i < 3; ++i)
+  {
+    client.labels.clear();
+    step();
+    BOOST_REQUIRE(client.labels["label"] == "hello");
+    BOOST_REQUIRE(client.checkboxes["checkbox"]);
+    BOOST_REQUIRE(client.numbers["number"] == 42.0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestControllerClientQueuedDeltas)
+{
+  size_t count = 0;
+  mc_rtc::gui::StateBuilder gui;
+  gui.addElement({"Test"}, mc_rtc::gui::Label("label", [&count]() { return std::to_string(count); }));
+  double dt = 0.005;
+  // A snapshot every 4 messages, the label changes in every message
+  mc_control::ControllerServer server(dt, dt, {"inproc://testControllerClientQueuedDeltas_pub"},
+                                      {"inproc://testControllerClientQueuedDeltas_pull"}, 4 * dt);
+  TestClient client("inproc://testControllerClientQueuedDeltas_pub", "inproc://testControllerClientQueuedDeltas_pull");
+  std::vector<char> buffer;
+  auto t_last_received = std::chrono::system_clock::now();
+  auto publish = [&]()
+  {
+    ++count;
+    server.handle_requests(gui);
+    server.publish(gui);
+  };
+  for(size_t i = 0; i < 2000 && client.labels.empty(); ++i)
+  {
+    publish();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    client.run(buffer, t_last_received);
+  }
+  BOOST_REQUIRE(client.labels.size());
+  // The client receives a snapshot and the deltas that refer to it at once, the newest message is shown
+  for(size_t i = 0; i < 8; ++i)
+  {
+    for(size_t j = 0; j < 4; ++j) { publish(); }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    client.labels.clear();
+    client.run(buffer, t_last_received);
+    BOOST_REQUIRE(client.labels["label"] == std::to_string(count));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestControllerClientSubscriptionsEndpoint)
+{
+  using mc_control::ControllerServer;
+  BOOST_REQUIRE(ControllerServer::subscriptions_uri("ipc:///tmp/mc_rtc_pub.ipc")
+                == "ipc:///tmp/mc_rtc_pub_subscriptions.ipc");
+  BOOST_REQUIRE(ControllerServer::subscriptions_uri("inproc://gui") == "inproc://gui_subscriptions");
+  BOOST_REQUIRE(ControllerServer::subscriptions_uri("tcp://*:4242") == "tcp://*:4244");
+  BOOST_REQUIRE(ControllerServer::subscriptions_uri("tcp://localhost").empty());
+  mc_rtc::gui::StateBuilder gui;
+  gui.addElement({"A"}, mc_rtc::gui::Label("a", []() { return std::string("a"); }));
+  gui.addElement({"B"}, mc_rtc::gui::Label("b", []() { return std::string("b"); }));
+  double dt = 0.005;
+  ControllerServer server(dt, dt, {"inproc://testControllerClientSubscriptions_pub"},
+                          {"inproc://testControllerClientSubscriptions_pull"});
+  TestClient full("inproc://testControllerClientSubscriptions_pub", "inproc://testControllerClientSubscriptions_pull");
+  TestClient subscribed("inproc://testControllerClientSubscriptions_pub",
+                        "inproc://testControllerClientSubscriptions_pull");
+  subscribed.subscribe({{"A"}});
+  std::vector<char> buffer;
+  auto t_full = std::chrono::system_clock::now();
+  auto t_subscribed = t_full;
+  for(size_t i = 0; i < 2000 && (full.labels.size() < 2 || subscribed.labels.empty()); ++i)
+  {
+    server.handle_requests(gui);
+    server.publish(gui);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    full.run(buffer, t_full);
+    subscribed.run(buffer, t_subscribed);
+  }
+  // The messages of the subscription are not published to the clients of the full GUI
+  BOOST_REQUIRE(full.labels.size() == 2);
+  BOOST_REQUIRE(subscribed.labels.size() == 1 && subscribed.labels.count("a"));
+}
+
+/** Client receiving from the network in its own thread */
+struct NetworkClient : public mc_control::ControllerClient
+{
+  using mc_control::ControllerClient::ControllerClient;
+
+  ~NetworkClient() { stop(); }
+
+  void label(const mc_control::ElementId &, const std::string &) override { ++labels; }
+
+  void number_input(const mc_control::ElementId &, double data) override { number = data; }
+
+  std::atomic<size_t> labels{0};
+  std::atomic<double> number{0.0};
+};
+
+BOOST_AUTO_TEST_CASE(TestControllerClientThreaded)
+{
+  double number = 1.0;
+  mc_rtc::gui::StateBuilder gui;
+  gui.addElement({"Test"}, mc_rtc::gui::Label("label", []() { return std::string("hello"); }),
+                 mc_rtc::gui::NumberInput(
+                     "number", [&number]() { return number; }, [&number](double n) { number = n; }));
+  double dt = 0.005;
+  // The network thread writes and sends the messages, it receives the requests
+  mc_control::ControllerServer server(dt, dt, {"inproc://testControllerClientThreaded_pub"},
+                                      {"inproc://testControllerClientThreaded_pull"}, 4 * dt, true);
+  NetworkClient client("inproc://testControllerClientThreaded_pub", "inproc://testControllerClientThreaded_pull");
+  auto wait_for = [&](auto && condition)
+  {
+    for(size_t i = 0; i < 2000 && !condition(); ++i)
+    {
+      server.handle_requests(gui);
+      server.publish(gui);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return condition();
+  };
+  BOOST_REQUIRE(wait_for([&]() { return client.number == 1.0; }));
+  client.send_request({{"Test"}, "number"}, 42.0);
+  BOOST_REQUIRE(wait_for([&]() { return number == 42.0 && client.number == 42.0; }));
+  // The elements keep coming through snapshots and deltas
+  size_t labels = client.labels;
+  BOOST_REQUIRE(wait_for([&]() { return client.labels > labels + 20; }));
+  BOOST_REQUIRE(client.number == 42.0);
+}
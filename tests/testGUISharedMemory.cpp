@@ -0,0 +1,99 @@
+/*
+ * Copyright 2015-2024 CNRS-UM LIRMM, CNRS-AIST JRL
+ */
+
+#include "internals/GUISharedMemory.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <thread>
+
+using namespace mc_control::internal;
+
+namespace
+{
+
+std::string shm_name(const std::string & test)
+{
+  return "/mc_rtc_testGUISharedMemory_" + test + "_" + std::to_string(getpid());
+}
+
+std::string str(const std::vector<char> & data, size_t size)
+{
+  return std::string(data.data(), size);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(TestGUISharedMemoryPublish)
+{
+  auto name = shm_name("publish");
+  GUIShmWriter writer(name, 1024);
+  BOOST_REQUIRE(writer.valid());
+  GUIShmReader reader(name);
+  BOOST_REQUIRE(reader.connect());
+  std::vector<char> out;
+  BOOST_REQUIRE(reader.read(out) == 0);
+  std::string message = "hello";
+  BOOST_REQUIRE(writer.publish(message.data(), message.size()));
+  size_t size = reader.read(out);
+  BOOST_REQUIRE(str(out, size) == message);
+  // A message is only read once
+  BOOST_REQUIRE(reader.read(out) == 0);
+  // Only the latest message is read
+  for(std::string m : {"a", "bc", "def"}) { BOOST_REQUIRE(writer.publish(m.data(), m.size())); }
+  size = reader.read(out);
+  BOOST_REQUIRE(str(out, size) == "def");
+  // A message that does not fit is dropped while a larger object is created in the background
+  std::string large(writer.capacity() + 1, 'x');
+  BOOST_REQUIRE(!writer.publish(large.data(), large.size()));
+  bool published = false;
+  for(size_t i = 0; i < 500 && !published; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    published = writer.publish(large.data(), large.size());
+  }
+  BOOST_REQUIRE(published);
+  BOOST_REQUIRE(writer.capacity() >= 2 * large.size());
+  // The reader sees that the previous object is closed and connects to the new one
+  BOOST_REQUIRE(reader.connect());
+  size = reader.read(out);
+  BOOST_REQUIRE(str(out, size) == large);
+}
+
+BOOST_AUTO_TEST_CASE(TestGUISharedMemoryRequests)
+{
+  auto name = shm_name("requests");
+  GUIShmWriter writer(name, 1024);
+  BOOST_REQUIRE(writer.valid());
+  std::vector<std::string> received;
+  auto receive = [&]()
+  {
+    received.clear();
+    writer.receive([&](const char * data) { received.push_back(data); });
+  };
+  GUIShmReader reader(name);
+  BOOST_REQUIRE(reader.connect());
+  for(std::string r : {"first", "second", "third"}) { BOOST_REQUIRE(reader.push(r.c_str(), r.size() + 1)); }
+  receive();
+  BOOST_REQUIRE(received == std::vector<std::string>({"first", "second", "third"}));
+  // Another client cannot use the ring while its owner is connected
+  {
+    GUIShmReader other(name);
+    BOOST_REQUIRE(other.connect());
+    BOOST_REQUIRE(!other.push("other", 6));
+  }
+  // The requests that do not fit in the ring are refused
+  std::vector<std::string> requests;
+  for(char c : {'a', 'b', 'c', 'd'}) { requests.emplace_back(GUIShmWriter::request_capacity / 4, c); }
+  size_t pushed = 0;
+  while(pushed < requests.size() && reader.push(requests[pushed].c_str(), requests[pushed].size() + 1)) { ++pushed; }
+  BOOST_REQUIRE(pushed == 3);
+  receive();
+  BOOST_REQUIRE(received == std::vector<std::string>(requests.begin(), requests.begin() + 3));
+  // The space is released once the server read the requests, this request wraps around the end of the ring
+  BOOST_REQUIRE(reader.push(requests[3].c_str(), requests[3].size() + 1));
+  receive();
+  BOOST_REQUIRE(received == std::vector<std::string>({requests[3]}));
+}
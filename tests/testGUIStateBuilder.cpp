@@ -4,6 +4,7 @@
 
 #include <mc_rtc/gui/ArrayLabel.h>
 #include <mc_rtc/gui/Label.h>
+#include <mc_rtc/gui/Polygon.h>
 #include <mc_rtc/gui/StateBuilder.h>
 
 #include <boost/test/unit_test.hpp>
@@ -111,3 +112,188 @@ BOOST_AUTO_TEST_CASE(TestGUIStateBuilder)
     BOOST_REQUIRE(s == empty_size);
   }
 }
+
+BOOST_AUTO_TEST_CASE(TestGUIStateDelta)
+{
+  DummyProvider provider;
+  mc_rtc::gui::StateBuilder builder;
+  builder.addElement({"dummy"}, mc_rtc::gui::Label("value", [&provider] { return provider.value; }),
+                     mc_rtc::gui::ArrayLabel("point", [&provider] { return provider.point; }));
+  std::vector<char> buffer;
+  auto message = [&](bool delta)
+  {
+    auto size = builder.update(buffer, delta);
+    return mc_rtc::Configuration::fromMessagePack(buffer.data(), size);
+  };
+  // The first message is always a snapshot
+  auto snapshot = message(true);
+  BOOST_REQUIRE(!snapshot[5]);
+  uint64_t snapshot_id = snapshot[4];
+  BOOST_REQUIRE(snapshot[1].isObject());
+  BOOST_REQUIRE(snapshot[2][1][0][1].isArray());
+  BOOST_REQUIRE(snapshot[2][1][0][2].isArray());
+  // Nothing changed, the elements are replaced by their index in the snapshot and the data is not sent
+  {
+    auto delta = message(true);
+    BOOST_REQUIRE(delta[5]);
+    BOOST_REQUIRE(static_cast<uint64_t>(delta[4]) == snapshot_id);
+    BOOST_REQUIRE(!delta[1].isObject());
+    auto dummy = delta[2][1][0];
+    BOOST_REQUIRE(static_cast<size_t>(dummy[1]) == 0);
+    BOOST_REQUIRE(static_cast<size_t>(dummy[2]) == 1);
+  }
+  // Only the element that changed is written
+  provider.value = 0.0;
+  {
+    auto delta = message(true);
+    auto dummy = delta[2][1][0];
+    BOOST_REQUIRE(dummy[1].isArray());
+    BOOST_REQUIRE(static_cast<double>(dummy[1][3]) == 0.0);
+    BOOST_REQUIRE(static_cast<size_t>(dummy[2]) == 1);
+  }
+  // Elements added after the snapshot are written in full
+  builder.addElement({"dummy"}, mc_rtc::gui::Label("other", [&provider] { return provider.value; }));
+  {
+    auto delta = message(true);
+    auto dummy = delta[2][1][0];
+    BOOST_REQUIRE(dummy[3].isArray());
+  }
+  // Data changes are sent
+  builder.data().add("key", 42);
+  {
+    auto delta = message(true);
+    BOOST_REQUIRE(delta[1].isObject());
+  }
+  // A new snapshot is referenced by the following deltas
+  {
+    auto next = message(false);
+    BOOST_REQUIRE(!next[5]);
+    BOOST_REQUIRE(static_cast<uint64_t>(next[4]) != snapshot_id);
+    snapshot_id = next[4];
+    auto delta = message(true);
+    BOOST_REQUIRE(static_cast<uint64_t>(delta[4]) == snapshot_id);
+    auto dummy = delta[2][1][0];
+    BOOST_REQUIRE(static_cast<size_t>(dummy[1]) == 0);
+    BOOST_REQUIRE(static_cast<size_t>(dummy[3]) == 2);
+    BOOST_REQUIRE(!delta[1].isObject());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestGUIStateSubscription)
+{
+  size_t calls_a = 0;
+  size_t calls_c = 0;
+  mc_rtc::gui::StateBuilder builder;
+  builder.addElement({"a"}, mc_rtc::gui::Label("a", [&calls_a] { return ++calls_a; }));
+  builder.addElement({"b"}, mc_rtc::gui::Label("b", [] { return 0; }));
+  builder.addElement({"b", "c"}, mc_rtc::gui::Label("c", [&calls_c] { return ++calls_c; }));
+  builder.addElement({"b", "d"}, mc_rtc::gui::Label("d", [] { return 0; }));
+  std::vector<char> buffer;
+  mc_rtc::gui::StateBuilder::Subscription subscription;
+  subscription.categories = {{"b", "c"}};
+  auto message = [&](bool delta)
+  {
+    auto size = builder.update(buffer, subscription, delta);
+    return mc_rtc::Configuration::fromMessagePack(buffer.data(), size);
+  };
+  auto snapshot = message(true);
+  BOOST_REQUIRE(!snapshot[5]);
+  // Only the subscribed category is evaluated
+  BOOST_REQUIRE(calls_a == 0);
+  BOOST_REQUIRE(calls_c == 1);
+  // Its parents are written without their elements
+  auto root = snapshot[2];
+  BOOST_REQUIRE(root.size() == 2);
+  BOOST_REQUIRE(root[1].size() == 1);
+  auto b = root[1][0];
+  BOOST_REQUIRE(static_cast<std::string>(b[0]) == "b");
+  BOOST_REQUIRE(b.size() == 2);
+  BOOST_REQUIRE(b[1].size() == 1);
+  auto c = b[1][0];
+  BOOST_REQUIRE(static_cast<std::string>(c[0]) == "c");
+  BOOST_REQUIRE(c.size() == 3);
+  BOOST_REQUIRE(c[1].isArray());
+  // Deltas are taken against the subscription's snapshot
+  auto delta = message(true);
+  BOOST_REQUIRE(delta[5]);
+  BOOST_REQUIRE(static_cast<uint64_t>(delta[4]) == static_cast<uint64_t>(snapshot[4]));
+  BOOST_REQUIRE(calls_a == 0);
+  BOOST_REQUIRE(calls_c == 2);
+  // Subscribing to a parent writes all its content
+  subscription.categories = {{"b"}};
+  auto full_b = message(false);
+  BOOST_REQUIRE(full_b[2][1][0].size() == 3);
+  BOOST_REQUIRE(full_b[2][1][0][2].size() == 2);
+  BOOST_REQUIRE(calls_a == 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestGUIStatePlotMessages)
+{
+  double t = 0.0;
+  mc_rtc::gui::StateBuilder builder;
+  builder.addElement({"a"}, mc_rtc::gui::Label("a", [] { return 0; }));
+  builder.addPlot("plot", mc_rtc::gui::plot::X("t", [&t]() { return t; }),
+                  mc_rtc::gui::plot::Y("y", [&t]() { return 2 * t; }, mc_rtc::gui::Color::Red));
+  mc_rtc::gui::StateBuilder::Subscription subscription;
+  subscription.categories = {{"a"}};
+  std::vector<char> full_buffer;
+  std::vector<char> subscription_buffer;
+  auto samples = [](const std::vector<char> & buffer, size_t size)
+  {
+    auto message = mc_rtc::Configuration::fromMessagePack(buffer.data(), size);
+    BOOST_REQUIRE(message[3].size() == 1);
+    auto plot = message[3][0];
+    std::vector<double> x = plot[3][1];
+    std::vector<double> y = plot[6][2];
+    BOOST_REQUIRE(x.size() == y.size());
+    return x;
+  };
+  // Sampled between publications
+  builder.update();
+  t = 1.0;
+  // Every message of a publication has the same samples
+  builder.update();
+  size_t full_size = builder.write(full_buffer);
+  size_t subscription_size = builder.write(subscription_buffer, subscription);
+  builder.clearPlots();
+  BOOST_REQUIRE(samples(full_buffer, full_size) == std::vector<double>({0.0, 1.0}));
+  BOOST_REQUIRE(samples(subscription_buffer, subscription_size) == std::vector<double>({0.0, 1.0}));
+  // The samples are cleared after the publication
+  t = 2.0;
+  full_size = builder.update(full_buffer);
+  BOOST_REQUIRE(samples(full_buffer, full_size) == std::vector<double>({2.0}));
+}
+
+BOOST_AUTO_TEST_CASE(TestGUIStateGeometry)
+{
+  std::vector<Eigen::Vector3d> points(16, Eigen::Vector3d(1.0, 2.0, 3.0));
+  std::vector<Eigen::Vector3d> small(1, Eigen::Vector3d::Zero());
+  mc_rtc::gui::StateBuilder builder;
+  builder.addElement({"geometry"}, mc_rtc::gui::Polygon("large", [&points]() { return points; }),
+                     mc_rtc::gui::Polygon("small", [&small]() { return small; }));
+  std::vector<char> buffer;
+  auto message = [&](bool delta)
+  {
+    auto size = builder.update(buffer, delta);
+    return mc_rtc::Configuration::fromMessagePack(buffer.data(), size);
+  };
+  // Large geometry is replaced by a reference to the geometry table
+  auto snapshot = message(true);
+  BOOST_REQUIRE(snapshot.size() == 7);
+  auto large = snapshot[2][1][0][1];
+  BOOST_REQUIRE(!large[3].isArray());
+  uint64_t hash = large[3];
+  BOOST_REQUIRE(snapshot[6].keys().size() == 1);
+  BOOST_REQUIRE(snapshot[6].has(std::to_string(hash)));
+  BOOST_REQUIRE(snapshot[6](std::to_string(hash)).size() == points.size());
+  // Small geometry is sent by value
+  BOOST_REQUIRE(snapshot[2][1][0][2][3].isArray());
+  // The table is empty in deltas when the geometry is in the snapshot
+  auto delta = message(true);
+  BOOST_REQUIRE(delta[6].keys().empty());
+  // New geometry is sent in the delta
+  points[0].x() = 0.0;
+  delta = message(true);
+  BOOST_REQUIRE(delta[6].keys().size() == 1);
+  BOOST_REQUIRE(static_cast<uint64_t>(delta[2][1][0][1][3]) != hash);
+}
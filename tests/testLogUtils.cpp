@@ -3,6 +3,7 @@
 #include <boost/filesystem.hpp>
 namespace bfs = boost::filesystem;
 
+#include <mc_rtc/log/BinaryLogIndex.h>
 #include <mc_rtc/log/FlatLog.h>
 #include <mc_rtc/log/Logger.h>
 
@@ -89,6 +90,7 @@ std::string make_log_ref()
 void do_cleanup(const std::string & path)
 {
   if(bfs::exists(path)) { bfs::remove(path); }
+  bfs::remove(mc_rtc::log::BinaryLogIndex::path(path));
 }
 
 bool check_split(const std::string & path)
@@ -139,6 +141,17 @@ bool check_split(const std::string & path)
   return do_return(true);
 }
 
+bool check_split_sequential(const std::string & path)
+{
+  // Without index the log is split while reading it
+  auto idx = mc_rtc::log::BinaryLogIndex::path(path);
+  auto idx_bak = idx + ".bak";
+  if(bfs::exists(idx)) { bfs::rename(idx, idx_bak); }
+  bool ret = check_split(path);
+  if(bfs::exists(idx_bak)) { bfs::rename(idx_bak, idx); }
+  return ret;
+}
+
 bool check_extract_time(const std::string & path)
 {
   auto out = fmt::format("{}/mc-rtc-test-log-utils-extract-time", bfs::temp_directory_path().string());
@@ -305,7 +318,7 @@ bool check_extract_events(const std::string & path)
   }
   ret = true;
 do_cleanup_extract_events:
-  bfs::remove(path_out);
+  do_cleanup(path_out);
   return ret;
 }
 
@@ -322,6 +335,7 @@ int main()
     }
   };
   do_check(check_split);
+  do_check(check_split_sequential);
   do_check(check_extract_time);
   do_check(check_extract_key);
   do_check(check_extract_keys);
@@ -4,14 +4,23 @@
 
 #define EIGEN_RUNTIME_NO_MALLOC
 
+#include <mc_rtc/MessagePackBuilder.h>
+#include <mc_rtc/log/BinaryLogIndex.h>
+#include <mc_rtc/log/ColumnarLog.h>
 #include <mc_rtc/log/FlatLog.h>
+#include <mc_rtc/log/LogTap.h>
 #include <mc_rtc/log/Logger.h>
+#include <mc_rtc/log/iterate_binary_log.h>
 
 #include <boost/filesystem.hpp>
 namespace bfs = boost::filesystem;
 
 #include <boost/test/unit_test.hpp>
 
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
 #include <thread>
 
 #include "utils.h"
@@ -585,3 +594,1061 @@ BOOST_AUTO_TEST_CASE(TestResume)
   bfs::remove(path_1);
   bfs::remove(path_2);
 }
+
+BOOST_AUTO_TEST_CASE(TestThreadedLogger)
+{
+  std::string path;
+  size_t n_iter = 1000;
+  {
+    using Policy = mc_rtc::Logger::Policy;
+    mc_rtc::Logger::Options options;
+    options.buffer_size = 1024 * 1024;
+    mc_rtc::Logger logger(Policy::THREADED, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+    logger.start("logger-threaded", 0.001);
+    path = logger.path();
+    LogData data;
+    data.addToLogger(logger, true);
+    for(size_t i = 0; i < n_iter; ++i)
+    {
+      logger.log();
+      data.refresh();
+      // Mimic a control loop, this leaves time to the writer thread on single core machines
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    auto stats = logger.bufferStats();
+    BOOST_REQUIRE(stats.capacity == options.buffer_size);
+    BOOST_REQUIRE(stats.high_water_mark > 0);
+    BOOST_REQUIRE(stats.high_water_mark <= stats.capacity);
+    BOOST_REQUIRE(stats.dropped_frames == 0);
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-threaded-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  {
+    mc_rtc::log::FlatLog flat(path);
+    BOOST_REQUIRE(flat.size() == n_iter);
+    auto t = flat.get<double>("t");
+    for(size_t i = 0; i < t.size(); ++i) { BOOST_REQUIRE(std::fabs(t[i] - 0.001 * static_cast<double>(i)) < 1e-9); }
+  }
+  bfs::remove(path);
+}
+
+/** Version of the binary log at \p path */
+uint8_t read_version(const std::string & path)
+{
+  std::ifstream ifs(path, std::ifstream::binary);
+  char magic[4];
+  ifs.read(magic, 4);
+  return static_cast<uint8_t>(magic[3] - mc_rtc::Logger::magic[3]);
+}
+
+BOOST_AUTO_TEST_CASE(TestCompressedLogger)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  mc_rtc::Logger::Options options;
+  options.compress = true;
+  // Small blocks so that the log contains complete and partial blocks
+  options.compression_block_size = 16;
+  auto check_version = [](const std::string & path)
+  { BOOST_REQUIRE(read_version(path) == (mc_rtc::Logger::supports(mc_rtc::Logger::COMPRESSED) ? 2 : 1)); };
+  std::string path;
+  {
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+    logger.start("logger-compressed", 0.001);
+    path = logger.path();
+    LogData data;
+    data.addToLogger(logger, true);
+    for(size_t iter = 1; iter <= 50; ++iter)
+    {
+      check<true>(logger,
+                  [&](const mc_rtc::log::FlatLog & log)
+                  {
+                    BOOST_REQUIRE(log.size() == iter);
+                    data.check(log);
+                    data.refresh();
+                  });
+    }
+  }
+  check_version(path);
+  bfs::remove(path);
+  size_t n_iter = 1000;
+  {
+    mc_rtc::Logger logger(Policy::THREADED, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+    logger.start("logger-compressed", 0.001);
+    path = logger.path();
+    LogData data;
+    data.addToLogger(logger, true);
+    for(size_t i = 0; i < n_iter; ++i)
+    {
+      logger.log();
+      data.refresh();
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-compressed-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  check_version(path);
+  {
+    mc_rtc::log::FlatLog flat(path);
+    BOOST_REQUIRE(flat.size() == n_iter);
+    auto t = flat.get<double>("t");
+    for(size_t i = 0; i < t.size(); ++i) { BOOST_REQUIRE(std::fabs(t[i] - 0.001 * static_cast<double>(i)) < 1e-9); }
+  }
+  bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestEntryPolicy)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  std::string path;
+  size_t n_iter = 10;
+  {
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test");
+    size_t i = 0;
+    uint64_t calls = 0;
+    mc_rtc::Logger::EntryPolicy every_3;
+    every_3.period = 3;
+    logger.addLogEntry("every_3", [&i]() { return static_cast<double>(i); }, every_3);
+    mc_rtc::Logger::EntryPolicy on_change;
+    on_change.on_change = true;
+    on_change.threshold = 0.5;
+    logger.addLogEntry("on_change", [&i]() { return 0.2 * static_cast<double>(i); }, on_change);
+    on_change.threshold = 0.0;
+    std::string s = "constant";
+    logger.addLogEntry("string", [&s]() -> const std::string & { return s; }, on_change);
+    Eigen::Vector3d v = Eigen::Vector3d::Zero();
+    logger.addLogEntry("vector", [&v]() -> const Eigen::Vector3d & { return v; }, on_change);
+    sva::PTransformd pt = sva::PTransformd::Identity();
+    logger.addLogEntry("pt", [&pt]() -> const sva::PTransformd & { return pt; }, on_change);
+    std::vector<double> vd = {1.0, 2.0};
+    logger.addLogEntry("std::vector<double>", [&vd]() -> const std::vector<double> & { return vd; }, on_change);
+    logger.addLogEntry(
+        "calls",
+        [&calls]()
+        {
+          calls += 1;
+          return calls;
+        },
+        on_change);
+    // Policies are decided when the file is started
+    logger.start("logger-policy", 0.001);
+    path = logger.path();
+    for(i = 0; i < n_iter; ++i)
+    {
+      if(i == 5)
+      {
+        v.x() = 1.0;
+        pt.translation().z() = 1.0;
+        vd.push_back(3.0);
+      }
+      logger.log();
+    }
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-policy-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  {
+    mc_rtc::log::FlatLog flat(path);
+    BOOST_REQUIRE(flat.size() == n_iter);
+    auto every_3 = flat.get<double>("every_3");
+    auto on_change = flat.get<double>("on_change");
+    auto strings = flat.get<std::string>("string");
+    auto vectors = flat.get<Eigen::Vector3d>("vector");
+    auto pts = flat.get<sva::PTransformd>("pt");
+    auto vds = flat.get<std::vector<double>>("std::vector<double>");
+    BOOST_REQUIRE(every_3.size() == n_iter);
+    for(size_t i = 0; i < n_iter; ++i)
+    {
+      double expected = static_cast<double>(3 * (i / 3));
+      BOOST_REQUIRE(every_3[i] == expected);
+      BOOST_REQUIRE(std::fabs(on_change[i] - 0.2 * expected) < 1e-9);
+      BOOST_REQUIRE(strings[i] == "constant");
+      BOOST_REQUIRE(vectors[i].x() == (i < 5 ? 0.0 : 1.0));
+      BOOST_REQUIRE(pts[i].translation().z() == (i < 5 ? 0.0 : 1.0));
+      BOOST_REQUIRE(vds[i].size() == (i < 5 ? 2 : 3));
+    }
+    // The callback of an on-change entry is called once per frame
+    auto calls = flat.get<uint64_t>("calls");
+    BOOST_REQUIRE(calls.size() == n_iter);
+    for(size_t i = 0; i < n_iter; ++i) { BOOST_REQUIRE(calls[i] == i + 1); }
+  }
+  BOOST_REQUIRE(read_version(path) == 2);
+  bfs::remove(path);
+  // A file started without policies is written as version 1, policies added later are ignored
+  {
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test");
+    logger.start("logger-policy", 0.001);
+    path = logger.path();
+    size_t i = 0;
+    mc_rtc::Logger::EntryPolicy every_3;
+    every_3.period = 3;
+    logger.addLogEntry("every_3", [&i]() { return static_cast<double>(i); }, every_3);
+    for(i = 0; i < n_iter; ++i) { logger.log(); }
+  }
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  BOOST_REQUIRE(read_version(path) == 1);
+  {
+    mc_rtc::log::FlatLog flat(path);
+    auto every_3 = flat.get<double>("every_3");
+    BOOST_REQUIRE(every_3.size() == n_iter);
+    for(size_t i = 0; i < n_iter; ++i) { BOOST_REQUIRE(every_3[i] == static_cast<double>(i)); }
+  }
+  bfs::remove(path);
+  // Unless every file holds values
+  {
+    mc_rtc::Logger::Options options;
+    options.held_values = true;
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+    logger.start("logger-policy", 0.001);
+    path = logger.path();
+    size_t i = 0;
+    mc_rtc::Logger::EntryPolicy every_3;
+    every_3.period = 3;
+    logger.addLogEntry("every_3", [&i]() { return static_cast<double>(i); }, every_3);
+    for(i = 0; i < n_iter; ++i) { logger.log(); }
+  }
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  BOOST_REQUIRE(read_version(path) == 2);
+  {
+    mc_rtc::log::FlatLog flat(path);
+    auto every_3 = flat.get<double>("every_3");
+    BOOST_REQUIRE(every_3.size() == n_iter);
+    for(size_t i = 0; i < n_iter; ++i) { BOOST_REQUIRE(every_3[i] == static_cast<double>(3 * (i / 3))); }
+  }
+  bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestCorruptedValues)
+{
+  using mc_rtc::log::LogType;
+  auto path = (bfs::temp_directory_path() / "mc-rtc-test-corrupted.bin").string();
+  // Writes a log with two double entries, the second frame has a value that is not a double and a nil value
+  auto write_log = [&](uint8_t version, uint32_t features)
+  {
+    std::ofstream ofs(path, std::ofstream::binary);
+    char magic[4];
+    std::memcpy(magic, mc_rtc::Logger::magic, 3);
+    magic[3] = static_cast<char>(mc_rtc::Logger::magic[3] + version);
+    ofs.write(magic, 4);
+    if(version > 1) { ofs.write((const char *)&features, sizeof(uint32_t)); }
+    std::vector<char> buffer;
+    auto frame = [&](auto && write_values)
+    {
+      mc_rtc::MessagePackBuilder builder(buffer);
+      builder.start_array(2);
+      write_values(builder);
+      builder.finish_array();
+      uint64_t size = builder.finish();
+      ofs.write((const char *)&size, sizeof(uint64_t));
+      ofs.write(buffer.data(), static_cast<std::streamsize>(size));
+    };
+    frame(
+        [](mc_rtc::MessagePackBuilder & builder)
+        {
+          builder.start_array(2);
+          for(std::string key : {"value", "held"})
+          {
+            builder.start_array(3);
+            builder.write(static_cast<uint8_t>(0));
+            builder.write(static_cast<std::underlying_type_t<LogType>>(LogType::Double));
+            builder.write(key);
+            builder.finish_array();
+          }
+          builder.finish_array();
+          builder.start_array(2);
+          builder.write(1.0);
+          builder.write(10.0);
+          builder.finish_array();
+        });
+    frame(
+        [](mc_rtc::MessagePackBuilder & builder)
+        {
+          builder.write();
+          builder.start_array(2);
+          builder.write(std::string("corrupted"));
+          builder.write();
+          builder.finish_array();
+        });
+    frame(
+        [](mc_rtc::MessagePackBuilder & builder)
+        {
+          builder.write();
+          builder.start_array(2);
+          builder.write(3.0);
+          builder.write(30.0);
+          builder.finish_array();
+        });
+  };
+  for(bool held : {false, true})
+  {
+    write_log(held ? 2 : 1, held ? static_cast<uint32_t>(mc_rtc::Logger::HELD_VALUES) : 0);
+    // Decoded in order and by the workers of the parallel decoder
+    for(size_t threads : {1, 4})
+    {
+      mc_rtc::log::FlatLog flat(path, threads);
+      BOOST_REQUIRE(flat.size() == 3);
+      // A value that cannot be decoded is missing, it does not hold the previous value
+      auto value = flat.getRaw<double>("value");
+      BOOST_REQUIRE(value.size() == 3);
+      BOOST_REQUIRE(value[0] && *value[0] == 1.0);
+      BOOST_REQUIRE(value[1] == nullptr);
+      BOOST_REQUIRE(value[2] && *value[2] == 3.0);
+      // A nil value only holds the previous value in a log that holds values
+      auto held_value = flat.getRaw<double>("held");
+      BOOST_REQUIRE(held_value.size() == 3);
+      if(held) { BOOST_REQUIRE(held_value[1] && *held_value[1] == 10.0); }
+      else { BOOST_REQUIRE(held_value[1] == nullptr); }
+      BOOST_REQUIRE(held_value[2] && *held_value[2] == 30.0);
+    }
+  }
+  bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestFixedLayout)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  std::string path;
+  size_t n_iter = 20;
+  {
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test");
+    size_t i = 0;
+    auto d = [&i]() { return static_cast<double>(i); };
+    logger.addLogEntry("double", d);
+    mc_rtc::Logger::EntryPolicy every_2;
+    every_2.period = 2;
+    logger.addLogEntry("every_2", d, every_2);
+    logger.addLogEntry("vector", [&]() { return Eigen::Vector3d(d(), 2 * d(), 3 * d()); });
+    logger.addLogEntry("string", [&i]() { return std::to_string(i); });
+    logger.addLogEntry("pt", [&]() { return sva::PTransformd(Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero()); });
+    // The size of these entries changes while logging, including array sizes that change the array header, the entries
+    // that outgrow their layout are serialized normally until the keys change
+    std::vector<double> vd = {1.0, 2.0};
+    logger.addLogEntry("std::vector<double>", [&vd]() -> const std::vector<double> & { return vd; });
+    Eigen::VectorXd vxd = Eigen::VectorXd::Zero(10);
+    logger.addLogEntry("Eigen::VectorXd", [&vxd]() -> const Eigen::VectorXd & { return vxd; });
+    logger.start("logger-fixed-layout", 0.001);
+    path = logger.path();
+    for(i = 0; i < n_iter; ++i)
+    {
+      if(i == 5) { vd.push_back(3.0); }
+      if(i == 10)
+      {
+        vd.clear();
+        vxd = Eigen::VectorXd::Ones(20);
+      }
+      if(i == 15) { logger.addLogEntry("added", d); }
+      if(i == 17) { vxd = Eigen::VectorXd::Ones(5); }
+      logger.log();
+    }
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-fixed-layout-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  {
+    mc_rtc::log::FlatLog flat(path);
+    BOOST_REQUIRE(flat.size() == n_iter);
+    auto doubles = flat.get<double>("double");
+    auto every_2 = flat.get<double>("every_2");
+    auto vectors = flat.get<Eigen::Vector3d>("vector");
+    auto strings = flat.get<std::string>("string");
+    auto pts = flat.get<sva::PTransformd>("pt");
+    auto vds = flat.get<std::vector<double>>("std::vector<double>");
+    auto vxds = flat.get<Eigen::VectorXd>("Eigen::VectorXd");
+    auto added = flat.get<double>("added", -1.0);
+    for(size_t i = 0; i < n_iter; ++i)
+    {
+      double expected = static_cast<double>(i);
+      BOOST_REQUIRE(doubles[i] == expected);
+      BOOST_REQUIRE(every_2[i] == static_cast<double>(2 * (i / 2)));
+      BOOST_REQUIRE(vectors[i] == Eigen::Vector3d(expected, 2 * expected, 3 * expected));
+      BOOST_REQUIRE(strings[i] == std::to_string(i));
+      BOOST_REQUIRE(pts[i].rotation() == Eigen::Matrix3d::Identity());
+      BOOST_REQUIRE(vds[i].size() == (i < 5 ? 2 : (i < 10 ? 3 : 0)));
+      BOOST_REQUIRE(vxds[i].size() == (i < 10 ? 10 : (i < 17 ? 20 : 5)));
+      BOOST_REQUIRE(added[i] == (i < 15 ? -1.0 : expected));
+    }
+  }
+  bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestEntryManagement)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  std::string path;
+  // Entries of three sources are interleaved in the log
+  std::array<int, 3> sources;
+  size_t n_entries = 100;
+  auto name = [](size_t s, size_t i) { return fmt::format("source{}_{}", s, i); };
+  auto value = [](size_t s, size_t i) { return static_cast<double>(1000 * s + i); };
+  {
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test");
+    logger.start("logger-entries", 0.001);
+    path = logger.path();
+    for(size_t i = 0; i < n_entries; ++i)
+    {
+      for(size_t s = 0; s < sources.size(); ++s)
+      {
+        logger.addLogEntry(name(s, i), &sources[s], [&, s, i]() { return value(s, i); });
+      }
+    }
+    BOOST_REQUIRE(logger.size() == sources.size() * n_entries + 1);
+    logger.log();
+    logger.removeLogEntries(&sources[1]);
+    BOOST_REQUIRE(logger.size() == 2 * n_entries + 1);
+    logger.removeLogEntry(name(0, 10));
+    logger.removeLogEntry(name(1, 10));
+    // Overwrite an entry, it moves to the end of the log
+    logger.addLogEntry(name(2, 20), &sources[2], [&]() { return -1.0; }, true);
+    logger.log();
+    logger.removeLogEntries(&sources[2]);
+    logger.addLogEntry(name(2, 20), &sources[2], [&]() { return -2.0; });
+    BOOST_REQUIRE(logger.size() == n_entries + 1);
+    logger.log();
+    logger.removeLogEntries(&sources[2]);
+    logger.removeLogEntries(&sources[0]);
+    BOOST_REQUIRE(logger.size() == 1);
+    logger.log();
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-entries-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  {
+    mc_rtc::log::FlatLog flat(path);
+    BOOST_REQUIRE(flat.size() == 4);
+    BOOST_REQUIRE(flat.entries().size() == sources.size() * n_entries + 1);
+    for(size_t s = 0; s < sources.size(); ++s)
+    {
+      for(size_t i = 0; i < n_entries; ++i)
+      {
+        auto values = flat.get<double>(name(s, i), 0.0);
+        bool removed_early = i == 10 && s != 2;
+        BOOST_REQUIRE(values[0] == value(s, i));
+        BOOST_REQUIRE(values[1] == (s == 1 || removed_early ? 0.0 : (s == 2 && i == 20 ? -1.0 : value(s, i))));
+        BOOST_REQUIRE(values[2] == (s == 0 && !removed_early ? value(s, i) : (s == 2 && i == 20 ? -2.0 : 0.0)));
+        BOOST_REQUIRE(values[3] == 0.0);
+      }
+    }
+  }
+  bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestDeltaLogger)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 100;
+  Eigen::VectorXd constant = Eigen::VectorXd::Random(100);
+  auto write_log = [&](bool delta)
+  {
+    mc_rtc::Logger::Options options;
+    options.delta = delta;
+    options.keyframe_interval = 30;
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+    logger.start(delta ? "logger-delta" : "logger-dense", 0.001);
+    std::string path = logger.path();
+    size_t i = 0;
+    logger.addLogEntry("constant", [&constant]() -> const Eigen::VectorXd & { return constant; });
+    logger.addLogEntry("slow", [&i]() { return static_cast<double>(i / 10); });
+    logger.addLogEntry("fast", [&i]() { return static_cast<double>(i); });
+    for(i = 0; i < n_iter; ++i) { logger.log(); }
+    return path;
+  };
+  auto dense_path = write_log(false);
+  auto delta_path = write_log(true);
+  for(const auto & n : {"logger-delta", "logger-dense"})
+  {
+    auto latest = bfs::temp_directory_path() / fmt::format("mc-rtc-test-{}-latest.bin", n);
+    if(bfs::exists(latest)) { bfs::remove(latest); }
+  }
+  BOOST_REQUIRE(5 * bfs::file_size(delta_path) < bfs::file_size(dense_path));
+  BOOST_REQUIRE(read_version(dense_path) == 1);
+  BOOST_REQUIRE(read_version(delta_path) == 2);
+  // The index is opt-in
+  BOOST_REQUIRE(!bfs::exists(mc_rtc::log::BinaryLogIndex::path(dense_path)));
+  {
+    mc_rtc::log::FlatLog dense(dense_path);
+    mc_rtc::log::FlatLog delta(delta_path);
+    BOOST_REQUIRE(dense.size() == n_iter);
+    BOOST_REQUIRE(delta.size() == n_iter);
+    BOOST_REQUIRE(dense.entries() == delta.entries());
+    BOOST_REQUIRE(dense.get<Eigen::VectorXd>("constant") == delta.get<Eigen::VectorXd>("constant"));
+    for(const auto & e : {"t", "slow", "fast"}) { BOOST_REQUIRE(dense.get<double>(e) == delta.get<double>(e)); }
+  }
+  for(const auto & p : {dense_path, delta_path})
+  {
+    bfs::remove(p);
+    bfs::remove(mc_rtc::log::BinaryLogIndex::path(p));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestDeltaLoggerDroppedFrames)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 1000;
+  double dt = 0.001;
+  std::string path;
+  size_t dropped = 0;
+  {
+    mc_rtc::Logger::Options options;
+    options.delta = true;
+    options.keyframe_interval = 500;
+    // The frames with a large value overflow this ring when the writer thread falls behind
+    options.buffer_size = 64 * 1024;
+    mc_rtc::Logger logger(Policy::THREADED, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+    size_t i = 0;
+    Eigen::VectorXd large = Eigen::VectorXd::Zero(2000);
+    logger.addLogEntry("large", [&large]() -> const Eigen::VectorXd & { return large; });
+    logger.addLogEntry("slow", [&i]() { return static_cast<double>(i / 10); });
+    mc_rtc::Logger::EntryPolicy on_change;
+    on_change.on_change = true;
+    logger.addLogEntry("on_change", [&i]() { return static_cast<double>(i / 100); }, on_change);
+    logger.start("logger-delta-dropped", dt);
+    path = logger.path();
+    for(i = 0; i < n_iter; ++i)
+    {
+      if(i % 3 == 0) { large.setConstant(static_cast<double>(i)); }
+      // The key is added in a frame that may be dropped
+      if(i == n_iter / 2) { logger.addLogEntry("added", [&i]() { return static_cast<double>(i); }); }
+      logger.log();
+    }
+    dropped = logger.bufferStats().dropped_frames;
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-delta-dropped-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  BOOST_WARN(dropped > 0);
+  {
+    // The values read after a dropped frame are the ones of their frame, not the ones held from before the drop
+    mc_rtc::log::FlatLog flat(path);
+    BOOST_REQUIRE(flat.size() == n_iter - dropped);
+    auto t = flat.get<double>("t");
+    auto large = flat.get<Eigen::VectorXd>("large");
+    auto slow = flat.get<double>("slow");
+    auto on_change = flat.get<double>("on_change");
+    auto added = flat.get<double>("added", std::numeric_limits<double>::quiet_NaN());
+    for(size_t k = 0; k < flat.size(); ++k)
+    {
+      auto i = static_cast<size_t>(std::llround(t[k] / dt));
+      BOOST_REQUIRE(large[k].size() == 2000);
+      BOOST_REQUIRE(large[k](0) == static_cast<double>(3 * (i / 3)));
+      BOOST_REQUIRE(slow[k] == static_cast<double>(i / 10));
+      BOOST_REQUIRE(on_change[k] == static_cast<double>(i / 100));
+      if(i >= n_iter / 2) { BOOST_REQUIRE(added[k] == static_cast<double>(i)); }
+    }
+  }
+  bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestColumnarLog)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 100;
+  std::string bin_path;
+  {
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test");
+    logger.start("logger-columnar", 0.001);
+    bin_path = logger.path();
+    size_t i = 0;
+    logger.addLogEntry("counter", [&i]() { return static_cast<uint64_t>(i); });
+    logger.addLogEntry("even", [&i]() { return i % 2 == 0; });
+    logger.addLogEntry("v3d", [&i]() { return Eigen::Vector3d(i, 2 * i, 3 * i); });
+    logger.addLogEntry("quat",
+                       [&i]() { return Eigen::Quaterniond(Eigen::AngleAxisd(0.01 * i, Eigen::Vector3d::UnitZ())); });
+    logger.addLogEntry("pt", [&i]() { return sva::PTransformd(sva::RotX(0.01 * i), Eigen::Vector3d(i, 0, 0)); });
+    logger.addLogEntry("fv", [&i]() { return sva::ForceVecd(Eigen::Vector6d::Constant(i)); });
+    logger.addLogEntry("vxd", [&i]() -> Eigen::VectorXd { return Eigen::VectorXd::Constant(i % 5, i); });
+    logger.addLogEntry("stdv", [&i]() { return std::vector<double>(i % 3, i); });
+    logger.addLogEntry("str", [&i]() { return std::to_string(i); });
+    for(i = 0; i < n_iter; ++i)
+    {
+      if(i == n_iter / 2) { logger.addLogEntry("late", [&i]() { return static_cast<double>(i); }); }
+      logger.log();
+    }
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-columnar-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  auto col_path = bfs::path(bin_path).replace_extension(".col").string();
+  mc_rtc::log::FlatLog flat(bin_path);
+  BOOST_REQUIRE(mc_rtc::log::ColumnarLog::write(flat, col_path));
+  {
+    mc_rtc::log::ColumnarLog col(col_path);
+    BOOST_REQUIRE(col.size() == n_iter);
+    BOOST_REQUIRE(col.entries() == flat.entries());
+    for(const auto & e : col.entries()) { BOOST_REQUIRE(col.type(e) == flat.type(e)); }
+    BOOST_REQUIRE(col.get<double>("counter").empty());
+    auto t = col.time();
+    auto counter = col.get<uint64_t>("counter");
+    auto even = col.get<bool>("even");
+    auto v3d = col.get<Eigen::Vector3d>("v3d");
+    auto quat = col.get<Eigen::Quaterniond>("quat");
+    auto pt = col.get<sva::PTransformd>("pt");
+    auto fv = col.get<sva::ForceVecd>("fv");
+    auto vxd = col.get<Eigen::VectorXd>("vxd");
+    auto stdv = col.get<std::vector<double>>("stdv");
+    auto str = col.get<std::string>("str");
+    auto late = col.get<double>("late");
+    auto flat_quat = flat.get<Eigen::Quaterniond>("quat");
+    auto flat_pt = flat.get<sva::PTransformd>("pt");
+    for(size_t i = 0; i < n_iter; ++i)
+    {
+      BOOST_REQUIRE(t.valid(i) && counter.valid(i) && str.valid(i));
+      BOOST_REQUIRE(t[i] == flat.get<double>("t")[i]);
+      BOOST_REQUIRE(counter[i] == i);
+      BOOST_REQUIRE(even[i] == (i % 2 == 0));
+      BOOST_REQUIRE(v3d[i] == Eigen::Vector3d(i, 2 * i, 3 * i));
+      BOOST_REQUIRE(quat[i].coeffs() == flat_quat[i].coeffs());
+      BOOST_REQUIRE(pt[i] == flat_pt[i]);
+      BOOST_REQUIRE(fv[i] == sva::ForceVecd(Eigen::Vector6d::Constant(i)));
+      BOOST_REQUIRE(vxd[i] == Eigen::VectorXd::Constant(i % 5, i));
+      BOOST_REQUIRE(stdv[i].size() == static_cast<Eigen::DenseIndex>(i % 3));
+      BOOST_REQUIRE(str[i] == std::to_string(i));
+      BOOST_REQUIRE(late.valid(i) == (i >= n_iter / 2));
+      if(late.valid(i)) { BOOST_REQUIRE(late[i] == i); }
+    }
+    BOOST_REQUIRE(col.index(t[42]) == 42);
+    BOOST_REQUIRE(col.index(-1.0) == 0);
+    BOOST_REQUIRE(col.index(t[n_iter - 1] + 1.0) == n_iter);
+  }
+  {
+    mc_rtc::log::FlatLog from_col(col_path);
+    BOOST_REQUIRE(from_col.size() == n_iter);
+    BOOST_REQUIRE(from_col.entries() == flat.entries());
+    BOOST_REQUIRE(from_col.get<double>("t") == flat.get<double>("t"));
+    BOOST_REQUIRE(from_col.get<Eigen::VectorXd>("vxd") == flat.get<Eigen::VectorXd>("vxd"));
+    BOOST_REQUIRE(from_col.get<std::vector<double>>("stdv") == flat.get<std::vector<double>>("stdv"));
+    BOOST_REQUIRE(from_col.get<std::string>("str") == flat.get<std::string>("str"));
+    auto late = from_col.getRaw<double>("late");
+    for(size_t i = 0; i < n_iter; ++i) { BOOST_REQUIRE((late[i] != nullptr) == (i >= n_iter / 2)); }
+  }
+  bfs::remove(bin_path);
+  bfs::remove(col_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestFilteredLoad)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 100;
+  std::string bin_path;
+  {
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test");
+    logger.start("logger-filtered", 0.001);
+    bin_path = logger.path();
+    size_t i = 0;
+    logger.addLogEntry("a", [&i]() { return static_cast<double>(i); });
+    logger.addLogEntry("b", [&i]() { return Eigen::Vector3d::Constant(static_cast<double>(i)).eval(); });
+    logger.addLogEntry("c_1", [&i]() { return std::to_string(i); });
+    logger.addLogEntry("c_2", [&i]() { return static_cast<int>(i); });
+    for(i = 0; i < n_iter; ++i)
+    {
+      if(i == n_iter / 2) { logger.removeLogEntry("a"); }
+      logger.log();
+    }
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-filtered-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  mc_rtc::log::FlatLog full(bin_path);
+  {
+    mc_rtc::log::FlatLog filtered;
+    filtered.load(bin_path, {"t", "a", "c_*"});
+    BOOST_REQUIRE(filtered.size() == n_iter);
+    BOOST_REQUIRE(filtered.entries() == std::set<std::string>({"t", "a", "c_1", "c_2"}));
+    BOOST_REQUIRE(filtered.get<double>("a", -1.0) == full.get<double>("a", -1.0));
+    BOOST_REQUIRE(filtered.get<double>("t") == full.get<double>("t"));
+    BOOST_REQUIRE(filtered.get<std::string>("c_1") == full.get<std::string>("c_1"));
+    BOOST_REQUIRE(filtered.get<int>("c_2") == full.get<int>("c_2"));
+  }
+  {
+    // Only the removed key is requested
+    mc_rtc::log::FlatLog filtered;
+    filtered.load(bin_path, {"a"});
+    BOOST_REQUIRE(filtered.size() == n_iter);
+    BOOST_REQUIRE(filtered.entries() == std::set<std::string>({"a"}));
+    BOOST_REQUIRE(filtered.get<double>("a", -1.0) == full.get<double>("a", -1.0));
+  }
+  size_t n_frames = 0;
+  BOOST_REQUIRE(mc_rtc::log::iterate_binary_log(
+      bin_path,
+      [&](mc_rtc::log::IterateBinaryLogData data)
+      {
+        if(n_frames++ == 0) { BOOST_REQUIRE(data.keys == std::vector<std::string>({"b"})); }
+        BOOST_REQUIRE(data.records.size() == 1);
+        BOOST_REQUIRE(data.records[0].type == mc_rtc::log::LogType::Vector3d);
+        BOOST_REQUIRE(data.time.has_value());
+        return true;
+      },
+      std::vector<std::string>{"b"}, true));
+  BOOST_REQUIRE(n_frames == n_iter);
+  bfs::remove(bin_path);
+}
+
+BOOST_AUTO_TEST_CASE(TestLogIndex)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 3500;
+  auto test = [&](Policy policy, bool compress)
+  {
+    std::string bin_path;
+    {
+      mc_rtc::Logger::Options options;
+      options.compress = compress;
+      options.compression_block_size = 100;
+      options.keyframe_interval = 500;
+      options.index = true;
+      mc_rtc::Logger logger(policy, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+      logger.start("logger-index", 0.001);
+      bin_path = logger.path();
+      size_t i = 0;
+      logger.addLogEntry("a", [&i]() { return static_cast<double>(i); });
+      for(i = 0; i < n_iter; ++i)
+      {
+        // The keyframe at 1000 changes the keys and is not an index point
+        if(i == 1000) { logger.addLogEntry("b", [&i]() { return std::to_string(i); }); }
+        logger.log();
+      }
+    }
+    auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-index-latest.bin";
+    if(bfs::exists(latest)) { bfs::remove(latest); }
+    mc_rtc::log::BinaryLogIndex index;
+    BOOST_REQUIRE(index.load(bin_path));
+    BOOST_REQUIRE(index.points.size() == 5);
+    BOOST_REQUIRE(index.keys.size() == 2);
+    BOOST_REQUIRE(index.keys[0].size() == 2);
+    BOOST_REQUIRE(index.keys[1].size() == 3);
+    BOOST_REQUIRE(index.keys[1].back().name == "b");
+    BOOST_REQUIRE(std::fabs(index.points[1].t - 1.5) < 1e-6);
+    BOOST_REQUIRE(index.points[1].keys == 1);
+    // Reading from an index point gives the same frames as reading the whole log
+    auto check_seek = [&]()
+    {
+      for(double from : {0.2, 1.7, 3.4})
+      {
+        size_t n_frames = 0;
+        double start = -1;
+        BOOST_REQUIRE(mc_rtc::log::iterate_binary_log(
+            bin_path,
+            [&](mc_rtc::log::IterateBinaryLogData data)
+            {
+              if(n_frames++ == 0)
+              {
+                start = *data.time;
+                BOOST_REQUIRE(data.keys.size() == (start < 1.0 ? 2 : 3));
+                BOOST_REQUIRE(data.meta.has_value());
+              }
+              size_t i = static_cast<size_t>(std::round(*data.time * 1000));
+              BOOST_REQUIRE(*static_cast<const double *>(data.records[1].data.get()) == static_cast<double>(i));
+              if(i >= 1000)
+              {
+                BOOST_REQUIRE(data.records.size() == 3);
+                BOOST_REQUIRE(*static_cast<const std::string *>(data.records[2].data.get()) == std::to_string(i));
+              }
+              return true;
+            },
+            true, "t", from));
+        BOOST_REQUIRE(start <= from);
+        BOOST_REQUIRE(from < 0.5 || start > 0);
+        BOOST_REQUIRE(n_frames == n_iter - static_cast<size_t>(std::round(start * 1000)));
+      }
+    };
+    check_seek();
+    // Rebuild the index from the log
+    BOOST_REQUIRE(index.build(bin_path, 500));
+    BOOST_REQUIRE(index.points.size() >= 5);
+    BOOST_REQUIRE(index.keys.size() == 2);
+    BOOST_REQUIRE(index.save(bin_path));
+    check_seek();
+    bfs::remove(bin_path);
+    // An outdated index is not used
+    std::ofstream(bin_path, std::ofstream::binary) << "invalid";
+    BOOST_REQUIRE(!index.load(bin_path));
+    bfs::remove(bin_path);
+    bfs::remove(mc_rtc::log::BinaryLogIndex::path(bin_path));
+  };
+  test(Policy::NON_THREADED, false);
+  test(Policy::THREADED, false);
+  test(Policy::NON_THREADED, true);
+  test(Policy::THREADED, true);
+}
+
+BOOST_AUTO_TEST_CASE(TestLogRotation)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 3500;
+  auto test = [&](Policy policy, bool compress, size_t rotate_size, double rotate_duration)
+  {
+    std::string bin_path;
+    {
+      mc_rtc::Logger::Options options;
+      options.compress = compress;
+      options.compression_block_size = 100;
+      options.delta = true;
+      options.keyframe_interval = 300;
+      options.rotate_size = rotate_size;
+      options.rotate_duration = rotate_duration;
+      options.index = true;
+      mc_rtc::Logger logger(policy, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+      logger.meta().main_robot = "robot";
+      logger.start("logger-rotation", 0.001);
+      bin_path = logger.path();
+      size_t i = 0;
+      logger.addLogEntry("a", [&i]() { return static_cast<double>(i); });
+      logger.addLogEntry("c", [&i]() { return std::to_string(i / 400); });
+      for(i = 0; i < n_iter; ++i)
+      {
+        if(i == 1500)
+        {
+          logger.addLogEntry("b", [&i]() { return Eigen::Vector3d::Constant(static_cast<double>(i)).eval(); });
+        }
+        if(i % 250 == 0) { logger.addGUIEvent({{"Category"}, "Button", mc_rtc::Configuration{}}); }
+        logger.log();
+        // The size of compressed logs is known once the writing thread compressed the frames
+        if(policy == Policy::THREADED && i % 100 == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+      }
+      BOOST_REQUIRE(logger.bufferStats().dropped_frames == 0);
+    }
+    auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-rotation-latest.bin";
+    if(bfs::exists(latest)) { bfs::remove(latest); }
+    std::vector<std::string> parts;
+    for(size_t part = 1; bfs::exists(mc_rtc::Logger::partPath(bin_path, part)); ++part)
+    {
+      parts.push_back(mc_rtc::Logger::partPath(bin_path, part));
+    }
+    if(rotate_duration > 0) { BOOST_REQUIRE(parts.size() == 4); }
+    else { BOOST_REQUIRE(parts.size() > 2); }
+    // Every part can be read on its own
+    size_t n_frames = 0;
+    size_t n_events = 0;
+    for(size_t part = 0; part < parts.size(); ++part)
+    {
+      size_t part_frames = 0;
+      BOOST_REQUIRE(mc_rtc::log::iterate_binary_log(
+          parts[part],
+          [&](mc_rtc::log::IterateBinaryLogData data)
+          {
+            size_t i = static_cast<size_t>(std::round(*data.time * 1000));
+            BOOST_REQUIRE(i == n_frames);
+            if(part_frames++ == 0)
+            {
+              BOOST_REQUIRE(data.meta.has_value());
+              BOOST_REQUIRE(data.meta->main_robot == "robot");
+              BOOST_REQUIRE(data.keys.size() == (i < 1500 ? 3 : 4));
+              if(part != 0 && rotate_duration > 0)
+              {
+                BOOST_REQUIRE(std::fabs(*data.time - static_cast<double>(part)) < 2e-3);
+              }
+            }
+            // The first frame of a part holds every value
+            if(part_frames == 1)
+            {
+              for(const auto & r : data.records) { BOOST_REQUIRE(r.data); }
+            }
+            n_events += data.gui_events.size();
+            n_frames += 1;
+            return true;
+          },
+          true, "t"));
+      if(rotate_size != 0 && part + 1 < parts.size()) { BOOST_REQUIRE(bfs::file_size(parts[part]) >= rotate_size); }
+      // A complete part of one second holds several keyframes
+      if(rotate_duration > 0 && part + 1 < parts.size())
+      {
+        BOOST_REQUIRE(mc_rtc::log::BinaryLogIndex().load(parts[part]));
+      }
+    }
+    BOOST_REQUIRE(n_frames == n_iter);
+    BOOST_REQUIRE(n_events == n_iter / 250);
+    // The parts are loaded together from the first one
+    mc_rtc::log::FlatLog flat(bin_path);
+    BOOST_REQUIRE(flat.size() == n_iter);
+    BOOST_REQUIRE(flat.meta().has_value());
+    auto a = flat.getRaw<double>("a");
+    auto b = flat.getRaw<Eigen::Vector3d>("b");
+    auto c = flat.getRaw<std::string>("c");
+    for(size_t i = 0; i < n_iter; ++i)
+    {
+      BOOST_REQUIRE(a[i] && *a[i] == static_cast<double>(i));
+      BOOST_REQUIRE(c[i] && *c[i] == std::to_string(i / 400));
+      if(i < 1500) { BOOST_REQUIRE(!b[i]); }
+      else { BOOST_REQUIRE(b[i] && b[i]->x() == static_cast<double>(i)); }
+    }
+    for(const auto & part : parts)
+    {
+      bfs::remove(part);
+      bfs::remove(mc_rtc::log::BinaryLogIndex::path(part));
+    }
+  };
+  for(auto policy : {Policy::NON_THREADED, Policy::THREADED})
+  {
+    for(bool compress : {false, true})
+    {
+      test(policy, compress, 0, 1.0);
+      test(policy, compress, 10000, 0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestDirectIO)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 40000;
+  auto test = [&](Policy policy, bool compress)
+  {
+    mc_rtc::Logger::Options options;
+    options.compress = compress;
+    options.direct_io = true;
+    options.index = true;
+    auto bin_path = (bfs::temp_directory_path() / "mc-rtc-test-logger-direct-io.bin").string();
+    {
+      mc_rtc::Logger logger(policy, "", "", options);
+      logger.open(bin_path, 0.001);
+      size_t i = 0;
+      logger.addLogEntry("a", [&i]() { return static_cast<double>(i); });
+      logger.addLogEntry("b", [&i]() { return Eigen::VectorXd::Constant(20, static_cast<double>(i)).eval(); });
+      for(i = 0; i < n_iter; ++i)
+      {
+        logger.log();
+        // The data written so far can be read after a flush
+        if(policy == Policy::NON_THREADED && !compress && i == n_iter / 2)
+        {
+          logger.flush();
+          BOOST_REQUIRE(mc_rtc::log::FlatLog(bin_path).size() == i + 1);
+        }
+      }
+    }
+    mc_rtc::log::FlatLog flat(bin_path);
+    BOOST_REQUIRE(flat.size() == n_iter);
+    auto a = flat.getRaw<double>("a");
+    auto b = flat.getRaw<Eigen::VectorXd>("b");
+    for(size_t i = 0; i < n_iter; ++i)
+    {
+      BOOST_REQUIRE(a[i] && *a[i] == static_cast<double>(i));
+      BOOST_REQUIRE(b[i] && b[i]->size() == 20 && (*b[i])(19) == static_cast<double>(i));
+    }
+    mc_rtc::log::BinaryLogIndex index;
+    BOOST_REQUIRE(index.load(bin_path));
+    bfs::remove(bin_path);
+    bfs::remove(mc_rtc::log::BinaryLogIndex::path(bin_path));
+  };
+  test(Policy::NON_THREADED, false);
+  test(Policy::THREADED, false);
+  test(Policy::NON_THREADED, true);
+  test(Policy::THREADED, true);
+}
+
+BOOST_AUTO_TEST_CASE(TestLogTap)
+{
+  mc_rtc::Logger::Options options;
+  options.tap = "/mc-rtc-test-logger-tap";
+  options.tap_size = 64 * 1024;
+  auto bin_path = (bfs::temp_directory_path() / "mc-rtc-test-logger-tap.bin").string();
+  mc_rtc::log::LogTap tap(options.tap);
+  size_t n_frames = 0;
+  size_t n_keys = 0;
+  double last_t = -1;
+  auto callback = [&](mc_rtc::log::IterateBinaryLogData data)
+  {
+    if(data.keys.size()) { n_keys = data.keys.size(); }
+    BOOST_REQUIRE(data.time.has_value());
+    BOOST_REQUIRE(*data.time > last_t);
+    last_t = *data.time;
+    size_t i = static_cast<size_t>(std::round(*data.time * 1000));
+    BOOST_REQUIRE(data.records.size() == n_keys);
+    BOOST_REQUIRE(*static_cast<const double *>(data.records[1].data.get()) == static_cast<double>(i));
+    BOOST_REQUIRE(data.meta.has_value());
+    BOOST_REQUIRE(data.meta->main_robot == "robot");
+    n_frames += 1;
+    return true;
+  };
+  {
+    mc_rtc::Logger logger(mc_rtc::Logger::Policy::NON_THREADED, "", "", options);
+    logger.meta().main_robot = "robot";
+    // Nothing has been logged yet
+    BOOST_REQUIRE(tap.read(callback) == 0);
+    BOOST_REQUIRE(tap.connected());
+    logger.open(bin_path, 0.001);
+    size_t i = 0;
+    logger.addLogEntry("a", [&i]() { return static_cast<double>(i); });
+    auto log = [&](size_t n)
+    {
+      for(size_t j = 0; j < n; ++j, ++i) { logger.log(); }
+    };
+    log(100);
+    // The reader starts with the most recent frame
+    BOOST_REQUIRE(tap.read(callback) == 1);
+    BOOST_REQUIRE(n_keys == 2);
+    log(50);
+    BOOST_REQUIRE(tap.read(callback) == 50);
+    BOOST_REQUIRE(tap.read(callback, 10) == 0);
+    logger.addLogEntry("b", [&i]() { return std::to_string(i); });
+    log(50);
+    BOOST_REQUIRE(tap.read(callback, 10) == 10);
+    BOOST_REQUIRE(n_keys == 3);
+    BOOST_REQUIRE(tap.read(callback) == 40);
+    BOOST_REQUIRE(n_frames == 101);
+    BOOST_REQUIRE(tap.dropped() == 0);
+    // The ring is overwritten when the reader is too slow
+    log(5000);
+    BOOST_REQUIRE(tap.read(callback) > 0);
+    BOOST_REQUIRE(tap.dropped() == 1);
+    BOOST_REQUIRE(std::fabs(last_t - 5.199) < 1e-6);
+  }
+  BOOST_REQUIRE(tap.read(callback) == 0);
+  BOOST_REQUIRE(!tap.connected());
+  bfs::remove(bin_path);
+  bfs::remove(mc_rtc::log::BinaryLogIndex::path(bin_path));
+}
+
+BOOST_AUTO_TEST_CASE(TestParallelLoad)
+{
+  using Policy = mc_rtc::Logger::Policy;
+  size_t n_iter = 3000;
+  std::string bin_path;
+  {
+    mc_rtc::Logger::Options options;
+    options.delta = true;
+    options.keyframe_interval = 100;
+    mc_rtc::Logger logger(Policy::NON_THREADED, bfs::temp_directory_path().string(), "mc-rtc-test", options);
+    logger.start("logger-parallel", 0.001);
+    bin_path = logger.path();
+    size_t i = 0;
+    logger.addLogEntry("a", [&i]() { return static_cast<double>(i / 7); });
+    logger.addLogEntry("b", [&i]() { return Eigen::Vector3d::Constant(static_cast<double>(i)).eval(); });
+    logger.addLogEntry("c", [&i]() { return std::to_string(i / 100); });
+    for(i = 0; i < n_iter; ++i)
+    {
+      // Change the keys in different batches
+      if(i == 700) { logger.removeLogEntry("a"); }
+      if(i == 1500) { logger.addLogEntry("a", [&i]() { return static_cast<double>(i); }); }
+      if(i == 2000) { logger.addLogEntry("d", [&i]() { return static_cast<int>(i % 3); }); }
+      logger.log();
+    }
+  }
+  auto latest = bfs::temp_directory_path() / "mc-rtc-test-logger-parallel-latest.bin";
+  if(bfs::exists(latest)) { bfs::remove(latest); }
+  auto check = [&](const std::vector<std::string> & keys)
+  {
+    mc_rtc::log::FlatLog sequential;
+    sequential.load(bin_path, keys);
+    mc_rtc::log::FlatLog parallel;
+    parallel.setThreads(4);
+    parallel.load(bin_path, keys);
+    BOOST_REQUIRE(parallel.size() == n_iter);
+    BOOST_REQUIRE(parallel.size() == sequential.size());
+    BOOST_REQUIRE(parallel.entries() == sequential.entries());
+    BOOST_REQUIRE(parallel.meta().has_value());
+    for(const auto & e : sequential.entries())
+    {
+      for(size_t i = 0; i < n_iter; ++i) { BOOST_REQUIRE(parallel.type(e, i) == sequential.type(e, i)); }
+    }
+    for(const auto & e : {"t", "a"})
+    {
+      if(sequential.has(e)) { BOOST_REQUIRE(parallel.get<double>(e, -1.0) == sequential.get<double>(e, -1.0)); }
+    }
+    if(sequential.has("b"))
+    {
+      BOOST_REQUIRE(parallel.get<Eigen::Vector3d>("b", Eigen::Vector3d::Zero())
+                    == sequential.get<Eigen::Vector3d>("b", Eigen::Vector3d::Zero()));
+    }
+    if(sequential.has("c"))
+    {
+      BOOST_REQUIRE(parallel.get<std::string>("c", "") == sequential.get<std::string>("c", ""));
+    }
+    if(sequential.has("d")) { BOOST_REQUIRE(parallel.get<int>("d", -1) == sequential.get<int>("d", -1)); }
+  };
+  check({});
+  check({"a", "d"});
+  bfs::remove(bin_path);
+  bfs::remove(mc_rtc::log::BinaryLogIndex::path(bin_path));
+}
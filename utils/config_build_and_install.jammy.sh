@@ -2,7 +2,7 @@
 export WITH_ROS_SUPPORT="false"
 export ROS_DISTRO=
 export SYSTEM_HAS_SPDLOG=ON
-export APT_DEPENDENCIES="curl wget cmake build-essential gfortran doxygen cython3 python3-pip python3-pytest python3-numpy python3-coverage python3-setuptools libeigen3-dev doxygen doxygen-latex libboost-all-dev libtinyxml2-dev libnanomsg-dev libyaml-cpp-dev libltdl-dev libqwt-qt5-dev python3-matplotlib python3-pyqt5 libspdlog-dev ninja-build git python-is-python3 graphviz libgeos++-dev libnotify-dev"
+export APT_DEPENDENCIES="curl wget cmake build-essential gfortran doxygen cython3 python3-pip python3-pytest python3-numpy python3-coverage python3-setuptools libeigen3-dev doxygen doxygen-latex libboost-all-dev libtinyxml2-dev libnanomsg-dev libyaml-cpp-dev libltdl-dev libqwt-qt5-dev python3-matplotlib python3-pyqt5 libspdlog-dev ninja-build git python-is-python3 graphviz libgeos++-dev libnotify-dev libzstd-dev"
 if $BUILD_BENCHMARKS
 then
   export APT_DEPENDENCIES="$APT_DEPENDENCIES libbenchmark-dev"
@@ -4,7 +4,7 @@ export PYTHON_FORCE_PYTHON3="true"
 export PYTHON_BUILD_PYTHON2_AND_PYTHON3="false"
 export MC_LOG_UI_PYTHON_EXECUTABLE=python3
 export SYSTEM_HAS_SPDLOG=ON
-export BREW_DEPENDENCIES="coreutils pkg-config gnu-sed wget python cmake doxygen libtool tinyxml2 geos boost eigen nanomsg yaml-cpp qt qwt pyqt gcc spdlog ninja libnotify"
+export BREW_DEPENDENCIES="coreutils pkg-config gnu-sed wget python cmake doxygen libtool tinyxml2 geos boost eigen nanomsg yaml-cpp qt qwt pyqt gcc spdlog ninja libnotify zstd"
 if $BUILD_BENCHMARKS
 then
   export BREW_DEPENDENCIES="$BREW_DEPENDENCIES google-benchmark"
@@ -2,12 +2,18 @@
  * Copyright 2015-2019 CNRS-UM LIRMM, CNRS-AIST JRL
  */
 
-#include <mc_rtc/log/FlatLog.h>
+#include <mc_rtc/log/iterate_binary_log.h>
 #include <mc_rtc/logging.h>
 
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
 #include <array>
+#include <cmath>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <set>
 
 struct PrettyColumn
 {
@@ -89,81 +95,331 @@ private:
   std::array<PrettyColumn, N> columns_;
 };
 
-using PerfTable = PrettyTable<5>;
+using PerfTable = PrettyTable<10>;
 
-/** This utilty works with a binary log and outputs performance information */
+/** This utilty streams a binary log and outputs performance information about the perf_ entries
+ *
+ * For each entry it reports percentiles of the values, the number of values above the log timestep and the spikes
+ * (values well above the median): their period and whether they happen on frames with GUI or key events.
+ *
+ * The log is read twice (the spikes are detected against the median), the memory used does not depend on its length
+ */
 
 static const std::string match = "perf_";
 
-void usage(char * name)
-{
-  std::cerr << name << " [log] [entry = t]\n";
-}
+/** perf_ entries that are not durations, they have no overrun */
+static const std::set<std::string> not_durations = {"FrameworkCost"};
 
-std::pair<size_t, size_t> getRange(const mc_rtc::log::FlatLog & log, const std::string & key)
+/** Streaming histogram of positive values with a relative precision of 1% */
+struct Histogram
 {
-  if(!log.has(key)) { mc_rtc::log::error_and_throw("No entry named {} in log", key); }
-  size_t start = 0;
-  size_t end = 0;
-  auto t = log.getRaw<double>(key);
-  while(t[start] == nullptr) { start++; }
-  end = start;
-  while(t[end] != nullptr && end < t.size()) { end++; }
-  if(start == end) { mc_rtc::log::error_and_throw("{} does not look like a valid time entry", key); }
-  return {start, end};
-}
+  static constexpr double min_value = 1e-6;
+  static constexpr double max_value = 1e6;
+  static constexpr double growth = 1.01;
+
+  Histogram() : buckets_(bucket(max_value) + 1, 0) {}
+
+  void add(double value)
+  {
+    count_++;
+    buckets_[bucket(value)]++;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    /** Based on https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Welford's_online_algorithm */
+    double delta = value - avg_;
+    avg_ += delta / static_cast<double>(count_);
+    M_2_ += delta * (value - avg_);
+  }
+
+  /** Value below which a fraction \p q of the values are */
+  double percentile(double q) const
+  {
+    if(count_ == 0) { return 0; }
+    auto target = static_cast<size_t>(std::ceil(q * static_cast<double>(count_)));
+    size_t cumulative = 0;
+    for(size_t i = 0; i < buckets_.size(); ++i)
+    {
+      cumulative += buckets_[i];
+      if(cumulative >= target) { return std::clamp(min_value * std::pow(growth, i), min_, max_); }
+    }
+    return max_;
+  }
 
-void show_perf(const mc_rtc::log::FlatLog & log,
-               const std::pair<size_t, size_t> & range,
-               const std::string & key,
-               PerfTable & vt)
+  size_t count() const noexcept { return count_; }
+  double avg() const noexcept { return avg_; }
+  double std() const noexcept { return count_ ? std::sqrt(M_2_ / static_cast<double>(count_)) : 0.0; }
+  double min() const noexcept { return count_ ? min_ : 0.0; }
+  double max() const noexcept { return max_; }
+
+private:
+  std::vector<size_t> buckets_;
+  size_t count_ = 0;
+  double min_ = std::numeric_limits<double>::infinity();
+  double max_ = 0;
+  double avg_ = 0;
+  double M_2_ = 0;
+
+  static size_t bucket(double value)
+  {
+    if(value <= min_value) { return 0; }
+    return static_cast<size_t>(std::ceil(std::log(std::min(value, max_value) / min_value) / std::log(growth)));
+  }
+};
+
+/** Spikes of an entry */
+struct Spikes
 {
-  auto data = log.get<double>(key);
-  /** Based on https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Welford's_online_algorithm */
-  double max = data[range.first];
-  double min = max != 0 ? max : std::numeric_limits<double>::infinity();
-  double prev_avg = max;
-  double avg = 0;
-  double std_sq = 0;
-  double M_2_i = 0;
-  double N = 1;
-  for(size_t i = range.first + 1; i < range.second; ++i)
-  {
-    if(data[i] != 0)
+  /** Maximum number of distinct intervals kept to find the period */
+  static constexpr size_t max_intervals = 4096;
+
+  /** Values above this threshold are spikes */
+  double threshold = 0;
+  size_t count = 0;
+  /** Spikes on frames with GUI events */
+  size_t on_gui_events = 0;
+  /** Spikes on frames where keys were added or removed */
+  size_t on_key_events = 0;
+  /** Number of ticks between consecutive spikes */
+  std::map<size_t, size_t> intervals;
+  size_t last_tick = 0;
+
+  void add(size_t tick, bool gui_event, bool key_event)
+  {
+    if(count++ > 0)
     {
-      N++;
-      avg = prev_avg + (data[i] - prev_avg) / N;
-      M_2_i = M_2_i + (data[i] - prev_avg) * (data[i] - avg);
-      std_sq = M_2_i / N;
-      prev_avg = avg;
-      max = std::max(max, data[i]);
-      min = std::min(min, data[i]);
+      size_t interval = tick - last_tick;
+      auto it = intervals.find(interval);
+      if(it != intervals.end()) { it->second++; }
+      else if(intervals.size() < max_intervals) { intervals[interval] = 1; }
     }
+    last_tick = tick;
+    on_gui_events += gui_event;
+    on_key_events += key_event;
   }
-  double std = std::sqrt(std_sq);
-  auto row = std::make_tuple(key.substr(match.size()), avg, std, min, max);
-  vt.put(row);
+
+  /** Returns the most common interval between spikes (+/- 1 tick) and the fraction of intervals it represents */
+  std::pair<size_t, double> period() const
+  {
+    if(count < 4) { return {0, 0.0}; }
+    auto get = [&](size_t interval)
+    {
+      auto it = intervals.find(interval);
+      return it != intervals.end() ? it->second : 0;
+    };
+    size_t best = 0;
+    size_t best_count = 0;
+    for(const auto & [interval, n] : intervals)
+    {
+      size_t around = get(interval - 1) + n + get(interval + 1);
+      if(around > best_count || (around == best_count && n > get(best)))
+      {
+        best = interval;
+        best_count = around;
+      }
+    }
+    return {best, static_cast<double>(best_count) / static_cast<double>(count - 1)};
+  }
+};
+
+struct EntryPerf
+{
+  /** False for entries that are not durations */
+  bool duration = true;
+  Histogram histogram;
+  /** Number of values larger than the deadline */
+  size_t overruns = 0;
+  Spikes spikes;
+};
+
+/** Go through the perf_ entries of the log, the callback is called for every frame where the time entry is present */
+template<typename Callback>
+bool iterate_perf(const std::string & file, const std::string & time_key, Callback && callback)
+{
+  std::vector<std::string> keys_str;
+  size_t time_idx = 0;
+  bool has_time = false;
+  std::vector<size_t> perf_idx;
+  std::vector<std::string> perf_keys;
+  std::vector<double> values;
+  return mc_rtc::log::iterate_binary_log(
+      file,
+      [&](mc_rtc::log::IterateBinaryLogData data)
+      {
+        bool key_event = false;
+        if(data.keys.size())
+        {
+          // The keys are reported for every frame with events, look for key events among them
+          auto frame = mc_rtc::Configuration::fromMessagePack(data.raw_data, data.raw_data_size);
+          auto events = frame[0];
+          for(size_t i = 0; i < events.size(); ++i)
+          {
+            uint8_t type = events[i][0];
+            key_event = key_event || type <= 1;
+          }
+          has_time = false;
+          perf_idx.clear();
+          perf_keys.clear();
+          for(size_t i = 0; i < data.keys.size(); ++i)
+          {
+            if(data.keys[i] == time_key)
+            {
+              has_time = true;
+              time_idx = i;
+            }
+            else if(data.keys[i].rfind(match, 0) == 0)
+            {
+              perf_idx.push_back(i);
+              perf_keys.push_back(data.keys[i]);
+            }
+          }
+        }
+        if(!has_time || !data.records[time_idx].data) { return true; }
+        values.resize(perf_idx.size());
+        for(size_t i = 0; i < perf_idx.size(); ++i)
+        {
+          const auto & record = data.records[perf_idx[i]];
+          // Entries that are not written in a frame or are not numbers are ignored
+          values[i] = record.type == mc_rtc::log::LogType::Double && record.data
+                          ? *static_cast<const double *>(record.data.get())
+                          : 0.0;
+        }
+        double t = *static_cast<const double *>(data.records[time_idx].data.get());
+        callback(perf_keys, values, data.meta, t, !data.gui_events.empty(), key_event);
+        return true;
+      },
+      {match + "*", time_key}, true, "");
 }
 
 int main(int argc, char * argv[])
 {
-  if(argc < 2)
+  std::string file;
+  std::string key = "t";
+  double deadline = 0;
+  double spike_factor = 2.0;
+  po::variables_map vm;
+  po::options_description tool("mc_bin_perf options");
+  // clang-format off
+  tool.add_options()
+    ("help", "Produce this message")
+    ("in", po::value<std::string>(&file), "Input file")
+    ("entry", po::value<std::string>(&key)->default_value("t"), "Time entry")
+    ("deadline", po::value<double>(&deadline)->default_value(0), "Deadline in ms (default: the log timestep)")
+    ("spike-factor", po::value<double>(&spike_factor)->default_value(2.0),
+     "Values larger than this factor times the median are spikes");
+  // clang-format on
+  po::positional_options_description pos;
+  pos.add("in", 1);
+  pos.add("entry", 1);
+  po::store(po::command_line_parser(argc, argv).options(tool).positional(pos).run(), vm);
+  po::notify(vm);
+  if(!vm.count("in") || vm.count("help"))
+  {
+    std::cout << "Usage: " << argv[0] << " [log] [entry = t]\n\n";
+    std::cout << tool << "\n";
+    return !vm.count("help");
+  }
+
+  std::map<std::string, EntryPerf> perfs;
+  size_t n_frames = 0;
+  size_t n_gui_frames = 0;
+  size_t n_key_frames = 0;
+  // First pass: distribution of the values
+  std::vector<EntryPerf *> slots;
+  std::vector<std::string> slots_keys;
+  auto update_slots = [&](const std::vector<std::string> & keys)
+  {
+    if(keys == slots_keys) { return; }
+    slots_keys = keys;
+    slots.clear();
+    for(const auto & k : keys)
+    {
+      auto name = k.substr(match.size());
+      auto & perf = perfs[name];
+      perf.duration = not_durations.count(name) == 0;
+      slots.push_back(&perf);
+    }
+  };
+  double timestep = 0;
+  double t0 = 0;
+  auto first_pass = [&](const std::vector<std::string> & keys, const std::vector<double> & values,
+                        const std::optional<mc_rtc::Logger::Meta> & meta, double t, bool gui_event, bool key_event)
   {
-    usage(argv[0]);
+    if(meta && meta->timestep > 0) { timestep = meta->timestep; }
+    // Fallback for logs without a timestep in their meta data
+    if(n_frames == 0) { t0 = t; }
+    if(n_frames == 1 && timestep == 0) { timestep = t - t0; }
+    update_slots(keys);
+    n_frames++;
+    n_gui_frames += gui_event;
+    n_key_frames += key_event;
+    for(size_t i = 0; i < values.size(); ++i)
+    {
+      // Zero values are phases that did not run in this frame
+      if(values[i] == 0) { continue; }
+      slots[i]->histogram.add(values[i]);
+    }
+  };
+  if(!iterate_perf(file, key, first_pass)) { return 1; }
+  if(n_frames == 0)
+  {
+    mc_rtc::log::error("{} does not have any frame with the time entry {}", file, key);
     return 1;
   }
-  std::string file = argv[1];
-  std::string key = "t";
-  if(argc > 2) { key = argv[2]; }
-  PerfTable vt(std::array<PrettyColumn, 5>{PrettyColumn{""}, PrettyColumn{"Average"}, PrettyColumn{"StdEv"},
-                                           PrettyColumn{"Min"}, PrettyColumn{"Max"}});
-  mc_rtc::log::FlatLog log(file);
-  auto range = getRange(log, key);
-  auto keys = log.entries();
-  for(const auto & k : keys)
-  {
-    if(k.find(match) == 0) { show_perf(log, range, k, vt); }
+  if(deadline == 0) { deadline = 1000 * timestep; }
+  // Second pass: overruns and spikes
+  for(auto & p : perfs) { p.second.spikes.threshold = spike_factor * p.second.histogram.percentile(0.5); }
+  size_t tick = 0;
+  auto second_pass = [&](const std::vector<std::string> & keys, const std::vector<double> & values,
+                         const std::optional<mc_rtc::Logger::Meta> &, double, bool gui_event, bool key_event)
+  {
+    update_slots(keys);
+    for(size_t i = 0; i < values.size(); ++i)
+    {
+      if(values[i] == 0) { continue; }
+      auto & perf = *slots[i];
+      if(perf.duration && deadline > 0 && values[i] > deadline) { perf.overruns++; }
+      if(values[i] > perf.spikes.threshold) { perf.spikes.add(tick, gui_event, key_event); }
+    }
+    tick++;
+  };
+  if(!iterate_perf(file, key, second_pass)) { return 1; }
+
+  PerfTable vt(std::array<PrettyColumn, 10>{PrettyColumn{""}, PrettyColumn{"Count"}, PrettyColumn{"Average"},
+                                            PrettyColumn{"StdEv"}, PrettyColumn{"Min"}, PrettyColumn{"p50"},
+                                            PrettyColumn{"p99"}, PrettyColumn{"p99.9"}, PrettyColumn{"Max"},
+                                            PrettyColumn{"Overruns"}});
+  for(const auto & [name, perf] : perfs)
+  {
+    const auto & h = perf.histogram;
+    vt.put(std::make_tuple(name, h.count(), h.avg(), h.std(), h.min(), h.percentile(0.5), h.percentile(0.99),
+                           h.percentile(0.999), h.max(), perf.overruns));
   }
+  std::cout << file << ": " << n_frames << " frames";
+  if(deadline > 0) { std::cout << ", deadline: " << deadline << " ms"; }
+  std::cout << "\n";
   vt.print(std::cout);
+  auto percent = [](size_t n, size_t total)
+  {
+    std::stringstream ss;
+    ss << std::setprecision(3) << 100.0 * static_cast<double>(n) / static_cast<double>(std::max<size_t>(total, 1))
+       << "%";
+    return ss.str();
+  };
+  std::cout << "\nSpikes (values above " << spike_factor << " x p50), " << percent(n_gui_frames, n_frames)
+            << " of the frames have GUI events, " << percent(n_key_frames, n_frames) << " have key events:\n";
+  for(const auto & [name, perf] : perfs)
+  {
+    const auto & spikes = perf.spikes;
+    if(spikes.count == 0) { continue; }
+    std::cout << "- " << name << ": " << spikes.count << " spikes (" << percent(spikes.count, n_frames)
+              << " of the frames)";
+    auto [period, share] = spikes.period();
+    if(share >= 0.5)
+    {
+      std::cout << ", every " << period << " ticks (" << std::setprecision(3) << 100 * share << "% of the intervals)";
+    }
+    std::cout << ", " << spikes.on_gui_events << " on frames with GUI events, " << spikes.on_key_events
+              << " on frames with key events\n";
+  }
   return 0;
 }
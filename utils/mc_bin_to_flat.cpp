@@ -331,7 +331,10 @@ void mc_bin_to_flat(const std::string & in,
                     const std::string & out,
                     const std::vector<std::string> & entriesFilter = {})
 {
-  mc_rtc::log::FlatLog log(in);
+  // The flat format is column-major so the log is loaded but only the requested entries are decoded
+  mc_rtc::log::FlatLog log;
+  log.setThreads(0);
+  log.load(in, entriesFilter);
   auto entries = utils::entries(log, entriesFilter);
   std::ofstream ofs(out, std::ofstream::binary);
   utils::write(utils::nEntries(log, entries), ofs);
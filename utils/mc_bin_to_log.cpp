@@ -3,6 +3,9 @@
  */
 
 #include "mc_bin_utils.h"
+
+#include <mc_rtc/log/iterate_binary_log.h>
+
 #include <fstream>
 
 struct SizedType
@@ -13,18 +16,14 @@ struct SizedType
 
 using SizedEntries = std::map<std::string, SizedType>;
 
-SizedEntries write_header(std::ofstream & ofs,
-                          const mc_rtc::log::FlatLog & log,
-                          const std::vector<std::string> & entriesFilter = {})
+void write_header(std::ofstream & ofs, const SizedEntries & entries)
 {
-  SizedEntries out;
-  auto entries = utils::entries(log, entriesFilter);
   size_t i = 0;
   for(const auto & e : entries)
   {
-    auto s = utils::entrySize(log, e.first, e.second);
+    auto s = e.second.size;
     // clang-format off
-    switch(e.second)
+    switch(e.second.type)
     {
       case mc_rtc::log::LogType::Bool:
       case mc_rtc::log::LogType::Int8_t:
@@ -100,15 +99,12 @@ SizedEntries write_header(std::ofstream & ofs,
         }
         break;
       case mc_rtc::log::LogType::None:
-        mc_rtc::log::error("{} cannot be written into log format", e.first);
         continue;
     }
     // clang-format on
     if(++i != entries.size()) { ofs << ';'; }
     else { ofs << '\n'; }
-    out[e.first] = {e.second, s};
   }
-  return out;
 }
 
 // clang-format off
@@ -203,89 +199,88 @@ void write_data<sva::MotionVecd>(std::ofstream & ofs, const sva::MotionVecd & da
 }
 
 template<typename T>
-void write_data(std::ofstream & ofs,
-                const mc_rtc::log::FlatLog & log,
-                const std::string & entry,
-                size_t idx,
-                size_t fsize)
+void write_data(std::ofstream & ofs, const mc_rtc::log::FlatLog::record & value, size_t fsize)
 {
-  const T * data = log.getRaw<T>(entry, idx);
-  if(data) { write_data<T>(ofs, *data, fsize); }
+  if(value.data) { write_data<T>(ofs, *static_cast<const T *>(value.data.get()), fsize); }
   else
   {
     for(size_t i = 0; i < fsize - 1; ++i) { ofs << ';'; }
   }
 }
 
-void write_data(std::ofstream & ofs, const mc_rtc::log::FlatLog & log, const SizedEntries & entries, size_t idx)
+/** Write a line of the log, \p values holds the current value of each entry */
+void write_data(std::ofstream & ofs,
+                const SizedEntries & entries,
+                const std::vector<mc_rtc::log::FlatLog::record> & values)
 {
   size_t i = 0;
   for(const auto & e : entries)
   {
+    const auto & value = values[i];
     switch(e.second.type)
     {
       case mc_rtc::log::LogType::Bool:
-        write_data<bool>(ofs, log, e.first, idx, e.second.size);
+        write_data<bool>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Int8_t:
-        write_data<int8_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<int8_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Int16_t:
-        write_data<int16_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<int16_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Int32_t:
-        write_data<int32_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<int32_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Int64_t:
-        write_data<int64_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<int64_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Uint8_t:
-        write_data<uint8_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<uint8_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Uint16_t:
-        write_data<uint16_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<uint16_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Uint32_t:
-        write_data<uint32_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<uint32_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Uint64_t:
-        write_data<uint64_t>(ofs, log, e.first, idx, e.second.size);
+        write_data<uint64_t>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Float:
-        write_data<float>(ofs, log, e.first, idx, e.second.size);
+        write_data<float>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Double:
-        write_data<double>(ofs, log, e.first, idx, e.second.size);
+        write_data<double>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::String:
-        write_data<std::string>(ofs, log, e.first, idx, e.second.size);
+        write_data<std::string>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Quaterniond:
-        write_data<Eigen::Quaterniond>(ofs, log, e.first, idx, e.second.size);
+        write_data<Eigen::Quaterniond>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Vector2d:
-        write_data<Eigen::Vector2d>(ofs, log, e.first, idx, e.second.size);
+        write_data<Eigen::Vector2d>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Vector3d:
-        write_data<Eigen::Vector3d>(ofs, log, e.first, idx, e.second.size);
+        write_data<Eigen::Vector3d>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::Vector6d:
-        write_data<Eigen::Vector6d>(ofs, log, e.first, idx, e.second.size);
+        write_data<Eigen::Vector6d>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::VectorXd:
-        write_data<Eigen::VectorXd>(ofs, log, e.first, idx, e.second.size);
+        write_data<Eigen::VectorXd>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::PTransformd:
-        write_data<sva::PTransformd>(ofs, log, e.first, idx, e.second.size);
+        write_data<sva::PTransformd>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::ForceVecd:
-        write_data<sva::ForceVecd>(ofs, log, e.first, idx, e.second.size);
+        write_data<sva::ForceVecd>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::MotionVecd:
-        write_data<sva::MotionVecd>(ofs, log, e.first, idx, e.second.size);
+        write_data<sva::MotionVecd>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::VectorDouble:
-        write_data<std::vector<double>>(ofs, log, e.first, idx, e.second.size);
+        write_data<std::vector<double>>(ofs, value, e.second.size);
         break;
       case mc_rtc::log::LogType::None:
         continue;
@@ -297,9 +292,104 @@ void write_data(std::ofstream & ofs, const mc_rtc::log::FlatLog & log, const Siz
 
 void mc_bin_to_log(const std::string & in, const std::string & out, const std::vector<std::string> & entriesFilter)
 {
-  mc_rtc::log::FlatLog log(in);
+  // The log is streamed twice: first to get the entries and their size, then to write the data
+  auto iterate = [&](const mc_rtc::log::iterate_binary_log_callback & callback, bool extract,
+                     const std::vector<std::string> & keys)
+  {
+    bool ok = keys.size() ? mc_rtc::log::iterate_binary_log(in, callback, keys, extract)
+                          : mc_rtc::log::iterate_binary_log(in, callback, extract);
+    if(!ok) { mc_rtc::log::error_and_throw("Failed to read {} for conversion from bin to log", in); }
+  };
+  SizedEntries entries;
+  iterate(
+      [&](mc_rtc::log::IterateBinaryLogData data)
+      {
+        for(size_t i = 0; i < data.keys.size(); ++i)
+        {
+          auto type = data.records[i].type;
+          if(type == mc_rtc::log::LogType::None) { continue; }
+          entries.emplace(data.keys[i], SizedType{type, utils::entrySize(type)});
+        }
+        return true;
+      },
+      false, entriesFilter);
+  for(const auto & e : entriesFilter)
+  {
+    if(!entries.count(e))
+    {
+      mc_rtc::log::warning("Requested log entry named {} but this entry is not part of the log, ignoring", e);
+    }
+  }
+  // Only the variable size entries are decoded to compute their size
+  std::vector<std::string> variable;
+  for(const auto & e : entries)
+  {
+    if(e.second.type == mc_rtc::log::LogType::VectorXd || e.second.type == mc_rtc::log::LogType::VectorDouble)
+    {
+      variable.push_back(e.first);
+    }
+  }
+  if(variable.size())
+  {
+    // Keys are only provided when they change
+    std::vector<std::string> keys;
+    iterate(
+        [&](mc_rtc::log::IterateBinaryLogData data)
+        {
+          if(data.keys.size() || data.records.empty()) { keys = data.keys; }
+          for(size_t i = 0; i < data.records.size(); ++i)
+          {
+            auto & r = data.records[i];
+            if(!r.data) { continue; }
+            auto & e = entries.at(keys[i]);
+            if(r.type != e.type) { continue; }
+            auto s = r.type == mc_rtc::log::LogType::VectorXd
+                         ? static_cast<size_t>(static_cast<const Eigen::VectorXd *>(r.data.get())->size())
+                         : static_cast<const std::vector<double> *>(r.data.get())->size();
+            e.size = std::max(e.size, s);
+          }
+          return true;
+        },
+        true, variable);
+  }
+  for(auto it = entries.begin(); it != entries.end();)
+  {
+    if(it->second.size == 0) { it = entries.erase(it); }
+    else { ++it; }
+  }
   std::ofstream ofs(out);
   if(!ofs.is_open()) { mc_rtc::log::error_and_throw("Failed to open {} for conversion from bin to log", out); }
-  auto entries = write_header(ofs, log, entriesFilter);
-  for(size_t i = 0; i < log.size(); ++i) { write_data(ofs, log, entries, i); }
+  write_header(ofs, entries);
+  // Current value of each entry, the last written value is kept when an entry is not written in a frame
+  std::vector<mc_rtc::log::FlatLog::record> values(entries.size());
+  // Column of each value in the frame
+  std::vector<size_t> columns;
+  std::vector<std::string> filter;
+  for(const auto & e : entries) { filter.push_back(e.first); }
+  iterate(
+      [&](mc_rtc::log::IterateBinaryLogData data)
+      {
+        if(data.keys.size() || data.records.size() != columns.size())
+        {
+          std::vector<mc_rtc::log::FlatLog::record> prev(entries.size());
+          std::swap(prev, values);
+          columns.resize(data.records.size());
+          for(size_t i = 0; i < data.keys.size(); ++i)
+          {
+            auto it = entries.find(data.keys[i]);
+            columns[i] = entries.size();
+            if(it == entries.end() || it->second.type != data.records[i].type) { continue; }
+            columns[i] = static_cast<size_t>(std::distance(entries.begin(), it));
+            values[columns[i]] = std::move(prev[columns[i]]);
+          }
+        }
+        for(size_t i = 0; i < data.records.size(); ++i)
+        {
+          auto & r = data.records[i];
+          if(r.data && columns[i] < values.size()) { values[columns[i]] = std::move(r); }
+        }
+        write_data(ofs, entries, values);
+        return true;
+      },
+      true, filter);
 }
@@ -53,7 +53,8 @@ inline size_t VectorEntrySize(const mc_rtc::log::FlatLog & log, const std::strin
   return s;
 }
 
-inline size_t entrySize(const mc_rtc::log::FlatLog & log, const std::string & entry, const mc_rtc::log::LogType & t)
+/** Number of columns used by an entry of the given type, 0 for variable size entries */
+inline size_t entrySize(const mc_rtc::log::LogType & t)
 {
   switch(t)
   {
@@ -78,19 +79,30 @@ inline size_t entrySize(const mc_rtc::log::FlatLog & log, const std::string & en
       return 3;
     case mc_rtc::log::LogType::Vector6d:
       return 6;
-    case mc_rtc::log::LogType::VectorXd:
-      return VectorXdEntrySize(log, entry);
     case mc_rtc::log::LogType::PTransformd:
       return 7;
     case mc_rtc::log::LogType::ForceVecd:
     case mc_rtc::log::LogType::MotionVecd:
       return 6;
+    case mc_rtc::log::LogType::VectorXd:
     case mc_rtc::log::LogType::VectorDouble:
-      return VectorEntrySize(log, entry);
     case mc_rtc::log::LogType::None:
     default:
       return 0;
   }
 }
 
+inline size_t entrySize(const mc_rtc::log::FlatLog & log, const std::string & entry, const mc_rtc::log::LogType & t)
+{
+  switch(t)
+  {
+    case mc_rtc::log::LogType::VectorXd:
+      return VectorXdEntrySize(log, entry);
+    case mc_rtc::log::LogType::VectorDouble:
+      return VectorEntrySize(log, entry);
+    default:
+      return entrySize(t);
+  }
+}
+
 } // namespace utils
@@ -6,11 +6,14 @@
  * - Display some information about the log
  * - Split the file into N parts
  * - Extract the part(s) where a given entry was recorded
- * - Convert to csv/flat/bag format
+ * - Convert to csv/flat/col/bag format
+ * - (Re-)build the time index of a log
  */
 
 #include <mc_rtc/config.h>
 #include <mc_rtc/io_utils.h>
+#include <mc_rtc/log/BinaryLogIndex.h>
+#include <mc_rtc/log/ColumnarLog.h>
 #include <mc_rtc/log/FlatLog.h>
 #include <mc_rtc/log/Logger.h>
 #include <mc_rtc/log/iterate_binary_log.h>
@@ -24,10 +27,13 @@ namespace po = boost::program_options;
 #include "mc_bin_to_flat.h"
 #include "mc_bin_to_log.h"
 
+#include <atomic>
 #include <bitset>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <thread>
 
 #include "../src/mc_rtc/internals/LogEntry.h"
 
@@ -35,64 +41,193 @@ namespace
 {
 static bfs::path MC_BIN_TO_ROSBAG = "@CMAKE_INSTALL_PREFIX@/bin/mc_bin_to_rosbag@CMAKE_EXECUTABLE_SUFFIX@";
 
-struct TypedKey
+void print_string_vector(const std::vector<std::string> & v)
 {
-  std::string key;
-  mc_rtc::log::LogType type;
-
-  friend inline bool operator==(const TypedKey & lhs, const TypedKey & rhs)
+  for(size_t i = 0; i < v.size(); ++i)
   {
-    return lhs.type == rhs.type && lhs.key == rhs.key;
+    if(i == 0) { std::cout << "["; }
+    std::cout << " " << v[i];
+    if(i == v.size() - 1) { std::cout << " ]"; }
+    else { std::cout << ","; }
   }
+}
 
-  friend inline bool operator!=(const TypedKey & lhs, const TypedKey & rhs) { return !(lhs == rhs); }
+/** Format of an input log */
+struct LogFormat
+{
+  /** Version of the frames, the frames of version 2 logs use the version 1 layout */
+  int8_t version = 1;
+  /** Features of the log (see mc_rtc::Logger::Features) */
+  uint32_t features = 0;
 };
 
-void addToLogger(const TypedKey & key, const mc_rtc::log::FlatLog & log, mc_rtc::Logger & logger, size_t & idx)
+/** Read the format of \p in, the log is not checked further */
+LogFormat log_format(const std::string & in)
 {
-#define HANDLE_CASE(LOGT, CPPT)                                                                                   \
-  case mc_rtc::log::LogType::LOGT:                                                                                \
-    logger.addLogEntry(key.key, [&idx, &log, key]() -> const CPPT & { return *log.getRaw<CPPT>(key.key, idx); }); \
-    break
-  switch(key.type)
-  {
-    HANDLE_CASE(Bool, bool);
-    HANDLE_CASE(Int8_t, int8_t);
-    HANDLE_CASE(Int16_t, int16_t);
-    HANDLE_CASE(Int32_t, int32_t);
-    HANDLE_CASE(Int64_t, int64_t);
-    HANDLE_CASE(Uint8_t, uint8_t);
-    HANDLE_CASE(Uint16_t, uint16_t);
-    HANDLE_CASE(Uint32_t, uint32_t);
-    HANDLE_CASE(Uint64_t, uint64_t);
-    HANDLE_CASE(Float, float);
-    HANDLE_CASE(Double, double);
-    HANDLE_CASE(String, std::string);
-    HANDLE_CASE(Vector2d, Eigen::Vector2d);
-    HANDLE_CASE(Vector3d, Eigen::Vector3d);
-    HANDLE_CASE(Vector6d, Eigen::Vector6d);
-    HANDLE_CASE(VectorXd, Eigen::VectorXd);
-    HANDLE_CASE(Quaterniond, Eigen::Quaterniond);
-    HANDLE_CASE(PTransformd, sva::PTransformd);
-    HANDLE_CASE(ForceVecd, sva::ForceVecd);
-    HANDLE_CASE(MotionVecd, sva::MotionVecd);
-    HANDLE_CASE(VectorDouble, std::vector<double>);
-    default:
-      return;
-  }
-#undef HANDLE_CASE
+  using Logger = mc_rtc::Logger;
+  LogFormat format;
+  std::ifstream ifs(in, std::ifstream::binary);
+  char magic[sizeof(Logger::magic)];
+  if(!ifs.read(magic, sizeof(magic))) { return format; }
+  auto version = static_cast<int8_t>(magic[sizeof(magic) - 1] - Logger::magic[3]);
+  if(version > 1 && !ifs.read((char *)&format.features, sizeof(uint32_t))) { format.features = 0; }
+  format.version = std::min<int8_t>(version, 1);
+  return format;
 }
 
-void print_string_vector(const std::vector<std::string> & v)
+/** Write the header of an output log
+ *
+ * Outputs are always written uncompressed. They are version 1 logs unless the input holds values, the frames copied
+ * from the input then have nil values as well.
+ */
+void write_magic(std::ofstream & ofs, const LogFormat & input)
 {
-  for(size_t i = 0; i < v.size(); ++i)
+  using Logger = mc_rtc::Logger;
+  const uint32_t features = input.features & Logger::HELD_VALUES;
+  ofs.write((const char *)&Logger::magic, sizeof(Logger::magic) - sizeof(uint8_t));
+  const char version = static_cast<uint8_t>(Logger::magic[3] + (features ? 2 : 1));
+  ofs.write(&version, sizeof(uint8_t));
+  if(features) { ofs.write((const char *)&features, sizeof(uint32_t)); }
+}
+
+void write_frame(std::ofstream & ofs, const char * data, uint64_t size)
+{
+  ofs.write((const char *)&size, sizeof(uint64_t));
+  ofs.write(data, static_cast<std::streamsize>(size));
+}
+
+/** Re-encode the frames of a log with a subset of its keys
+ *
+ * The values are copied without being decoded, key events are generated when the selected keys change
+ */
+struct FilteredLogWriter
+{
+  using TypedKey = mc_rtc::log::internal::TypedKey;
+
+  /** Select \p keys (see internal::KeyFilter) in a log with the given \p format, GUI events are copied if \p
+   * gui_events is true */
+  FilteredLogWriter(const std::vector<std::string> & keys, const LogFormat & format, bool gui_events)
+  : filter_(keys), version_(format.version), held_(format.features & mc_rtc::Logger::HELD_VALUES),
+    gui_events_(gui_events)
   {
-    if(i == 0) { std::cout << "["; }
-    std::cout << " " << v[i];
-    if(i == v.size() - 1) { std::cout << " ]"; }
-    else { std::cout << ","; }
   }
-}
+
+  /** Selected keys in the last frame read */
+  const std::vector<TypedKey> & selected() const noexcept { return selected_; }
+
+  /** Read a frame of the input log */
+  bool read(const char * data, uint64_t size)
+  {
+    bool keys_changed = false;
+    std::vector<mc_rtc::Logger::GUIEvent> events;
+    entry_.reset();
+    entry_ = std::make_unique<mc_rtc::log::internal::LogEntry>(version_, data, size, meta_, keys_, events,
+                                                               keys_changed, false, &filter_);
+    if(!entry_->valid()) { return false; }
+    if(held_)
+    {
+      if(keys_changed) { held_values_.update(keys_); }
+      entry_->hold(held_values_);
+    }
+    if(start_event_size_ == 0 && entry_->events(3))
+    {
+      mc_rtc::MessagePackBuilder builder(start_event_);
+      entry_->copy_events(builder, 3);
+      start_event_size_ = builder.finish();
+    }
+    if(keys_changed)
+    {
+      selected_.clear();
+      for(auto i : filter_.selected) { selected_.push_back(keys_[i]); }
+    }
+    return true;
+  }
+
+  /** Write the last frame read, \p first must be true for the first frame of a new output
+   *
+   * The first frame of an output has the last value written for every entry
+   */
+  void write(std::ofstream & ofs, bool first)
+  {
+    if(first) { written_.clear(); }
+    auto same = [](const TypedKey & lhs, const TypedKey & rhs) { return lhs.type == rhs.type && lhs.key == rhs.key; };
+    auto contains = [&](const std::vector<TypedKey> & keys, const TypedKey & key)
+    { return std::any_of(keys.begin(), keys.end(), [&](const TypedKey & k) { return same(k, key); }); };
+    // When reading, removed keys are erased then added keys are appended to the keys
+    std::vector<std::string> removed;
+    std::vector<TypedKey> added;
+    if(!std::equal(written_.begin(), written_.end(), selected_.begin(), selected_.end(), same))
+    {
+      std::vector<TypedKey> keys;
+      for(const auto & k : written_)
+      {
+        if(contains(selected_, k)) { keys.push_back(k); }
+        else { removed.push_back(k.key); }
+      }
+      for(const auto & k : selected_)
+      {
+        if(!contains(written_, k))
+        {
+          keys.push_back(k);
+          added.push_back(k);
+        }
+      }
+      // The values are in the input order so the keys are re-created if the order does not match
+      if(!std::equal(keys.begin(), keys.end(), selected_.begin(), selected_.end(), same))
+      {
+        removed.clear();
+        for(const auto & k : written_) { removed.push_back(k.key); }
+        added = selected_;
+      }
+      written_ = selected_;
+    }
+    bool start_event = first && start_event_size_ != 0;
+    size_t n_events = removed.size() + added.size() + (start_event ? 1 : 0) + (gui_events_ ? entry_->events(2) : 0);
+    mc_rtc::MessagePackBuilder builder(buffer_);
+    builder.start_array(2);
+    if(n_events == 0) { builder.write(); }
+    else
+    {
+      builder.start_array(n_events);
+      if(start_event) { builder.write_object(start_event_.data(), start_event_size_); }
+      for(const auto & k : removed)
+      {
+        builder.start_array(2);
+        builder.write(static_cast<uint8_t>(1));
+        builder.write(k);
+        builder.finish_array();
+      }
+      for(const auto & k : added)
+      {
+        builder.start_array(3);
+        builder.write(static_cast<uint8_t>(0));
+        builder.write(static_cast<typename std::underlying_type<mc_rtc::log::LogType>::type>(k.type));
+        builder.write(k.key);
+        builder.finish_array();
+      }
+      if(gui_events_) { entry_->copy_events(builder, 2); }
+      builder.finish_array();
+    }
+    entry_->copy_values(builder, first && held_ ? &held_values_ : nullptr);
+    builder.finish_array();
+    write_frame(ofs, buffer_.data(), builder.finish());
+  }
+
+private:
+  mc_rtc::log::internal::KeyFilter filter_;
+  int8_t version_;
+  bool held_;
+  mc_rtc::log::internal::HeldValues held_values_;
+  bool gui_events_;
+  std::vector<TypedKey> keys_;
+  std::vector<TypedKey> selected_;
+  std::vector<TypedKey> written_;
+  std::optional<mc_rtc::Logger::Meta> meta_;
+  std::vector<char> start_event_;
+  size_t start_event_size_ = 0;
+  std::unique_ptr<mc_rtc::log::internal::LogEntry> entry_;
+  std::vector<char> buffer_;
+};
 
 } // namespace
 
@@ -104,6 +239,7 @@ void usage()
   std::cout << "    split     Split a log into N part\n";
   std::cout << "    extract   Extra part of a log\n";
   std::cout << "    convert   Convert binary logs to various formats\n";
+  std::cout << "    index     Build the time index of binary logs\n";
   std::cout << "\nUse mc_bin_utils <command> --help for usage of each command\n";
 }
 
@@ -235,14 +371,6 @@ int show(int argc, char * argv[])
   return 0;
 }
 
-void write_magic(std::ofstream & ofs)
-{
-  using Logger = mc_rtc::Logger;
-  ofs.write((const char *)&Logger::magic, sizeof(Logger::magic) - sizeof(uint8_t));
-  const char version = static_cast<uint8_t>(Logger::magic[3] + Logger::version);
-  ofs.write(&version, sizeof(uint8_t));
-}
-
 int split(int argc, char * argv[])
 {
   po::variables_map vm;
@@ -263,6 +391,7 @@ int split(int argc, char * argv[])
   if(vm.count("help") || !vm.count("in") || !vm.count("out") || !vm.count("parts"))
   {
     std::cout << "Usage: mc_bin_utils split [in] [out] [parts]\n\n";
+    std::cout << "When the log is indexed (see mc_bin_utils index) the parts are written in parallel\n\n";
     std::cout << tool << "\n";
     return !vm.count("help");
   }
@@ -280,6 +409,7 @@ int split(int argc, char * argv[])
     std::cerr << in << " does not exist or is not a file, aborting...\n";
     return 1;
   }
+  const auto format = log_format(in);
   auto size = bfs::file_size(in_p);
   auto part_size = size / parts;
   if(part_size < 10 * 1024 * 1024)
@@ -288,6 +418,80 @@ int split(int argc, char * argv[])
     return 1;
   }
   auto width = static_cast<int>(std::to_string(parts).size());
+  auto part_name = [&](size_t part)
+  {
+    std::stringstream ss;
+    ss << out << "_" << std::setfill('0') << std::setw(width) << part << ".bin";
+    return ss.str();
+  };
+  // When the log is indexed, parts start at index points and they are written in parallel
+  mc_rtc::log::BinaryLogIndex index;
+  std::vector<double> starts;
+  if(index.load(in))
+  {
+    auto it = index.points.begin();
+    for(size_t i = 1; i < parts; ++i)
+    {
+      it = std::find_if(it, index.points.end(), [&](const auto & p) { return p.offset >= i * part_size; });
+      if(it == index.points.end()) { break; }
+      starts.push_back((it++)->t);
+    }
+  }
+  if(starts.size() + 1 == parts)
+  {
+    auto write_part = [&](size_t i)
+    {
+      auto fpath = part_name(i + 1);
+      std::ofstream ofs(fpath, std::ofstream::binary);
+      if(!ofs)
+      {
+        mc_rtc::log::error("Failed to open {} for writing", fpath);
+        return false;
+      }
+      write_magic(ofs, format);
+      std::optional<double> from = i == 0 ? std::nullopt : std::optional<double>(starts[i - 1]);
+      std::optional<double> to = i + 1 == parts ? std::nullopt : std::optional<double>(starts[i]);
+      std::vector<char> buffer;
+      bool done = false;
+      auto callback = [&](mc_rtc::log::IterateBinaryLogData data)
+      {
+        if(to && *data.time >= *to)
+        {
+          done = true;
+          return false;
+        }
+        if(from)
+        {
+          // The index point has every value but the keys must be written in the frame
+          from = std::nullopt;
+          mc_rtc::MessagePackBuilder builder(buffer);
+          data.copy_cb(builder, data.keys);
+          write_frame(ofs, buffer.data(), builder.finish());
+          return true;
+        }
+        write_frame(ofs, data.raw_data, data.raw_data_size);
+        return true;
+      };
+      return (mc_rtc::log::iterate_binary_log(in, mc_rtc::log::iterate_binary_log_callback(callback), false, "t", from)
+              || done)
+             && ofs.good();
+    };
+    std::vector<char> ok(parts, 0);
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    auto n_threads = std::min<size_t>(parts, std::max(std::thread::hardware_concurrency(), 1u));
+    for(size_t i = 0; i < n_threads; ++i)
+    {
+      threads.emplace_back(
+          [&]()
+          {
+            for(size_t part = next++; part < parts; part = next++) { ok[part] = write_part(part); }
+          });
+    }
+    for(auto & th : threads) { th.join(); }
+    return std::all_of(ok.begin(), ok.end(), [](char c) { return c != 0; }) ? 0 : 1;
+  }
+  mc_rtc::log::info("{} is not indexed, run mc_bin_utils index {} to split it in parallel", in, in);
   std::vector<std::string> keys;
   size_t written = 0;
   size_t part = 0;
@@ -300,31 +504,29 @@ int split(int argc, char * argv[])
     if(written == 0)
     {
       if(ofs.is_open()) { ofs.close(); }
-      std::stringstream ss;
-      ss << out << "_" << std::setfill('0') << std::setw(static_cast<int>(width)) << ++part << ".bin";
-      if(part == parts) { desired_size = size; }
-      ofs.open(ss.str(), std::ofstream::binary);
+      auto fpath = part_name(++part);
+      // The input might be compressed so its size does not match the written size, the last part gets all the rest
+      if(part == parts) { desired_size = std::numeric_limits<size_t>::max(); }
+      ofs.open(fpath, std::ofstream::binary);
       if(!ofs)
       {
-        mc_rtc::log::error("Failed to open {} for writing", ss.str());
+        mc_rtc::log::error("Failed to open {} for writing", fpath);
         return false;
       }
-      write_magic(ofs);
+      write_magic(ofs, format);
     }
     if(ks.size()) { keys = ks; }
-    else if(written == 0) // Started a new part but split on an entry with no keys
+    if(written == 0 && part > 1) // Started a new part, the frame must hold all the keys
     {
       std::vector<char> data;
       mc_rtc::MessagePackBuilder builder(data);
       copy(builder, keys);
       uint64_t s = builder.finish();
-      ofs.write((char *)(&s), sizeof(uint64_t));
-      ofs.write(data.data(), static_cast<int>(s));
+      write_frame(ofs, data.data(), s);
       written += sizeof(uint64_t) + s;
       return true;
     }
-    ofs.write((char *)&dataSize, sizeof(uint64_t));
-    ofs.write(data, static_cast<int>(dataSize * sizeof(char)));
+    write_frame(ofs, data, dataSize);
     written += sizeof(uint64_t) + dataSize * sizeof(char);
     if(written >= desired_size) { written = 0; }
     return true;
@@ -399,6 +601,7 @@ int extract(int argc, char * argv[])
     std::cout << "End time must be greater than starting time, acting as if you provided infinity\n";
     to = std::numeric_limits<double>::infinity();
   }
+  const auto format = log_format(in);
   size_t width = 0;
   size_t n = 0;
   auto rename_all = [&out](size_t prev_w, size_t w)
@@ -450,7 +653,7 @@ int extract(int argc, char * argv[])
           mc_rtc::log::error("Failed to open {} for writing", nfile);
           return false;
         }
-        write_magic(ofs);
+        write_magic(ofs, format);
         {
           std::vector<char> data;
           mc_rtc::MessagePackBuilder builder(data);
@@ -473,13 +676,20 @@ int extract(int argc, char * argv[])
   };
   std::vector<std::string> keys;
   double final_t = 0;
+  bool past_to = false;
   auto callback_extract_from_to = [&](const std::vector<std::string> & ks,
                                       const std::vector<mc_rtc::log::FlatLog::record> &, double t,
                                       const mc_rtc::log::copy_callback & copy, const char * data, uint64_t dataSize)
   {
     final_t = t;
     if(ks.size()) { keys = ks; }
-    if(t >= from && t <= to)
+    if(t > to)
+    {
+      // Nothing left to extract
+      past_to = true;
+      return false;
+    }
+    if(t >= from)
     {
       if(!ofs.is_open())
       {
@@ -489,7 +699,7 @@ int extract(int argc, char * argv[])
         else { ss << to; }
         ss << ".bin";
         ofs.open(ss.str(), std::ofstream::binary);
-        write_magic(ofs);
+        write_magic(ofs, format);
         {
           std::vector<char> data;
           mc_rtc::MessagePackBuilder builder(data);
@@ -515,7 +725,10 @@ int extract(int argc, char * argv[])
   }
   if(from != 0 || to != std::numeric_limits<double>::infinity())
   {
-    if(!mc_rtc::log::iterate_binary_log(in, mc_rtc::log::binary_log_copy_callback(callback_extract_from_to), false))
+    // Start from the index point before from when the log is indexed
+    if(!mc_rtc::log::iterate_binary_log(in, mc_rtc::log::binary_log_copy_callback(callback_extract_from_to), false, "t",
+                                        from)
+       && !past_to)
     {
       return 1;
     }
@@ -523,102 +736,104 @@ int extract(int argc, char * argv[])
   }
   if(extract_keys.size())
   {
-    auto log = mc_rtc::log::FlatLog{in};
-    if(log.size() <= 1)
+    // "t" is always extracted
+    extract_keys.erase(std::remove_if(extract_keys.begin(), extract_keys.end(),
+                                      [](const std::string & k) { return k.empty() || k == "t"; }),
+                       extract_keys.end());
+    if(extract_keys.empty())
     {
-      std::cout << in << " is empty or has only one entry\n";
+      std::cout << "You cannot extract \"t\" only\n";
       return 1;
     }
-    // Remove "t" from the extract_keys as we will implicitly extract it
-    {
-      auto it = std::find(extract_keys.begin(), extract_keys.end(), "t");
-      if(it != extract_keys.end()) { extract_keys.erase(it); }
-    }
-    std::vector<std::string> wildcards;
-    for(auto it = extract_keys.begin(); it != extract_keys.end();)
+    auto filter = extract_keys;
+    filter.push_back("t");
+    FilteredLogWriter writer(filter, format, false);
+    std::set<std::string> found;
+    bool has_data = false;
+    auto callback = [&](mc_rtc::log::IterateBinaryLogData data)
     {
-      const auto & key = *it;
-      if(key.empty())
+      if(!writer.read(data.raw_data, data.raw_data_size)) { return false; }
+      if(data.keys.size())
       {
-        it = extract_keys.erase(it);
-        continue;
+        has_data = false;
+        for(const auto & k : writer.selected())
+        {
+          if(k.key == "t") { continue; }
+          has_data = true;
+          found.insert(k.key);
+        }
       }
-      if(!log.has(key))
+      // A new log is started every time the extracted keys appear in the log
+      if(!has_data)
       {
-        if(key.back() == '*') { wildcards.push_back(std::string{key, 0, key.size() - 1}); }
-        else { std::cout << *it << " is not in " << in << "\n"; }
-        it = extract_keys.erase(it);
+        if(ofs.is_open()) { ofs.close(); }
+        return true;
       }
-      else { ++it; }
-    }
-    for(const auto & key : wildcards)
-    {
-      auto size_before = extract_keys.size();
-      for(const auto & k : log.entries())
+      bool first = !ofs.is_open();
+      if(first)
       {
-        if(boost::algorithm::starts_with(k, key)) { extract_keys.push_back(k); }
+        std::string nfile = out_name(n++);
+        ofs.open(nfile, std::ofstream::binary);
+        if(!ofs)
+        {
+          mc_rtc::log::error("Failed to open {} for writing", nfile);
+          return false;
+        }
+        write_magic(ofs, format);
       }
-      if(extract_keys.size() == size_before) { std::cout << "No match for wildcard " << key << "* in " << in << "\n"; }
-    }
-    if(extract_keys.empty())
+      writer.write(ofs, first);
+      return true;
+    };
+    if(!mc_rtc::log::iterate_binary_log(in, mc_rtc::log::iterate_binary_log_callback(callback), false, ""))
     {
-      std::cout << "All the keys you asked to extract are not in this log (You cannot extract \"t\" only)\n";
       return 1;
     }
-    // Returns the keys in the log at iteration i
-    auto get_keys_in_log = [&](size_t i)
+    for(const auto & key : extract_keys)
     {
-      std::vector<TypedKey> out;
-      for(const auto & k : extract_keys)
+      if(key.back() == '*')
       {
-        auto type = log.type(k, i);
-        if(type != mc_rtc::log::LogType::None) { out.push_back({k, type}); }
-      }
-      return out;
-    };
-    std::vector<TypedKey> prev_keys_in_log;
-    mc_rtc::Logger logger(mc_rtc::Logger::Policy::NON_THREADED, "", "");
-    double timestep = *log.getRaw<double>("t", 1) - *log.getRaw<double>("t", 0);
-    for(size_t i = 0; i < log.size(); ++i)
-    {
-      auto keys_in_log = get_keys_in_log(i);
-      if(keys_in_log != prev_keys_in_log)
-      {
-        if(prev_keys_in_log.empty())
+        auto prefix = key.substr(0, key.size() - 1);
+        if(std::none_of(found.begin(), found.end(),
+                        [&](const std::string & k) { return boost::algorithm::starts_with(k, prefix); }))
         {
-          double start_t = *log.getRaw<double>("t", i);
-          std::string file = out_name(n++);
-          logger.open(file, timestep, start_t);
+          std::cout << "No match for wildcard " << key << " in " << in << "\n";
         }
-        for(const auto & k : prev_keys_in_log) { logger.removeLogEntry(k.key); }
-        for(const auto & k : keys_in_log) { addToLogger(k, log, logger, i); }
-        prev_keys_in_log = keys_in_log;
       }
-      if(keys_in_log.size()) { logger.log(); }
+      else if(!found.count(key)) { std::cout << key << " is not in " << in << "\n"; }
+    }
+    if(n == 0)
+    {
+      std::cout << "All the keys you asked to extract are not in this log (You cannot extract \"t\" only)\n";
+      return 1;
     }
   }
   if(extract_events)
   {
-    auto log = mc_rtc::log::FlatLog{in};
-    if(log.size() < 1)
+    auto fpath = out_name(0);
+    ofs.open(fpath, std::ofstream::binary);
+    if(!ofs)
     {
-      std::cout << in << " is empty\n";
+      mc_rtc::log::error("Failed to open {} for writing", fpath);
       return 1;
     }
-    double dt = 0;
-    if(!log.meta())
+    write_magic(ofs, format);
+    FilteredLogWriter writer({"t"}, format, true);
+    bool first = true;
+    auto callback = [&](mc_rtc::log::IterateBinaryLogData data)
     {
-      if(log.size() == 1) { dt = 0.005; }
-      else { dt = *log.getRaw<double>("t", 1) - *log.getRaw<double>("t", 0); }
+      if(!writer.read(data.raw_data, data.raw_data_size)) { return false; }
+      writer.write(ofs, first);
+      first = false;
+      return true;
+    };
+    if(!mc_rtc::log::iterate_binary_log(in, mc_rtc::log::iterate_binary_log_callback(callback), false, ""))
+    {
+      return 1;
     }
-    else { dt = log.meta()->timestep; }
-    mc_rtc::Logger logger(mc_rtc::Logger::Policy::NON_THREADED, "", "");
-    if(log.meta()) { logger.meta() = *log.meta(); }
-    logger.open(out_name(0), dt, 0);
-    for(const auto & events : log.guiEvents())
+    if(first)
     {
-      for(const auto & e : events) { logger.addGUIEvent(mc_rtc::Logger::GUIEvent{e}); }
-      logger.log();
+      std::cout << in << " is empty\n";
+      return 1;
     }
   }
   return 0;
@@ -634,7 +849,7 @@ int convert(int argc, char * argv[])
     ("help", "Produce this message")
     ("in", po::value<std::string>(), "Input file")
     ("out", po::value<std::string>(), "Output file or template")
-    ("format", po::value<std::string>(), "Log format (csv|flat|bag), can be deduced from [out]")
+    ("format", po::value<std::string>(), "Log format (csv|flat|col|bag), can be deduced from [out]")
     ("entries", po::value<std::vector<std::string>>()->multitoken(), "Name of entries to log (all if ommitted)")
     ("dt", po::value<double>(&dt), "Log timestep (only for bag conversion)");
   // clang-format on
@@ -664,7 +879,7 @@ int convert(int argc, char * argv[])
   {
     format = vm["format"].as<std::string>();
     if(format[0] != '.') { format = "." + format; }
-    if(format != ".bag" && format != ".csv" && format != ".flat")
+    if(format != ".bag" && format != ".csv" && format != ".flat" && format != ".col")
     {
       mc_rtc::log::error("Unsupported format {}", format);
       format = "";
@@ -686,7 +901,7 @@ int convert(int argc, char * argv[])
     }
     else { format = ext; }
   }
-  else if(ext == ".flat")
+  else if(ext == ".flat" || ext == ".col")
   {
     if(format.size() && format != ext)
     {
@@ -711,6 +926,14 @@ int convert(int argc, char * argv[])
   if(vm.count("entries")) { entries = vm["entries"].as<std::vector<std::string>>(); }
 
   if(format == ".flat") { mc_bin_to_flat(in, out_p.string(), entries); }
+  else if(format == ".col")
+  {
+    // Columns are written one after the other so the log is loaded but only the requested entries are decoded
+    mc_rtc::log::FlatLog log;
+    log.setThreads(0);
+    log.load(in, entries);
+    if(!mc_rtc::log::ColumnarLog::write(log, out_p.string(), entries)) { return 1; }
+  }
   else if(format == ".csv" || format == ".log") { mc_bin_to_log(in, out_p.string(), entries); }
   else if(format == ".bag")
   {
@@ -731,6 +954,38 @@ int convert(int argc, char * argv[])
   return 0;
 }
 
+int build_index(int argc, char * argv[])
+{
+  po::variables_map vm;
+  po::options_description tool("mc_bin_utils index options");
+  size_t interval = 1000;
+  // clang-format off
+  tool.add_options()
+    ("help", "Produce this message")
+    ("interval", po::value<size_t>(&interval)->default_value(1000), "Minimum number of frames between two index points")
+    ("in", po::value<std::vector<std::string>>(), "Input file(s)");
+  // clang-format on
+  po::positional_options_description pos;
+  pos.add("in", -1);
+  po::store(po::command_line_parser(argc, argv).options(tool).positional(pos).run(), vm);
+  po::notify(vm);
+
+  if(!vm.count("in") || vm.count("help"))
+  {
+    std::cout << "Usage: mc_bin_utils index [in...]\n\n";
+    std::cout << "Build (or rebuild) the time index of the provided logs, the index is written in [in].idx\n\n";
+    std::cout << tool << "\n";
+    return !vm.count("help");
+  }
+  for(const auto & in : vm["in"].as<std::vector<std::string>>())
+  {
+    mc_rtc::log::BinaryLogIndex index;
+    if(!index.build(in, std::max<size_t>(interval, 1)) || !index.save(in)) { return 1; }
+    std::cout << "Indexed " << in << " (" << index.points.size() << " points)\n";
+  }
+  return 0;
+}
+
 int main(int argc, char * argv[])
 {
   if(argc < 2)
@@ -745,6 +1000,7 @@ int main(int argc, char * argv[])
   else if(tool == "split") { return split(argc, argv); }
   else if(tool == "extract") { return extract(argc, argv); }
   else if(tool == "convert") { return convert(argc, argv); }
+  else if(tool == "index") { return build_index(argc, argv); }
   else
   {
     usage();